@@ -6,12 +6,14 @@
 #ifndef CHANGESETGETVARINT_H
 #define CHANGESETGETVARINT_H
 
+#include <assert.h>
 #include <stdint.h>
 
 // Contents of this file is entirely based on code from sqlite3
 //
-// the following two macro should be used for varint reading:
-// - getVarint32
+// the following should be used for varint reading:
+// - getVarint32 macro (32-bit values)
+// - sqlite3GetVarint (64-bit values)
 
 
 typedef uint8_t u8;
@@ -48,7 +50,7 @@ typedef uint64_t u64;
 ** Read a 64-bit variable-length integer from memory starting at p[0].
 ** Return the number of bytes read.  The value is stored in *v.
 */
-static u8 sqlite3GetVarint( const unsigned char *p, u64 *v )
+static inline u8 sqlite3GetVarint( const unsigned char *p, u64 *v )
 {
   u32 a, b, s;
 
@@ -212,7 +214,7 @@ static u8 sqlite3GetVarint( const unsigned char *p, u64 *v )
 ** single-byte case.  All code should use the MACRO version as
 ** this function assumes the single-byte case has already been handled.
 */
-static u8 sqlite3GetVarint32( const unsigned char *p, u32 *v )
+static inline u8 sqlite3GetVarint32( const unsigned char *p, u32 *v )
 {
   u32 a, b;
 
@@ -6,12 +6,14 @@
 #ifndef CHANGESETPUTVARINT_H
 #define CHANGESETPUTVARINT_H
 
+#include <assert.h>
 #include <stdint.h>
 
 // Contents of this file is entirely based on code from sqlite3
 //
-// the following macro should be used for varint writing:
-// - putVarint32
+// the following should be used for varint writing:
+// - putVarint32 macro (32-bit values)
+// - sqlite3PutVarint (64-bit values)
 
 
 typedef uint8_t u8;
@@ -33,7 +35,7 @@ typedef uint64_t u64;
 ** bit clear.  Except, if we get to the 9th byte, it stores the full
 ** 8 bits and is the last byte.
 */
-static int putVarint64( unsigned char *p, u64 v )
+static inline int putVarint64( unsigned char *p, u64 v )
 {
   int i, j, n;
   u8 buf[10];
@@ -64,7 +66,7 @@ static int putVarint64( unsigned char *p, u64 v )
   return n;
 }
 
-static int sqlite3PutVarint( unsigned char *p, u64 v )
+static inline int sqlite3PutVarint( unsigned char *p, u64 v )
 {
   if ( v <= 0x7f )
   {
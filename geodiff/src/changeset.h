@@ -7,8 +7,14 @@
 #define CHANGESET_H
 
 #include <assert.h>
+#include <memory.h>
+#include <stdint.h>
+
+#include <atomic>
 #include <memory>
+#include <new>
 #include <string>
+#include <string_view>
 #include <vector>
 
 
@@ -25,15 +31,27 @@
  * from "null". The "undefined" value means that the particular value
  * has not changed, for example in UPDATE change if a column's value
  * is unchanged, its value will have this type.
+ *
+ * Short strings and blobs (up to INLINE_CAPACITY bytes - codes, dates, names...) are stored
+ * directly in the value without any heap allocation. Longer data are allocated once and then
+ * shared by all copies of the value (the data are immutable, so this is safe).
  */
 struct Value
 {
+    //! Maximum size of text/blob data that are stored inline
+    static const size_t INLINE_CAPACITY = 24;
+
     Value() {}
     ~Value() { reset(); }
 
     Value( const Value &other )
     {
-      *this = other;
+      copyFrom( other );
+    }
+
+    Value( Value &&other ) noexcept
+    {
+      moveFrom( other );
     }
 
     Value &operator=( const Value &other )
@@ -41,12 +59,17 @@ struct Value
       if ( &other != this )
       {
         reset();
-        mType = other.mType;
-        mVal = other.mVal;
-        if ( mType == TypeText || mType == TypeBlob )
-        {
-          mVal.str = new std::string( *mVal.str ); // make a deep copy
-        }
+        copyFrom( other );
+      }
+      return *this;
+    }
+
+    Value &operator=( Value &&other ) noexcept
+    {
+      if ( &other != this )
+      {
+        reset();
+        moveFrom( other );
       }
       return *this;
     }
@@ -62,7 +85,7 @@ struct Value
       if ( mType == TypeDouble )
         return getDouble() == other.getDouble();
       if ( mType == TypeText || mType == TypeBlob )
-        return getString() == other.getString();
+        return getStringView() == other.getStringView();
 
       assert( false );
       return false;
@@ -74,7 +97,7 @@ struct Value
     }
 
     //! Possible value types
-    enum Type
+    enum Type : uint8_t
     {
       TypeUndefined = 0,   //!< equal to "undefined" value type in sqlite3 session extension
       TypeInt       = 1,   //!< equal to SQLITE_INTEGER
@@ -96,10 +119,27 @@ struct Value
       assert( mType == TypeDouble );
       return mVal.num_f;
     }
-    const std::string &getString() const
+    //! Returns pointer to the text/blob data (text is not null-terminated!)
+    const char *getStringData() const
     {
       assert( mType == TypeText || mType == TypeBlob );
-      return *mVal.str;
+      return mShared ? mVal.shared->data() : mVal.inl;
+    }
+    //! Returns size of the text/blob data in bytes
+    size_t getStringSize() const
+    {
+      assert( mType == TypeText || mType == TypeBlob );
+      return mShared ? mVal.shared->size : mInlineSize;
+    }
+    //! Returns text/blob data without copying them
+    std::string_view getStringView() const
+    {
+      return std::string_view( getStringData(), getStringSize() );
+    }
+    //! Returns a copy of the text/blob data
+    std::string getString() const
+    {
+      return std::string( getStringData(), getStringSize() );
     }
 
     void setInt( int64_t n )
@@ -118,8 +158,18 @@ struct Value
     {
       reset();
       assert( t == TypeText || t == TypeBlob );
+      if ( size <= INLINE_CAPACITY )
+      {
+        if ( size )
+          memcpy( mVal.inl, ptr, size );
+        mInlineSize = static_cast<uint8_t>( size );
+      }
+      else
+      {
+        mVal.shared = SharedData::create( ptr, size );
+        mShared = true;
+      }
       mType = t;
-      mVal.str = new std::string( ptr, size );
     }
     void setUndefined()
     {
@@ -137,24 +187,194 @@ struct Value
     static Value makeNull() { Value v; v.setNull(); return v; }
 
   protected:
+
+    //! Reference-counted text/blob data - allocated in one block together with the data that follow it
+    struct SharedData
+    {
+      std::atomic<size_t> refCount;
+      size_t size;
+
+      char *data() { return reinterpret_cast<char *>( this + 1 ); }
+      const char *data() const { return reinterpret_cast<const char *>( this + 1 ); }
+
+      static SharedData *create( const char *ptr, size_t size )
+      {
+        void *mem = ::operator new( sizeof( SharedData ) + size );
+        SharedData *d = new ( mem ) SharedData;
+        d->refCount = 1;
+        d->size = size;
+        memcpy( d->data(), ptr, size );
+        return d;
+      }
+
+      void ref() { refCount.fetch_add( 1, std::memory_order_relaxed ); }
+
+      void deref()
+      {
+        if ( refCount.fetch_sub( 1, std::memory_order_acq_rel ) == 1 )
+        {
+          this->~SharedData();
+          ::operator delete( this );
+        }
+      }
+    };
+
     void reset()
     {
-      if ( mType == TypeText || mType == TypeBlob )
+      if ( mShared )
       {
-        delete mVal.str;
+        mVal.shared->deref();
+        mShared = false;
       }
       mType = TypeUndefined;
     }
 
+    //! Copies content of the other value - expects this value to be reset
+    void copyFrom( const Value &other )
+    {
+      mType = other.mType;
+      mInlineSize = other.mInlineSize;
+      mShared = other.mShared;
+      mVal = other.mVal;
+      if ( mShared )
+        mVal.shared->ref();
+    }
+
+    //! Takes over content of the other value (which is left undefined) - expects this value to be reset
+    void moveFrom( Value &other )
+    {
+      mType = other.mType;
+      mInlineSize = other.mInlineSize;
+      mShared = other.mShared;
+      mVal = other.mVal;
+      other.mType = TypeUndefined;
+      other.mShared = false;
+    }
+
   protected:
-    Type mType = TypeUndefined;
     union
     {
       int64_t num_i;
       double num_f;
-      std::string *str;
+      SharedData *shared;
+      char inl[INLINE_CAPACITY];
     } mVal = {0};
+    Type mType = TypeUndefined;
+    uint8_t mInlineSize = 0;  // size of inline text/blob data
+    bool mShared = false;     // whether text/blob data are stored in mVal.shared
+
+};
+
+
+/**
+ * Non-owning counterpart of Value. Numeric values are stored directly, but text and blob
+ * values only point to data owned by someone else (typically the buffer of ChangesetReader
+ * or a Value instance), so a view is only valid as long as the data it points to.
+ *
+ * It is meant for read-only passes over a changeset where copying of every text/blob cell
+ * (e.g. every geometry) to the heap would be wasteful. Use toValue() to get an owning copy.
+ */
+struct ValueView
+{
+    Value::Type type() const { return mType; }
+
+    int64_t getInt() const
+    {
+      assert( mType == Value::TypeInt );
+      return mVal.num_i;
+    }
+    double getDouble() const
+    {
+      assert( mType == Value::TypeDouble );
+      return mVal.num_f;
+    }
+    //! Returns pointer to the text/blob data (text is not null-terminated!)
+    const char *getStringData() const
+    {
+      assert( mType == Value::TypeText || mType == Value::TypeBlob );
+      return mStr;
+    }
+    //! Returns size of the text/blob data in bytes
+    size_t getStringSize() const
+    {
+      assert( mType == Value::TypeText || mType == Value::TypeBlob );
+      return mStrSize;
+    }
+
+    void setInt( int64_t n )
+    {
+      mType = Value::TypeInt;
+      mVal.num_i = n;
+    }
+    void setDouble( double n )
+    {
+      mType = Value::TypeDouble;
+      mVal.num_f = n;
+    }
+    //! Sets text/blob value - the data are not copied, they must outlive the view
+    void setString( Value::Type t, const char *ptr, size_t size )
+    {
+      assert( t == Value::TypeText || t == Value::TypeBlob );
+      mType = t;
+      mStr = ptr;
+      mStrSize = size;
+    }
+    void setUndefined()
+    {
+      mType = Value::TypeUndefined;
+    }
+    void setNull()
+    {
+      mType = Value::TypeNull;
+    }
+
+    //! Copies the value to an owning Value instance
+    void toValue( Value &v ) const
+    {
+      switch ( mType )
+      {
+        case Value::TypeInt: v.setInt( mVal.num_i ); break;
+        case Value::TypeDouble: v.setDouble( mVal.num_f ); break;
+        case Value::TypeText:
+        case Value::TypeBlob: v.setString( mType, mStr, mStrSize ); break;
+        case Value::TypeNull: v.setNull(); break;
+        case Value::TypeUndefined: v.setUndefined(); break;
+      }
+    }
+
+    //! Returns an owning copy of the value
+    Value toValue() const
+    {
+      Value v;
+      toValue( v );
+      return v;
+    }
 
+    //! Returns a view of the given value - it is only valid as long as the value is not modified or deleted
+    static ValueView fromValue( const Value &v )
+    {
+      ValueView view;
+      switch ( v.type() )
+      {
+        case Value::TypeInt: view.setInt( v.getInt() ); break;
+        case Value::TypeDouble: view.setDouble( v.getDouble() ); break;
+        case Value::TypeText:
+        case Value::TypeBlob: view.setString( v.type(), v.getStringData(), v.getStringSize() ); break;
+        case Value::TypeNull: view.setNull(); break;
+        case Value::TypeUndefined: break;
+      }
+      return view;
+    }
+
+  private:
+    Value::Type mType = Value::TypeUndefined;
+    union
+    {
+      int64_t num_i;
+      double num_f;
+    } mVal = {0};
+    const char *mStr = nullptr;
+    size_t mStrSize = 0;
 };
 
 
@@ -175,7 +395,7 @@ namespace std
           return std::hash<double> {}( v.getDouble() );
         case Value::TypeText:
         case Value::TypeBlob:
-          return std::hash<std::string> {}( v.getString() );
+          return std::hash<std::string_view> {}( v.getStringView() );
         case Value::TypeNull:
           return 0xdddddddd;
       }
@@ -250,4 +470,61 @@ struct ChangesetEntry
   }
 };
 
+
+/**
+ * Non-owning counterpart of ChangesetEntry - old/new values are ValueView instances.
+ *
+ * When read by ChangesetReader::nextEntry(), text/blob values point directly to the reader's
+ * buffer and the whole entry (including the table pointer) is only valid until the next call
+ * to nextEntry() (or until the reader is destroyed). Use toEntry() to get an owning copy
+ * when the entry needs to be kept around for longer.
+ */
+struct ChangesetEntryView
+{
+  //! Type of the operation in this entry
+  ChangesetEntry::OperationType op;
+  //! Column values for "old" record - only valid for UPDATE and DELETE
+  std::vector<ValueView> oldValues;
+  //! Column values for "new" record - only valid for UPDATE and INSERT
+  std::vector<ValueView> newValues;
+  //! Pointer to the source table information (same semantics as in ChangesetEntry)
+  ChangesetTable *table = nullptr;
+
+  //! Copies content of the view to an owning changeset entry (table pointer is copied as is)
+  void toEntry( ChangesetEntry &entry ) const
+  {
+    entry.op = op;
+    entry.table = table;
+    entry.oldValues.resize( oldValues.size() );
+    for ( size_t i = 0; i < oldValues.size(); ++i )
+      oldValues[i].toValue( entry.oldValues[i] );
+    entry.newValues.resize( newValues.size() );
+    for ( size_t i = 0; i < newValues.size(); ++i )
+      newValues[i].toValue( entry.newValues[i] );
+  }
+
+  //! Returns an owning copy of the entry
+  ChangesetEntry toEntry() const
+  {
+    ChangesetEntry entry;
+    toEntry( entry );
+    return entry;
+  }
+
+  //! Returns a view of the given entry - it is only valid as long as the entry is not modified or deleted
+  static ChangesetEntryView fromEntry( const ChangesetEntry &entry )
+  {
+    ChangesetEntryView view;
+    view.op = entry.op;
+    view.table = entry.table;
+    view.oldValues.reserve( entry.oldValues.size() );
+    for ( const Value &v : entry.oldValues )
+      view.oldValues.push_back( ValueView::fromValue( v ) );
+    view.newValues.reserve( entry.newValues.size() );
+    for ( const Value &v : entry.newValues )
+      view.newValues.push_back( ValueView::fromValue( v ) );
+    return view;
+  }
+};
+
 #endif // CHANGESET_H
@@ -0,0 +1,110 @@
+/*
+ GEODIFF - MIT License
+ Copyright (C) 2023 Lutra Consulting
+*/
+
+#include "changesetapplyorder.h"
+
+#include <map>
+#include <set>
+
+
+ChangesetApplyOrder::ChangesetApplyOrder( const std::vector<std::pair<std::string, std::string>> &foreignKeys )
+{
+  // table -> tables it references (self references are ignored, these can't be resolved by ordering)
+  std::map<std::string, std::set<std::string>> references;
+  // table -> tables referencing it
+  std::map<std::string, std::set<std::string>> referencedBy;
+  for ( const std::pair<std::string, std::string> &fk : foreignKeys )
+  {
+    if ( fk.first == fk.second )
+      continue;
+    references[fk.first].insert( fk.second );
+    referencedBy[fk.second].insert( fk.first );
+    references[fk.second];  // make sure every table is in the map
+  }
+
+  // topological sort (Kahn's algorithm) - tables that are ready get picked by name, so that the order is stable
+  std::map<std::string, size_t> missing;  // number of referenced tables not in the order yet
+  std::set<std::string> ready;
+  for ( const auto &it : references )
+  {
+    missing[it.first] = it.second.size();
+    if ( it.second.empty() )
+      ready.insert( it.first );
+  }
+
+  while ( mTableRank.size() < references.size() )
+  {
+    if ( ready.empty() )
+    {
+      // there is a cycle - the remaining tables are added as they are (conflicts are retried by drivers)
+      for ( const auto &it : missing )
+      {
+        if ( mTableRank.count( it.first ) == 0 )
+        {
+          ready.insert( it.first );
+          break;
+        }
+      }
+    }
+
+    std::string tableName = *ready.begin();
+    ready.erase( ready.begin() );
+    size_t rank = mTableRank.size();
+    mTableRank[tableName] = rank;
+    for ( const std::string &child : referencedBy[tableName] )
+    {
+      if ( mTableRank.count( child ) == 0 && --missing[child] == 0 )
+        ready.insert( child );
+    }
+  }
+
+  mInsertsUpdates.resize( mTableRank.size() );
+  mDeletes.resize( mTableRank.size() );
+}
+
+void ChangesetApplyOrder::addEntry( const ChangesetEntry &entry )
+{
+  addEntry( mPool.create( entry ) );
+}
+
+void ChangesetApplyOrder::addEntry( const ChangesetEntryView &entry )
+{
+  addEntry( mPool.create( entry.toEntry() ) );
+}
+
+void ChangesetApplyOrder::addEntry( ChangesetEntry *entry )
+{
+  // the entry's table is usually owned by a changeset reader and it changes with the next table
+  const std::string &tableName = entry->table->name;
+  std::unique_ptr<ChangesetTable> &table = mTables[tableName];
+  if ( !table )
+    table.reset( new ChangesetTable( *entry->table ) );
+  entry->table = table.get();
+
+  size_t rank = mTableRank.at( tableName );
+  if ( entry->op == ChangesetEntry::OpDelete )
+    mDeletes[rank].push_back( entry );
+  else
+    mInsertsUpdates[rank].push_back( entry );
+}
+
+std::vector<const ChangesetEntry *> ChangesetApplyOrder::orderedEntries() const
+{
+  std::vector<const ChangesetEntry *> entries;
+  entries.reserve( mPool.size() );
+  for ( const std::vector<ChangesetEntry *> &tableEntries : mInsertsUpdates )
+    entries.insert( entries.end(), tableEntries.begin(), tableEntries.end() );
+  for ( auto it = mDeletes.rbegin(); it != mDeletes.rend(); ++it )
+    entries.insert( entries.end(), it->begin(), it->end() );
+  return entries;
+}
+
+std::vector<std::string> ChangesetApplyOrder::orderedTables() const
+{
+  std::vector<std::string> tables( mTableRank.size() );
+  for ( const auto &it : mTableRank )
+    tables[it.second] = it.first;
+  return tables;
+}
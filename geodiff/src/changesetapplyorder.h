@@ -0,0 +1,63 @@
+/*
+ GEODIFF - MIT License
+ Copyright (C) 2023 Lutra Consulting
+*/
+
+#ifndef CHANGESETAPPLYORDER_H
+#define CHANGESETAPPLYORDER_H
+
+#include "changeset.h"
+#include "changesetentrypool.h"
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+/**
+ * Orders changes of tables linked by foreign keys, so that they can be applied without violating
+ * the foreign keys: inserts and updates of a referenced (parent) table go before the ones of tables
+ * referencing it, and deletes go after all inserts and updates in the opposite order (children
+ * first - this also avoids deletes of children that have already been removed by ON DELETE CASCADE).
+ *
+ * Changes of tables that are not linked to other tables by foreign keys do not need any ordering
+ * and drivers apply them right away as they are read. Foreign keys of a table referencing itself
+ * and cycles of foreign keys cannot be resolved by ordering tables - these are left to be retried
+ * by the driver when a change fails with a constraint conflict.
+ */
+class ChangesetApplyOrder
+{
+  public:
+    //! Foreign keys are given as pairs of table names: (referencing table, referenced table)
+    explicit ChangesetApplyOrder( const std::vector<std::pair<std::string, std::string>> &foreignKeys );
+
+    ChangesetApplyOrder( const ChangesetApplyOrder & ) = delete;
+    ChangesetApplyOrder &operator=( const ChangesetApplyOrder & ) = delete;
+
+    //! Returns whether changes of the table need to be ordered (i.e. passed to addEntry())
+    bool isOrdered( const std::string &tableName ) const { return mTableRank.count( tableName ) != 0; }
+
+    //! Stores a copy of the entry (of an ordered table) to be applied later
+    void addEntry( const ChangesetEntry &entry );
+
+    //! Stores a copy of the entry (of an ordered table) to be applied later
+    void addEntry( const ChangesetEntryView &entry );
+
+    //! Returns all stored entries in the order in which they should be applied. Entries are owned by this object
+    std::vector<const ChangesetEntry *> orderedEntries() const;
+
+    //! Returns names of ordered tables - referenced tables come before tables referencing them
+    std::vector<std::string> orderedTables() const;
+
+  private:
+    void addEntry( ChangesetEntry *entry );
+
+    std::unordered_map<std::string, size_t> mTableRank;  // position of the table in the order
+    std::unordered_map<std::string, std::unique_ptr<ChangesetTable>> mTables;  // copies of tables of stored entries
+    ChangesetEntryPool mPool;  // owns stored entries
+    std::vector<std::vector<ChangesetEntry *>> mInsertsUpdates;  // stored inserts and updates for each rank
+    std::vector<std::vector<ChangesetEntry *>> mDeletes;  // stored deletes for each rank
+};
+
+#endif // CHANGESETAPPLYORDER_H
@@ -0,0 +1,316 @@
+/*
+ GEODIFF - MIT License
+ Copyright (C) 2023 Lutra Consulting
+*/
+
+#include "changesetcompression.h"
+
+#include "geodiffutils.hpp"
+#include "portableendian.h"
+
+#include <memory.h>
+
+#include <algorithm>
+#include <atomic>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+// compressed changeset starts with an 8-byte magic (it can't be confused with a raw
+// changeset which always starts with 'T'), followed by codec id and maximum block size
+static const char COMPRESSION_MAGIC[8] = { 'G', 'D', 'I', 'F', 'F', 'Z', 0, 1 };
+static const size_t COMPRESSION_HEADER_SIZE = 8 + 1 + 4;
+static const char COMPRESSION_CODEC_LZ = 1;
+
+// frame: 4-byte uncompressed size, 4-byte stored size (highest bit set = stored uncompressed), data
+static const size_t FRAME_HEADER_SIZE = 8;
+static const uint32_t FRAME_STORED_FLAG = 0x80000000;
+
+// LZ4 block format constants
+static const int LZ_HASH_LOG = 16;
+static const size_t LZ_MIN_MATCH = 4;
+static const size_t LZ_MAX_OFFSET = 65535;
+static const size_t LZ_LAST_LITERALS = 5;   // last bytes are always literals
+static const size_t LZ_MF_LIMIT = 12;       // no match may start within the last bytes
+
+
+static void appendUInt32( std::string &out, uint32_t v )
+{
+  uint32_t x = htobe32( v );
+  out.append( reinterpret_cast<const char *>( &x ), 4 );
+}
+
+static uint32_t readUInt32( const char *ptr )
+{
+  uint32_t x;
+  memcpy( &x, ptr, 4 );
+  return be32toh( x );
+}
+
+static uint32_t read32( const unsigned char *ptr )
+{
+  uint32_t x;
+  memcpy( &x, ptr, 4 );
+  return x;
+}
+
+static void appendLength( std::string &out, size_t len )
+{
+  while ( len >= 255 )
+  {
+    out.push_back( static_cast<char>( 255 ) );
+    len -= 255;
+  }
+  out.push_back( static_cast<char>( len ) );
+}
+
+static void appendSequence( std::string &out, const unsigned char *literals, size_t literalCount, size_t offset, size_t matchLength )
+{
+  size_t matchCode = matchLength - LZ_MIN_MATCH;
+  unsigned char token = static_cast<unsigned char>( ( std::min<size_t>( literalCount, 15 ) << 4 ) | std::min<size_t>( matchCode, 15 ) );
+  out.push_back( static_cast<char>( token ) );
+  if ( literalCount >= 15 )
+    appendLength( out, literalCount - 15 );
+  out.append( reinterpret_cast<const char *>( literals ), literalCount );
+  out.push_back( static_cast<char>( offset & 0xff ) );
+  out.push_back( static_cast<char>( offset >> 8 ) );
+  if ( matchCode >= 15 )
+    appendLength( out, matchCode - 15 );
+}
+
+static void appendLastLiterals( std::string &out, const unsigned char *literals, size_t literalCount )
+{
+  unsigned char token = static_cast<unsigned char>( std::min<size_t>( literalCount, 15 ) << 4 );
+  out.push_back( static_cast<char>( token ) );
+  if ( literalCount >= 15 )
+    appendLength( out, literalCount - 15 );
+  out.append( reinterpret_cast<const char *>( literals ), literalCount );
+}
+
+//! Greedy LZ compression (LZ4 block format), output is appended
+static void lzCompress( const unsigned char *src, size_t size, std::string &out )
+{
+  size_t anchor = 0;
+  if ( size > LZ_MF_LIMIT )
+  {
+    std::vector<uint32_t> table( size_t( 1 ) << LZ_HASH_LOG, 0 );
+    const size_t limit = size - LZ_MF_LIMIT;
+    const size_t matchLimit = size - LZ_LAST_LITERALS;
+    size_t ip = 0;
+    while ( ip < limit )
+    {
+      uint32_t seq = read32( src + ip );
+      uint32_t h = ( seq * 2654435761U ) >> ( 32 - LZ_HASH_LOG );
+      size_t ref = table[h];
+      table[h] = static_cast<uint32_t>( ip );
+
+      if ( ref < ip && ip - ref <= LZ_MAX_OFFSET && read32( src + ref ) == seq )
+      {
+        size_t len = LZ_MIN_MATCH;
+        while ( ip + len < matchLimit && src[ref + len] == src[ip + len] )
+          ++len;
+        appendSequence( out, src + anchor, ip - anchor, ip - ref, len );
+        ip += len;
+        anchor = ip;
+      }
+      else
+      {
+        // skip faster through data that do not compress
+        ip += 1 + ( ( ip - anchor ) >> 6 );
+      }
+    }
+  }
+  appendLastLiterals( out, src + anchor, size - anchor );
+}
+
+//! Decompresses LZ4 block format data, returns false if the data are not valid
+static bool lzDecompress( const unsigned char *src, size_t srcSize, unsigned char *dst, size_t dstSize )
+{
+  size_t ip = 0, op = 0;
+  while ( ip < srcSize )
+  {
+    unsigned char token = src[ip++];
+
+    size_t literalCount = token >> 4;
+    if ( literalCount == 15 )
+    {
+      unsigned char b;
+      do
+      {
+        if ( ip >= srcSize )
+          return false;
+        b = src[ip++];
+        literalCount += b;
+      }
+      while ( b == 255 );
+    }
+    if ( literalCount > srcSize - ip || literalCount > dstSize - op )
+      return false;
+    memcpy( dst + op, src + ip, literalCount );
+    ip += literalCount;
+    op += literalCount;
+
+    if ( ip == srcSize )
+      break;  // last sequence has only literals
+
+    if ( srcSize - ip < 2 )
+      return false;
+    size_t offset = src[ip] | ( src[ip + 1] << 8 );
+    ip += 2;
+    if ( offset == 0 || offset > op )
+      return false;
+
+    size_t matchLength = token & 15;
+    if ( matchLength == 15 )
+    {
+      unsigned char b;
+      do
+      {
+        if ( ip >= srcSize )
+          return false;
+        b = src[ip++];
+        matchLength += b;
+      }
+      while ( b == 255 );
+    }
+    matchLength += LZ_MIN_MATCH;
+    if ( matchLength > dstSize - op )
+      return false;
+
+    const unsigned char *match = dst + op - offset;
+    if ( offset >= matchLength )
+      memcpy( dst + op, match, matchLength );
+    else
+    {
+      // overlapping copy - repeats the last "offset" bytes
+      for ( size_t i = 0; i < matchLength; ++i )
+        dst[op + i] = match[i];
+    }
+    op += matchLength;
+  }
+  return op == dstSize;
+}
+
+
+bool isCompressedChangeset( const char *data, int64_t size )
+{
+  return size >= ( int64_t ) sizeof( COMPRESSION_MAGIC ) && memcmp( data, COMPRESSION_MAGIC, sizeof( COMPRESSION_MAGIC ) ) == 0;
+}
+
+std::string changesetCompressionHeader()
+{
+  std::string header( COMPRESSION_MAGIC, sizeof( COMPRESSION_MAGIC ) );
+  header.push_back( COMPRESSION_CODEC_LZ );
+  appendUInt32( header, CHANGESET_COMPRESSION_BLOCK_SIZE );
+  return header;
+}
+
+void compressChangesetBlock( const char *data, size_t size, std::string &output )
+{
+  assert( size > 0 && size <= CHANGESET_COMPRESSION_BLOCK_SIZE );
+
+  size_t frameStart = output.size();
+  appendUInt32( output, static_cast<uint32_t>( size ) );
+  appendUInt32( output, 0 );  // stored size - to be updated
+
+  lzCompress( reinterpret_cast<const unsigned char *>( data ), size, output );
+  size_t compressedSize = output.size() - frameStart - FRAME_HEADER_SIZE;
+  uint32_t storedSize = static_cast<uint32_t>( compressedSize );
+  if ( compressedSize >= size )
+  {
+    // does not compress - store the data as they are
+    output.resize( frameStart + FRAME_HEADER_SIZE );
+    output.append( data, size );
+    storedSize = static_cast<uint32_t>( size ) | FRAME_STORED_FLAG;
+  }
+  uint32_t x = htobe32( storedSize );
+  memcpy( &output[frameStart + 4], &x, 4 );
+}
+
+std::string changesetCompressionEndMarker()
+{
+  std::string marker;
+  appendUInt32( marker, 0 );
+  appendUInt32( marker, 0 );
+  return marker;
+}
+
+void decompressChangeset( const char *data, int64_t size, Buffer &output )
+{
+  if ( size < ( int64_t ) COMPRESSION_HEADER_SIZE || !isCompressedChangeset( data, size ) )
+    throw GeoDiffException( "Not a compressed changeset" );
+  if ( data[8] != COMPRESSION_CODEC_LZ )
+    throw GeoDiffException( "Unsupported compression codec of the changeset: " + std::to_string( data[8] ) );
+  uint32_t maxBlockSize = readUInt32( data + 9 );
+
+  // first pass: validate frames and get the total size (blocks are independent,
+  // so once we know where they are, each of them can be decoded separately)
+  struct Frame
+  {
+    int64_t dataOffset;
+    int64_t outOffset;
+    uint32_t size;
+    uint32_t storedSize;
+    bool stored;
+  };
+  std::vector<Frame> frames;
+  int64_t totalSize = 0;
+  int64_t offset = COMPRESSION_HEADER_SIZE;
+  while ( true )
+  {
+    if ( size - offset < ( int64_t ) FRAME_HEADER_SIZE )
+      throw GeoDiffException( "Compressed changeset is truncated" );
+    Frame f;
+    f.size = readUInt32( data + offset );
+    uint32_t stored = readUInt32( data + offset + 4 );
+    f.stored = ( stored & FRAME_STORED_FLAG ) != 0;
+    f.storedSize = stored & ~FRAME_STORED_FLAG;
+    f.dataOffset = offset + FRAME_HEADER_SIZE;
+    offset = f.dataOffset + f.storedSize;
+    if ( f.size == 0 )
+      break;  // end marker
+    if ( f.size > maxBlockSize || offset > size || ( f.stored && f.storedSize != f.size ) )
+      throw GeoDiffException( "Compressed changeset is corrupted" );
+    f.outOffset = totalSize;
+    frames.push_back( f );
+    totalSize += f.size;
+  }
+
+  // second pass: decode the blocks in parallel, each thread takes the next block that is not decoded yet
+  char *out = output.allocate( totalSize );
+  std::atomic<size_t> nextFrame( 0 );
+  std::atomic<bool> corrupted( false );
+  auto worker = [&]
+  {
+    size_t i;
+    while ( !corrupted && ( i = nextFrame++ ) < frames.size() )
+    {
+      const Frame &f = frames[i];
+      if ( f.stored )
+        memcpy( out + f.outOffset, data + f.dataOffset, f.size );
+      else if ( !lzDecompress( reinterpret_cast<const unsigned char *>( data + f.dataOffset ), f.storedSize,
+                               reinterpret_cast<unsigned char *>( out + f.outOffset ), f.size ) )
+        corrupted = true;
+    }
+  };
+
+  size_t threadCount = std::min<size_t>( std::max( 1u, std::thread::hardware_concurrency() ), frames.size() );
+  std::vector<std::thread> threads;
+  for ( size_t t = 1; t < threadCount; ++t )
+  {
+    try
+    {
+      threads.emplace_back( worker );
+    }
+    catch ( const std::system_error & )
+    {
+      break;  // not able to start more threads - the remaining blocks get decoded by the others
+    }
+  }
+  worker();
+  for ( std::thread &t : threads )
+    t.join();
+
+  if ( corrupted )
+    throw GeoDiffException( "Compressed changeset is corrupted" );
+}
@@ -0,0 +1,44 @@
+/*
+ GEODIFF - MIT License
+ Copyright (C) 2023 Lutra Consulting
+*/
+
+#ifndef CHANGESETCOMPRESSION_H
+#define CHANGESETCOMPRESSION_H
+
+#include <stdint.h>
+#include <string>
+
+class Buffer;
+
+/**
+ * Compressed changeset container (see changeset-format.md).
+ *
+ * The raw changeset data are split into blocks (at most CHANGESET_COMPRESSION_BLOCK_SIZE bytes
+ * each), every block is compressed independently with a LZ77-style codec (LZ4 block format)
+ * and stored in a frame. Blocks that would not get smaller are stored uncompressed.
+ */
+
+//! Maximum size of uncompressed data in a single block
+const uint32_t CHANGESET_COMPRESSION_BLOCK_SIZE = 1024 * 1024;
+
+//! Returns whether the data start with the header of a compressed changeset
+bool isCompressedChangeset( const char *data, int64_t size );
+
+//! Returns header that starts every compressed changeset
+std::string changesetCompressionHeader();
+
+//! Compresses a block of data and appends the frame to the output. Size must not exceed the block size
+void compressChangesetBlock( const char *data, size_t size, std::string &output );
+
+//! Returns marker that ends every compressed changeset
+std::string changesetCompressionEndMarker();
+
+/**
+ * Decompresses the whole compressed changeset to the output buffer, so the buffer takes
+ * the full uncompressed size in memory. Blocks are decoded in parallel when there are more
+ * of them. Throws GeoDiffException if the data are not valid.
+ */
+void decompressChangeset( const char *data, int64_t size, Buffer &output );
+
+#endif // CHANGESETCOMPRESSION_H
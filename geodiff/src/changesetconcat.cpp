@@ -15,6 +15,8 @@
 #include "geodiffutils.hpp"
 #include "changesetreader.h"
 #include "changesetwriter.h"
+#include "changesetentrypool.h"
+#include "changesetutils.h"
 
 
 //! Hash value generator based on primary keys to have ChangesetEntry used in std::unordered_set
@@ -88,14 +90,16 @@ static bool mergeUpdate(
     Value vOld = mergeValue( valuesOld1[i], valuesOld2.size() ? valuesOld2[i] : Value() );
     Value vNew = mergeValue( valuesNew1[i], valuesNew2.size() ? valuesNew2[i] : Value() );
 
+    bool changed = vOld != vNew;
+
     // if there would be no actual changes after the merge, we would discard the merged update...
-    if ( vOld != vNew && !t.primaryKeys[i] )
+    if ( changed && !t.primaryKeys[i] )
       bRequired = true;
 
     // write OLD
-    if ( t.primaryKeys[i] || vOld != vNew )
+    if ( t.primaryKeys[i] || changed )
     {
-      outputOld.push_back( vOld );
+      outputOld.push_back( std::move( vOld ) );
     }
     else
     {
@@ -103,13 +107,13 @@ static bool mergeUpdate(
     }
 
     // write NEW
-    if ( t.primaryKeys[i] || vOld == vNew )
+    if ( t.primaryKeys[i] || !changed )
     {
       outputNew.push_back( Value() );
     }
     else
     {
-      outputNew.push_back( vNew );
+      outputNew.push_back( std::move( vNew ) );
     }
   }
 
@@ -157,8 +161,8 @@ static MergeEntriesResult mergeEntriesForRow( ChangesetEntry *e1, ChangesetEntry
     std::vector<Value> oldVals, newVals;
     if ( !mergeUpdate( *e1->table, e2->oldValues, e1->oldValues, e1->newValues, e2->newValues, oldVals, newVals ) )
       return EntryRemoved;
-    e1->oldValues = oldVals;
-    e1->newValues = newVals;
+    e1->oldValues = std::move( oldVals );
+    e1->newValues = std::move( newVals );
     return EntryModified;
   }
 
@@ -181,8 +185,8 @@ static MergeEntriesResult mergeEntriesForRow( ChangesetEntry *e1, ChangesetEntry
     if ( !mergeUpdate( *e1->table, e1->oldValues, {}, e2->newValues, {}, oldVals, newVals ) )
       return EntryRemoved;
     e1->op = ChangesetEntry::OpUpdate;
-    e1->oldValues = oldVals;
-    e1->newValues = newVals;
+    e1->oldValues = std::move( oldVals );
+    e1->newValues = std::move( newVals );
     return EntryModified;
   }
 
@@ -191,31 +195,52 @@ static MergeEntriesResult mergeEntriesForRow( ChangesetEntry *e1, ChangesetEntry
 }
 
 
-//! Concatenation of multiple changesets, based on the implementation from sqlite3session
-//! (functions sqlite3changegroup_add() and sqlite3changegroup_output())
 void concatChangesets(
   const Context *context,
   const std::vector<std::string> &filenames,
   const std::string &outputChangeset )
 {
-  // hashtable: table name -> ( fid -> changeset entry )
-  std::unordered_map<std::string, TableChanges> result;
-
+  std::vector<std::unique_ptr<ChangesetReader>> readers;
+  std::vector<ChangesetReader *> readerPtrs;
   for ( const std::string &inputFilename : filenames )
   {
-    ChangesetReader reader;
-    if ( !reader.open( inputFilename ) )
+    readers.emplace_back( new ChangesetReader );
+    if ( !readers.back()->open( inputFilename ) )
       throw GeoDiffException( "concatChangesets: unable to open input file: " + inputFilename );
+    readerPtrs.push_back( readers.back().get() );
+  }
+
+  ChangesetWriter writer;
+  writer.setIndexEnabled( context->isChangesetIndexEnabled() );
+  writer.setCompressionEnabled( context->isChangesetCompressionEnabled() );
+  writer.open( outputChangeset );
+  concatChangesets( context, readerPtrs, writer );
+  writer.close();
+}
 
+//! Concatenation of multiple changesets, based on the implementation from sqlite3session
+//! (functions sqlite3changegroup_add() and sqlite3changegroup_output())
+void concatChangesets( const Context *context, const std::vector<ChangesetReader *> &readers, ChangesetWriter &writer )
+{
+  // hashtable: table name -> ( fid -> changeset entry )
+  std::unordered_map<std::string, TableChanges> result;
+  // owns all changeset entries referenced from the hashtable
+  ChangesetEntryPool pool;
+  ProgressReporter progress( context );
+
+  for ( ChangesetReader *readerPtr : readers )
+  {
+    ChangesetReader &reader = *readerPtr;
     ChangesetEntry entry;
     while ( reader.nextEntry( entry ) )
     {
+      progress.entryDone( entry.table->name );
       auto tableIt = result.find( entry.table->name );
       if ( tableIt == result.end() )
       {
         TableChanges &t = result[ entry.table->name ];   // adds new entry
         t.table.reset( new ChangesetTable( *entry.table ) );
-        ChangesetEntry *e = new ChangesetEntry( entry );
+        ChangesetEntry *e = pool.create( entry );
         e->table = t.table.get();
         t.entries.insert( e );
       }
@@ -226,7 +251,7 @@ void concatChangesets(
         if ( entriesIt == t.entries.end() )
         {
           // row with this pkey is not in our list yet
-          ChangesetEntry *e = new ChangesetEntry( entry );
+          ChangesetEntry *e = pool.create( entry );
           e->table = t.table.get();
           t.entries.insert( e );
         }
@@ -241,13 +266,13 @@ void concatChangesets(
               break;   // nothing else to do - the original entry got updated in place
             case EntryRemoved:
               t.entries.erase( entriesIt );
-              delete entry0;
+              pool.release( entry0 );
               break;
             case Unsupported:
               // we are discarding the new entry (there's no sensible way to integrate it)
               context->logger().warn( "concatChangesets: unsupported sequence of entries for a single row - discarding newer entry" );
               t.entries.erase( entriesIt );
-              delete entry0;
+              pool.release( entry0 );
               break;
           }
         }
@@ -255,9 +280,6 @@ void concatChangesets(
     }
   }
 
-  ChangesetWriter writer;
-  writer.open( outputChangeset );
-
   // output all we have captured
   for ( auto it = result.begin(); it != result.end(); ++it )
   {
@@ -269,7 +291,10 @@ void concatChangesets(
     for ( ChangesetEntry *e : t.entries )
     {
       writer.writeEntry( *e );
-      delete e;
     }
   }
+  progress.finish();
+
+  context->logger().debug( "concatChangesets: " + std::to_string( pool.size() ) + " entries in " +
+                           std::to_string( pool.chunkCount() ) + " chunks" );
 }
@@ -0,0 +1,53 @@
+/*
+ GEODIFF - MIT License
+ Copyright (C) 2023 Lutra Consulting
+*/
+
+#include "changesetentrypool.h"
+
+
+ChangesetEntry *ChangesetEntryPool::allocate()
+{
+  if ( !mFree.empty() )
+  {
+    ChangesetEntry *entry = mFree.back();
+    mFree.pop_back();
+    return entry;
+  }
+
+  size_t indexInChunk = mUsed % CHUNK_SIZE;
+  if ( indexInChunk == 0 )
+    mChunks.emplace_back( new ChangesetEntry[CHUNK_SIZE] );
+  ++mUsed;
+  return &mChunks.back()[indexInChunk];
+}
+
+ChangesetEntry *ChangesetEntryPool::create( const ChangesetEntry &entry )
+{
+  ChangesetEntry *e = allocate();
+  e->op = entry.op;
+  e->table = entry.table;
+  // assignment keeps capacity of recycled entries, so there is usually no allocation
+  e->oldValues.assign( entry.oldValues.begin(), entry.oldValues.end() );
+  e->newValues.assign( entry.newValues.begin(), entry.newValues.end() );
+  return e;
+}
+
+ChangesetEntry *ChangesetEntryPool::create( ChangesetEntry &&entry )
+{
+  ChangesetEntry *e = allocate();
+  e->op = entry.op;
+  e->table = entry.table;
+  e->oldValues = std::move( entry.oldValues );
+  e->newValues = std::move( entry.newValues );
+  return e;
+}
+
+void ChangesetEntryPool::release( ChangesetEntry *entry )
+{
+  // drop the values (e.g. shared blobs) now, but keep the capacity of the arrays
+  entry->oldValues.clear();
+  entry->newValues.clear();
+  entry->table = nullptr;
+  mFree.push_back( entry );
+}
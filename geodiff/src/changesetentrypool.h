@@ -0,0 +1,56 @@
+/*
+ GEODIFF - MIT License
+ Copyright (C) 2023 Lutra Consulting
+*/
+
+#ifndef CHANGESETENTRYPOOL_H
+#define CHANGESETENTRYPOOL_H
+
+#include "changeset.h"
+
+#include <memory>
+#include <vector>
+
+/**
+ * Owns changeset entries created during a single operation (e.g. concat or rebase),
+ * so that they do not need to be allocated and freed one by one.
+ *
+ * Entries are allocated in large chunks and all of them are released at once when
+ * the pool is destroyed. Entries returned to the pool with release() are recycled
+ * by subsequent calls to create(), including the capacity of their value arrays.
+ */
+class ChangesetEntryPool
+{
+  public:
+    //! Number of entries allocated at once
+    static const size_t CHUNK_SIZE = 4096;
+
+    ChangesetEntryPool() = default;
+
+    ChangesetEntryPool( const ChangesetEntryPool & ) = delete;
+    ChangesetEntryPool &operator=( const ChangesetEntryPool & ) = delete;
+
+    //! Returns a new entry owned by the pool with a copy of the given entry
+    ChangesetEntry *create( const ChangesetEntry &entry );
+
+    //! Returns a new entry owned by the pool with content moved from the given entry
+    ChangesetEntry *create( ChangesetEntry &&entry );
+
+    //! Returns entry to the pool so that it can be reused. The entry must not be used afterwards
+    void release( ChangesetEntry *entry );
+
+    //! Returns number of entries currently in use
+    size_t size() const { return mUsed - mFree.size(); }
+
+    //! Returns number of allocated chunks of entries
+    size_t chunkCount() const { return mChunks.size(); }
+
+  private:
+    ChangesetEntry *allocate();
+
+    std::vector<std::unique_ptr<ChangesetEntry[]>> mChunks;
+    size_t mUsed = 0;  // number of entries handed out from chunks (including released ones)
+    std::vector<ChangesetEntry *> mFree;  // released entries that can be reused
+};
+
+#endif // CHANGESETENTRYPOOL_H
@@ -0,0 +1,185 @@
+/*
+ GEODIFF - MIT License
+ Copyright (C) 2023 Lutra Consulting
+*/
+
+#include "changesetindex.h"
+
+#include "changesetgetvarint.h"
+#include "changesetputvarint.h"
+#include "portableendian.h"
+
+#include <assert.h>
+#include <memory.h>
+
+#include <algorithm>
+
+// the index record is a table header with the payload stored in place of primary key flags:
+//   'T', varint payload size, payload, "geodiff_index\0"
+// payload ends with 8-byte big endian checksum and 8-byte big endian offset of the 'T' byte
+static const char INDEX_TABLE_NAME[] = "geodiff_index";
+static const size_t INDEX_TABLE_NAME_SIZE = sizeof( INDEX_TABLE_NAME );  // including null terminator
+static const char INDEX_VERSION = 1;
+
+// readers expect that number of columns of a table is at most this
+static const size_t INDEX_MAX_PAYLOAD_SIZE = 65536;
+
+
+uint64_t changesetChecksum( uint64_t checksum, const char *data, size_t size )
+{
+  const unsigned char *ptr = reinterpret_cast<const unsigned char *>( data );
+  for ( size_t i = 0; i < size; ++i )
+  {
+    checksum ^= ptr[i];
+    checksum *= 0x100000001b3ULL;
+  }
+  return checksum;
+}
+
+
+static void appendVarint( std::string &out, uint64_t v )
+{
+  unsigned char buf[9];
+  int n = sqlite3PutVarint( buf, v );
+  out.append( reinterpret_cast<char *>( buf ), n );
+}
+
+static void appendUInt64( std::string &out, uint64_t v )
+{
+  uint64_t x = htobe64( v );
+  out.append( reinterpret_cast<char *>( &x ), 8 );
+}
+
+std::string encodeChangesetIndex( const ChangesetIndex &index, uint64_t indexOffset )
+{
+  std::string payload;
+  payload.push_back( INDEX_VERSION );
+  appendVarint( payload, index.tables.size() );
+  for ( const ChangesetTableIndex &t : index.tables )
+  {
+    appendVarint( payload, t.name.size() );
+    payload.append( t.name );
+    appendVarint( payload, t.offset );
+    appendVarint( payload, t.size );
+    appendVarint( payload, t.inserts );
+    appendVarint( payload, t.updates );
+    appendVarint( payload, t.deletes );
+  }
+  appendUInt64( payload, index.checksum );
+  appendUInt64( payload, indexOffset );
+
+  if ( payload.size() > INDEX_MAX_PAYLOAD_SIZE )
+    return std::string();
+
+  std::string record;
+  record.push_back( 'T' );
+  appendVarint( record, payload.size() );
+  record.append( payload );
+  record.append( INDEX_TABLE_NAME, INDEX_TABLE_NAME_SIZE );
+  return record;
+}
+
+
+//! Simple bounds-checked reader of the index payload
+class IndexPayloadReader
+{
+  public:
+    IndexPayloadReader( const unsigned char *data, size_t size ) : mData( data ), mSize( size ) {}
+
+    bool readVarint( uint64_t &v )
+    {
+      if ( mOffset >= mSize )
+        return false;
+      unsigned char tail[9] = {0};
+      size_t avail = std::min<size_t>( 9, mSize - mOffset );
+      memcpy( tail, mData + mOffset, avail );
+      u64 value;
+      size_t n = sqlite3GetVarint( tail, &value );
+      if ( n > avail )
+        return false;
+      mOffset += n;
+      v = value;
+      return true;
+    }
+
+    bool readBytes( size_t n, const unsigned char *&ptr )
+    {
+      if ( n > mSize - mOffset )
+        return false;
+      ptr = mData + mOffset;
+      mOffset += n;
+      return true;
+    }
+
+    size_t remaining() const { return mSize - mOffset; }
+
+  private:
+    const unsigned char *mData;
+    size_t mSize;
+    size_t mOffset = 0;
+};
+
+static uint64_t readUInt64( const unsigned char *ptr )
+{
+  uint64_t x;
+  memcpy( &x, ptr, 8 );
+  return be64toh( x );
+}
+
+bool decodeChangesetIndex( const char *data, uint64_t size, ChangesetIndex &index, uint64_t &indexOffset )
+{
+  // smallest possible index: 'T', 1-byte varint, version, table count, checksum, offset, name
+  if ( size < 1 + 1 + 1 + 1 + 16 + INDEX_TABLE_NAME_SIZE )
+    return false;
+
+  const unsigned char *udata = reinterpret_cast<const unsigned char *>( data );
+  if ( memcmp( data + size - INDEX_TABLE_NAME_SIZE, INDEX_TABLE_NAME, INDEX_TABLE_NAME_SIZE ) != 0 )
+    return false;
+
+  uint64_t payloadEnd = size - INDEX_TABLE_NAME_SIZE;
+  uint64_t offset = readUInt64( udata + payloadEnd - 8 );
+  if ( offset >= payloadEnd - 16 || data[offset] != 'T' )
+    return false;
+
+  // the table header must span exactly till the end of data
+  IndexPayloadReader header( udata + offset + 1, payloadEnd - offset - 1 );
+  uint64_t payloadSize;
+  if ( !header.readVarint( payloadSize ) || payloadSize != header.remaining() || payloadSize > INDEX_MAX_PAYLOAD_SIZE )
+    return false;
+
+  const unsigned char *payloadPtr;
+  header.readBytes( ( size_t ) payloadSize, payloadPtr );
+  IndexPayloadReader payload( payloadPtr, ( size_t ) payloadSize - 16 );
+
+  const unsigned char *ptr;
+  if ( !payload.readBytes( 1, ptr ) || *ptr != INDEX_VERSION )
+    return false;
+
+  uint64_t tableCount;
+  if ( !payload.readVarint( tableCount ) )
+    return false;
+
+  ChangesetIndex idx;
+  for ( uint64_t i = 0; i < tableCount; ++i )
+  {
+    ChangesetTableIndex t;
+    uint64_t nameSize;
+    if ( !payload.readVarint( nameSize ) || !payload.readBytes( ( size_t ) nameSize, ptr ) )
+      return false;
+    t.name = std::string( reinterpret_cast<const char *>( ptr ), ( size_t ) nameSize );
+    if ( !payload.readVarint( t.offset ) || !payload.readVarint( t.size ) ||
+         !payload.readVarint( t.inserts ) || !payload.readVarint( t.updates ) || !payload.readVarint( t.deletes ) )
+      return false;
+    if ( t.offset > offset || t.size > offset - t.offset )
+      return false;
+    idx.tables.push_back( t );
+  }
+  if ( payload.remaining() != 0 )
+    return false;
+
+  idx.checksum = readUInt64( payloadPtr + payloadSize - 16 );
+
+  index = idx;
+  indexOffset = offset;
+  return true;
+}
@@ -0,0 +1,69 @@
+/*
+ GEODIFF - MIT License
+ Copyright (C) 2023 Lutra Consulting
+*/
+
+#ifndef CHANGESETINDEX_H
+#define CHANGESETINDEX_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+/**
+ * Information about a single block of table changes as stored in the optional
+ * index at the end of a changeset file (see changeset-format.md)
+ */
+struct ChangesetTableIndex
+{
+  //! Name of the table
+  std::string name;
+  //! Offset of the table header ('T' byte) from the start of the changeset
+  uint64_t offset = 0;
+  //! Size of the table block in bytes (table header and all its entries)
+  uint64_t size = 0;
+  //! Number of INSERT entries in the block
+  uint64_t inserts = 0;
+  //! Number of UPDATE entries in the block
+  uint64_t updates = 0;
+  //! Number of DELETE entries in the block
+  uint64_t deletes = 0;
+
+  //! Returns total number of entries in the block
+  uint64_t entryCount() const { return inserts + updates + deletes; }
+};
+
+/**
+ * Index of a changeset: list of table blocks and a checksum of the data.
+ * It is stored at the end of a changeset disguised as a table header
+ * without any changes, so that it is ignored by readers not aware of it.
+ */
+struct ChangesetIndex
+{
+  std::vector<ChangesetTableIndex> tables;
+  //! Checksum of all changeset data preceding the index (see changesetChecksum())
+  uint64_t checksum = 0;
+};
+
+//! Initial value of the checksum (to be used with changesetChecksum())
+const uint64_t CHANGESET_CHECKSUM_INIT = 0xcbf29ce484222325ULL;
+
+//! Updates checksum (64-bit FNV-1a) with the given data and returns the new value
+uint64_t changesetChecksum( uint64_t checksum, const char *data, size_t size );
+
+/**
+ * Returns encoded index record (including the table header) that should be
+ * appended to the changeset. Returns empty string if the index is too large
+ * to be stored in the changeset.
+ * \param indexOffset offset in the changeset where the index record will be written
+ */
+std::string encodeChangesetIndex( const ChangesetIndex &index, uint64_t indexOffset );
+
+/**
+ * Tries to find and decode index record at the end of changeset data.
+ * Returns true on success, with index and its offset (which is also the
+ * end of changeset entries) set. Returns false if there is no (valid) index.
+ */
+bool decodeChangesetIndex( const char *data, uint64_t size, ChangesetIndex &index, uint64_t &indexOffset );
+
+#endif // CHANGESETINDEX_H
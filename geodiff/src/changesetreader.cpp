@@ -8,6 +8,7 @@
 #include "geodiffutils.hpp"
 #include "changesetgetvarint.h"
 #include "portableendian.h"
+#include "changesetcompression.h"
 
 #include <assert.h>
 #include <memory.h>
@@ -22,25 +23,88 @@ ChangesetReader::~ChangesetReader() = default;
 
 bool ChangesetReader::open( const std::string &filename )
 {
+  if ( isStdioPath( filename ) )
+    return openFileDescriptor( fileno( stdin ) );
+
   try
   {
-    mBuffer.reset( new Buffer );
-    mBuffer->read( filename );
+    mOwnedBuffer.reset( new Buffer );
+    mOwnedBuffer->map( filename );
+    mBuffer = mOwnedBuffer.get();
+    initBuffer();
   }
   catch ( const GeoDiffException & )
   {
     return false;
   }
+  return true;
+}
 
+bool ChangesetReader::openFileDescriptor( int fd )
+{
+  try
+  {
+    mOwnedBuffer.reset( new Buffer );
+    mOwnedBuffer->readFileDescriptor( fd );
+    mBuffer = mOwnedBuffer.get();
+    initBuffer();
+  }
+  catch ( const GeoDiffException & )
+  {
+    return false;
+  }
   return true;
 }
 
+bool ChangesetReader::openBuffer( const Buffer &buffer )
+{
+  try
+  {
+    mOwnedBuffer.reset();
+    mBuffer = &buffer;
+    initBuffer();
+  }
+  catch ( const GeoDiffException & )
+  {
+    return false;
+  }
+  return true;
+}
+
+void ChangesetReader::initBuffer()
+{
+  if ( isCompressedChangeset( mBuffer->c_buf(), mBuffer->size() ) )
+  {
+    std::unique_ptr<Buffer> decompressed( new Buffer );
+    decompressChangeset( mBuffer->c_buf(), mBuffer->size(), *decompressed );
+    mOwnedBuffer = std::move( decompressed );
+    mBuffer = mOwnedBuffer.get();
+  }
+
+  uint64_t indexOffset;
+  mIndex = ChangesetIndex();
+  mHasIndex = decodeChangesetIndex( mBuffer->c_buf(), mBuffer->size(), mIndex, indexOffset );
+  mDataEnd = mHasIndex ? ( int64_t ) indexOffset : mBuffer->size();
+  rewind();
+}
+
 bool ChangesetReader::nextEntry( ChangesetEntry &entry )
+{
+  return readEntry( entry );
+}
+
+bool ChangesetReader::nextEntry( ChangesetEntryView &entry )
+{
+  return readEntry( entry );
+}
+
+template<typename T>
+bool ChangesetReader::readEntry( T &entry )
 {
   while ( 1 )
   {
-    if ( mOffset >= mBuffer->size() )
-      break;   // EOF
+    if ( mOffset >= mDataEnd )
+      break;   // EOF (or start of the index)
 
     int type = readByte();
     if ( type == 'T' )
@@ -74,7 +138,7 @@ bool ChangesetReader::nextEntry( ChangesetEntry &entry )
 
 bool ChangesetReader::isEmpty() const
 {
-  return mBuffer->size() == 0;
+  return mDataEnd == 0;
 }
 
 void ChangesetReader::rewind()
@@ -83,6 +147,27 @@ void ChangesetReader::rewind()
   mCurrentTable = ChangesetTable();
 }
 
+bool ChangesetReader::seekToTable( const std::string &tableName )
+{
+  for ( const ChangesetTableIndex &t : mIndex.tables )
+  {
+    if ( t.name == tableName )
+    {
+      mOffset = ( int64_t ) t.offset;
+      mCurrentTable = ChangesetTable();
+      return true;
+    }
+  }
+  return false;
+}
+
+bool ChangesetReader::verifyIndexChecksum() const
+{
+  if ( !mHasIndex )
+    return false;
+  return changesetChecksum( CHANGESET_CHECKSUM_INIT, mBuffer->c_buf(), ( size_t ) mDataEnd ) == mIndex.checksum;
+}
+
 char ChangesetReader::readByte()
 {
   if ( mOffset >= mBuffer->size() )
@@ -92,11 +177,26 @@ char ChangesetReader::readByte()
   return *ptr;
 }
 
-int ChangesetReader::readVarint()
+uint64_t ChangesetReader::readVarint()
 {
-  u32 value;
+  if ( mOffset >= mBuffer->size() )
+    throwReaderError( "readVarint: at the end of buffer" );
+
+  u64 value;
   const unsigned char *ptr = reinterpret_cast<const unsigned char *>( mBuffer->c_buf() ) + mOffset;
-  int nBytes = getVarint32( ptr, value );
+  int nBytes;
+  if ( mBuffer->size() - mOffset >= 9 )
+    nBytes = sqlite3GetVarint( ptr, &value );
+  else
+  {
+    // varint may take up to 9 bytes - make sure we do not read past the end of the buffer
+    // (which may be a memory mapped file), zero padding terminates the varint
+    unsigned char tail[9] = {0};
+    memcpy( tail, ptr, ( size_t )( mBuffer->size() - mOffset ) );
+    nBytes = sqlite3GetVarint( tail, &value );
+    if ( mOffset + nBytes > mBuffer->size() )
+      throwReaderError( "readVarint: at the end of buffer" );
+  }
   mOffset += nBytes;
   return value;
 }
@@ -104,7 +204,7 @@ int ChangesetReader::readVarint()
 std::string ChangesetReader::readNullTerminatedString()
 {
   const char *ptr = mBuffer->c_buf() + mOffset;
-  int count = 0;
+  int64_t count = 0;
   while ( mOffset + count < mBuffer->size() && ptr[count] )
     ++count;
 
@@ -112,7 +212,72 @@ std::string ChangesetReader::readNullTerminatedString()
     throwReaderError( "readNullTerminatedString: at the end of buffer" );
 
   mOffset += count + 1;
-  return std::string( ptr, count );
+  return std::string( ptr, ( size_t ) count );
+}
+
+void ChangesetReader::readValue( ValueView &value )
+{
+  int type = readByte();
+  if ( type == Value::TypeInt ) // 0x01
+  {
+    // 64-bit int (big endian)
+    if ( mOffset + 8 > mBuffer->size() )
+      throwReaderError( "readValue: int: at the end of buffer" );
+    int64_t v;
+    uint64_t x;
+    memcpy( &x, mBuffer->c_buf() + mOffset, 8 );
+    mOffset += 8;
+    x = be64toh( x ); // convert big endian to host
+    memcpy( &v, &x, 8 );
+    value.setInt( v );
+  }
+  else if ( type == Value::TypeDouble ) // 0x02
+  {
+    // 64-bit double (big endian)
+    if ( mOffset + 8 > mBuffer->size() )
+      throwReaderError( "readValue: double: at the end of buffer" );
+    double v;
+    uint64_t x;
+    memcpy( &x, mBuffer->c_buf() + mOffset, 8 );
+    mOffset += 8;
+    x = be64toh( x ); // convert big endian to host
+    memcpy( &v, &x, 8 );
+    value.setDouble( v );
+  }
+  else if ( type == Value::TypeText || type == Value::TypeBlob ) // 0x03 or 0x04
+  {
+    uint64_t len = readVarint();
+    if ( len > ( uint64_t )( mBuffer->size() - mOffset ) )
+      throwReaderError( "readRowValues: text/blob: at the end of buffer" );
+    value.setString( type == Value::TypeText ? Value::TypeText : Value::TypeBlob, mBuffer->c_buf() + mOffset, ( size_t ) len );
+    mOffset += len;
+  }
+  else if ( type == Value::TypeNull ) // 0x05
+  {
+    value.setNull();
+  }
+  else if ( type == Value::TypeUndefined )  // undefined value  (different from NULL)
+  {
+    value.setUndefined();
+  }
+  else
+  {
+    throwReaderError( "readRowValues: unexpected entry type" );
+  }
+}
+
+void ChangesetReader::readRowValues( std::vector<ValueView> &values )
+{
+  // let's ensure we have the right size of array
+  if ( values.size() != mCurrentTable.columnCount() )
+  {
+    values.resize( mCurrentTable.columnCount() );
+  }
+
+  for ( size_t i = 0; i < mCurrentTable.columnCount(); ++i )
+  {
+    readValue( values[i] );
+  }
 }
 
 void ChangesetReader::readRowValues( std::vector<Value> &values )
@@ -123,51 +288,11 @@ void ChangesetReader::readRowValues( std::vector<Value> &values )
     values.resize( mCurrentTable.columnCount() );
   }
 
+  ValueView view;
   for ( size_t i = 0; i < mCurrentTable.columnCount(); ++i )
   {
-    int type = readByte();
-    if ( type == Value::TypeInt ) // 0x01
-    {
-      // 64-bit int (big endian)
-      int64_t v;
-      uint64_t x;
-      memcpy( &x, mBuffer->c_buf() + mOffset, 8 );
-      mOffset += 8;
-      x = be64toh( x ); // convert big endian to host
-      memcpy( &v, &x, 8 );
-      values[i].setInt( v );
-    }
-    else if ( type == Value::TypeDouble ) // 0x02
-    {
-      // 64-bit double (big endian)
-      double v;
-      uint64_t x;
-      memcpy( &x, mBuffer->c_buf() + mOffset, 8 );
-      mOffset += 8;
-      x = be64toh( x ); // convert big endian to host
-      memcpy( &v, &x, 8 );
-      values[i].setDouble( v );
-    }
-    else if ( type == Value::TypeText || type == Value::TypeBlob ) // 0x03 or 0x04
-    {
-      int len = readVarint();
-      if ( mOffset + len > mBuffer->size() )
-        throwReaderError( "readRowValues: text/blob: at the end of buffer" );
-      values[i].setString( type == Value::TypeText ? Value::TypeText : Value::TypeBlob, mBuffer->c_buf() + mOffset, len );
-      mOffset += len;
-    }
-    else if ( type == Value::TypeNull ) // 0x05
-    {
-      values[i].setNull();
-    }
-    else if ( type == Value::TypeUndefined )  // undefined value  (different from NULL)
-    {
-      values[i].setUndefined();
-    }
-    else
-    {
-      throwReaderError( "readRowValues: unexpected entry type" );
-    }
+    readValue( view );
+    view.toValue( values[i] );
   }
 }
 
@@ -181,13 +306,13 @@ void ChangesetReader::readTableRecord()
   **   * A nul-terminated table name.
   */
 
-  int nCol = readVarint();
-  if ( nCol < 0 || nCol > 65536 )
+  uint64_t nCol = readVarint();
+  if ( nCol > 65536 )
     throwReaderError( "readByte: unexpected number of columns" );
 
   mCurrentTable.primaryKeys.clear();
 
-  for ( int i = 0; i < nCol; ++i )
+  for ( uint64_t i = 0; i < nCol; ++i )
   {
     mCurrentTable.primaryKeys.push_back( readByte() );
   }
@@ -10,6 +10,7 @@
 #include "geodiff.h"
 
 #include "changeset.h"
+#include "changesetindex.h"
 
 
 class Buffer;
@@ -26,31 +27,82 @@ class ChangesetReader
     ChangesetReader();
     ~ChangesetReader();
 
-    //! Starts reading of changeset from a file
+    /**
+     * Starts reading of changeset from a file (compressed changesets are decompressed transparently).
+     * The file may also be a pipe, and "-" stands for the standard input.
+     * Regular files are memory-mapped, but a compressed changeset gets decompressed to memory
+     * as a whole, so reading it needs memory for its full uncompressed size.
+     */
     bool open( const std::string &filename );
 
+    //! Starts reading of changeset from a file descriptor (e.g. a pipe). The descriptor is not closed
+    bool openFileDescriptor( int fd );
+
+    //! Starts reading of changeset from a memory buffer. The data are not copied, so the buffer must outlive the reader
+    bool openBuffer( const Buffer &buffer );
+
     //! Reads next changeset entry to the passed object
     bool nextEntry( ChangesetEntry &entry );
 
+    /**
+     * Reads next changeset entry to the passed view without copying text/blob values:
+     * they point directly to the reader's buffer. The view is only valid until the next
+     * call to nextEntry() - use ChangesetEntryView::toEntry() to keep a copy of it.
+     */
+    bool nextEntry( ChangesetEntryView &entry );
+
     //! Returns whether the changeset being read is completely empty
     bool isEmpty() const;
 
+    //! Returns size of the changeset entries in bytes (uncompressed, without the index)
+    int64_t dataSize() const { return mDataEnd; }
+
     //! Resets the reader position back to the start of the changeset
     void rewind();
 
+    //! Returns whether the changeset contains an index of tables (see changeset-format.md)
+    bool hasIndex() const { return mHasIndex; }
+
+    //! Returns list of table blocks from changeset's index (empty if there is no index)
+    const std::vector<ChangesetTableIndex> &indexTables() const { return mIndex.tables; }
+
+    /**
+     * Moves the reader to the start of the first block of changes of the given table, so that
+     * the following nextEntry() returns the first entry of that table. Entries of the following
+     * tables are returned afterwards as usual. Requires changeset with index.
+     * Returns false if there is no index or the table is not in the changeset.
+     */
+    bool seekToTable( const std::string &tableName );
+
+    /**
+     * Verifies that checksum stored in the changeset's index matches the data.
+     * This needs to go through the whole changeset. Returns false if there is no index.
+     */
+    bool verifyIndexChecksum() const;
+
   private:
 
+    void initBuffer();
+
     char readByte();
-    int readVarint();
+    uint64_t readVarint();
     std::string readNullTerminatedString();
+    void readValue( ValueView &value );
     void readRowValues( std::vector<Value> &values );
+    void readRowValues( std::vector<ValueView> &values );
+    template<typename T> bool readEntry( T &entry );
     void readTableRecord();
 
     void throwReaderError( const std::string &message ) const;
 
-    int mOffset = 0;  // where are we in the buffer
+    int64_t mOffset = 0;  // where are we in the buffer
+    int64_t mDataEnd = 0;  // where changeset entries end (start of index or end of buffer)
+
+    bool mHasIndex = false;
+    ChangesetIndex mIndex;
 
-    std::unique_ptr<Buffer> mBuffer;
+    std::unique_ptr<Buffer> mOwnedBuffer;  // buffer owned by the reader (if not reading external buffer)
+    const Buffer *mBuffer = nullptr;  // buffer with the changeset data
 
     ChangesetTable mCurrentTable;  // currently processed table
 };
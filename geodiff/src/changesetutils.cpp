@@ -77,6 +77,11 @@ void invertChangeset( ChangesetReader &reader, ChangesetWriter &writer )
 }
 
 nlohmann::json valueToJSON( const Value &value )
+{
+  return valueToJSON( ValueView::fromValue( value ) );
+}
+
+nlohmann::json valueToJSON( const ValueView &value )
 {
   nlohmann::json j;
   switch ( value.type() )
@@ -90,15 +95,15 @@ nlohmann::json valueToJSON( const Value &value )
       j = value.getDouble();
       break;
     case Value::TypeText:
-      j = value.getString();
+      j = std::string( value.getStringData(), value.getStringSize() );
       break;
     case Value::TypeBlob:
     {
       // this used to either show "blob N bytes" or would be converted to WKT
       // but this is better - it preserves content of any type + can be decoded back
       std::string base64 = base64_encode(
-                             reinterpret_cast<const unsigned char *>( value.getString().data() ),
-                             static_cast<unsigned int>( value.getString().size() ) );
+                             reinterpret_cast<const unsigned char *>( value.getStringData() ),
+                             static_cast<unsigned int>( value.getStringSize() ) );
       j = base64;
       break;
     }
@@ -113,6 +118,11 @@ nlohmann::json valueToJSON( const Value &value )
 
 
 nlohmann::json changesetEntryToJSON( const ChangesetEntry &entry )
+{
+  return changesetEntryToJSON( ChangesetEntryView::fromEntry( entry ) );
+}
+
+nlohmann::json changesetEntryToJSON( const ChangesetEntryView &entry )
 {
   std::string status;
   if ( entry.op == ChangesetEntry::OpUpdate )
@@ -136,11 +146,11 @@ nlohmann::json changesetEntryToJSON( const ChangesetEntry &entry )
 
   auto entries = nlohmann::json::array();
 
-  Value valueOld, valueNew;
+  ValueView valueOld, valueNew;
   for ( size_t i = 0; i < entry.table->columnCount(); ++i )
   {
-    valueNew = ( entry.op == ChangesetEntry::OpUpdate || entry.op == ChangesetEntry::OpInsert ) ? entry.newValues[i] : Value();
-    valueOld = ( entry.op == ChangesetEntry::OpUpdate || entry.op == ChangesetEntry::OpDelete ) ? entry.oldValues[i] : Value();
+    valueNew = ( entry.op == ChangesetEntry::OpUpdate || entry.op == ChangesetEntry::OpInsert ) ? entry.newValues[i] : ValueView();
+    valueOld = ( entry.op == ChangesetEntry::OpUpdate || entry.op == ChangesetEntry::OpDelete ) ? entry.oldValues[i] : ValueView();
 
     nlohmann::json change;
 
@@ -178,7 +188,7 @@ nlohmann::json changesetToJSON( ChangesetReader &reader )
 {
   auto entries = nlohmann::json::array();
 
-  ChangesetEntry entry;
+  ChangesetEntryView entry;
   while ( reader.nextEntry( entry ) )
   {
     nlohmann::json msg = changesetEntryToJSON( entry );
@@ -206,11 +216,22 @@ nlohmann::json changesetToJSONSummary( ChangesetReader &reader )
 {
   std::map< std::string, TableSummary > summary;
 
-  ChangesetEntry entry;
-  while ( reader.nextEntry( entry ) )
+  if ( reader.hasIndex() )
+  {
+    // no need to go through the whole changeset
+    for ( const ChangesetTableIndex &t : reader.indexTables() )
+    {
+      TableSummary &tableSummary = summary[t.name];
+      tableSummary.inserts += static_cast<int>( t.inserts );
+      tableSummary.updates += static_cast<int>( t.updates );
+      tableSummary.deletes += static_cast<int>( t.deletes );
+    }
+  }
+
+  ChangesetEntryView entry;
+  while ( !reader.hasIndex() && reader.nextEntry( entry ) )
   {
-    std::string tableName = entry.table->name;
-    TableSummary &tableSummary = summary[tableName];
+    TableSummary &tableSummary = summary[entry.table->name];
 
     if ( entry.op == ChangesetEntry::OpUpdate )
       ++tableSummary.updates;
@@ -16,9 +16,11 @@ class ConflictFeature;
 class ChangesetReader;
 class ChangesetWriter;
 struct ChangesetEntry;
+struct ChangesetEntryView;
 struct ChangesetTable;
 struct TableSchema;
 struct Value;
+struct ValueView;
 class Context;
 
 ChangesetTable schemaToChangesetTable( const std::string &tableName, const TableSchema &tbl );
@@ -27,8 +29,13 @@ void invertChangeset( ChangesetReader &reader, ChangesetWriter &writer );
 
 void concatChangesets( const Context *context, const std::vector<std::string> &filenames, const std::string &outputChangeset );
 
+//! Concatenates changesets from the readers and writes the result to an already opened writer (which is not closed)
+void concatChangesets( const Context *context, const std::vector<ChangesetReader *> &readers, ChangesetWriter &writer );
+
 nlohmann::json changesetEntryToJSON( const ChangesetEntry &entry );
 
+nlohmann::json changesetEntryToJSON( const ChangesetEntryView &entry );
+
 nlohmann::json changesetToJSON( ChangesetReader &reader );
 
 nlohmann::json changesetToJSONSummary( ChangesetReader &reader );
@@ -37,6 +44,8 @@ nlohmann::json conflictsToJSON( const std::vector<ConflictFeature> &conflicts );
 
 nlohmann::json valueToJSON( const Value &value );
 
+nlohmann::json valueToJSON( const ValueView &value );
+
 std::string hex2bin( const std::string &str );
 std::string bin2hex( const std::string &str );
 
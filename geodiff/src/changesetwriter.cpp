@@ -8,29 +8,222 @@
 #include "geodiffutils.hpp"
 #include "changesetputvarint.h"
 #include "portableendian.h"
+#include "changesetcompression.h"
 
 #include <assert.h>
 #include <memory.h>
 
+#include <algorithm>
 #include <sstream>
 
+#ifdef __linux__
+#include <fcntl.h>
+#endif
+
+//! Size of the internal buffer - when it gets full, its content is written to the file
+static const size_t WRITE_BUFFER_SIZE = 1024 * 1024;
+
+
+ChangesetWriter::ChangesetWriter() = default;
+
+ChangesetWriter::~ChangesetWriter()
+{
+  try
+  {
+    close();
+  }
+  catch ( const GeoDiffException & )
+  {
+    // nothing we can do here - callers interested in errors should use close()
+  }
+}
+
 void ChangesetWriter::open( const std::string &filename )
 {
-#ifdef WIN32
-  mFile.open( stringToWString( filename ), std::ios::out | std::ios::binary );
-#else
-  mFile.open( filename, std::ios::out | std::ios::binary );
-#endif
-  if ( !mFile.is_open() )
+  if ( isStdioPath( filename ) )
+  {
+    // anything already buffered by stdio needs to go first
+    fflush( stdout );
+    openFileDescriptor( fileno( stdout ) );
+    return;
+  }
+
+  close();
+
+  try
+  {
+    mFile = openFile( filename, "wb" );
+  }
+  catch ( const GeoDiffException & )
+  {
+    mFile = nullptr;
+  }
+  if ( !mFile )
     throw GeoDiffException( "Unable to open changeset file for writing: " + filename );
+
+  init( filename );
+}
+
+void ChangesetWriter::openFileDescriptor( int fd )
+{
+  close();
+
+  mFile = ::openFileDescriptor( fd, "wb" );
+  if ( !mFile )
+    throw GeoDiffException( "Unable to open file descriptor for writing changeset: " + std::to_string( fd ) );
+
+  init( "file descriptor " + std::to_string( fd ) );
+}
+
+void ChangesetWriter::openBuffer( Buffer &output )
+{
+  close();
+
+  mOutputBuffer = &output;
+  init( "memory buffer" );
+}
+
+void ChangesetWriter::init( const std::string &filename )
+{
+  // we do our own buffering, so there is no need for another copy in stdio
+  if ( mFile )
+    setvbuf( mFile, nullptr, _IONBF, 0 );
+
+  mFilename = filename;
+  mBuffer.reserve( WRITE_BUFFER_SIZE );
+  mDataOffset = 0;
+  mCompressionStarted = false;
+  mChecksum = CHANGESET_CHECKSUM_INIT;
+  mIndexTables.clear();
+}
+
+void ChangesetWriter::preallocate( int64_t size )
+{
+  if ( !mFile || size <= 0 )
+    return;
+
+#ifdef __linux__
+  // keep the file size unchanged - otherwise we would end up with trailing zeros
+  // in case the hint was larger than the actual changeset
+  ( void ) fallocate( fileno( mFile ), FALLOC_FL_KEEP_SIZE, 0, size );
+#endif
+}
+
+void ChangesetWriter::flush()
+{
+  if ( !isOpen() || mBuffer.empty() )
+    return;
+
+  writeToFile( mBuffer.data(), mBuffer.size() );
+  mBuffer.clear();
+}
+
+void ChangesetWriter::writeToFile( const char *data, size_t size )
+{
+  mDataOffset += size;
+  if ( mIndexEnabled )
+    mChecksum = changesetChecksum( mChecksum, data, size );
+
+  if ( mCompressionEnabled )
+  {
+    // the header is only written with the first data, so that empty changesets stay empty
+    mCompressed.clear();
+    if ( !mCompressionStarted )
+    {
+      mCompressed = changesetCompressionHeader();
+      mCompressionStarted = true;
+    }
+    for ( size_t offset = 0; offset < size; offset += CHANGESET_COMPRESSION_BLOCK_SIZE )
+    {
+      size_t blockSize = std::min<size_t>( size - offset, CHANGESET_COMPRESSION_BLOCK_SIZE );
+      compressChangesetBlock( data + offset, blockSize, mCompressed );
+    }
+    data = mCompressed.data();
+    size = mCompressed.size();
+  }
+
+  writeOutput( data, size );
+}
+
+void ChangesetWriter::writeOutput( const char *data, size_t size )
+{
+  if ( mOutputBuffer )
+    mOutputBuffer->append( data, ( int64_t ) size );
+  else if ( fwrite( data, 1, size, mFile ) != size )
+    throw GeoDiffException( "Unable to write changeset file: " + mFilename );
+}
+
+void ChangesetWriter::writeIndex()
+{
+  flush();
+
+  uint64_t indexOffset = mDataOffset;
+  if ( !mIndexTables.empty() )
+    mIndexTables.back().size = indexOffset - mIndexTables.back().offset;
+
+  ChangesetIndex index;
+  index.tables = mIndexTables;
+  index.checksum = mChecksum;
+  std::string record = encodeChangesetIndex( index, indexOffset );
+  if ( !record.empty() )  // too many tables to fit the index - just skip it
+    writeToFile( record.data(), record.size() );
+}
+
+void ChangesetWriter::close()
+{
+  if ( !isOpen() )
+    return;
+
+  FILE *file = mFile;
+  try
+  {
+    // index is only written for non-empty changesets, empty changeset should stay empty
+    if ( mIndexEnabled && !mIndexTables.empty() )
+      writeIndex();
+    flush();
+
+    if ( mCompressionStarted )
+    {
+      std::string marker = changesetCompressionEndMarker();
+      writeOutput( marker.data(), marker.size() );
+    }
+  }
+  catch ( const GeoDiffException & )
+  {
+    if ( file )
+      fclose( file );
+    mFile = nullptr;
+    mOutputBuffer = nullptr;
+    throw;
+  }
+
+  mFile = nullptr;
+  if ( mOutputBuffer )
+  {
+    mOutputBuffer = nullptr;
+    return;
+  }
+  if ( fclose( file ) != 0 )
+    throw GeoDiffException( "Unable to close changeset file: " + mFilename );
 }
 
 void ChangesetWriter::beginTable( const ChangesetTable &table )
 {
   mCurrentTable = table;
 
+  if ( mIndexEnabled )
+  {
+    uint64_t offset = mDataOffset + mBuffer.size();
+    if ( !mIndexTables.empty() )
+      mIndexTables.back().size = offset - mIndexTables.back().offset;
+    ChangesetTableIndex tableIndex;
+    tableIndex.name = table.name;
+    tableIndex.offset = offset;
+    mIndexTables.push_back( tableIndex );
+  }
+
   writeByte( 'T' );
-  writeVarint( ( int ) table.columnCount() );
+  writeVarint( table.columnCount() );
   for ( size_t i = 0; i < table.columnCount(); ++i )
     writeByte( table.primaryKeys[i] );
   writeNullTerminatedString( table.name );
@@ -43,27 +236,117 @@ void ChangesetWriter::writeEntry( const ChangesetEntry &entry )
   writeByte( ( char ) entry.op );
   writeByte( 0 );  // "indirect" always false
 
+  if ( mIndexEnabled && !mIndexTables.empty() )
+  {
+    ChangesetTableIndex &tableIndex = mIndexTables.back();
+    if ( entry.op == ChangesetEntry::OpInsert )
+      ++tableIndex.inserts;
+    else if ( entry.op == ChangesetEntry::OpUpdate )
+      ++tableIndex.updates;
+    else
+      ++tableIndex.deletes;
+  }
+
   if ( entry.op != ChangesetEntry::OpInsert )
     writeRowValues( entry.oldValues );
   if ( entry.op != ChangesetEntry::OpDelete )
     writeRowValues( entry.newValues );
 }
 
+void ChangesetWriter::writeTables( const char *data, size_t size, const std::vector<ChangesetTableIndex> &tables )
+{
+  if ( size == 0 )
+    return;
+
+  if ( mIndexEnabled && !tables.empty() )
+  {
+    uint64_t start = mDataOffset + mBuffer.size();
+    if ( !mIndexTables.empty() )
+      mIndexTables.back().size = start - mIndexTables.back().offset;
+    for ( ChangesetTableIndex tableIndex : tables )
+    {
+      tableIndex.offset += start;
+      mIndexTables.push_back( tableIndex );
+    }
+  }
+
+  mCurrentTable = ChangesetTable();
+  writeData( data, size );
+}
+
+void ChangesetWriter::continueTable( const ChangesetTable &table )
+{
+  mCurrentTable = table;
+
+  if ( mIndexEnabled )
+  {
+    uint64_t offset = mDataOffset + mBuffer.size();
+    if ( !mIndexTables.empty() )
+      mIndexTables.back().size = offset - mIndexTables.back().offset;
+    ChangesetTableIndex tableIndex;
+    tableIndex.name = table.name;
+    tableIndex.offset = offset;
+    mIndexTables.push_back( tableIndex );
+  }
+}
+
+void ChangesetWriter::writeEntries( const char *data, size_t size, const ChangesetTableIndex &counts )
+{
+  if ( size == 0 )
+    return;
+
+  if ( mCurrentTable.name.empty() )
+    throw GeoDiffException( "writeEntries: no table has been started" );
+
+  if ( mIndexEnabled && !mIndexTables.empty() )
+  {
+    ChangesetTableIndex &tableIndex = mIndexTables.back();
+    tableIndex.inserts += counts.inserts;
+    tableIndex.updates += counts.updates;
+    tableIndex.deletes += counts.deletes;
+  }
+
+  writeData( data, size );
+}
+
+void ChangesetWriter::writeData( const char *data, size_t size )
+{
+  if ( !isOpen() )
+    throw GeoDiffException( "Changeset file is not open for writing" );
+
+  if ( mBuffer.size() + size > WRITE_BUFFER_SIZE )
+  {
+    flush();
+
+    if ( size > WRITE_BUFFER_SIZE )
+    {
+      // large blobs are written directly without copying them to the buffer
+      writeToFile( data, size );
+      return;
+    }
+  }
+
+  mBuffer.append( data, size );
+}
+
 void ChangesetWriter::writeByte( char c )
 {
-  mFile.write( &c, 1 );
+  if ( isOpen() && mBuffer.size() < WRITE_BUFFER_SIZE )
+    mBuffer.push_back( c );
+  else
+    writeData( &c, 1 );
 }
 
-void ChangesetWriter::writeVarint( int n )
+void ChangesetWriter::writeVarint( uint64_t n )
 {
   unsigned char output[9];  // 1-9 bytes
-  int numBytes = putVarint32( output, n );
-  mFile.write( reinterpret_cast<char *>( output ), numBytes );
+  int numBytes = sqlite3PutVarint( output, n );
+  writeData( reinterpret_cast<char *>( output ), numBytes );
 }
 
 void ChangesetWriter::writeNullTerminatedString( const std::string &str )
 {
-  mFile.write( str.c_str(), str.size() + 1 );
+  writeData( str.c_str(), str.size() + 1 );
 }
 
 void ChangesetWriter::writeRowValues( const std::vector<Value> &values )
@@ -82,7 +365,7 @@ void ChangesetWriter::writeRowValues( const std::vector<Value> &values )
       int64_t v = values[i].getInt();
       memcpy( &x, &v, 8 );
       x = htobe64( x ); // convert host to big endian
-      mFile.write( reinterpret_cast<char *>( &x ), 8 );
+      writeData( reinterpret_cast<char *>( &x ), 8 );
     }
     else if ( type == Value::TypeDouble ) // 0x02
     {
@@ -91,13 +374,13 @@ void ChangesetWriter::writeRowValues( const std::vector<Value> &values )
       double v = values[i].getDouble();
       memcpy( &x, &v, 8 );
       x = htobe64( x ); // convert host to big endian
-      mFile.write( reinterpret_cast<char *>( &x ), 8 );
+      writeData( reinterpret_cast<char *>( &x ), 8 );
     }
     else if ( type == Value::TypeText || type == Value::TypeBlob ) // 0x03 or 0x04
     {
-      const std::string &str = values[i].getString();
-      writeVarint( static_cast<int>( str.size() ) );
-      mFile.write( str.c_str(), str.size() );
+      size_t size = values[i].getStringSize();
+      writeVarint( size );
+      writeData( values[i].getStringData(), size );
     }
     else if ( type == Value::TypeNull ) // 0x05
     {
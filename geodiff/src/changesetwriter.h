@@ -9,14 +9,23 @@
 #include "geodiff.h"
 
 #include "changeset.h"
+#include "changesetindex.h"
 
-#include <fstream>
+#include <stdio.h>
+#include <string>
+
+class Buffer;
 
 /**
  * Class for writing binary changeset files.
  * First use open() to create a new changeset file and then for each modified table:
  * - call beginTable() once
  * - then call writeEntry() for each change within that table
+ * Finally call close() to flush all buffered data to the file and get notified
+ * about any write errors (destructor also flushes the data, but ignores errors).
+ *
+ * Written data are collected in an internal buffer and only flushed to the file
+ * once the buffer is full, so that small writes of individual values are cheap.
  *
  * See changeset-format.md for the documentation of the format.
  */
@@ -24,27 +33,127 @@ class ChangesetWriter
 {
   public:
 
+    ChangesetWriter();
+    ~ChangesetWriter();
+
+    ChangesetWriter( const ChangesetWriter & ) = delete;
+    ChangesetWriter &operator=( const ChangesetWriter & ) = delete;
+
     /**
-     *  opens a file for writing changeset (will overwrite if it exists already)
+     *  opens a file for writing changeset (will overwrite if it exists already),
+     *  "-" stands for the standard output
      *  throws GeoDiffException on error
      */
     void open( const std::string &filename );
 
+    /**
+     *  opens a file descriptor (e.g. a pipe) for writing changeset. The descriptor
+     *  is not closed by close(), only all data get written to it
+     *  throws GeoDiffException on error
+     */
+    void openFileDescriptor( int fd );
+
+    /**
+     *  opens a memory buffer for writing changeset - the data get appended to the buffer,
+     *  which needs to outlive the writer (or at least until close() is called)
+     */
+    void openBuffer( Buffer &output );
+
+    //! Returns whether the writer has been opened and not closed yet
+    bool isOpen() const { return mFile || mOutputBuffer; }
+
+    /**
+     * Hints the expected size of the changeset in bytes (if known in advance by the caller),
+     * so that the disk space can be reserved upfront and the file is less fragmented.
+     * This is only a hint: it does not change the size of the file and any errors are ignored.
+     * Only has effect on Linux, it is a no-op elsewhere.
+     */
+    void preallocate( int64_t size );
+
+    /**
+     * Sets whether an index of tables should be appended to the changeset when it is closed
+     * (see changeset-format.md). The index is ignored by readers not aware of it, but the
+     * output is not byte-identical to the one produced by sqlite3 session extension anymore.
+     * Disabled by default.
+     */
+    void setIndexEnabled( bool enabled ) { mIndexEnabled = enabled; }
+
+    /**
+     * Sets whether the changeset should be written in the compressed container format
+     * (see changeset-format.md). ChangesetReader decompresses such changesets transparently,
+     * but they can't be read by sqlite3 session extension. Must be set before any data are written.
+     * Disabled by default.
+     */
+    void setCompressionEnabled( bool enabled ) { mCompressionEnabled = enabled; }
+
+    //! writes all buffered data to the file. Throws GeoDiffException on error
+    void flush();
+
+    //! flushes buffered data and closes the file. Throws GeoDiffException on error
+    void close();
+
     //! writes table information, all subsequent writes will be related to this table until next call to beginTable()
     void beginTable( const ChangesetTable &table );
 
     //! writes table change entry
     void writeEntry( const ChangesetEntry &entry );
 
+    /**
+     * Writes complete table blocks (table headers followed by their entries) that have been
+     * encoded by another writer to a memory buffer with compression disabled. "tables" is the index
+     * of these blocks as collected by the other writer (see indexTables()), with offsets relative
+     * to the start of the data - it is used to keep the index of this writer up to date.
+     * beginTable() needs to be called before any further writeEntry() calls.
+     */
+    void writeTables( const char *data, size_t size, const std::vector<ChangesetTableIndex> &tables );
+
+    /**
+     * Sets the table for subsequent writeEntry() calls without writing the table header.
+     * This is used when the entries are going to be appended to a table block started
+     * by another writer (see writeEntries()). When the index is enabled, a new index item
+     * is started to collect counts of the entries.
+     */
+    void continueTable( const ChangesetTable &table );
+
+    /**
+     * Writes entries of the current table (set by beginTable()) that have been encoded by another
+     * writer after continueTable(). "counts" are the numbers of inserts/updates/deletes within
+     * the data, as collected by the other writer - they are added to the current table's index.
+     */
+    void writeEntries( const char *data, size_t size, const ChangesetTableIndex &counts );
+
+    //! Returns index of table blocks written so far (only collected when the index is enabled)
+    const std::vector<ChangesetTableIndex> &indexTables() const { return mIndexTables; }
+
   private:
 
+    void init( const std::string &filename );
+
     void writeByte( char c );
-    void writeVarint( int n );
+    void writeVarint( uint64_t n );
     void writeNullTerminatedString( const std::string &str );
 
     void writeRowValues( const std::vector<Value> &values );
 
-    std::ofstream mFile;
+    void writeData( const char *data, size_t size );
+    void writeToFile( const char *data, size_t size );
+    void writeOutput( const char *data, size_t size );
+    void writeIndex();
+
+    FILE *mFile = nullptr;
+    Buffer *mOutputBuffer = nullptr;  // used instead of file when writing to memory
+    std::string mFilename;
+
+    std::string mBuffer;  // data not yet written to the file
+    uint64_t mDataOffset = 0;  // number of changeset bytes written so far (before compression)
+    uint64_t mChecksum = CHANGESET_CHECKSUM_INIT;  // checksum of the changeset data written so far
+
+    bool mCompressionEnabled = false;
+    bool mCompressionStarted = false;  // whether the header of compressed changeset has been written
+    std::string mCompressed;  // compressed frames to be written to the file
+
+    bool mIndexEnabled = false;
+    std::vector<ChangesetTableIndex> mIndexTables;  // table blocks written so far
 
     ChangesetTable mCurrentTable;  // currently processed table
 };
@@ -9,6 +9,7 @@
 #include "geodifflogger.hpp"
 #include "geodiffutils.hpp"
 #include "changeset.h"
+#include "changesetapplyorder.h"
 #include "changesetreader.h"
 #include "changesetutils.h"
 #include "changesetwriter.h"
@@ -423,7 +424,7 @@ static std::string sqlFindInserted( const std::string &schemaNameBase, const std
 }
 
 
-static std::string sqlFindModified( const std::string &schemaNameBase, const std::string &schemaNameModified, const std::string &tableName, const TableSchema &tbl )
+static std::string sqlFindModified( const Context *context, const std::string &schemaNameBase, const std::string &schemaNameModified, const std::string &tableName, const TableSchema &tbl )
 {
   std::string exprPk;
   std::string exprOther;
@@ -436,7 +437,7 @@ static std::string sqlFindModified( const std::string &schemaNameBase, const std
       exprPk += "b." + quotedIdentifier( c.name ) + "=" +
                 "a." + quotedIdentifier( c.name );
     }
-    else // not a primary key column
+    else if ( !context->isColumnIgnored( tableName, c.name ) ) // not a primary key column
     {
       if ( !exprOther.empty() )
         exprOther += " OR ";
@@ -549,49 +550,7 @@ static Value resultToValue( const PostgresResult &res, int r, int i, const Table
   return v;
 }
 
-static std::string valueToSql( const Value &v, const TableColumnInfo &col )
-{
-  if ( v.type() == Value::TypeUndefined )
-  {
-    throw GeoDiffException( "valueToSql: got 'undefined' value (malformed changeset?)" );
-  }
-  else if ( v.type() == Value::TypeNull )
-  {
-    return "NULL";
-  }
-  else if ( v.type() == Value::TypeInt )
-  {
-    if ( col.type == "boolean" )
-      return v.getInt() ? "'t'" : "'f'";
-    else
-      return std::to_string( v.getInt() );
-  }
-  else if ( v.type() == Value::TypeDouble )
-  {
-    return to_string_with_max_precision( v.getDouble() );
-  }
-  else if ( v.type() == Value::TypeText || v.type() == Value::TypeBlob )
-  {
-    if ( col.isGeometry )
-    {
-      // handling of geometries - they are encoded with GPKG header
-      std::string gpkgWkb = v.getString();
-      int headerSize = parseGpkgbHeaderSize( gpkgWkb );
-      std::string wkb( gpkgWkb.size() - headerSize, 0 );
-
-      memcpy( &wkb[0], &gpkgWkb[headerSize], gpkgWkb.size() - headerSize );
-      return "ST_GeomFromWKB('\\x" + bin2hex( wkb ) + "', " + std::to_string( col.geomSrsId ) + ")";
-    }
-    return quotedString( v.getString() );
-  }
-  else
-  {
-    throw GeoDiffException( "unexpected value" );
-  }
-}
-
-
-static void handleInserted( const std::string &schemaNameBase, const std::string &schemaNameModified, const std::string &tableName, const TableSchema &tbl, bool reverse, PGconn *conn, ChangesetWriter &writer, bool &first )
+static void handleInserted( const std::string &schemaNameBase, const std::string &schemaNameModified, const std::string &tableName, const TableSchema &tbl, bool reverse, PGconn *conn, ChangesetWriter &writer, bool &first, ProgressReporter &progress )
 {
   std::string sqlInserted = sqlFindInserted( schemaNameBase, schemaNameModified, tableName, tbl, reverse );
   PostgresResult res = execSql( conn, sqlInserted );
@@ -599,6 +558,7 @@ static void handleInserted( const std::string &schemaNameBase, const std::string
   int rows = res.rowCount();
   for ( int r = 0; r < rows; ++r )
   {
+    progress.entryDone();
     if ( first )
     {
       ChangesetTable chTable = schemaToChangesetTable( tableName, tbl );
@@ -624,20 +584,20 @@ static void handleInserted( const std::string &schemaNameBase, const std::string
 }
 
 
-static void handleUpdated( const std::string &schemaNameBase, const std::string &schemaNameModified, const std::string &tableName, const TableSchema &tbl, PGconn *conn, ChangesetWriter &writer, bool &first )
+static void handleUpdated( const Context *context, const std::string &schemaNameBase, const std::string &schemaNameModified, const std::string &tableName, const TableSchema &tbl, PGconn *conn, ChangesetWriter &writer, bool &first, ProgressReporter &progress )
 {
-  std::string sqlModified = sqlFindModified( schemaNameBase, schemaNameModified, tableName, tbl );
+  std::string sqlModified = sqlFindModified( context, schemaNameBase, schemaNameModified, tableName, tbl );
   PostgresResult res = execSql( conn, sqlModified );
 
+  double geometryTolerance = context->geometryTolerance();
+  std::vector<bool> ignored;
+  for ( const TableColumnInfo &c : tbl.columns )
+    ignored.push_back( !c.isPrimaryKey && context->isColumnIgnored( tableName, c.name ) );
+
   int rows = res.rowCount();
   for ( int r = 0; r < rows; ++r )
   {
-    if ( first )
-    {
-      ChangesetTable chTable = schemaToChangesetTable( tableName, tbl );
-      writer.beginTable( chTable );
-      first = false;
-    }
+    progress.entryDone();
 
     /*
     ** Within the old.* record associated with an UPDATE change, all fields
@@ -653,17 +613,35 @@ static void handleUpdated( const std::string &schemaNameBase, const std::string
     ChangesetEntry e;
     e.op = ChangesetEntry::OpUpdate;
 
+    bool hasUpdates = false;
     int numColumns = static_cast<int>( tbl.columns.size() );
     for ( int i = 0; i < numColumns; ++i )
     {
       Value v1( resultToValue( res, r, i + numColumns, tbl.columns[i] ) );
       Value v2( resultToValue( res, r, i, tbl.columns[i] ) );
       bool pkey = tbl.columns[i].isPrimaryKey;
-      bool updated = v1 != v2;
+      bool updated = !ignored[i] && v1 != v2;
+      if ( updated && geometryTolerance >= 0 && isColumnGeometry( tbl.columns[i] ) &&
+           v1.type() == Value::TypeBlob && v2.type() == Value::TypeBlob )
+      {
+        updated = !gpkgGeometriesEqual( v1.getStringData(), v1.getStringSize(), v2.getStringData(), v2.getStringSize(), geometryTolerance );
+      }
+      hasUpdates |= updated;
       e.oldValues.push_back( ( pkey || updated ) ? v1 : Value() );
       e.newValues.push_back( updated ? v2 : Value() );
     }
 
+    // all compared columns may be ignored (or there are no other columns than primary key)
+    if ( !hasUpdates )
+      continue;
+
+    if ( first )
+    {
+      ChangesetTable chTable = schemaToChangesetTable( tableName, tbl );
+      writer.beginTable( chTable );
+      first = false;
+    }
+
     writer.writeEntry( e );
   }
 }
@@ -684,8 +662,10 @@ void PostgresDriver::createChangeset( ChangesetWriter &writer )
                             "Modified: " + concatNames( tablesModified ) );
   }
 
+  ProgressReporter progress( context(), static_cast<int>( tablesBase.size() ) );
   for ( const std::string &tableName : tablesBase )
   {
+    progress.startTable( tableName );
     TableSchema tbl = tableSchema( tableName );
     TableSchema tblNew = tableSchema( tableName, true );
 
@@ -701,19 +681,70 @@ void PostgresDriver::createChangeset( ChangesetWriter &writer )
 
     bool first = true;
 
-    handleInserted( mBaseSchema, mModifiedSchema, tableName, tbl, false, mConn, writer, first );  // INSERT
-    handleInserted( mBaseSchema, mModifiedSchema, tableName, tbl, true, mConn, writer, first );   // DELETE
-    handleUpdated( mBaseSchema, mModifiedSchema, tableName, tbl, mConn, writer, first );          // UPDATE
+    handleInserted( mBaseSchema, mModifiedSchema, tableName, tbl, false, mConn, writer, first, progress );  // INSERT
+    handleInserted( mBaseSchema, mModifiedSchema, tableName, tbl, true, mConn, writer, first, progress );   // DELETE
+    handleUpdated( context(), mBaseSchema, mModifiedSchema, tableName, tbl, mConn, writer, first, progress );  // UPDATE
+  }
+  progress.finish();
+}
+
+
+//! Returns SQL expression for the n-th parameter of a prepared statement
+static std::string paramSql( size_t n, const TableColumnInfo &col )
+{
+  std::string param = "$" + std::to_string( n );
+  if ( col.isGeometry )
+    return "ST_GeomFromWKB(" + param + "::bytea, " + std::to_string( col.geomSrsId ) + ")";
+  return param;
+}
+
+//! Adds the value as a parameter of a prepared statement
+static void addParam( PostgresParams &params, const Value &v, const TableColumnInfo &col )
+{
+  if ( v.type() == Value::TypeUndefined )
+  {
+    throw GeoDiffException( "addParam: got 'undefined' value (malformed changeset?)" );
+  }
+  else if ( v.type() == Value::TypeNull )
+  {
+    params.addNull();
+  }
+  else if ( v.type() == Value::TypeInt )
+  {
+    if ( col.type == "boolean" )
+      params.addText( v.getInt() ? "t" : "f" );
+    else
+      params.addText( std::to_string( v.getInt() ) );
+  }
+  else if ( v.type() == Value::TypeDouble )
+  {
+    params.addText( to_string_with_max_precision( v.getDouble() ) );
+  }
+  else if ( v.type() == Value::TypeText || v.type() == Value::TypeBlob )
+  {
+    if ( col.isGeometry )
+    {
+      // geometries are encoded with GPKG header - WKB without the header is passed in binary format
+      const std::string &gpkgWkb = v.getString();
+      int headerSize = parseGpkgbHeaderSize( gpkgWkb );
+      params.addBinary( gpkgWkb.substr( headerSize ) );
+    }
+    else
+      params.addText( v.getString() );
+  }
+  else
+  {
+    throw GeoDiffException( "unexpected value" );
   }
 }
 
 
-static std::string sqlForInsert( const std::string &schemaName, const std::string &tableName, const TableSchema &tbl, const std::vector<Value> &values )
+static std::string sqlForInsert( const std::string &schemaName, const std::string &tableName, const TableSchema &tbl )
 {
   /*
    * For a table defined like this: CREATE TABLE x(a, b, c, d, PRIMARY KEY(a, c));
    *
-   * INSERT INTO x (a, b, c, d) VALUES (?, ?, ?, ?)
+   * INSERT INTO x (a, b, c, d) VALUES ($1, $2, $3, $4)
    */
 
   std::string sql;
@@ -729,43 +760,70 @@ static std::string sqlForInsert( const std::string &schemaName, const std::strin
   {
     if ( i > 0 )
       sql += ", ";
-    sql += valueToSql( values[i], tbl.columns[i] );
+    sql += paramSql( i + 1, tbl.columns[i] );
   }
   sql += ")";
   return sql;
 }
 
 
-static std::string sqlForUpdate( const std::string &schemaName, const std::string &tableName, const TableSchema &tbl, const std::vector<Value> &oldValues, const std::vector<Value> &newValues )
+//! Returns key of the update statement - which old and new values are used (see PostgresChangeApplyState::TableState)
+static std::string updateKey( const std::vector<Value> &oldValues, const std::vector<Value> &newValues )
+{
+  std::string key( oldValues.size(), '-' );
+  for ( size_t i = 0; i < oldValues.size(); ++i )
+  {
+    bool hasOld = oldValues[i].type() != Value::TypeUndefined;
+    bool hasNew = newValues[i].type() != Value::TypeUndefined;
+    if ( hasOld && hasNew )
+      key[i] = 'b';
+    else if ( hasOld )
+      key[i] = 'o';
+    else if ( hasNew )
+      key[i] = 'n';
+  }
+  return key;
+}
+
+
+static std::string sqlForUpdate( const std::string &schemaName, const std::string &tableName, const TableSchema &tbl, const std::string &key )
 {
+  /*
+   * For a table defined like this: CREATE TABLE x(a, b, c, d, PRIMARY KEY(a, c));
+   * and an update of column b (key "obo-"):
+   *
+   * UPDATE x SET b = $1 WHERE a = $2 AND b IS NOT DISTINCT FROM $3 AND c = $4
+   *
+   * Parameters are new values followed by old values.
+   */
+
+  size_t param = 0;
   std::string sql;
   sql += "UPDATE " + quotedIdentifier( schemaName ) + "." + quotedIdentifier( tableName ) + " SET ";
 
   bool first = true;
   for ( size_t i = 0; i < tbl.columns.size(); ++i )
   {
-    if ( newValues[i].type() != Value::TypeUndefined )
+    if ( key[i] == 'n' || key[i] == 'b' )
     {
       if ( !first )
         sql += ", ";
       first = false;
-      sql += quotedIdentifier( tbl.columns[i].name ) + " = " + valueToSql( newValues[i], tbl.columns[i] );
+      sql += quotedIdentifier( tbl.columns[i].name ) + " = " + paramSql( ++param, tbl.columns[i] );
     }
   }
   first = true;
   sql += " WHERE ";
   for ( size_t i = 0; i < tbl.columns.size(); ++i )
   {
-    if ( oldValues[i].type() != Value::TypeUndefined )
+    if ( key[i] == 'o' || key[i] == 'b' )
     {
       if ( !first )
         sql += " AND ";
       first = false;
       sql += quotedIdentifier( tbl.columns[i].name );
-      if ( oldValues[i].type() == Value::TypeNull )
-        sql += " IS NULL";
-      else
-        sql += " = " + valueToSql( oldValues[i], tbl.columns[i] );
+      sql += tbl.columns[i].isPrimaryKey ? " = " : " IS NOT DISTINCT FROM ";
+      sql += paramSql( ++param, tbl.columns[i] );
     }
   }
 
@@ -773,38 +831,59 @@ static std::string sqlForUpdate( const std::string &schemaName, const std::strin
 }
 
 
-static std::string sqlForDelete( const std::string &schemaName, const std::string &tableName, const TableSchema &tbl, const std::vector<Value> &values )
+static std::string sqlForDelete( const std::string &schemaName, const std::string &tableName, const TableSchema &tbl )
 {
+  /*
+   * For a table defined like this: CREATE TABLE x(a, b, c, d, PRIMARY KEY(a, c));
+   *
+   * DELETE FROM x WHERE a = $1 AND b IS NOT DISTINCT FROM $2 AND c = $3 AND d IS NOT DISTINCT FROM $4
+   */
+
   std::string sql;
   sql += "DELETE FROM " + quotedIdentifier( schemaName ) + "." + quotedIdentifier( tableName ) + " WHERE ";
   for ( size_t i = 0; i < tbl.columns.size(); ++i )
   {
     if ( i > 0 )
       sql += " AND ";
-    if ( tbl.columns[i].isPrimaryKey )
-      sql += quotedIdentifier( tbl.columns[i].name ) + " = " + valueToSql( values[i], tbl.columns[i] );
-    else
-    {
-      if ( values[i].type() == Value::TypeNull )
-        sql += quotedIdentifier( tbl.columns[i].name ) + " IS NULL";
-      else
-        sql += quotedIdentifier( tbl.columns[i].name ) + " = " + valueToSql( values[i], tbl.columns[i] ) ;
-    }
+    sql += quotedIdentifier( tbl.columns[i].name );
+    sql += tbl.columns[i].isPrimaryKey ? " = " : " IS NOT DISTINCT FROM ";
+    sql += paramSql( i + 1, tbl.columns[i] );
   }
   return sql;
 }
 
-ChangeApplyResult PostgresDriver::applyChange( PostgresChangeApplyState &state, const ChangesetEntry &entry )
+PostgresChangeApplyState::~PostgresChangeApplyState()
+{
+  for ( const std::string &name : mStatementNames )
+  {
+    // errors are ignored - there is nothing to do about them at this point
+    PQclear( PQexec( mConn, ( "DEALLOCATE " + quotedIdentifier( name ) ).c_str() ) );
+  }
+}
+
+void PostgresChangeApplyState::prepare( PostgresPreparedStatement &stmt, const std::string &sql )
+{
+  if ( !stmt.name.empty() )
+    return;
+
+  std::string name = "geodiff_apply_" + std::to_string( mStatementNames.size() );
+  prepareSql( mConn, name, sql );
+  mStatementNames.push_back( name );
+  stmt.name = name;
+  stmt.sql = sql;
+}
+
+PostgresChangeApplyState::TableState *PostgresDriver::applyTableState( PostgresChangeApplyState &state, const ChangesetEntry &entry )
 {
   std::string tableName = entry.table->name;
 
   // skip any changes to GPKG meta tables
   if ( startsWith( tableName, "gpkg_" ) )
-    return ChangeApplyResult::Skipped;
+    return nullptr;
 
   // skip table if asked to
   if ( context()->isTableSkipped( tableName ) )
-    return ChangeApplyResult::Skipped;
+    return nullptr;
 
   if ( state.tableState.count( tableName ) == 0 )
   {
@@ -830,70 +909,482 @@ ChangeApplyResult PostgresDriver::applyChange( PostgresChangeApplyState &state,
     if ( tbl.autoIncrementPkeyIndex != -1 )
       tbl.sequenceName = seqName;
   }
+  return &state.tableState[tableName];
+}
+
+//! Returns which old and new values of the entry are used by the statement applying it (like updateKey())
+static std::string changeKey( const ChangesetEntry &entry )
+{
+  if ( entry.op == ChangesetEntry::OpInsert )
+    return std::string( entry.newValues.size(), 'n' );
+  else if ( entry.op == ChangesetEntry::OpUpdate )
+    return updateKey( entry.oldValues, entry.newValues );
+  else if ( entry.op == ChangesetEntry::OpDelete )
+    return std::string( entry.oldValues.size(), 'o' );
+  else
+    throw GeoDiffException( "Unexpected operation" );
+}
+
+//! Adds parameters of the statement applying the entry - used new values followed by used old values
+static void addChangeParams( PostgresParams &params, const TableSchema &tbl, const ChangesetEntry &entry, const std::string &key )
+{
+  for ( size_t i = 0; i < tbl.columns.size(); ++i )
+  {
+    if ( key[i] == 'n' || key[i] == 'b' )
+      addParam( params, entry.newValues[i], tbl.columns[i] );
+  }
+  for ( size_t i = 0; i < tbl.columns.size(); ++i )
+  {
+    if ( key[i] == 'o' || key[i] == 'b' )
+      addParam( params, entry.oldValues[i], tbl.columns[i] );
+  }
+}
+
+const PostgresPreparedStatement &PostgresDriver::prepareChange( PostgresChangeApplyState &state, PostgresChangeApplyState::TableState &tbl, const ChangesetEntry &entry, PostgresParams &params )
+{
+  const std::string &tableName = entry.table->name;
+  std::string key = changeKey( entry );
+  addChangeParams( params, tbl.schema, entry, key );
+  if ( entry.op == ChangesetEntry::OpInsert )
+  {
+    state.prepare( tbl.stmtInsert, sqlForInsert( mBaseSchema, tableName, tbl.schema ) );
+    return tbl.stmtInsert;
+  }
+  else if ( entry.op == ChangesetEntry::OpUpdate )
+  {
+    PostgresPreparedStatement &stmt = tbl.stmtUpdate[key];
+    state.prepare( stmt, sqlForUpdate( mBaseSchema, tableName, tbl.schema, key ) );
+    return stmt;
+  }
+  else
+  {
+    state.prepare( tbl.stmtDelete, sqlForDelete( mBaseSchema, tableName, tbl.schema ) );
+    return tbl.stmtDelete;
+  }
+}
+
+//! Keeps track of the highest inserted value of auto-incrementing pkey (to update its sequence at the end)
+static void updateAutoIncrementMax( PostgresChangeApplyState::TableState &tbl, const ChangesetEntry &entry )
+{
+  if ( tbl.autoIncrementPkeyIndex != -1 )
+  {
+    int64_t pkey = entry.newValues[tbl.autoIncrementPkeyIndex].getInt();
+    tbl.autoIncrementMax = std::max( tbl.autoIncrementMax, pkey );
+  }
+}
+
+ChangeApplyResult PostgresDriver::checkChangeResult( PostgresChangeApplyState::TableState &tbl, const ChangesetEntry &entry, const PostgresResult &res, const std::string &sql )
+{
+  if ( entry.op == ChangesetEntry::OpInsert )
+  {
+    if ( res.affectedRows() != "1" )
+      throw GeoDiffException( "Wrong number of affected rows! Expected 1, got: " + res.affectedRows() );
+
+    updateAutoIncrementMax( tbl, entry );
+  }
+  else if ( entry.op == ChangesetEntry::OpUpdate )
+  {
+    if ( res.affectedRows() != "1" )
+    {
+      logApplyConflict( "update_nothing", entry );
+      context()->logger().warn( "Wrong number of affected rows! Expected 1, got: " + res.affectedRows() + "\nSQL: " + sql );
+      return ChangeApplyResult::NoChange;
+    }
+  }
+  else if ( entry.op == ChangesetEntry::OpDelete )
+  {
+    if ( res.affectedRows() != "1" )
+    {
+      logApplyConflict( "delete_nothing", entry );
+      context()->logger().warn( "Wrong number of affected rows! Expected 1, got: " + res.affectedRows() );
+      return ChangeApplyResult::NoChange;
+    }
+  }
+  return ChangeApplyResult::Applied;
+}
+
+ChangeApplyResult PostgresDriver::applyChange( PostgresChangeApplyState &state, const ChangesetEntry &entry )
+{
+  PostgresChangeApplyState::TableState *tbl = applyTableState( state, entry );
+  if ( !tbl )
+    return ChangeApplyResult::Skipped;
+
+  PostgresParams params;
+  const PostgresPreparedStatement &stmt = prepareChange( state, *tbl, entry, params );
+
   // Create savepoint so we have somewhere to rollback to if the command fails
   execSql( mConn, "SAVEPOINT geodiff_apply" );
 
+  ChangeApplyResult result;
   try
   {
-    PostgresChangeApplyState::TableState &tbl = state.tableState[tableName];
-    if ( entry.op == ChangesetEntry::OpInsert )
+    PostgresResult res = execPrepared( mConn, stmt.name, params, stmt.sql );
+    result = checkChangeResult( *tbl, entry, res, stmt.sql );
+  }
+  catch ( GeoDiffPostgresException &ex )
+  {
+    if ( ex.result().isIntegrityError() )
+    {
+      execSql( mConn, "ROLLBACK TO SAVEPOINT geodiff_apply" );
+      return ChangeApplyResult::ConstraintConflict;
+    }
+    throw;
+  }
+
+  execSql( mConn, "RELEASE SAVEPOINT geodiff_apply" );
+  return result;
+}
+
+//! Number of changes sent to the server at once when applying a changeset (see PostgresDriver::applyChangesPipelined())
+static const size_t APPLY_BATCH_SIZE = 1000;
+//! Number of changes applied at once if they are all of the same kind (see PostgresDriver::applyChangesBulk())
+static const size_t APPLY_BULK_BATCH_SIZE = 10000;
+//! Minimal number of changes of the same kind to apply them with set based commands instead of one by one
+static const size_t APPLY_BULK_MIN_SIZE = 100;
+
+std::vector<ChangeApplyResult> PostgresDriver::applyChangesPipelined( PostgresChangeApplyState &state, const std::vector<const ChangesetEntry *> &entries )
+{
+  std::vector<ChangeApplyResult> results;
+  if ( entries.empty() )
+    return results;
+
+  if ( entries.size() > APPLY_BATCH_SIZE )
+  {
+    // pipelines are kept short (see PostgresPipeline)
+    for ( size_t i = 0; i < entries.size(); i += APPLY_BATCH_SIZE )
+    {
+      std::vector<const ChangesetEntry *> part( entries.begin() + i, entries.begin() + std::min( i + APPLY_BATCH_SIZE, entries.size() ) );
+      std::vector<ChangeApplyResult> partResults = applyChangesPipelined( state, part );
+      results.insert( results.end(), partResults.begin(), partResults.end() );
+    }
+    return results;
+  }
+
+#ifdef LIBPQ_HAS_PIPELINING
+  // statements need to be prepared first - other commands cannot be run in pipeline mode
+  std::vector<PostgresChangeApplyState::TableState *> tables( entries.size() );
+  std::vector<const PostgresPreparedStatement *> statements( entries.size() );
+  std::vector<PostgresParams> params( entries.size() );
+  for ( size_t i = 0; i < entries.size(); ++i )
+  {
+    tables[i] = applyTableState( state, *entries[i] );
+    if ( tables[i] )
+      statements[i] = &prepareChange( state, *tables[i], *entries[i], params[i] );
+  }
+
+  // all changes are sent at once and a single savepoint is used for the whole batch
+  std::vector<PostgresResult> pipelineResults;
+  try
+  {
+    PostgresPipeline pipeline( mConn );
+    pipeline.sendSql( "SAVEPOINT geodiff_apply_batch" );
+    for ( size_t i = 0; i < entries.size(); ++i )
+    {
+      if ( statements[i] )
+        pipeline.sendPrepared( statements[i]->name, params[i], statements[i]->sql );
+    }
+    pipeline.sendSql( "RELEASE SAVEPOINT geodiff_apply_batch" );
+    pipelineResults = pipeline.results();
+  }
+  catch ( GeoDiffPostgresException &ex )
+  {
+    if ( !ex.result().isIntegrityError() )
+      throw;
+
+    // some change has failed - the batch gets replayed change by change to find out which ones
+    // are conflicting (the same way as if there was no batching)
+    execSql( mConn, "ROLLBACK TO SAVEPOINT geodiff_apply_batch" );
+    execSql( mConn, "RELEASE SAVEPOINT geodiff_apply_batch" );
+    for ( const ChangesetEntry *entry : entries )
+      results.push_back( applyChange( state, *entry ) );
+    return results;
+  }
+
+  size_t resultIndex = 1;  // the first result is of the savepoint
+  for ( size_t i = 0; i < entries.size(); ++i )
+  {
+    if ( statements[i] )
+      results.push_back( checkChangeResult( *tables[i], *entries[i], pipelineResults[resultIndex++], statements[i]->sql ) );
+    else
+      results.push_back( ChangeApplyResult::Skipped );
+  }
+#else
+  for ( const ChangesetEntry *entry : entries )
+    results.push_back( applyChange( state, *entry ) );
+#endif
+
+  return results;
+}
+
+
+/**
+ * Returns column type without type modifiers, e.g. "numeric" for "numeric(10,2)" or "timestamp without time zone"
+ * for "timestamp(3) without time zone". Types whose name without modifiers means length 1 are returned as their
+ * internal variable length names ("bpchar" for "character(5)", "varbit" for "bit(5)").
+ */
+static std::string typeWithoutModifiers( const std::string &dbType )
+{
+  std::string type;
+  size_t depth = 0;
+  for ( char c : dbType )
+  {
+    if ( c == '(' )
+      ++depth;
+    else if ( c == ')' && depth > 0 )
+      --depth;
+    else if ( depth == 0 )
+      type += c;
+  }
+
+  size_t arrayPos = type.find( "[]" );
+  std::string baseType = type.substr( 0, arrayPos );
+  std::string arraySuffix = arrayPos == std::string::npos ? std::string() : type.substr( arrayPos );
+  if ( baseType == "character" || baseType == "char" )
+    return "bpchar" + arraySuffix;
+  if ( baseType == "bit" )
+    return "varbit" + arraySuffix;
+  return type;
+}
+
+//! Returns SQL expression for a value from the staging table (see sqlForBulkChange())
+static std::string stagingValueSql( const std::string &stagingColumn, const TableColumnInfo &col, bool assignment )
+{
+  std::string value = "s." + quotedIdentifier( stagingColumn );
+  if ( col.isGeometry )
+    return "ST_GeomFromWKB(" + value + ", " + std::to_string( col.geomSrsId ) + ")";
+  if ( assignment && isColumnText( col ) )
+    return value;  // an explicit cast to e.g. varchar(10) would silently truncate longer strings
+  if ( !assignment )
+  {
+    // an explicit cast to e.g. varchar(10) or numeric(6,1) would truncate or round the old value,
+    // which could then match the row even though the old value in the changeset is different
+    return "CAST(" + value + " AS " + typeWithoutModifiers( col.type.dbType ) + ")";
+  }
+  return "CAST(" + value + " AS " + col.type.dbType + ")";
+}
+
+//! Returns SQL to create staging table for the given key (see changeKey()) - columns are text and bytea (geometries)
+static std::string sqlForStagingTable( const std::string &stagingTable, const TableSchema &tbl, const std::string &key )
+{
+  std::string columns;
+  for ( char valueType : std::string( "no" ) )
+  {
+    for ( size_t i = 0; i < tbl.columns.size(); ++i )
     {
-      std::string sql = sqlForInsert( mBaseSchema, tableName, tbl.schema, entry.newValues );
-      PostgresResult res = execSql( mConn, sql );
-      if ( res.affectedRows() != "1" )
-        throw GeoDiffException( "Wrong number of affected rows! Expected 1, got: " + res.affectedRows() );
+      if ( key[i] != valueType && key[i] != 'b' )
+        continue;
+      if ( !columns.empty() )
+        columns += ", ";
+      columns += quotedIdentifier( valueType + std::to_string( i ) ) + ( tbl.columns[i].isGeometry ? " bytea" : " text" );
+    }
+  }
+  return "CREATE TEMPORARY TABLE " + quotedIdentifier( stagingTable ) + " (" + columns + ") ON COMMIT DROP";
+}
+
+static std::string sqlForBulkChange( const std::string &schemaName, const std::string &tableName, const TableSchema &tbl, ChangesetEntry::OperationType op, const std::string &key, const std::string &stagingTable )
+{
+  /*
+   * For a table defined like this: CREATE TABLE x(a, b, c, d, PRIMARY KEY(a, c))
+   * and staging table s with new values (n0, n1, ...) and old values (o0, o1, ...):
+   *
+   * INSERT INTO x (a, b, c, d) SELECT s.n0, s.n1, s.n2, s.n3 FROM s
+   * UPDATE x AS t SET b = s.n1 FROM s WHERE t.a = s.o0 AND t.b IS NOT DISTINCT FROM s.o1 AND t.c = s.o2
+   * DELETE FROM x AS t USING s WHERE t.a = s.o0 AND t.b IS NOT DISTINCT FROM s.o1 AND ...
+   *
+   * (with casts of staging values to column types)
+   */
 
-      if ( tbl.autoIncrementPkeyIndex != -1 )
+  std::string target = quotedIdentifier( schemaName ) + "." + quotedIdentifier( tableName );
+  std::string staging = quotedIdentifier( stagingTable ) + " AS s";
+
+  std::string where;
+  for ( size_t i = 0; i < tbl.columns.size(); ++i )
+  {
+    if ( key[i] == 'o' || key[i] == 'b' )
+    {
+      if ( !where.empty() )
+        where += " AND ";
+      where += "t." + quotedIdentifier( tbl.columns[i].name );
+      where += tbl.columns[i].isPrimaryKey ? " = " : " IS NOT DISTINCT FROM ";
+      where += stagingValueSql( "o" + std::to_string( i ), tbl.columns[i], false );
+    }
+  }
+
+  if ( op == ChangesetEntry::OpInsert )
+  {
+    std::string columns, values;
+    for ( size_t i = 0; i < tbl.columns.size(); ++i )
+    {
+      if ( i > 0 )
       {
-        int64_t pkey = entry.newValues[tbl.autoIncrementPkeyIndex].getInt();
-        tbl.autoIncrementMax = std::max( tbl.autoIncrementMax, pkey );
+        columns += ", ";
+        values += ", ";
       }
+      columns += quotedIdentifier( tbl.columns[i].name );
+      values += stagingValueSql( "n" + std::to_string( i ), tbl.columns[i], true );
     }
-    else if ( entry.op == ChangesetEntry::OpUpdate )
+    return "INSERT INTO " + target + " (" + columns + ") SELECT " + values + " FROM " + staging;
+  }
+  else if ( op == ChangesetEntry::OpUpdate )
+  {
+    std::string set;
+    for ( size_t i = 0; i < tbl.columns.size(); ++i )
     {
-      std::string sql = sqlForUpdate( mBaseSchema, tableName, tbl.schema, entry.oldValues, entry.newValues );
-      PostgresResult res = execSql( mConn, sql );
-      if ( res.affectedRows() != "1" )
+      if ( key[i] == 'n' || key[i] == 'b' )
       {
-        logApplyConflict( "update_nothing", entry );
-        context()->logger().warn( "Wrong number of affected rows! Expected 1, got: " + res.affectedRows() + "\nSQL: " + sql );
-        return ChangeApplyResult::NoChange;
+        if ( !set.empty() )
+          set += ", ";
+        set += quotedIdentifier( tbl.columns[i].name ) + " = " + stagingValueSql( "n" + std::to_string( i ), tbl.columns[i], true );
       }
     }
-    else if ( entry.op == ChangesetEntry::OpDelete )
+    return "UPDATE " + target + " AS t SET " + set + " FROM " + staging + " WHERE " + where;
+  }
+  else
+    return "DELETE FROM " + target + " AS t USING " + staging + " WHERE " + where;
+}
+
+//! Returns key of a run of changes that can be applied by a single set based command, or an empty string if the change can't be part of it
+static std::string bulkRunKey( const ChangesetEntry &entry )
+{
+  std::string key = changeKey( entry );
+  if ( entry.op == ChangesetEntry::OpUpdate )
+  {
+    // with updates of primary keys, result of a set based update could differ from updates applied one by one
+    for ( size_t i = 0; i < key.size(); ++i )
+    {
+      if ( entry.table->primaryKeys[i] && key[i] != 'o' )
+        return std::string();
+    }
+  }
+  return entry.table->name + "\n" + std::to_string( entry.op ) + "\n" + key;
+}
+
+std::vector<ChangeApplyResult> PostgresDriver::applyChangesBulk( PostgresChangeApplyState &state, const std::vector<const ChangesetEntry *> &entries )
+{
+  const ChangesetEntry &first = *entries[0];
+  PostgresChangeApplyState::TableState *tbl = applyTableState( state, first );
+  if ( !tbl )
+    return std::vector<ChangeApplyResult>( entries.size(), ChangeApplyResult::Skipped );
+
+  // staging tables are created outside of savepoints, so that they do not get dropped by a rollback
+  std::string key = changeKey( first );
+  std::string &stagingTable = tbl->stagingTables[std::to_string( first.op ) + key];
+  if ( stagingTable.empty() )
+  {
+    std::string name = "geodiff_staging_" + std::to_string( state.stagingTableCount++ );
+    try
+    {
+      execSql( mConn, "SAVEPOINT geodiff_staging" );
+      execSql( mConn, sqlForStagingTable( name, tbl->schema, key ) );
+      execSql( mConn, "RELEASE SAVEPOINT geodiff_staging" );
+      stagingTable = name;
+    }
+    catch ( GeoDiffPostgresException &ex )
+    {
+      // e.g. missing privilege to create temporary tables - changes get applied one by one
+      context()->logger().warn( "Cannot create staging table for applying changes: " + ex.result().statusErrorMessage() );
+      execSql( mConn, "ROLLBACK TO SAVEPOINT geodiff_staging" );
+      execSql( mConn, "RELEASE SAVEPOINT geodiff_staging" );
+      state.bulkUnavailable = true;
+      return applyChanges( state, entries );
+    }
+  }
+
+  std::vector<PostgresParams> rows( entries.size() );
+  for ( size_t i = 0; i < entries.size(); ++i )
+    addChangeParams( rows[i], tbl->schema, *entries[i], key );
+
+  execSql( mConn, "SAVEPOINT geodiff_apply_batch" );
+  try
+  {
+    execSql( mConn, "TRUNCATE " + quotedIdentifier( stagingTable ) );
+    copyRows( mConn, "COPY " + quotedIdentifier( stagingTable ) + " FROM STDIN (FORMAT binary)", rows );
+    PostgresResult res = execSql( mConn, sqlForBulkChange( mBaseSchema, first.table->name, tbl->schema, first.op, key, stagingTable ) );
+    if ( res.affectedRows() == std::to_string( entries.size() ) )
     {
-      std::string sql = sqlForDelete( mBaseSchema, tableName, tbl.schema, entry.oldValues );
-      PostgresResult res = execSql( mConn, sql );
-      if ( res.affectedRows() != "1" )
+      execSql( mConn, "RELEASE SAVEPOINT geodiff_apply_batch" );
+      if ( first.op == ChangesetEntry::OpInsert )
       {
-        logApplyConflict( "delete_nothing", entry );
-        context()->logger().warn( "Wrong number of affected rows! Expected 1, got: " + res.affectedRows() );
-        return ChangeApplyResult::NoChange;
+        for ( const ChangesetEntry *entry : entries )
+          updateAutoIncrementMax( *tbl, *entry );
       }
+      return std::vector<ChangeApplyResult>( entries.size(), ChangeApplyResult::Applied );
     }
-    else
-      throw GeoDiffException( "Unexpected operation" );
   }
   catch ( GeoDiffPostgresException &ex )
   {
-    if ( ex.result().isIntegrityError() )
+    if ( !ex.result().isIntegrityError() )
+      throw;
+  }
+
+  // some changes are conflicting - they get replayed change by change to find out which ones
+  execSql( mConn, "ROLLBACK TO SAVEPOINT geodiff_apply_batch" );
+  execSql( mConn, "RELEASE SAVEPOINT geodiff_apply_batch" );
+  return applyChangesPipelined( state, entries );
+}
+
+std::vector<ChangeApplyResult> PostgresDriver::applyChanges( PostgresChangeApplyState &state, const std::vector<const ChangesetEntry *> &entries )
+{
+  // long runs of changes of the same kind get applied with set based commands, the rest one by one
+  std::vector<std::string> keys;
+  for ( const ChangesetEntry *entry : entries )
+    keys.push_back( bulkRunKey( *entry ) );
+
+  std::vector<ChangeApplyResult> results;
+  auto apply = [&]( size_t start, size_t end, bool bulk )
+  {
+    if ( start == end )
+      return;
+    std::vector<const ChangesetEntry *> part( entries.begin() + start, entries.begin() + end );
+    std::vector<ChangeApplyResult> partResults = bulk ? applyChangesBulk( state, part ) : applyChangesPipelined( state, part );
+    results.insert( results.end(), partResults.begin(), partResults.end() );
+  };
+
+  size_t start = 0;  // first change that has not been applied yet
+  size_t runStart = 0;
+  while ( runStart < entries.size() )
+  {
+    size_t runEnd = runStart + 1;
+    while ( !keys[runStart].empty() && runEnd < entries.size() && keys[runEnd] == keys[runStart] )
+      ++runEnd;
+
+    if ( !keys[runStart].empty() && runEnd - runStart >= APPLY_BULK_MIN_SIZE && !state.bulkUnavailable )
     {
-      execSql( mConn, "ROLLBACK TO SAVEPOINT geodiff_apply" );
-      return ChangeApplyResult::ConstraintConflict;
+      apply( start, runStart, false );
+      apply( runStart, runEnd, true );
+      start = runEnd;
     }
-    throw;
+    runStart = runEnd;
   }
-
-  execSql( mConn, "RELEASE SAVEPOINT geodiff_apply" );
-  return ChangeApplyResult::Applied;
+  apply( start, entries.size(), false );
+  return results;
 }
 
 
+//! Returns foreign keys between tables of the schema as pairs (referencing table, referenced table)
+static std::vector<std::pair<std::string, std::string>> foreignKeyTables( PGconn *conn, const std::string &schemaName )
+{
+  std::string sql =
+    "SELECT cl.relname, ref.relname FROM pg_constraint c"
+    " JOIN pg_class cl ON cl.oid = c.conrelid JOIN pg_namespace n ON n.oid = cl.relnamespace"
+    " JOIN pg_class ref ON ref.oid = c.confrelid JOIN pg_namespace rn ON rn.oid = ref.relnamespace"
+    " WHERE c.contype = 'f' AND n.nspname = " + quotedString( schemaName ) + " AND rn.nspname = " + quotedString( schemaName );
+  PostgresResult res = execSql( conn, sql );
+
+  std::vector<std::pair<std::string, std::string>> tables;
+  for ( int i = 0; i < res.rowCount(); ++i )
+    tables.push_back( std::make_pair( res.value( i, 0 ), res.value( i, 1 ) ) );
+  return tables;
+}
+
 void PostgresDriver::applyChangeset( ChangesetReader &reader )
 {
   if ( !mConn )
     throw GeoDiffException( "Not connected to a database" );
 
+  // prepared statements get deallocated when the transaction has finished
+  PostgresChangeApplyState state( mConn );
+
   // start a transaction, so that all changes get committed at once (or nothing get committed)
   PostgresTransaction transaction( mConn );
   execSql( mConn, "SET CONSTRAINTS ALL DEFERRED" );
@@ -903,29 +1394,78 @@ void PostgresDriver::applyChangeset( ChangesetReader &reader )
   int unrecoverableConflictCount = 0;
   std::vector<ChangesetEntry> conflictingEntries;
   ChangesetEntry entry;
-  PostgresChangeApplyState state;
   std::unordered_map<std::string, std::unique_ptr<ChangesetTable>> tableCopies;
+  ProgressReporter progress( context() );  // cancellation throws, rolling back the transaction
+  ChangesetApplyOrder applyOrder( foreignKeyTables( mConn, mBaseSchema ) );
+
+  // changes are applied in batches, to save round trips to the server (see applyChanges())
+  auto applyBatch = [&]( const std::vector<const ChangesetEntry *> &entries )
+  {
+    std::vector<ChangeApplyResult> results = applyChanges( state, entries );
+    for ( size_t i = 0; i < entries.size(); ++i )
+    {
+      switch ( results[i] )
+      {
+        case ChangeApplyResult::Applied:
+        case ChangeApplyResult::Skipped:
+          break;
+        case ChangeApplyResult::ConstraintConflict:
+          conflictingEntries.push_back( *entries[i] );
+          break;
+        case ChangeApplyResult::NoChange:
+          unrecoverableConflictCount++;
+          break;
+      }
+    }
+  };
+
+  std::vector<ChangesetEntry> batch;
+  std::string batchRunKey;  // set if all changes of the batch are of the same kind (see bulkRunKey())
+  auto applyReadBatch = [&]()
+  {
+    std::vector<const ChangesetEntry *> entries;
+    for ( const ChangesetEntry &bentry : batch )
+      entries.push_back( &bentry );
+    applyBatch( entries );
+    batch.clear();
+  };
+
   while ( reader.nextEntry( entry ) )
   {
-    ChangeApplyResult res = applyChange( state, entry );
-    switch ( res )
+    progress.entryDone( entry.table->name );
+    if ( applyOrder.isOrdered( entry.table->name ) )
     {
-      case ChangeApplyResult::Applied:
-      case ChangeApplyResult::Skipped:
-        break;
-      case ChangeApplyResult::ConstraintConflict:
-        if ( tableCopies.count( entry.table->name ) == 0 )
-          // cppcheck-suppress stlFindInsert
-          tableCopies[entry.table->name] = std::unique_ptr<ChangesetTable>( new ChangesetTable( *entry.table ) );
-        entry.table = tableCopies[entry.table->name].get();
-        conflictingEntries.push_back( entry );
-        break;
-      case ChangeApplyResult::NoChange:
-        unrecoverableConflictCount++;
-        break;
+      // tables linked by foreign keys get applied once all their changes are known
+      applyOrder.addEntry( entry );
+      continue;
     }
+
+    // the reader's table gets replaced by the next one, entries need to keep a copy
+    if ( tableCopies.count( entry.table->name ) == 0 )
+      // cppcheck-suppress stlFindInsert
+      tableCopies[entry.table->name] = std::unique_ptr<ChangesetTable>( new ChangesetTable( *entry.table ) );
+    entry.table = tableCopies[entry.table->name].get();
+    std::string runKey = bulkRunKey( entry );
+    if ( batch.empty() )
+      batchRunKey = runKey;
+    else if ( runKey != batchRunKey )
+      batchRunKey.clear();
+    batch.push_back( entry );
+
+    // changes of the same kind are applied by a few set based commands, so their batches can be larger
+    if ( batch.size() >= ( batchRunKey.empty() ? APPLY_BATCH_SIZE : APPLY_BULK_BATCH_SIZE ) )
+      applyReadBatch();
   }
+  applyReadBatch();
 
+  std::vector<const ChangesetEntry *> orderedEntries = applyOrder.orderedEntries();
+  for ( size_t i = 0; i < orderedEntries.size(); i += APPLY_BULK_BATCH_SIZE )
+  {
+    size_t end = std::min( i + APPLY_BULK_BATCH_SIZE, orderedEntries.size() );
+    applyBatch( std::vector<const ChangesetEntry *>( orderedEntries.begin() + i, orderedEntries.begin() + end ) );
+  }
+
+  // only conflicts that can't be resolved by ordering of tables are left to retrying
   std::vector<ChangesetEntry> newConflictingEntries;
   while ( conflictingEntries.size() > 0 )
   {
@@ -956,6 +1496,8 @@ void PostgresDriver::applyChangeset( ChangesetReader &reader )
     newConflictingEntries.clear();
   }
 
+  progress.finish();
+
   // at the end, update any SEQUENCE objects if needed
   for ( const auto &it : state.tableState )
     if ( it.second.autoIncrementMax )
@@ -1060,8 +1602,10 @@ void PostgresDriver::dumpData( ChangesetWriter &writer, bool useModified )
     throw GeoDiffException( "Not connected to a database" );
 
   std::vector<std::string> tables = listTables();
+  ProgressReporter progress( context(), static_cast<int>( tables.size() ) );
   for ( const std::string &tableName : tables )
   {
+    progress.startTable( tableName );
     TableSchema tbl = tableSchema( tableName, useModified );
     if ( !tbl.hasPrimaryKey() )
       continue;  // ignore tables without primary key - they can't be compared properly
@@ -1086,6 +1630,8 @@ void PostgresDriver::dumpData( ChangesetWriter &writer, bool useModified )
         e.newValues.push_back( Value( resultToValue( res, r, i, tbl.columns[i] ) ) );
       }
       writer.writeEntry( e );
+      progress.entryDone();
     }
   }
+  progress.finish();
 }
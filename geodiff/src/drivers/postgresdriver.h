@@ -7,25 +7,66 @@
 #define POSTGRESDRIVER_H
 
 #include "driver.h"
+#include "postgresutils.h"
 
 extern "C"
 {
 #include <libpq-fe.h>
 }
 
-struct PostgresChangeApplyState
+//! Prepared statement used when applying changes
+struct PostgresPreparedStatement
 {
-  struct TableState
-  {
-    TableSchema schema;
-    // name of its pkey's sequence object (or "" if it doesn't exist)
-    std::string sequenceName;
-    int autoIncrementPkeyIndex;
-    // max. value in changeset
-    int64_t autoIncrementMax = 0;
-  };
-  // key = table name,
-  std::map<std::string, TableState> tableState;
+  std::string name;  // empty if the statement has not been prepared yet
+  std::string sql;   // used for error messages
+};
+
+/**
+ * Holds state that is useful to keep between entries when applying changeset.
+ *
+ * Statements get prepared once per table (updates once per combination of changed columns)
+ * and they are deallocated when the state is destroyed - which needs to happen after
+ * the transaction has finished, as no commands can be run in a failed transaction.
+ */
+class PostgresChangeApplyState
+{
+  public:
+    struct TableState
+    {
+      TableSchema schema;
+      // name of its pkey's sequence object (or "" if it doesn't exist)
+      std::string sequenceName;
+      int autoIncrementPkeyIndex;
+      // max. value in changeset
+      int64_t autoIncrementMax = 0;
+
+      PostgresPreparedStatement stmtInsert;
+      PostgresPreparedStatement stmtDelete;
+      // key = columns used by the update: for each column 'o' (old value), 'n' (new value), 'b' (both) or '-'
+      std::map<std::string, PostgresPreparedStatement> stmtUpdate;
+      // temporary tables for set based changes, key = operation and used columns (like for updates)
+      std::map<std::string, std::string> stagingTables;
+    };
+
+    explicit PostgresChangeApplyState( PGconn *conn ) : mConn( conn ) {}
+    ~PostgresChangeApplyState();
+
+    PostgresChangeApplyState( const PostgresChangeApplyState & ) = delete;
+    PostgresChangeApplyState &operator=( const PostgresChangeApplyState & ) = delete;
+
+    //! Prepares the statement (if it has not been prepared yet)
+    void prepare( PostgresPreparedStatement &stmt, const std::string &sql );
+
+    // key = table name,
+    std::map<std::string, TableState> tableState;
+    // number of created staging tables (used for their unique names)
+    size_t stagingTableCount = 0;
+    // whether staging tables cannot be created (and changes need to be applied one by one)
+    bool bulkUnavailable = false;
+
+  private:
+    PGconn *mConn = nullptr;
+    std::vector<std::string> mStatementNames;
 };
 
 // TODO: add docs!
@@ -50,7 +91,13 @@ class PostgresDriver : public Driver
     void close();
     std::string getSequenceObjectName( const TableSchema &tbl, int &autoIncrementPkeyIndex );
     void updateSequenceObject( const std::string &seqName, int64_t maxValue );
+    PostgresChangeApplyState::TableState *applyTableState( PostgresChangeApplyState &state, const ChangesetEntry &entry );
+    const PostgresPreparedStatement &prepareChange( PostgresChangeApplyState &state, PostgresChangeApplyState::TableState &tbl, const ChangesetEntry &entry, PostgresParams &params );
+    ChangeApplyResult checkChangeResult( PostgresChangeApplyState::TableState &tbl, const ChangesetEntry &entry, const PostgresResult &res, const std::string &sql );
     ChangeApplyResult applyChange( PostgresChangeApplyState &state, const ChangesetEntry &entry );
+    std::vector<ChangeApplyResult> applyChangesPipelined( PostgresChangeApplyState &state, const std::vector<const ChangesetEntry *> &entries );
+    std::vector<ChangeApplyResult> applyChangesBulk( PostgresChangeApplyState &state, const std::vector<const ChangesetEntry *> &entries );
+    std::vector<ChangeApplyResult> applyChanges( PostgresChangeApplyState &state, const std::vector<const ChangesetEntry *> &entries );
 
     PGconn *mConn = nullptr;
     std::string mBaseSchema;
@@ -29,10 +29,9 @@ int GeoDiffPostgresException::errorCode() const
     return GEODIFF_ERROR;
 }
 
-PostgresResult execSql( PGconn *c, const std::string &sql )
+//! Takes ownership of the result and throws an exception if the command has failed
+static PostgresResult checkedResult( PGconn *c, PGresult *res, const std::string &sql )
 {
-  PGresult *res = ::PQexec( c, sql.c_str() );
-
   if ( res && ::PQstatus( c ) == CONNECTION_OK )
   {
     int errorStatus = PQresultStatus( res );
@@ -57,6 +56,199 @@ PostgresResult execSql( PGconn *c, const std::string &sql )
   return PostgresResult( nullptr );
 }
 
+PostgresResult execSql( PGconn *c, const std::string &sql )
+{
+  PGresult *res = ::PQexec( c, sql.c_str() );
+  return checkedResult( c, res, sql );
+}
+
+void prepareSql( PGconn *c, const std::string &stmtName, const std::string &sql )
+{
+  PGresult *res = ::PQprepare( c, stmtName.c_str(), sql.c_str(), 0, nullptr );
+  checkedResult( c, res, sql );
+}
+
+PostgresResult execPrepared( PGconn *c, const std::string &stmtName, const PostgresParams &params, const std::string &sql )
+{
+  size_t count = params.values.size();
+  std::vector<const char *> values( count );
+  std::vector<int> lengths( count );
+  for ( size_t i = 0; i < count; ++i )
+  {
+    values[i] = params.nulls[i] ? nullptr : params.values[i].data();
+    lengths[i] = static_cast<int>( params.values[i].size() );
+  }
+
+  PGresult *res = ::PQexecPrepared( c, stmtName.c_str(), static_cast<int>( count ), values.data(), lengths.data(), params.formats.data(), 0 );
+  return checkedResult( c, res, sql );
+}
+
+//! Appends integer in network byte order
+template <typename T>
+static void appendInt( std::string &buffer, T value )
+{
+  for ( int shift = ( sizeof( T ) - 1 ) * 8; shift >= 0; shift -= 8 )
+    buffer.push_back( static_cast<char>( ( value >> shift ) & 0xff ) );
+}
+
+PostgresResult copyRows( PGconn *c, const std::string &sql, const std::vector<PostgresParams> &rows )
+{
+  PGresult *res = ::PQexec( c, sql.c_str() );
+  if ( !res || ::PQresultStatus( res ) != PGRES_COPY_IN )
+  {
+    checkedResult( c, res, sql );  // throws an exception for failed commands
+    throw GeoDiffException( "postgres error: not a COPY FROM STDIN command: " + sql );
+  }
+  ::PQclear( res );
+
+  // header: signature, flags and length of header extension
+  std::string buffer( "PGCOPY\n\377\r\n\0", 11 );
+  appendInt<int32_t>( buffer, 0 );
+  appendInt<int32_t>( buffer, 0 );
+
+  bool sent = true;
+  for ( const PostgresParams &row : rows )
+  {
+    appendInt<int16_t>( buffer, static_cast<int16_t>( row.values.size() ) );
+    for ( size_t i = 0; i < row.values.size(); ++i )
+    {
+      if ( row.nulls[i] )
+        appendInt<int32_t>( buffer, -1 );
+      else
+      {
+        appendInt<int32_t>( buffer, static_cast<int32_t>( row.values[i].size() ) );
+        buffer += row.values[i];
+      }
+    }
+
+    if ( buffer.size() > 1024 * 1024 )
+    {
+      sent = ::PQputCopyData( c, buffer.data(), static_cast<int>( buffer.size() ) ) == 1;
+      buffer.clear();
+      if ( !sent )
+        break;
+    }
+  }
+
+  // trailer
+  appendInt<int16_t>( buffer, -1 );
+  if ( sent )
+    sent = ::PQputCopyData( c, buffer.data(), static_cast<int>( buffer.size() ) ) == 1;
+
+  if ( ::PQputCopyEnd( c, sent ? nullptr : "sending data failed" ) != 1 )
+    throw GeoDiffException( "postgres conn error: " + std::string( PQerrorMessage( c ) ) );
+
+  PGresult *copyRes = ::PQgetResult( c );
+  while ( PGresult *extra = ::PQgetResult( c ) )
+    ::PQclear( extra );
+  return checkedResult( c, copyRes, sql );
+}
+
+#ifdef LIBPQ_HAS_PIPELINING
+
+PostgresPipeline::PostgresPipeline( PGconn *c )
+  : mConn( c )
+{
+  if ( !::PQenterPipelineMode( mConn ) )
+    throw GeoDiffException( "postgres error: cannot enter pipeline mode: " + std::string( PQerrorMessage( mConn ) ) );
+}
+
+PostgresPipeline::~PostgresPipeline()
+{
+  if ( !mSql.empty() && ::PQpipelineSync( mConn ) )
+  {
+    // results have not been read (there was an exception) - discard them, so that the connection
+    // can be used again (e.g. to roll back the transaction)
+    while ( true )
+    {
+      PGresult *res = ::PQgetResult( mConn );
+      if ( !res )
+      {
+        if ( ::PQstatus( mConn ) != CONNECTION_OK )
+          break;
+        continue;  // end of results of a command
+      }
+      bool synced = ::PQresultStatus( res ) == PGRES_PIPELINE_SYNC;
+      ::PQclear( res );
+      if ( synced )
+        break;
+    }
+  }
+  ::PQexitPipelineMode( mConn );
+}
+
+void PostgresPipeline::sendSql( const std::string &sql )
+{
+  // PQsendQuery() is not allowed in pipeline mode
+  if ( !::PQsendQueryParams( mConn, sql.c_str(), 0, nullptr, nullptr, nullptr, nullptr, 0 ) )
+    throw GeoDiffException( "postgres conn error: " + std::string( PQerrorMessage( mConn ) ) );
+  mSql.push_back( sql );
+}
+
+void PostgresPipeline::sendPrepared( const std::string &stmtName, const PostgresParams &params, const std::string &sql )
+{
+  size_t count = params.values.size();
+  std::vector<const char *> values( count );
+  std::vector<int> lengths( count );
+  for ( size_t i = 0; i < count; ++i )
+  {
+    values[i] = params.nulls[i] ? nullptr : params.values[i].data();
+    lengths[i] = static_cast<int>( params.values[i].size() );
+  }
+
+  if ( !::PQsendQueryPrepared( mConn, stmtName.c_str(), static_cast<int>( count ), values.data(), lengths.data(), params.formats.data(), 0 ) )
+    throw GeoDiffException( "postgres conn error: " + std::string( PQerrorMessage( mConn ) ) );
+  mSql.push_back( sql );
+}
+
+std::vector<PostgresResult> PostgresPipeline::results()
+{
+  if ( !::PQpipelineSync( mConn ) )
+    throw GeoDiffException( "postgres conn error: " + std::string( PQerrorMessage( mConn ) ) );
+
+  // all results need to be read (up to the sync point) before the connection can be used again,
+  // so a failure gets reported only at the end
+  std::vector<PostgresResult> results;
+  std::vector<std::string> sqls;
+  sqls.swap( mSql );
+  PGresult *error = nullptr;
+  std::string errorSql;
+  for ( const std::string &sql : sqls )
+  {
+    PGresult *res = ::PQgetResult( mConn );
+    if ( !res )
+      break;  // the connection got broken
+
+    ExecStatusType status = ::PQresultStatus( res );
+    if ( status == PGRES_COMMAND_OK || status == PGRES_TUPLES_OK )
+      results.emplace_back( res );
+    else if ( status == PGRES_PIPELINE_ABORTED || error )
+      ::PQclear( res );  // skipped because of an earlier failure
+    else
+    {
+      error = res;
+      errorSql = sql;
+    }
+
+    // results of each command are terminated by null
+    while ( PGresult *extra = ::PQgetResult( mConn ) )
+      ::PQclear( extra );
+  }
+
+  PGresult *sync = ::PQgetResult( mConn );
+  bool synced = sync && ::PQresultStatus( sync ) == PGRES_PIPELINE_SYNC;
+  if ( sync )
+    ::PQclear( sync );
+
+  if ( error )
+    throw GeoDiffPostgresException( error, errorSql );
+  if ( !synced || ::PQstatus( mConn ) != CONNECTION_OK )
+    throw GeoDiffException( "postgres conn error: " + std::string( PQerrorMessage( mConn ) ) );
+  return results;
+}
+
+#endif
+
 std::string quotedIdentifier( const std::string &ident )
 {
   std::string result = replace( ident, "\"", "\"\"" );
@@ -9,6 +9,7 @@
 #include <assert.h>
 #include <iostream>
 #include <string>
+#include <vector>
 
 extern "C"
 {
@@ -104,8 +105,83 @@ class GeoDiffPostgresException: public GeoDiffException
     std::shared_ptr<PostgresResult> mRes;
 };
 
+/**
+ * Parameters of a prepared statement (see execPrepared()). Values can be passed
+ * either as text or in binary format (e.g. bytea with raw bytes).
+ */
+struct PostgresParams
+{
+  void addNull() { add( std::string(), true, 0 ); }
+  void addText( const std::string &value ) { add( value, false, 0 ); }
+  void addBinary( const std::string &value ) { add( value, false, 1 ); }
+
+  std::vector<std::string> values;
+  std::vector<bool> nulls;
+  std::vector<int> formats;  // 0 = text, 1 = binary
+
+  private:
+    void add( const std::string &value, bool isNull, int format )
+    {
+      values.push_back( value );
+      nulls.push_back( isNull );
+      formats.push_back( format );
+    }
+};
+
 PostgresResult execSql( PGconn *c, const std::string &sql );
 
+//! Creates a prepared statement with the given name (types of parameters are inferred by the server)
+void prepareSql( PGconn *c, const std::string &stmtName, const std::string &sql );
+
+//! Executes a prepared statement - the SQL command is only used for error messages
+PostgresResult execPrepared( PGconn *c, const std::string &stmtName, const PostgresParams &params, const std::string &sql );
+
+/**
+ * Runs COPY ... FROM STDIN (FORMAT binary) command and sends it the rows. All columns need to be
+ * of text or bytea type, so that the values (in any format) can be sent as they are.
+ */
+PostgresResult copyRows( PGconn *c, const std::string &sql, const std::vector<PostgresParams> &rows );
+
+#ifdef LIBPQ_HAS_PIPELINING
+
+/**
+ * Runs commands in libpq's pipeline mode: commands are queued with sendSql() and sendPrepared()
+ * and they are all sent to the server at once by results(), which then reads their results.
+ * That saves a network round trip for each command.
+ *
+ * When a command fails, the server skips the remaining commands of the pipeline, and the
+ * failure is reported by an exception from results() like with execSql().
+ *
+ * Results are read only after all commands have been sent, so pipelines should be kept
+ * reasonably small (e.g. a thousand of commands) so that the server does not get blocked
+ * sending results that the client is not reading yet.
+ */
+class PostgresPipeline
+{
+  public:
+    //! Enters pipeline mode of the connection
+    explicit PostgresPipeline( PGconn *c );
+    //! Leaves pipeline mode of the connection (if results have not been read, the connection stays unusable)
+    ~PostgresPipeline();
+
+    PostgresPipeline( const PostgresPipeline & ) = delete;
+    PostgresPipeline &operator=( const PostgresPipeline & ) = delete;
+
+    //! Queues SQL command without parameters
+    void sendSql( const std::string &sql );
+    //! Queues execution of a prepared statement - the SQL command is only used for error messages
+    void sendPrepared( const std::string &stmtName, const PostgresParams &params, const std::string &sql );
+
+    //! Sends all queued commands and returns their results (in the same order). Throws GeoDiffPostgresException if any command failed
+    std::vector<PostgresResult> results();
+
+  private:
+    PGconn *mConn = nullptr;
+    std::vector<std::string> mSql;  // queued commands - for error messages
+};
+
+#endif
+
 std::string quotedIdentifier( const std::string &ident );
 std::string quotedString( const std::string &value );
 
@@ -5,19 +5,33 @@
 
 #include "sqlitedriver.h"
 
+#include "changesetapplyorder.h"
 #include "changesetreader.h"
 #include "changesetwriter.h"
 #include "changesetutils.h"
+#include "geodiff_config.hpp"
 #include "geodiffcontext.hpp"
 #include "geodifflogger.hpp"
 #include "geodiffutils.hpp"
 #include "sqliteutils.h"
+#include "sqliterowcomparator.h"
+#include "sqliterowhashindex.h"
 
 #include <memory.h>
 #include <sqlite3.h>
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <exception>
+#include <mutex>
+#include <sstream>
+#include <thread>
 
-void SqliteDriver::logApplyConflict( const std::string &type, const ChangesetEntry &entry, bool isDbErr ) const
+
+void SqliteDriver::logApplyConflict( const std::string &type, const ChangesetEntryView &entry, bool isDbErr ) const
 {
   std::string msg = "CONFLICT: " + type;
   if ( isDbErr )
@@ -99,6 +113,60 @@ class Sqlite3SavepointTransaction
 };
 
 
+/**
+ * Changes settings of the connection for applying of large changesets ("bulk_apply" driver option)
+ * and restores the original settings when destroyed: syncing to disk is turned off and the page cache
+ * is made larger. The settings can't be changed within a transaction, so the object needs to be created
+ * before (and destroyed after) Sqlite3SavepointTransaction.
+ */
+class Sqlite3BulkApplySettings
+{
+  public:
+    Sqlite3BulkApplySettings( const Context *context, std::shared_ptr<Sqlite3Db> db )
+      : mDb( db ), mContext( context )
+    {
+      mSynchronous = pragmaValue( "synchronous" );
+      mCacheSize = pragmaValue( "cache_size" );
+      setPragma( "synchronous", "OFF" );
+      setPragma( "cache_size", "-65536" );  // 64 MiB
+    }
+
+    ~Sqlite3BulkApplySettings()
+    {
+      if ( !mSynchronous.empty() )
+        setPragma( "synchronous", mSynchronous );
+      if ( !mCacheSize.empty() )
+        setPragma( "cache_size", mCacheSize );
+    }
+
+  private:
+    std::string pragmaValue( const char *name )
+    {
+      Sqlite3Stmt statement;
+      statement.prepare( mDb, "PRAGMA %s", name );
+      if ( sqlite3_step( statement.get() ) != SQLITE_ROW )
+      {
+        logSqliteError( mContext, mDb, std::string( "Failed to read pragma " ) + name );
+        return std::string();
+      }
+      return reinterpret_cast<const char *>( sqlite3_column_text( statement.get(), 0 ) );
+    }
+
+    void setPragma( const char *name, const std::string &value )
+    {
+      Buffer sql;
+      sql.printf( "PRAGMA %s = %s", name, value.c_str() );
+      if ( sqlite3_exec( mDb->get(), sql.c_buf(), 0, 0, 0 ) != SQLITE_OK )
+        logSqliteError( mContext, mDb, std::string( "Failed to set pragma " ) + name );
+    }
+
+    std::shared_ptr<Sqlite3Db> mDb;
+    const Context *mContext;
+    std::string mSynchronous;
+    std::string mCacheSize;
+};
+
+
 ///////
 
 
@@ -107,6 +175,35 @@ SqliteDriver::SqliteDriver( const Context *context )
 {
 }
 
+SqliteDriver::~SqliteDriver()
+{
+#ifdef HAVE_SQLITE_SESSION
+  if ( mSession )
+    sqlite3session_delete( mSession );
+#endif
+}
+
+void SqliteDriver::parseOptions( const DriverParametersMap &conn )
+{
+  mUseRowHashIndex = false;
+  mBulkApply = false;
+  DriverParametersMap::const_iterator connInfoIt = conn.find( "conninfo" );
+  if ( connInfoIt != conn.end() )
+  {
+    std::istringstream options( connInfoIt->second );
+    std::string option;
+    while ( options >> option )
+    {
+      if ( option == "row_hash_index" )
+        mUseRowHashIndex = true;
+      else if ( option == "bulk_apply" )
+        mBulkApply = true;
+      else
+        context()->logger().warn( "Ignoring unknown option of sqlite driver: " + option );
+    }
+  }
+}
+
 void SqliteDriver::open( const DriverParametersMap &conn )
 {
   DriverParametersMap::const_iterator connBaseIt = conn.find( "base" );
@@ -121,6 +218,9 @@ void SqliteDriver::open( const DriverParametersMap &conn )
   {
     throw GeoDiffException( "Missing 'base' file when opening sqlite driver: " + base );
   }
+  mConnParams = conn;
+
+  parseOptions( conn );
 
   mDb = std::make_shared<Sqlite3Db>();
   if ( mHasModified )
@@ -137,6 +237,9 @@ void SqliteDriver::open( const DriverParametersMap &conn )
     Buffer sqlBuf;
     sqlBuf.printf( "ATTACH '%q' AS aux", base.c_str() );
     mDb->exec( sqlBuf );
+
+    // used to find out quickly which tables are the same in both databases
+    registerContentHashFunction( mDb );
   }
   else
   {
@@ -163,6 +266,7 @@ void SqliteDriver::create( const DriverParametersMap &conn, bool overwrite )
     throw GeoDiffException( "Missing 'base' file" );
 
   std::string base = connBaseIt->second;
+  parseOptions( conn );
 
   if ( overwrite )
   {
@@ -190,6 +294,40 @@ std::string SqliteDriver::databaseName( bool useModified )
   }
 }
 
+//! Returns whether the table should be ignored by geodiff (GeoPackage metadata, SQLite internal tables, ...)
+static bool isIgnoredTable( const Context *context, const std::string &tableName )
+{
+  /* typically geopackage from ogr would have these (table name is simple)
+  gpkg_contents
+  gpkg_extensions
+  gpkg_geometry_columns
+  gpkg_ogr_contents
+  gpkg_spatial_ref_sys
+  gpkg_tile_matrix
+  gpkg_tile_matrix_set
+  rtree_simple_geometry_node
+  rtree_simple_geometry_parent
+  rtree_simple_geometry_rowid
+  simple (or any other name(s) of layers)
+  sqlite_sequence
+  */
+
+  // table handled by triggers trigger_*_feature_count_*
+  if ( startsWith( tableName, "gpkg_" ) )
+    return true;
+  // table handled by triggers rtree_*_geometry_*
+  if ( startsWith( tableName, "rtree_" ) )
+    return true;
+  // internal table for AUTOINCREMENT
+  if ( tableName == "sqlite_sequence" )
+    return true;
+  // tables of the row hash index
+  if ( startsWith( tableName, ROW_HASH_INDEX_PREFIX ) )
+    return true;
+
+  return context->isTableSkipped( tableName );
+}
+
 std::vector<std::string> SqliteDriver::listTables( bool useModified )
 {
   std::string dbName = databaseName( useModified );
@@ -207,32 +345,7 @@ std::vector<std::string> SqliteDriver::listTables( bool useModified )
       continue;
 
     std::string tableName( name );
-    /* typically geopackage from ogr would have these (table name is simple)
-    gpkg_contents
-    gpkg_extensions
-    gpkg_geometry_columns
-    gpkg_ogr_contents
-    gpkg_spatial_ref_sys
-    gpkg_tile_matrix
-    gpkg_tile_matrix_set
-    rtree_simple_geometry_node
-    rtree_simple_geometry_parent
-    rtree_simple_geometry_rowid
-    simple (or any other name(s) of layers)
-    sqlite_sequence
-    */
-
-    // table handled by triggers trigger_*_feature_count_*
-    if ( startsWith( tableName, "gpkg_" ) )
-      continue;
-    // table handled by triggers rtree_*_geometry_*
-    if ( startsWith( tableName, "rtree_" ) )
-      continue;
-    // internal table for AUTOINCREMENT
-    if ( tableName == "sqlite_sequence" )
-      continue;
-
-    if ( context()->isTableSkipped( tableName ) )
+    if ( isIgnoredTable( context(), tableName ) )
       continue;
 
     tableNames.push_back( tableName );
@@ -410,8 +523,8 @@ static std::string sqlFindInserted( const std::string &tableName, const TableSch
   return sql;
 }
 
-//! Constructs SQL query to get all modified rows for a single table
-static std::string sqlFindModified( const std::string &tableName, const TableSchema &tbl )
+//! Constructs SQL query to get all modified rows for a single table (changes in ignored columns are not considered)
+static std::string sqlFindModified( const Context *context, const std::string &tableName, const TableSchema &tbl )
 {
   std::string exprPk;
   std::string exprOther;
@@ -424,7 +537,7 @@ static std::string sqlFindModified( const std::string &tableName, const TableSch
       exprPk += sqlitePrintf( "\"%w\".\"%w\".\"%w\"=\"%w\".\"%w\".\"%w\"",
                               "main", tableName.c_str(), c.name.c_str(), "aux", tableName.c_str(), c.name.c_str() );
     }
-    else // not a primary key column
+    else if ( !context->isColumnIgnored( tableName, c.name ) ) // not a primary key column
     {
       if ( !exprOther.empty() )
         exprOther += " OR ";
@@ -470,35 +583,188 @@ static Value changesetValue( sqlite3_value *v )
   return x;
 }
 
-static void handleInserted( const Context *context, const std::string &tableName, const TableSchema &tbl, bool reverse, std::shared_ptr<Sqlite3Db> db, ChangesetWriter &writer, bool &first )
+//! Returns value of the i-th column of the current row of the statement
+static Value changesetColumnValue( sqlite3_stmt *stmt, int i )
 {
-  std::string sqlInserted = sqlFindInserted( tableName, tbl, reverse );
-  Sqlite3Stmt statementI;
-  statementI.prepare( db, "%s", sqlInserted.c_str() );
-  int rc;
-  while ( SQLITE_ROW == ( rc = sqlite3_step( statementI.get() ) ) )
+  Value x;
+  int type = sqlite3_column_type( stmt, i );
+  if ( type == SQLITE_NULL )
+    x.setNull();
+  else if ( type == SQLITE_INTEGER )
+    x.setInt( sqlite3_column_int64( stmt, i ) );
+  else if ( type == SQLITE_FLOAT )
+    x.setDouble( sqlite3_column_double( stmt, i ) );
+  else if ( type == SQLITE_TEXT )
+  {
+    const char *text = reinterpret_cast<const char *>( sqlite3_column_text( stmt, i ) );
+    x.setString( Value::TypeText, text, sqlite3_column_bytes( stmt, i ) );
+  }
+  else if ( type == SQLITE_BLOB )
   {
-    if ( first )
+    const char *blob = reinterpret_cast<const char *>( sqlite3_column_blob( stmt, i ) );
+    x.setString( Value::TypeBlob, blob, sqlite3_column_bytes( stmt, i ) );
+  }
+  else
+    throw GeoDiffException( "Unexpected value type" );
+
+  return x;
+}
+
+/**
+ * Compares an integer with a floating point number exactly, the same way as SQLite does
+ * (see sqlite3IntFloatCompare()): converting the integer to double would lose precision
+ * of integers above 2^53. Returns negative number, zero or positive number if the integer
+ * is smaller, equal or greater.
+ */
+static int compareIntFloat( sqlite3_int64 i, double r )
+{
+  if ( std::isnan( r ) )
+    return 1;
+  if ( r < -9223372036854775808.0 )
+    return 1;
+  if ( r >= 9223372036854775808.0 )
+    return -1;
+  sqlite3_int64 y = static_cast<sqlite3_int64>( r );
+  if ( i != y )
+    return i < y ? -1 : 1;
+  double s = static_cast<double>( i );
+  return s < r ? -1 : ( s > r ? 1 : 0 );
+}
+
+//! Compares two column values the same way as SQLite does with BINARY collation:
+//! NULL values come first, then numbers (integers and floats compared by value), text and finally blobs.
+//! Returns negative number, zero or positive number if the first value is smaller, equal or greater
+static int compareColumns( sqlite3_stmt *stmt1, int i1, sqlite3_stmt *stmt2, int i2 )
+{
+  // rank of types in SQLite sort order
+  auto typeRank = []( int type ) -> int
+  {
+    switch ( type )
     {
-      ChangesetTable chTable = schemaToChangesetTable( tableName, tbl );
-      writer.beginTable( chTable );
-      first = false;
+      case SQLITE_NULL: return 0;
+      case SQLITE_INTEGER:
+      case SQLITE_FLOAT: return 1;
+      case SQLITE_TEXT: return 2;
+      default: return 3;
     }
+  };
 
-    ChangesetEntry e;
-    e.op = reverse ? ChangesetEntry::OpDelete : ChangesetEntry::OpInsert;
+  int type1 = sqlite3_column_type( stmt1, i1 );
+  int type2 = sqlite3_column_type( stmt2, i2 );
+  int rank1 = typeRank( type1 ), rank2 = typeRank( type2 );
+  if ( rank1 != rank2 )
+    return rank1 < rank2 ? -1 : 1;
 
-    size_t numColumns = tbl.columns.size();
-    for ( size_t i = 0; i < numColumns; ++i )
+  if ( rank1 == 0 )
+    return 0;
+  else if ( rank1 == 1 )
+  {
+    if ( type1 == SQLITE_INTEGER && type2 == SQLITE_INTEGER )
     {
-      Sqlite3Value v( sqlite3_column_value( statementI.get(), static_cast<int>( i ) ) );
-      if ( reverse )
-        e.oldValues.push_back( changesetValue( v.value() ) );
-      else
-        e.newValues.push_back( changesetValue( v.value() ) );
+      sqlite3_int64 n1 = sqlite3_column_int64( stmt1, i1 ), n2 = sqlite3_column_int64( stmt2, i2 );
+      return n1 < n2 ? -1 : ( n1 > n2 ? 1 : 0 );
     }
+    if ( type1 == SQLITE_INTEGER )
+      return compareIntFloat( sqlite3_column_int64( stmt1, i1 ), sqlite3_column_double( stmt2, i2 ) );
+    if ( type2 == SQLITE_INTEGER )
+      return -compareIntFloat( sqlite3_column_int64( stmt2, i2 ), sqlite3_column_double( stmt1, i1 ) );
+    double d1 = sqlite3_column_double( stmt1, i1 ), d2 = sqlite3_column_double( stmt2, i2 );
+    return d1 < d2 ? -1 : ( d1 > d2 ? 1 : 0 );
+  }
+  else
+  {
+    const void *data1 = rank1 == 2 ? static_cast<const void *>( sqlite3_column_text( stmt1, i1 ) ) : sqlite3_column_blob( stmt1, i1 );
+    const void *data2 = rank2 == 2 ? static_cast<const void *>( sqlite3_column_text( stmt2, i2 ) ) : sqlite3_column_blob( stmt2, i2 );
+    int len1 = sqlite3_column_bytes( stmt1, i1 );
+    int len2 = sqlite3_column_bytes( stmt2, i2 );
+    int res = std::min( len1, len2 ) > 0 ? memcmp( data1, data2, static_cast<size_t>( std::min( len1, len2 ) ) ) : 0;
+    if ( res != 0 )
+      return res;
+    return len1 - len2;
+  }
+}
 
-    writer.writeEntry( e );
+//! Writes the current row of the statement as INSERT (or DELETE if reverse is true)
+static void writeInsertedRow( const std::string &tableName, const TableSchema &tbl, bool reverse, sqlite3_stmt *stmt, ChangesetWriter &writer, bool &first )
+{
+  if ( first )
+  {
+    ChangesetTable chTable = schemaToChangesetTable( tableName, tbl );
+    writer.beginTable( chTable );
+    first = false;
+  }
+
+  ChangesetEntry e;
+  e.op = reverse ? ChangesetEntry::OpDelete : ChangesetEntry::OpInsert;
+
+  size_t numColumns = tbl.columns.size();
+  for ( size_t i = 0; i < numColumns; ++i )
+  {
+    if ( reverse )
+      e.oldValues.push_back( changesetColumnValue( stmt, static_cast<int>( i ) ) );
+    else
+      e.newValues.push_back( changesetColumnValue( stmt, static_cast<int>( i ) ) );
+  }
+
+  writer.writeEntry( e );
+}
+
+/**
+ * Compares the current row of the old statement (starting at column offsetOld) with the current
+ * row of the new statement (starting at column offsetNew) and writes UPDATE if they differ.
+ * Both rows are expected to have the same primary key.
+ */
+static void writeUpdatedRow( const std::string &tableName, const TableSchema &tbl, SqliteRowComparator &comparator,
+                             sqlite3_stmt *stmtOld, int offsetOld, sqlite3_stmt *stmtNew, int offsetNew,
+                             ChangesetWriter &writer, bool &first )
+{
+  /*
+  ** Within the old.* record associated with an UPDATE change, all fields
+  ** associated with table columns that are not PRIMARY KEY columns and are
+  ** not modified by the UPDATE change are set to "undefined". Other fields
+  ** are set to the values that made up the row before the UPDATE that the
+  ** change records took place. Within the new.* record, fields associated
+  ** with table columns modified by the UPDATE change contain the new
+  ** values. Fields associated with table columns that are not modified
+  ** are set to "undefined".
+  */
+
+  if ( !comparator.compare( stmtOld, offsetOld, stmtNew, offsetNew ) )
+    return;
+
+  if ( first )
+  {
+    ChangesetTable chTable = schemaToChangesetTable( tableName, tbl );
+    writer.beginTable( chTable );
+    first = false;
+  }
+
+  ChangesetEntry e;
+  e.op = ChangesetEntry::OpUpdate;
+
+  size_t numColumns = tbl.columns.size();
+  for ( size_t i = 0; i < numColumns; ++i )
+  {
+    int iOld = offsetOld + static_cast<int>( i );
+    int iNew = offsetNew + static_cast<int>( i );
+    bool updated = comparator.isUpdated( i );
+    e.oldValues.push_back( ( tbl.columns[i].isPrimaryKey || updated ) ? changesetColumnValue( stmtOld, iOld ) : Value() );
+    e.newValues.push_back( updated ? changesetColumnValue( stmtNew, iNew ) : Value() );
+  }
+
+  writer.writeEntry( e );
+}
+
+static void handleInserted( const Context *context, const std::string &tableName, const TableSchema &tbl, bool reverse, std::shared_ptr<Sqlite3Db> db, ChangesetWriter &writer, bool &first, ProgressReporter &progress )
+{
+  std::string sqlInserted = sqlFindInserted( tableName, tbl, reverse );
+  Sqlite3Stmt statementI;
+  statementI.prepare( db, "%s", sqlInserted.c_str() );
+  int rc;
+  while ( SQLITE_ROW == ( rc = sqlite3_step( statementI.get() ) ) )
+  {
+    writeInsertedRow( tableName, tbl, reverse, statementI.get(), writer, first );
+    progress.entryDone();
   }
   if ( rc != SQLITE_DONE )
   {
@@ -506,85 +772,258 @@ static void handleInserted( const Context *context, const std::string &tableName
   }
 }
 
-static void handleUpdated( const Context *context, const std::string &tableName, const TableSchema &tbl, std::shared_ptr<Sqlite3Db> db, ChangesetWriter &writer, bool &first )
+static void handleUpdated( const Context *context, const std::string &tableName, const TableSchema &tbl, std::shared_ptr<Sqlite3Db> db, ChangesetWriter &writer, bool &first, ProgressReporter &progress )
 {
-  std::string sqlModified = sqlFindModified( tableName, tbl );
+  std::string sqlModified = sqlFindModified( context, tableName, tbl );
 
   Sqlite3Stmt statement;
   statement.prepare( db, "%s", sqlModified.c_str() );
+  int numColumns = static_cast<int>( tbl.columns.size() );
+  SqliteRowComparator comparator( context, db, tableName, tbl );
   int rc;
   while ( SQLITE_ROW == ( rc = sqlite3_step( statement.get() ) ) )
   {
-    /*
-    ** Within the old.* record associated with an UPDATE change, all fields
-    ** associated with table columns that are not PRIMARY KEY columns and are
-    ** not modified by the UPDATE change are set to "undefined". Other fields
-    ** are set to the values that made up the row before the UPDATE that the
-    ** change records took place. Within the new.* record, fields associated
-    ** with table columns modified by the UPDATE change contain the new
-    ** values. Fields associated with table columns that are not modified
-    ** are set to "undefined".
-    */
-
-    ChangesetEntry e;
-    e.op = ChangesetEntry::OpUpdate;
-
-    bool hasUpdates = false;
-    size_t numColumns = tbl.columns.size();
-    for ( size_t i = 0; i < numColumns; ++i )
-    {
-      Sqlite3Value v1( sqlite3_column_value( statement.get(), static_cast<int>( i + numColumns ) ) );
-      Sqlite3Value v2( sqlite3_column_value( statement.get(), static_cast<int>( i ) ) );
-      bool pkey = tbl.columns[i].isPrimaryKey;
-      bool updated = ( v1 != v2 );
-      if ( updated )
-      {
-        // Let's do a secondary check for some column types to avoid false positives, for example
-        // multiple different string representations could be used for a single datetime value,
-        // see "Time Values" section in https://sqlite.org/lang_datefunc.html
-        // Use strftime() to take into account fractional seconds
-        if ( tbl.columns[i].type == TableColumnType::DATETIME )
-        {
-          Sqlite3Stmt stmtDatetime;
-          stmtDatetime.prepare( db, "SELECT STRFTIME('%%Y-%%m-%%d %%H:%%M:%%f', ?1) IS NOT STRFTIME('%%Y-%%m-%%d %%H:%%M:%%f', ?2)" );
-          sqlite3_bind_value( stmtDatetime.get(), 1, v1.value() );
-          sqlite3_bind_value( stmtDatetime.get(), 2, v2.value() );
-          int res = sqlite3_step( stmtDatetime.get() );
-          if ( SQLITE_ROW == res )
-          {
-            updated = sqlite3_column_int( stmtDatetime.get(), 0 );
-          }
-          else if ( SQLITE_DONE != res )
-          {
-            logSqliteError( context, db, "Failed to write information about updated rows in table " + tableName );
-          }
-        }
+    // columns of the row in "main" (modified) are followed by columns of the row in "aux" (base)
+    writeUpdatedRow( tableName, tbl, comparator, statement.get(), numColumns, statement.get(), 0, writer, first );
+    progress.entryDone();
+  }
+  if ( rc != SQLITE_DONE )
+  {
+    logSqliteError( context, db, "Failed to write information about inserted rows in table " + tableName );
+  }
+}
 
-        if ( updated )
-        {
-          hasUpdates = true;
-        }
-      }
-      e.oldValues.push_back( ( pkey || updated ) ? changesetValue( v1.value() ) : Value() );
-      e.newValues.push_back( updated ? changesetValue( v2.value() ) : Value() );
+//! How rows of a table can be read ordered by primary key without sorting
+enum class PrimaryKeyOrder
+{
+  Unusable,  //!< no index on primary key or some column does not use BINARY collation
+  Rowid,     //!< INTEGER PRIMARY KEY - an alias for rowid, values are always integers
+  Index,     //!< primary key with an automatic index
+};
+
+static PrimaryKeyOrder primaryKeyOrder( std::shared_ptr<Sqlite3Db> db, const char *dbName, const std::string &tableName, const TableSchema &tbl )
+{
+  size_t pkCount = 0;
+  bool integerPk = false;
+  for ( const TableColumnInfo &c : tbl.columns )
+  {
+    const char *dataType = nullptr;
+    const char *collSeq = nullptr;
+    int notNull, primaryKey, autoinc;
+    if ( sqlite3_table_column_metadata( db->get(), dbName, tableName.c_str(), c.name.c_str(),
+                                        &dataType, &collSeq, &notNull, &primaryKey, &autoinc ) != SQLITE_OK )
+      return PrimaryKeyOrder::Unusable;
+    if ( collSeq && sqlite3_stricmp( collSeq, "BINARY" ) != 0 )
+      return PrimaryKeyOrder::Unusable;
+    if ( c.isPrimaryKey )
+    {
+      ++pkCount;
+      integerPk = dataType && sqlite3_stricmp( dataType, "INTEGER" ) == 0;
     }
+  }
 
-    if ( hasUpdates )
+  // INTEGER PRIMARY KEY is an alias for rowid (unless it is a WITHOUT ROWID table),
+  // other primary keys have an automatic index
+  bool hasPkIndex = false;
+  Sqlite3Stmt stmt;
+  stmt.prepare( db, "PRAGMA \"%w\".index_list(\"%w\")", dbName, tableName.c_str() );
+  while ( SQLITE_ROW == sqlite3_step( stmt.get() ) )
+  {
+    const char *origin = reinterpret_cast<const char *>( sqlite3_column_text( stmt.get(), 3 ) );
+    if ( origin && strcmp( origin, "pk" ) == 0 )
+      hasPkIndex = true;
+  }
+
+  if ( hasPkIndex )
+    return PrimaryKeyOrder::Index;
+  if ( pkCount == 1 && integerPk )
+    return PrimaryKeyOrder::Rowid;
+  return PrimaryKeyOrder::Unusable;
+}
+
+/**
+ * Returns true if the table in both databases has primary key backed by an index (or by rowid)
+ * and all columns use BINARY collation, so that rows can be read ordered by primary key without
+ * sorting and compareColumns() gives the same results as comparisons in SQL.
+ */
+static bool canMergeJoin( std::shared_ptr<Sqlite3Db> db, const std::string &tableName, const TableSchema &tbl )
+{
+  return primaryKeyOrder( db, "main", tableName, tbl ) != PrimaryKeyOrder::Unusable &&
+         primaryKeyOrder( db, "aux", tableName, tbl ) != PrimaryKeyOrder::Unusable;
+}
+
+//! Compares primary keys of the current rows of the two statements (the same way as SQL "=" does)
+static int comparePrimaryKeys( const TableSchema &tbl, sqlite3_stmt *stmtNew, sqlite3_stmt *stmtOld )
+{
+  bool hasNull = false;
+  for ( size_t i = 0; i < tbl.columns.size(); ++i )
+  {
+    if ( !tbl.columns[i].isPrimaryKey )
+      continue;
+
+    int res = compareColumns( stmtNew, static_cast<int>( i ), stmtOld, static_cast<int>( i ) );
+    if ( res != 0 )
+      return res;
+    if ( sqlite3_column_type( stmtNew, static_cast<int>( i ) ) == SQLITE_NULL )
+      hasNull = true;
+  }
+  // NULL is never equal to anything in SQL, so such rows are reported as inserted and deleted
+  return hasNull ? -1 : 0;
+}
+
+/**
+ * Finds inserted, deleted and updated rows of a table in a single pass: rows of "main" (modified)
+ * and "aux" (base) are read ordered by primary key and the two cursors are advanced in lockstep.
+ * The table must be usable according to canMergeJoin(). If "range" is given, only rows with
+ * the (single integer) primary key within the range are compared.
+ */
+static void handleMergeJoin( const Context *context, const std::string &tableName, const TableSchema &tbl, std::shared_ptr<Sqlite3Db> db, ChangesetWriter &writer, bool &first, ProgressReporter &progress, const SqlitePrimaryKeyRange *range = nullptr )
+{
+  std::string orderBy;
+  std::vector<int> otherColumns;  // columns to compare other than primary key
+  for ( size_t i = 0; i < tbl.columns.size(); ++i )
+  {
+    const TableColumnInfo &c = tbl.columns[i];
+    if ( c.isPrimaryKey )
     {
-      if ( first )
-      {
-        ChangesetTable chTable = schemaToChangesetTable( tableName, tbl );
-        writer.beginTable( chTable );
-        first = false;
-      }
+      if ( !orderBy.empty() )
+        orderBy += ", ";
+      orderBy += sqlitePrintf( "\"%w\"", c.name.c_str() );
+    }
+    else if ( !context->isColumnIgnored( tableName, c.name ) )
+      otherColumns.push_back( static_cast<int>( i ) );
+  }
 
-      writer.writeEntry( e );
+  std::string where;
+  if ( range )
+    where = "WHERE " + orderBy + " >= ?1 AND " + orderBy + " <= ?2 ";
+
+  Sqlite3Stmt stmtNew, stmtOld;
+  stmtNew.prepare( db, "SELECT * FROM \"main\".\"%w\" %sORDER BY %s", tableName.c_str(), where.c_str(), orderBy.c_str() );
+  stmtOld.prepare( db, "SELECT * FROM \"aux\".\"%w\" %sORDER BY %s", tableName.c_str(), where.c_str(), orderBy.c_str() );
+  if ( range )
+  {
+    for ( Sqlite3Stmt *stmt : { &stmtNew, &stmtOld } )
+    {
+      sqlite3_bind_int64( stmt->get(), 1, range->from );
+      sqlite3_bind_int64( stmt->get(), 2, range->to );
     }
   }
-  if ( rc != SQLITE_DONE )
+
+  SqliteRowComparator comparator( context, db, tableName, tbl );
+  int rcNew = sqlite3_step( stmtNew.get() );
+  int rcOld = sqlite3_step( stmtOld.get() );
+  while ( rcNew == SQLITE_ROW || rcOld == SQLITE_ROW )
   {
-    logSqliteError( context, db, "Failed to write information about inserted rows in table " + tableName );
+    int cmp;
+    if ( rcNew != SQLITE_ROW )
+      cmp = 1;
+    else if ( rcOld != SQLITE_ROW )
+      cmp = -1;
+    else
+      cmp = comparePrimaryKeys( tbl, stmtNew.get(), stmtOld.get() );
+
+    if ( cmp < 0 )
+    {
+      writeInsertedRow( tableName, tbl, false, stmtNew.get(), writer, first );  // INSERT
+      rcNew = sqlite3_step( stmtNew.get() );
+    }
+    else if ( cmp > 0 )
+    {
+      writeInsertedRow( tableName, tbl, true, stmtOld.get(), writer, first );  // DELETE
+      rcOld = sqlite3_step( stmtOld.get() );
+    }
+    else
+    {
+      // only look closer at rows where some of the other columns differ (like "IS NOT" in sqlFindModified())
+      bool modified = otherColumns.empty();
+      for ( size_t i = 0; !modified && i < otherColumns.size(); ++i )
+        modified = compareColumns( stmtNew.get(), otherColumns[i], stmtOld.get(), otherColumns[i] ) != 0;
+      if ( modified )
+        writeUpdatedRow( tableName, tbl, comparator, stmtOld.get(), 0, stmtNew.get(), 0, writer, first );  // UPDATE
+
+      rcNew = sqlite3_step( stmtNew.get() );
+      rcOld = sqlite3_step( stmtOld.get() );
+    }
+    progress.entryDone();
   }
+  if ( rcNew != SQLITE_DONE || rcOld != SQLITE_DONE )
+  {
+    logSqliteError( context, db, "Failed to write information about changed rows in table " + tableName );
+  }
+}
+
+//! Largest number of columns that can be passed to geodiff_content_hash() - SQLite's default limit of function arguments
+static const size_t MAX_CONTENT_HASH_COLUMNS = 127;
+
+//! Returns number of rows of the table in the given database ("main" or "aux")
+static int64_t tableRowCount( std::shared_ptr<Sqlite3Db> db, const char *dbName, const std::string &tableName )
+{
+  Sqlite3Stmt stmt;
+  stmt.prepare( db, "SELECT count(*) FROM \"%w\".\"%w\"", dbName, tableName.c_str() );
+  if ( sqlite3_step( stmt.get() ) != SQLITE_ROW )
+    throwSqliteError( db->get(), "Failed to count rows of table " + tableName );
+  return sqlite3_column_int64( stmt.get(), 0 );
+}
+
+/**
+ * Returns hash of content of the table in the given database ("main" or "aux") calculated
+ * by geodiff_content_hash() SQL function from the given (quoted, comma separated) columns
+ * - see registerContentHashFunction()
+ */
+static std::string tableContentHash( std::shared_ptr<Sqlite3Db> db, const char *dbName, const std::string &tableName, const std::string &columns )
+{
+  Sqlite3Stmt stmt;
+  stmt.prepare( db, "SELECT geodiff_content_hash( %s ) FROM \"%w\".\"%w\"", columns.c_str(), dbName, tableName.c_str() );
+  if ( sqlite3_step( stmt.get() ) != SQLITE_ROW )
+    throwSqliteError( db->get(), "Failed to calculate content hash of table " + tableName );
+  const char *data = static_cast<const char *>( sqlite3_column_blob( stmt.get(), 0 ) );
+  return std::string( data, static_cast<size_t>( sqlite3_column_bytes( stmt.get(), 0 ) ) );
+}
+
+/**
+ * Returns true if the table has exactly the same rows in "main" and "aux" databases, so that comparing
+ * the rows one by one can be skipped. Row counts get compared first (cheap, no rows need to be read),
+ * then hashes of content of the table in both databases.
+ */
+static bool tableIsUnchanged( const Context *context, const std::string &tableName, const TableSchema &tbl, std::shared_ptr<Sqlite3Db> db )
+{
+  int64_t countOld = tableRowCount( db, "aux", tableName );
+  int64_t countNew = tableRowCount( db, "main", tableName );
+  if ( countOld != countNew )
+  {
+    context->logger().debug( "Table " + tableName + " has different number of rows (" + std::to_string( countOld ) +
+                             " -> " + std::to_string( countNew ) + ") - comparing rows" );
+    return false;
+  }
+
+  // ignored columns are left out, so that tables that differ just in them are skipped as well
+  std::string columns;
+  size_t columnCount = 0;
+  for ( const TableColumnInfo &c : tbl.columns )
+  {
+    if ( !c.isPrimaryKey && context->isColumnIgnored( tableName, c.name ) )
+      continue;
+    if ( !columns.empty() )
+      columns += ", ";
+    columns += sqlitePrintf( "\"%w\"", c.name.c_str() );
+    ++columnCount;
+  }
+
+  if ( columnCount > MAX_CONTENT_HASH_COLUMNS )
+  {
+    context->logger().debug( "Table " + tableName + " has too many columns for content hash - comparing rows" );
+    return false;
+  }
+
+  if ( tableContentHash( db, "aux", tableName, columns ) != tableContentHash( db, "main", tableName, columns ) )
+  {
+    context->logger().debug( "Table " + tableName + " has different content hash - comparing rows" );
+    return false;
+  }
+
+  context->logger().debug( "Table " + tableName + " is unchanged (" + std::to_string( countNew ) + " rows) - skipping" );
+  return true;
 }
 
 void SqliteDriver::createChangeset( ChangesetWriter &writer )
@@ -599,28 +1038,358 @@ void SqliteDriver::createChangeset( ChangesetWriter &writer )
                             "Modified: " + concatNames( tablesModified ) );
   }
 
+  size_t threadCount = static_cast<size_t>( std::max( context()->diffThreadCount(), 1 ) );
+  if ( threadCount > 1 && !tablesBase.empty() )
+  {
+    createChangesetParallel( tablesBase, writer, threadCount );
+    return;
+  }
+
+  ProgressReporter progress( context(), static_cast<int>( tablesBase.size() ) );
   for ( const std::string &tableName : tablesBase )
   {
-    TableSchema tbl = tableSchema( tableName );
-    TableSchema tblNew = tableSchema( tableName, true );
+    progress.startTable( tableName );
+    createChangesetForTable( tableName, writer, progress );
+  }
+  progress.finish();
+}
 
-    // test that table schema in the modified is the same
-    if ( tbl != tblNew )
+void SqliteDriver::createChangesetForTable( const std::string &tableName, ChangesetWriter &writer, ProgressReporter &progress, const SqlitePrimaryKeyRange *range )
+{
+  TableSchema tbl = tableSchema( tableName );
+  TableSchema tblNew = tableSchema( tableName, true );
+
+  // test that table schema in the modified is the same
+  if ( tbl != tblNew )
+  {
+    if ( !tbl.compareWithBaseTypes( tblNew ) )
+      throw GeoDiffException( "GeoPackage Table schemas are not the same for table: " + tableName );
+  }
+
+  if ( !tbl.hasPrimaryKey() )
+    return;  // ignore tables without primary key - they can't be compared properly
+
+  bool first = true;
+
+  if ( range )
+  {
+    // entries of a range get appended to a table block started elsewhere, see createChangesetParallel()
+    if ( !canMergeJoin( mDb, tableName, tbl ) )
+      throw GeoDiffException( "Unable to compare a range of primary keys of table: " + tableName );
+    writer.continueTable( schemaToChangesetTable( tableName, tbl ) );
+    first = false;
+    handleMergeJoin( context(), tableName, tbl, mDb, writer, first, progress, range );  // INSERT + DELETE + UPDATE
+  }
+  else if ( canUseRowHashIndex( tableName, tbl ) )
+  {
+    // only blocks of rows whose hashes differ (or that have been modified since they were hashed) need to be compared
+    size_t blockCount = 0;
+    std::vector<SqlitePrimaryKeyRange> ranges = rowHashIndexChangedRanges( mDb, tbl, blockCount );
+    context()->logger().debug( "Table " + tableName + " has row hash index - comparing " + std::to_string( blockCount ) + " blocks of rows" );
+    for ( const SqlitePrimaryKeyRange &range : ranges )
+      handleMergeJoin( context(), tableName, tbl, mDb, writer, first, progress, &range );  // INSERT + DELETE + UPDATE
+  }
+  else if ( tableIsUnchanged( context(), tableName, tbl, mDb ) )
+  {
+    // nothing to write - reading the table once from each database was enough
+  }
+  else if ( canMergeJoin( mDb, tableName, tbl ) )
+  {
+    handleMergeJoin( context(), tableName, tbl, mDb, writer, first, progress );      // INSERT + DELETE + UPDATE
+  }
+  else
+  {
+    context()->logger().debug( "Table " + tableName + " has no usable primary key index - comparing with SQL queries" );
+    handleInserted( context(), tableName, tbl, false, mDb, writer, first, progress );  // INSERT
+    handleInserted( context(), tableName, tbl, true, mDb, writer, first, progress );   // DELETE
+    handleUpdated( context(), tableName, tbl, mDb, writer, first, progress );          // UPDATE
+  }
+}
+
+bool SqliteDriver::canUseRowHashIndex( const std::string &tableName, const TableSchema &tbl )
+{
+  return mUseRowHashIndex && mHasModified &&
+         primaryKeyOrder( mDb, "main", tableName, tbl ) == PrimaryKeyOrder::Rowid &&
+         primaryKeyOrder( mDb, "aux", tableName, tbl ) == PrimaryKeyOrder::Rowid &&
+         hasRowHashIndex( mDb, "main", tbl ) && hasRowHashIndex( mDb, "aux", tbl );
+}
+
+//! Smallest number of primary key values per range when a table gets split into ranges
+static const uint64_t MIN_PRIMARY_KEY_RANGE_SIZE = 10000;
+
+//! Number of ranges per thread - more ranges than threads keep the threads busy even if rows are not spread evenly
+static const uint64_t PRIMARY_KEY_RANGES_PER_THREAD = 4;
+
+std::vector<SqlitePrimaryKeyRange> SqliteDriver::primaryKeyRanges( const std::string &tableName, size_t threadCount )
+{
+  std::vector<SqlitePrimaryKeyRange> ranges;
+
+  // only tables with INTEGER PRIMARY KEY in both databases can be split: values are guaranteed
+  // to be integers and both MIN() and MAX() are simple lookups in the rowid b-tree
+  TableSchema tbl = tableSchema( tableName );
+  if ( primaryKeyOrder( mDb, "main", tableName, tbl ) != PrimaryKeyOrder::Rowid ||
+       primaryKeyOrder( mDb, "aux", tableName, tbl ) != PrimaryKeyOrder::Rowid )
+    return ranges;
+
+  // with row hash index, just a small part of the table is usually compared
+  if ( canUseRowHashIndex( tableName, tbl ) )
+    return ranges;
+
+  std::string pkName;
+  for ( const TableColumnInfo &c : tbl.columns )
+  {
+    if ( c.isPrimaryKey )
+      pkName = c.name;
+  }
+
+  bool hasRows = false;
+  int64_t minPk = 0, maxPk = 0;
+  for ( const char *dbName : { "main", "aux" } )
+  {
+    Sqlite3Stmt stmt;
+    stmt.prepare( mDb, "SELECT MIN(\"%w\"), MAX(\"%w\") FROM \"%w\".\"%w\"", pkName.c_str(), pkName.c_str(), dbName, tableName.c_str() );
+    if ( sqlite3_step( stmt.get() ) != SQLITE_ROW || sqlite3_column_type( stmt.get(), 0 ) == SQLITE_NULL )
+      continue;
+    int64_t dbMin = sqlite3_column_int64( stmt.get(), 0 );
+    int64_t dbMax = sqlite3_column_int64( stmt.get(), 1 );
+    minPk = hasRows ? std::min( minPk, dbMin ) : dbMin;
+    maxPk = hasRows ? std::max( maxPk, dbMax ) : dbMax;
+    hasRows = true;
+  }
+  if ( !hasRows )
+    return ranges;
+
+  // the key space is split evenly - this assumes that keys are not too sparse, which is the case
+  // for the usual auto-incremented feature IDs (and if they are, more ranges than threads help)
+  uint64_t span = static_cast<uint64_t>( maxPk ) - static_cast<uint64_t>( minPk );
+  uint64_t count = std::min<uint64_t>( threadCount * PRIMARY_KEY_RANGES_PER_THREAD, span / MIN_PRIMARY_KEY_RANGE_SIZE );
+  if ( count < 2 )
+    return ranges;
+
+  uint64_t step = span / count;
+  int64_t from = minPk;
+  for ( uint64_t i = 0; i < count; ++i )
+  {
+    SqlitePrimaryKeyRange range;
+    range.from = from;
+    range.to = i + 1 == count ? maxPk : static_cast<int64_t>( static_cast<uint64_t>( from ) + step - 1 );
+    ranges.push_back( range );
+    from = static_cast<int64_t>( static_cast<uint64_t>( range.to ) + 1 );
+  }
+  return ranges;
+}
+
+/**
+ * Changes of a table (or of a range of primary keys of a table) created by a worker thread,
+ * waiting to be written to the changeset
+ */
+struct TableChangesetPart
+{
+  size_t tableIndex = 0;  // index to the list of table names
+  bool hasRange = false;
+  SqlitePrimaryKeyRange range;
+  std::unique_ptr<Buffer> data;
+  std::vector<ChangesetTableIndex> tables;  // index of the table block within data (just counts when hasRange is set)
+  std::exception_ptr error;
+  bool done = false;
+};
+
+void SqliteDriver::createChangesetParallel( const std::vector<std::string> &tableNames, ChangesetWriter &writer, size_t threadCount )
+{
+  // large tables with integer primary key are split into ranges of keys, so that a single
+  // huge table does not end up being processed by one thread while the others have nothing to do
+  std::vector<TableChangesetPart> parts;
+  std::vector<ChangesetTable> rangeTables( tableNames.size() );  // headers of tables split into ranges
+  for ( size_t i = 0; i < tableNames.size(); ++i )
+  {
+    std::vector<SqlitePrimaryKeyRange> ranges = primaryKeyRanges( tableNames[i], threadCount );
+    if ( !ranges.empty() )
     {
-      if ( !tbl.compareWithBaseTypes( tblNew ) )
-        throw GeoDiffException( "GeoPackage Table schemas are not the same for table: " + tableName );
+      context()->logger().debug( "Comparing table " + tableNames[i] + " in " + std::to_string( ranges.size() ) + " ranges of primary keys" );
+      rangeTables[i] = schemaToChangesetTable( tableNames[i], tableSchema( tableNames[i] ) );
     }
 
-    if ( !tbl.hasPrimaryKey() )
-      continue;  // ignore tables without primary key - they can't be compared properly
+    for ( const SqlitePrimaryKeyRange &range : ranges )
+    {
+      parts.emplace_back();
+      parts.back().tableIndex = i;
+      parts.back().hasRange = true;
+      parts.back().range = range;
+    }
+    if ( ranges.empty() )
+    {
+      parts.emplace_back();
+      parts.back().tableIndex = i;
+    }
+  }
 
-    bool first = true;
+  ProgressReporter progress( context(), static_cast<int>( tableNames.size() ) );
+  if ( parts.size() < 2 )
+  {
+    for ( const std::string &tableName : tableNames )
+    {
+      progress.startTable( tableName );
+      createChangesetForTable( tableName, writer, progress );
+    }
+    progress.finish();
+    return;
+  }
+
+  threadCount = std::min( threadCount, parts.size() );
+  context()->logger().debug( "Comparing " + std::to_string( tableNames.size() ) + " tables in " + std::to_string( parts.size() ) +
+                             " parts using " + std::to_string( threadCount ) + " threads" );
+
+  std::mutex mutex;
+  std::condition_variable partDone;
+  std::atomic<size_t> nextPart( 0 );
+  std::atomic<bool> stop( false );
+  std::atomic<bool> cancelled( false );  // set when writing of the changeset has failed (or got cancelled), workers abort their parts
+  std::unique_ptr<std::atomic<int64_t>[]> tableEntries( new std::atomic<int64_t>[tableNames.size()]() );  // rows compared by workers
+
+  // each worker has its own connections to the databases and keeps taking the next part
+  // that has not been processed yet, so that workers with small tables do not sit idle
+  auto worker = [&]()
+  {
+    std::unique_ptr<SqliteDriver> driver;
+    size_t i;
+    while ( !stop && ( i = nextPart++ ) < parts.size() )
+    {
+      std::unique_ptr<Buffer> data( new Buffer );
+      std::vector<ChangesetTableIndex> tables;
+      std::exception_ptr error;
+      try
+      {
+        if ( !driver )
+        {
+          driver.reset( new SqliteDriver( context() ) );
+          driver->open( mConnParams );
+        }
+
+        ChangesetWriter tableWriter;
+        tableWriter.setIndexEnabled( true );  // only to collect offsets and counts of entries
+        tableWriter.openBuffer( *data );
+        ProgressReporter partProgress( &tableEntries[parts[i].tableIndex], &cancelled );
+        driver->createChangesetForTable( tableNames[parts[i].tableIndex], tableWriter, partProgress, parts[i].hasRange ? &parts[i].range : nullptr );
+        tables = tableWriter.indexTables();
+        tableWriter.setIndexEnabled( false );
+        tableWriter.close();
+      }
+      catch ( ... )
+      {
+        error = std::current_exception();
+        stop = true;
+      }
 
-    handleInserted( context(), tableName, tbl, false, mDb, writer, first );  // INSERT
-    handleInserted( context(), tableName, tbl, true, mDb, writer, first );   // DELETE
-    handleUpdated( context(), tableName, tbl, mDb, writer, first );          // UPDATE
+      std::lock_guard<std::mutex> lock( mutex );
+      parts[i].data = std::move( data );
+      parts[i].tables = std::move( tables );
+      parts[i].error = error;
+      parts[i].done = true;
+      partDone.notify_all();
+    }
+  };
+
+  std::vector<std::thread> threads;
+  for ( size_t t = 0; t < threadCount; ++t )
+    threads.emplace_back( worker );
+
+  // write the parts in the original order of tables (and ranges) as soon as they are ready
+  std::exception_ptr error;
+  size_t startedTable = tableNames.size();  // table split into ranges whose header has been written
+  for ( size_t i = 0; i < parts.size() && !error; ++i )
+  {
+    // progress is reported (and cancellation handled) only from this thread - workers just stop taking new parts
+    if ( i == 0 || parts[i].tableIndex != parts[i - 1].tableIndex )
+    {
+      try
+      {
+        progress.startTable( tableNames[parts[i].tableIndex] );
+      }
+      catch ( ... )
+      {
+        error = std::current_exception();
+        stop = true;
+        break;
+      }
+    }
+
+    std::unique_ptr<Buffer> data;
+    std::vector<ChangesetTableIndex> tables;
+    {
+      std::unique_lock<std::mutex> lock( mutex );
+      auto isReady = [&] { return parts[i].done || ( stop && i >= nextPart ); };
+      if ( context()->hasProgressCallback() )
+      {
+        // while waiting, report rows of the table compared by workers so far (the callback may cancel the operation)
+        int64_t entriesReported = tableEntries[parts[i].tableIndex];
+        while ( !partDone.wait_for( lock, std::chrono::milliseconds( 100 ), isReady ) && !error )
+        {
+          int64_t entries = tableEntries[parts[i].tableIndex];
+          if ( entries == entriesReported )
+            continue;
+          entriesReported = entries;
+          try
+          {
+            progress.setEntriesDone( entries );
+          }
+          catch ( ... )
+          {
+            error = std::current_exception();
+          }
+        }
+        if ( error )
+          break;
+      }
+      else
+      {
+        partDone.wait( lock, isReady );
+      }
+      if ( !parts[i].done )
+        break;  // a part with lower index has failed, this one has not been processed at all
+      error = parts[i].error;
+      data = std::move( parts[i].data );
+      tables = std::move( parts[i].tables );
+    }
+    if ( error )
+      break;
+
+    try
+    {
+      size_t tableIndex = parts[i].tableIndex;
+      if ( !parts[i].hasRange )
+      {
+        writer.writeTables( data->c_buf(), static_cast<size_t>( data->size() ), tables );
+      }
+      else if ( data->size() > 0 )
+      {
+        // all ranges of a table go to a single table block, started by the first range with any changes
+        if ( startedTable != tableIndex )
+        {
+          writer.beginTable( rangeTables[tableIndex] );
+          startedTable = tableIndex;
+        }
+        writer.writeEntries( data->c_buf(), static_cast<size_t>( data->size() ), tables.empty() ? ChangesetTableIndex() : tables[0] );
+      }
+    }
+    catch ( ... )
+    {
+      error = std::current_exception();
+      stop = true;
+    }
   }
 
+  if ( error )
+  {
+    stop = true;
+    cancelled = true;
+  }
+  for ( std::thread &thread : threads )
+    thread.join();
+
+  if ( error )
+    std::rethrow_exception( error );
+
+  progress.finish();
 }
 
 static std::string sqlForInsert( const std::string &tableName, const TableSchema &tbl )
@@ -728,7 +1497,7 @@ static std::string sqlForDelete( const std::string &tableName, const TableSchema
   return sql;
 }
 
-static void bindValue( sqlite3_stmt *stmt, int index, const Value &v )
+static void bindValue( sqlite3_stmt *stmt, int index, const ValueView &v )
 {
   int rc;
   if ( v.type() == Value::TypeInt )
@@ -738,9 +1507,9 @@ static void bindValue( sqlite3_stmt *stmt, int index, const Value &v )
   else if ( v.type() == Value::TypeNull )
     rc = sqlite3_bind_null( stmt, index );
   else if ( v.type() == Value::TypeText )
-    rc = sqlite3_bind_text( stmt, index, v.getString().c_str(), -1, SQLITE_TRANSIENT );
+    rc = sqlite3_bind_text( stmt, index, v.getStringData(), ( int ) v.getStringSize(), SQLITE_TRANSIENT );
   else if ( v.type() == Value::TypeBlob )
-    rc = sqlite3_bind_blob( stmt, index, v.getString().c_str(), ( int ) v.getString().size(), SQLITE_TRANSIENT );
+    rc = sqlite3_bind_blob( stmt, index, v.getStringData(), ( int ) v.getStringSize(), SQLITE_TRANSIENT );
   else
     throw GeoDiffException( "unexpected bind type" );
 
@@ -751,7 +1520,7 @@ static void bindValue( sqlite3_stmt *stmt, int index, const Value &v )
 }
 
 
-ChangeApplyResult SqliteDriver::applyChange( SqliteChangeApplyState &state, const ChangesetEntry &entry )
+ChangeApplyResult SqliteDriver::applyChange( SqliteChangeApplyState &state, const ChangesetEntryView &entry )
 {
   std::string tableName = entry.table->name;
 
@@ -780,6 +1549,9 @@ ChangeApplyResult SqliteDriver::applyChange( SqliteChangeApplyState &state, cons
     SqliteChangeApplyState::TableState &tbl = state.tableState[tableName];
     tbl.schema = schema;
 
+    if ( state.bulkApply )
+      deferIndexes( state, tableName, schema );
+
     tbl.stmtInsert.prepare( mDb, sqlForInsert( tableName, schema ) );
     tbl.stmtUpdate.prepare( mDb, sqlForUpdate( tableName, schema ) );
     tbl.stmtDelete.prepare( mDb, sqlForDelete( tableName, schema ) );
@@ -791,7 +1563,7 @@ ChangeApplyResult SqliteDriver::applyChange( SqliteChangeApplyState &state, cons
     sqlite3_reset( tbl.stmtInsert.get() );
     for ( size_t i = 0; i < tbl.schema.columns.size(); ++i )
     {
-      const Value &v = entry.newValues[i];
+      const ValueView &v = entry.newValues[i];
       bindValue( tbl.stmtInsert.get(), static_cast<int>( i ) + 1, v );
     }
     int res = sqlite3_step( tbl.stmtInsert.get() );
@@ -810,8 +1582,8 @@ ChangeApplyResult SqliteDriver::applyChange( SqliteChangeApplyState &state, cons
     sqlite3_reset( tbl.stmtUpdate.get() );
     for ( size_t i = 0; i < tbl.schema.columns.size(); ++i )
     {
-      const Value &vOld = entry.oldValues[i];
-      const Value &vNew = entry.newValues[i];
+      const ValueView &vOld = entry.oldValues[i];
+      const ValueView &vNew = entry.newValues[i];
       sqlite3_bind_int( tbl.stmtUpdate.get(), static_cast<int>( i ) * 3 + 2, vNew.type() != Value::TypeUndefined );
       if ( vOld.type() != Value::TypeUndefined )
         bindValue( tbl.stmtUpdate.get(), static_cast<int>( i ) * 3 + 1, vOld );
@@ -838,7 +1610,7 @@ ChangeApplyResult SqliteDriver::applyChange( SqliteChangeApplyState &state, cons
     sqlite3_reset( tbl.stmtDelete.get() );
     for ( size_t i = 0; i < tbl.schema.columns.size(); ++i )
     {
-      const Value &v = entry.oldValues[i];
+      const ValueView &v = entry.oldValues[i];
       bindValue( tbl.stmtDelete.get(), static_cast<int>( i ) + 1, v );
     }
     int res = sqlite3_step( tbl.stmtDelete.get() );
@@ -863,6 +1635,93 @@ ChangeApplyResult SqliteDriver::applyChange( SqliteChangeApplyState &state, cons
 }
 
 
+void SqliteDriver::deferIndexes( SqliteChangeApplyState &state, const std::string &tableName, const TableSchema &tbl )
+{
+  // names and SQL of the indexes and triggers to drop
+  std::vector<std::pair<std::string, std::string>> indexes;
+  std::vector<std::pair<std::string, std::string>> triggers;
+
+  // only indexes created with CREATE INDEX - indexes of UNIQUE constraints are needed to detect conflicts,
+  // and indexes of tables with foreign keys are used when checking the constraints
+  if ( state.tablesWithForeignKeys.count( tableName ) == 0 )
+  {
+    Sqlite3Stmt statement;
+    statement.prepare( mDb, "SELECT m.name, m.sql FROM pragma_index_list(%Q) AS il "
+                       "JOIN sqlite_master AS m ON m.type = 'index' AND m.name = il.name "
+                       "WHERE il.\"unique\" = 0 AND il.origin = 'c' AND m.sql IS NOT NULL", tableName.c_str() );
+    while ( sqlite3_step( statement.get() ) == SQLITE_ROW )
+    {
+      indexes.push_back( std::make_pair( reinterpret_cast<const char *>( sqlite3_column_text( statement.get(), 0 ) ),
+                                         reinterpret_cast<const char *>( sqlite3_column_text( statement.get(), 1 ) ) ) );
+    }
+  }
+
+  // GeoPackage spatial index is kept up to date by triggers - instead it gets refilled from the table at the end.
+  // Ids in the spatial index are values of the (single column) integer primary key
+  size_t pkIndex = tbl.columns.size();
+  for ( size_t i = 0; i < tbl.columns.size(); ++i )
+  {
+    if ( tbl.columns[i].isPrimaryKey )
+      pkIndex = pkIndex == tbl.columns.size() ? i : tbl.columns.size() + 1;  // composite key - not a feature table
+  }
+  for ( const TableColumnInfo &col : tbl.columns )
+  {
+    if ( !col.isGeometry || pkIndex >= tbl.columns.size() )
+      continue;
+
+    std::string rtreeName = "rtree_" + tableName + "_" + col.name;
+    Sqlite3Stmt statement;
+    statement.prepare( mDb, "SELECT name, sql FROM sqlite_master WHERE type = 'trigger' AND tbl_name = %Q AND substr(name, 1, %d) = %Q "
+                       "AND EXISTS (SELECT 1 FROM sqlite_master WHERE type = 'table' AND name = %Q)",
+                       tableName.c_str(), static_cast<int>( rtreeName.size() ) + 1, ( rtreeName + "_" ).c_str(), rtreeName.c_str() );
+    bool hasTriggers = false;
+    while ( sqlite3_step( statement.get() ) == SQLITE_ROW )
+    {
+      triggers.push_back( std::make_pair( reinterpret_cast<const char *>( sqlite3_column_text( statement.get(), 0 ) ),
+                                          reinterpret_cast<const char *>( sqlite3_column_text( statement.get(), 1 ) ) ) );
+      hasTriggers = true;
+    }
+    if ( !hasTriggers )
+      continue;
+
+    Buffer sql;
+    sql.printf( "DELETE FROM \"%w\"; INSERT INTO \"%w\" SELECT \"%w\", ST_MinX(\"%w\"), ST_MaxX(\"%w\"), ST_MinY(\"%w\"), ST_MaxY(\"%w\") "
+                "FROM \"%w\" WHERE \"%w\" NOT NULL AND NOT ST_IsEmpty(\"%w\")",
+                rtreeName.c_str(), rtreeName.c_str(), tbl.columns[pkIndex].name.c_str(),
+                col.name.c_str(), col.name.c_str(), col.name.c_str(), col.name.c_str(),
+                tableName.c_str(), col.name.c_str(), col.name.c_str() );
+    state.bulkRebuildSql.push_back( sql.c_buf() );
+  }
+
+  for ( const auto &index : indexes )
+  {
+    Buffer sql;
+    sql.printf( "DROP INDEX \"%w\"", index.first.c_str() );
+    mDb->exec( sql );
+    state.bulkRebuildSql.push_back( index.second );
+  }
+  for ( const auto &trigger : triggers )
+  {
+    Buffer sql;
+    sql.printf( "DROP TRIGGER \"%w\"", trigger.first.c_str() );
+    mDb->exec( sql );
+    state.bulkRebuildSql.push_back( trigger.second );
+  }
+
+  if ( !indexes.empty() || !triggers.empty() )
+    context()->logger().debug( "Bulk apply: rebuilding " + std::to_string( indexes.size() ) + " indexes and " +
+                               std::to_string( triggers.size() ) + " spatial index triggers of table " + tableName + " at the end" );
+}
+
+//! Returns foreign keys between tables as pairs (referencing table, referenced table)
+static std::vector<std::pair<std::string, std::string>> foreignKeyTables( const Context *context, std::shared_ptr<Sqlite3Db> db )
+{
+  std::vector<std::pair<std::string, std::string>> tables;
+  for ( const auto &fk : sqliteForeignKeys( context, db, "main" ) )
+    tables.push_back( std::make_pair( fk.first.first, fk.second.first ) );
+  return tables;
+}
+
 void SqliteDriver::applyChangeset( ChangesetReader &reader )
 {
   TableSchema tbl;
@@ -870,6 +1729,10 @@ void SqliteDriver::applyChangeset( ChangesetReader &reader )
   // this will acquire DB mutex and release it when the function ends (or when an exception is thrown)
   Sqlite3DbMutexLocker dbMutexLocker( mDb );
 
+  std::unique_ptr<Sqlite3BulkApplySettings> bulkApplySettings;
+  if ( mBulkApply )
+    bulkApplySettings.reset( new Sqlite3BulkApplySettings( context(), mDb ) );
+
   // start transaction!
   Sqlite3SavepointTransaction savepointTransaction( context(), mDb );
 
@@ -901,11 +1764,25 @@ void SqliteDriver::applyChangeset( ChangesetReader &reader )
 
   int unrecoverableConflictCount = 0;
   std::vector<ChangesetEntry> conflictingEntries;
-  ChangesetEntry entry;
+  ChangesetEntryView entry;
   SqliteChangeApplyState state;
   std::unordered_map<std::string, std::unique_ptr<ChangesetTable>> tableCopies;
+  ProgressReporter progress( context() );  // cancellation throws, rolling back the savepoint
+  std::vector<std::pair<std::string, std::string>> foreignKeys = foreignKeyTables( context(), mDb );
+  ChangesetApplyOrder applyOrder( foreignKeys );
+  state.bulkApply = mBulkApply;
+  for ( const std::pair<std::string, std::string> &fk : foreignKeys )
+    state.tablesWithForeignKeys.insert( fk.first );
   while ( reader.nextEntry( entry ) )
   {
+    progress.entryDone( entry.table->name );
+    if ( applyOrder.isOrdered( entry.table->name ) )
+    {
+      // tables linked by foreign keys get applied once all their changes are known
+      applyOrder.addEntry( entry );
+      continue;
+    }
+
     ChangeApplyResult res = applyChange( state, entry );
     switch ( res )
     {
@@ -913,32 +1790,53 @@ void SqliteDriver::applyChangeset( ChangesetReader &reader )
       case ChangeApplyResult::Skipped:
         break; // Applied correctly, continue onward.
       case ChangeApplyResult::ConstraintConflict:
+      {
         // Ordering conflict found, handle later.
-        // Effectively copying the entry isn't simple, since ChangesetReader is
+        // The entry only points to reader's buffer, so it needs to be copied.
+        // Copying the entry isn't simple, since ChangesetReader is
         // happy to change entry.table under our feet. We need to copy the
         // table object, ideally only keeping one per table.
         if ( tableCopies.count( entry.table->name ) == 0 )
           // cppcheck-suppress stlFindInsert
           tableCopies[entry.table->name] = std::unique_ptr<ChangesetTable>( new ChangesetTable( *entry.table ) );
-        entry.table = tableCopies[entry.table->name].get();
-        conflictingEntries.push_back( entry );
+        conflictingEntries.push_back( entry.toEntry() );
+        conflictingEntries.back().table = tableCopies[entry.table->name].get();
         break;
+      }
       case ChangeApplyResult::NoChange:
         unrecoverableConflictCount++; // Other issue, will throw at the end.
         break;
     }
   }
 
-  // Applying some entries may fail due to constraints, since they require the
-  // entries to be in some specific, unknown order. To work around this, we
-  // retry applying the conflicting entries until either we apply them all or we
-  // get stuck.
+  for ( const ChangesetEntry *oentry : applyOrder.orderedEntries() )
+  {
+    ChangeApplyResult res = applyChange( state, ChangesetEntryView::fromEntry( *oentry ) );
+    switch ( res )
+    {
+      case ChangeApplyResult::Applied:
+      case ChangeApplyResult::Skipped:
+        break;
+      case ChangeApplyResult::ConstraintConflict:
+        conflictingEntries.push_back( *oentry ); // The table is owned by applyOrder, no need to copy it.
+        break;
+      case ChangeApplyResult::NoChange:
+        unrecoverableConflictCount++;
+        break;
+    }
+  }
+
+  // Applying some entries may still fail due to constraints that can't be resolved
+  // by ordering of tables (e.g. a table referencing itself or unique constraints),
+  // since they require the entries to be in some specific, unknown order. To work
+  // around this, we retry applying the conflicting entries until either we apply
+  // them all or we get stuck.
   std::vector<ChangesetEntry> newConflictingEntries;
   while ( conflictingEntries.size() > 0 )
   {
     for ( const ChangesetEntry &centry : conflictingEntries )
     {
-      ChangeApplyResult res = applyChange( state, centry );
+      ChangeApplyResult res = applyChange( state, ChangesetEntryView::fromEntry( centry ) );
       switch ( res )
       {
         case ChangeApplyResult::Applied:
@@ -958,13 +1856,26 @@ void SqliteDriver::applyChangeset( ChangesetReader &reader )
     if ( newConflictingEntries.size() == conflictingEntries.size() )
     {
       for ( const ChangesetEntry &centry : conflictingEntries )
-        logApplyConflict( "unresolvable_conflict", centry );
+        logApplyConflict( "unresolvable_conflict", ChangesetEntryView::fromEntry( centry ) );
       throw GeoDiffConflictsException( "Could not resolve dependencies in constraint conflicts." );
     }
     conflictingEntries = newConflictingEntries;
     newConflictingEntries.clear();
   }
 
+  progress.finish();
+
+  // indexes dropped for bulk apply get rebuilt (if there are conflicts, everything gets rolled back anyway)
+  if ( !unrecoverableConflictCount )
+  {
+    for ( const std::string &sql : state.bulkRebuildSql )
+    {
+      Buffer sqlBuf;
+      sqlBuf.printf( "%s", sql.c_str() );
+      mDb->exec( sqlBuf );
+    }
+  }
+
   // recreate triggers
   for ( const std::string &cmd : triggerCmds )
   {
@@ -976,6 +1887,12 @@ void SqliteDriver::applyChangeset( ChangesetReader &reader )
     statement.close();
   }
 
+  // hashes of the modified blocks of rows get re-calculated
+  if ( !unrecoverableConflictCount && mUseRowHashIndex && rowHashIndexExists( mDb ) )
+  {
+    ::updateRowHashIndex( context(), mDb, rowHashIndexTables() );
+  }
+
   if ( !unrecoverableConflictCount )
   {
     savepointTransaction.commitChanges();
@@ -1130,12 +2047,128 @@ void SqliteDriver::createTables( const std::vector<TableSchema> &tables )
 }
 
 
+std::vector<TableSchema> SqliteDriver::rowHashIndexTables()
+{
+  std::vector<TableSchema> tables;
+  for ( const std::string &tableName : listTables() )
+  {
+    TableSchema tbl = tableSchema( tableName );
+    if ( primaryKeyOrder( mDb, "main", tableName, tbl ) == PrimaryKeyOrder::Rowid )
+      tables.push_back( tbl );
+  }
+  return tables;
+}
+
+void SqliteDriver::updateRowHashIndex()
+{
+  if ( mHasModified )
+    throw GeoDiffException( "Row hash index can be only updated for a single database" );
+
+  Sqlite3DbMutexLocker dbMutexLocker( mDb );
+  Sqlite3SavepointTransaction savepointTransaction( context(), mDb );
+  ::updateRowHashIndex( context(), mDb, rowHashIndexTables() );
+  savepointTransaction.commitChanges();
+}
+
+void SqliteDriver::removeRowHashIndex()
+{
+  if ( mHasModified )
+    throw GeoDiffException( "Row hash index can be only removed from a single database" );
+
+  Sqlite3DbMutexLocker dbMutexLocker( mDb );
+  Sqlite3SavepointTransaction savepointTransaction( context(), mDb );
+  ::removeRowHashIndex( context(), mDb );
+  savepointTransaction.commitChanges();
+}
+
+#ifdef HAVE_SQLITE_SESSION
+//! Table filter of the session - changes of tables ignored by geodiff are not captured
+static int captureTableFilter( void *ctx, const char *tableName )
+{
+  return isIgnoredTable( static_cast<const Context *>( ctx ), tableName ) ? 0 : 1;
+}
+#endif
+
+void SqliteDriver::startChangeCapture()
+{
+  if ( mHasModified )
+    throw GeoDiffException( "Changes can be only captured in a single database" );
+  if ( mSession )
+    throw GeoDiffException( "Changes of the database are being captured already" );
+
+#ifdef HAVE_SQLITE_SESSION
+  int rc = sqlite3session_create( mDb->get(), "main", &mSession );
+  if ( rc != SQLITE_OK )
+    throwSqliteError( mDb->get(), "Failed to create session for capturing changes" );
+
+  // all tables (including ones created later) are attached, the filter is consulted when a table gets modified first
+  sqlite3session_table_filter( mSession, captureTableFilter, const_cast<Context *>( context() ) );
+  rc = sqlite3session_attach( mSession, nullptr );
+  if ( rc != SQLITE_OK )
+  {
+    sqlite3session_delete( mSession );
+    mSession = nullptr;
+    throwSqliteError( mDb->get(), "Failed to attach tables to session for capturing changes" );
+  }
+#else
+  throw GeoDiffException( "Capturing changes is not available: SQLite library has been built without session extension" );
+#endif
+}
+
+void SqliteDriver::executeSql( const std::string &sql )
+{
+  Buffer sqlBuf;
+  sqlBuf.printf( "%s", sql.c_str() );
+  mDb->exec( sqlBuf );
+}
+
+void SqliteDriver::writeCapturedChangeset( ChangesetWriter &writer )
+{
+  if ( !mSession )
+    throw GeoDiffException( "Changes of the database are not being captured" );
+
+#ifdef HAVE_SQLITE_SESSION
+  int size = 0;
+  void *data = nullptr;
+  int rc = sqlite3session_changeset( mSession, &size, &data );
+  if ( rc != SQLITE_OK )
+    throwSqliteError( mDb->get(), "Failed to get changeset of captured changes" );
+
+  // session changesets are in the same format, entries just need to go through the writer
+  // (which may add the index or compress the output)
+  Buffer buffer;
+  buffer.append( static_cast<const char *>( data ), size );
+  sqlite3_free( data );
+
+  ChangesetReader reader;
+  if ( !reader.openBuffer( buffer ) )
+    throw GeoDiffException( "Failed to read changeset of captured changes" );
+
+  std::string currentTableName;
+  ChangesetEntry entry;
+  while ( reader.nextEntry( entry ) )
+  {
+    if ( entry.table->name != currentTableName )
+    {
+      writer.beginTable( *entry.table );
+      currentTableName = entry.table->name;
+    }
+    writer.writeEntry( entry );
+  }
+#else
+  ( void )writer;
+#endif
+}
+
+
 void SqliteDriver::dumpData( ChangesetWriter &writer, bool useModified )
 {
   std::string dbName = databaseName( useModified );
   std::vector<std::string> tables = listTables();
+  ProgressReporter progress( context(), static_cast<int>( tables.size() ) );
   for ( const std::string &tableName : tables )
   {
+    progress.startTable( tableName );
     TableSchema tbl = tableSchema( tableName, useModified );
     if ( !tbl.hasPrimaryKey() )
       continue;  // ignore tables without primary key - they can't be compared properly
@@ -1161,10 +2194,12 @@ void SqliteDriver::dumpData( ChangesetWriter &writer, bool useModified )
         e.newValues.push_back( changesetValue( v.value() ) );
       }
       writer.writeEntry( e );
+      progress.entryDone();
     }
     if ( rc != SQLITE_DONE )
     {
       logSqliteError( context(), mDb, "Failure dumping changeset" );
     }
   }
+  progress.finish();
 }
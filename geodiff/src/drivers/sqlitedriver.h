@@ -6,11 +6,14 @@
 #ifndef SQLITEDRIVER_H
 #define SQLITEDRIVER_H
 
+#include <set>
 #include <unordered_map>
 
 #include "driver.h"
 #include "sqliteutils.h"
 
+class ProgressReporter;
+
 /**
  * Holds state that is useful to keep between entries when applying changeset.
  */
@@ -26,8 +29,14 @@ class SqliteChangeApplyState
     };
 
     std::unordered_map<std::string, TableState> tableState;
-};
 
+    //! Whether indexes get rebuilt after applying all changes (see "bulk_apply" driver option)
+    bool bulkApply = false;
+    //! Tables with foreign keys - their indexes are kept in bulk apply, they are used to check the constraints
+    std::set<std::string> tablesWithForeignKeys;
+    //! SQL commands to rebuild indexes and spatial indexes (and their triggers) dropped for bulk apply
+    std::vector<std::string> bulkRebuildSql;
+};
 
 /**
  * Support for diffs between Sqlite-based files (including GeoPackage)
@@ -40,11 +49,21 @@ class SqliteChangeApplyState
  * - for use with two databases (possible to call createChangeset())
  *   - "base" = path to the 'base' database
  *   - "modified" = path to the 'modified' database
+ *
+ * - optionally "conninfo" = driver options, a list of space separated flags:
+ *   - "row_hash_index" = use row hash index (see sqliterowhashindex.h) when creating changesets
+ *     if both databases have it, and keep it up to date when applying changesets
+ *   - "bulk_apply" = optimize applying of large changesets (e.g. when copying databases): secondary
+ *     indexes and GeoPackage spatial indexes of modified tables are dropped and rebuilt once all changes
+ *     are applied (still within the transaction), and the connection uses larger cache and no syncing
+ *     to disk during the apply (the database may get corrupted if the system crashes meanwhile)
+ *   Unknown flags are ignored.
  */
 class SqliteDriver : public Driver
 {
   public:
     explicit SqliteDriver( const Context *context );
+    ~SqliteDriver() override;
 
     void open( const DriverParametersMap &conn ) override;
     void create( const DriverParametersMap &conn, bool overwrite = false ) override;
@@ -55,13 +74,52 @@ class SqliteDriver : public Driver
     void createTables( const std::vector<TableSchema> &tables ) override;
     void dumpData( ChangesetWriter &writer, bool useModified = false ) override;
 
+    /**
+     * Creates or refreshes row hash index of all tables with INTEGER PRIMARY KEY in the database
+     * (only for a single database use). Throws GeoDiffException on error.
+     */
+    void updateRowHashIndex();
+
+    //! Removes row hash index from the database (only for a single database use). Throws GeoDiffException on error.
+    void removeRowHashIndex();
+
+    /**
+     * Starts capturing changes of the database (only for a single database use) with SQLite session
+     * extension, so that a changeset can be written without comparing the database to a base copy.
+     * Only changes made through this driver's connection (see executeSql()) are captured. Tables are
+     * filtered the same way as in listTables(). Throws GeoDiffException on error (e.g. when SQLite
+     * has been built without session extension).
+     */
+    void startChangeCapture();
+
+    //! Executes SQL statement(s) on the database. Throws GeoDiffException on error.
+    void executeSql( const std::string &sql );
+
+    /**
+     * Writes changes captured since startChangeCapture() to the changeset. Multiple changes of a row
+     * are written as a single entry (e.g. a row that got inserted and then updated is written as an insert).
+     * Throws GeoDiffException on error.
+     */
+    void writeCapturedChangeset( ChangesetWriter &writer );
+
   private:
-    void logApplyConflict( const std::string &type, const ChangesetEntry &entry, bool isDbErr = false ) const;
-    ChangeApplyResult applyChange( SqliteChangeApplyState &state, const ChangesetEntry &entry );
+    void parseOptions( const DriverParametersMap &conn );
+    void logApplyConflict( const std::string &type, const ChangesetEntryView &entry, bool isDbErr = false ) const;
+    void deferIndexes( SqliteChangeApplyState &state, const std::string &tableName, const TableSchema &tbl );
+    ChangeApplyResult applyChange( SqliteChangeApplyState &state, const ChangesetEntryView &entry );
     std::string databaseName( bool useModified = false );
+    void createChangesetForTable( const std::string &tableName, ChangesetWriter &writer, ProgressReporter &progress, const SqlitePrimaryKeyRange *range = nullptr );
+    std::vector<SqlitePrimaryKeyRange> primaryKeyRanges( const std::string &tableName, size_t threadCount );
+    bool canUseRowHashIndex( const std::string &tableName, const TableSchema &tbl );
+    std::vector<TableSchema> rowHashIndexTables();
+    void createChangesetParallel( const std::vector<std::string> &tableNames, ChangesetWriter &writer, size_t threadCount );
 
     std::shared_ptr<Sqlite3Db> mDb;
     bool mHasModified = false;  // whether there is also a second file attached
+    DriverParametersMap mConnParams;  // parameters used to open the driver (to open more connections)
+    bool mUseRowHashIndex = false;  // whether "row_hash_index" driver option is set
+    bool mBulkApply = false;  // whether "bulk_apply" driver option is set
+    struct sqlite3_session *mSession = nullptr;  // set while capturing changes (see startChangeCapture())
 };
 
 
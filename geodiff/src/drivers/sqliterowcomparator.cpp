@@ -0,0 +1,234 @@
+/*
+ GEODIFF - MIT License
+ Copyright (C) 2023 Lutra Consulting
+*/
+
+#include "sqliterowcomparator.h"
+
+#include "geodiffcontext.hpp"
+#include "geodiffutils.hpp"
+
+#include <string.h>
+
+
+//! Reads "count" digits and checks that the number is within the range. Advances "p" on success
+static bool parseDigits( const char *&p, const char *end, int count, int minValue, int maxValue, int &value )
+{
+  if ( end - p < count )
+    return false;
+  value = 0;
+  for ( int i = 0; i < count; ++i )
+  {
+    if ( p[i] < '0' || p[i] > '9' )
+      return false;
+    value = value * 10 + ( p[i] - '0' );
+  }
+  if ( value < minValue || value > maxValue )
+    return false;
+  p += count;
+  return true;
+}
+
+//! Returns number of days of the month in the proleptic Gregorian calendar (as used by SQLite)
+static int daysInMonth( int year, int month )
+{
+  static const int DAYS[] = { 31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 };
+  if ( month == 2 && year % 4 == 0 && ( year % 100 != 0 || year % 400 == 0 ) )
+    return 29;
+  return DAYS[month - 1];
+}
+
+bool sqliteDatetimeKey( const char *str, size_t len, int64_t &key )
+{
+  // Accepted formats follow parsing of time values in SQLite's date.c. Only valid dates and times
+  // are accepted: SQLite also parses days up to 31 in any month and hour 24, but depending on its
+  // version STRFTIME() prints such values as they are or normalizes them to the following day
+  // (e.g. "2023-02-30" to "2023-03-02"), so they are left to SQLite. For valid values STRFTIME()
+  // prints the parsed fields, so equal output means equal fields (with seconds rounded to milliseconds)
+  const char *p = str;
+  const char *end = str + len;
+  int year, month, day, hour = 0, minute = 0, second = 0;
+  if ( !parseDigits( p, end, 4, 0, 9999, year ) || p == end || *p++ != '-' ||
+       !parseDigits( p, end, 2, 1, 12, month ) || p == end || *p++ != '-' ||
+       !parseDigits( p, end, 2, 1, daysInMonth( year, month ), day ) )
+    return false;
+
+  int64_t msec = 0;
+  bool hasTime = p != end && ( *p == ' ' || *p == 'T' );
+  if ( hasTime )
+  {
+    ++p;
+    if ( !parseDigits( p, end, 2, 0, 23, hour ) || p == end || *p++ != ':' ||
+         !parseDigits( p, end, 2, 0, 59, minute ) )
+      return false;
+
+    if ( p != end && *p == ':' )
+    {
+      ++p;
+      if ( !parseDigits( p, end, 2, 0, 59, second ) )
+        return false;
+      msec = second * 1000;
+
+      if ( end - p >= 2 && *p == '.' && p[1] >= '0' && p[1] <= '9' )
+      {
+        ++p;
+        const char *fraction = p;
+        int64_t digits = 0;
+        while ( p != end && *p >= '0' && *p <= '9' && p - fraction < 3 )
+          digits = digits * 10 + ( *p++ - '0' );
+
+        if ( p == end || *p < '0' || *p > '9' )
+        {
+          // up to three digits are printed back exactly
+          for ( ptrdiff_t i = p - fraction; i < 3; ++i )
+            digits *= 10;
+          msec += digits;
+        }
+        else
+        {
+          // longer fractions get rounded - do the same floating point operations as SQLite
+          double ms = 0.0, scale = 1.0;
+          for ( p = fraction; p != end && *p >= '0' && *p <= '9'; ++p )
+          {
+            ms = ms * 10.0 + *p - '0';
+            scale *= 10.0;
+          }
+          double s = second + ms / scale;
+          if ( s > 59.999 )
+            s = 59.999;
+          char buf[16];
+          sqlite3_snprintf( sizeof( buf ), buf, "%06.3f", s );
+          msec = ( buf[0] - '0' ) * 10000 + ( buf[1] - '0' ) * 1000 +
+                 ( buf[3] - '0' ) * 100 + ( buf[4] - '0' ) * 10 + ( buf[5] - '0' );
+        }
+      }
+    }
+  }
+
+  // SQLite only accepts the time zone suffix after a time (STRFTIME() of "2023-01-01Z" is NULL)
+  if ( hasTime && p != end && *p == 'Z' )
+    ++p;
+  if ( p != end )
+    return false;
+
+  key = ( ( ( ( int64_t( year ) * 13 + month ) * 32 + day ) * 24 + hour ) * 60 + minute ) * 60000 + msec;
+  return true;
+}
+
+
+SqliteRowComparator::SqliteRowComparator( const Context *context, std::shared_ptr<Sqlite3Db> db, const std::string &tableName, const TableSchema &tbl )
+  : mContext( context )
+  , mDb( db )
+  , mTableName( tableName )
+  , mGeometryTolerance( context->geometryTolerance() )
+  , mUpdated( tbl.columns.size(), 0 )
+{
+  for ( const TableColumnInfo &col : tbl.columns )
+  {
+    if ( !col.isPrimaryKey && context->isColumnIgnored( tableName, col.name ) )
+      mEqual.push_back( &SqliteRowComparator::ignoredEqual );
+    else if ( col.isGeometry && mGeometryTolerance >= 0 )
+      mEqual.push_back( &SqliteRowComparator::geometryEqual );
+    else if ( col.type == TableColumnType::DATETIME )
+      mEqual.push_back( &SqliteRowComparator::datetimeEqual );
+    else
+      mEqual.push_back( &SqliteRowComparator::exactEqual );
+  }
+}
+
+bool SqliteRowComparator::compare( sqlite3_stmt *stmtOld, int offsetOld, sqlite3_stmt *stmtNew, int offsetNew )
+{
+  bool hasUpdates = false;
+  for ( size_t i = 0; i < mEqual.size(); ++i )
+  {
+    int n = static_cast<int>( i );
+    bool updated = !( this->*mEqual[i] )( stmtOld, offsetOld + n, stmtNew, offsetNew + n );
+    mUpdated[i] = updated;
+    hasUpdates |= updated;
+  }
+  return hasUpdates;
+}
+
+bool SqliteRowComparator::ignoredEqual( sqlite3_stmt *, int, sqlite3_stmt *, int )
+{
+  return true;
+}
+
+bool SqliteRowComparator::exactEqual( sqlite3_stmt *stmt1, int i1, sqlite3_stmt *stmt2, int i2 )
+{
+  int type1 = sqlite3_column_type( stmt1, i1 );
+  int type2 = sqlite3_column_type( stmt2, i2 );
+  if ( type1 != type2 )
+    return false;
+
+  if ( type1 == SQLITE_NULL )
+    return true;
+  else if ( type1 == SQLITE_INTEGER )
+    return sqlite3_column_int64( stmt1, i1 ) == sqlite3_column_int64( stmt2, i2 );
+  else if ( type1 == SQLITE_FLOAT )
+    return sqlite3_column_double( stmt1, i1 ) == sqlite3_column_double( stmt2, i2 );
+  else if ( type1 == SQLITE_TEXT || type1 == SQLITE_BLOB )
+  {
+    const void *data1 = type1 == SQLITE_TEXT ? static_cast<const void *>( sqlite3_column_text( stmt1, i1 ) ) : sqlite3_column_blob( stmt1, i1 );
+    const void *data2 = type2 == SQLITE_TEXT ? static_cast<const void *>( sqlite3_column_text( stmt2, i2 ) ) : sqlite3_column_blob( stmt2, i2 );
+    int len1 = sqlite3_column_bytes( stmt1, i1 );
+    int len2 = sqlite3_column_bytes( stmt2, i2 );
+    return len1 == len2 && ( len1 == 0 || memcmp( data1, data2, static_cast<size_t>( len1 ) ) == 0 );
+  }
+  else
+  {
+    throw GeoDiffException( "Unexpected value type" );
+  }
+}
+
+bool SqliteRowComparator::datetimeEqual( sqlite3_stmt *stmt1, int i1, sqlite3_stmt *stmt2, int i2 )
+{
+  if ( exactEqual( stmt1, i1, stmt2, i2 ) )
+    return true;
+
+  // multiple different string representations could be used for a single datetime value
+  if ( sqlite3_column_type( stmt1, i1 ) == SQLITE_TEXT && sqlite3_column_type( stmt2, i2 ) == SQLITE_TEXT )
+  {
+    const char *text1 = reinterpret_cast<const char *>( sqlite3_column_text( stmt1, i1 ) );
+    const char *text2 = reinterpret_cast<const char *>( sqlite3_column_text( stmt2, i2 ) );
+    int64_t key1, key2;
+    if ( sqliteDatetimeKey( text1, static_cast<size_t>( sqlite3_column_bytes( stmt1, i1 ) ), key1 ) &&
+         sqliteDatetimeKey( text2, static_cast<size_t>( sqlite3_column_bytes( stmt2, i2 ) ), key2 ) )
+      return key1 == key2;
+  }
+
+  // other formats (e.g. julian day numbers or time zone offsets) are left to SQLite
+  if ( !mStmtDatetime.get() )
+    mStmtDatetime.prepare( mDb, "SELECT STRFTIME('%%Y-%%m-%%d %%H:%%M:%%f', ?1) IS NOT STRFTIME('%%Y-%%m-%%d %%H:%%M:%%f', ?2)" );
+
+  sqlite3_stmt *stmt = mStmtDatetime.get();
+  sqlite3_bind_value( stmt, 1, sqlite3_column_value( stmt1, i1 ) );
+  sqlite3_bind_value( stmt, 2, sqlite3_column_value( stmt2, i2 ) );
+  bool equal = false;
+  int res = sqlite3_step( stmt );
+  if ( SQLITE_ROW == res )
+  {
+    equal = sqlite3_column_int( stmt, 0 ) == 0;
+  }
+  else if ( SQLITE_DONE != res )
+  {
+    logSqliteError( mContext, mDb, "Failed to write information about updated rows in table " + mTableName );
+  }
+  sqlite3_reset( stmt );
+  sqlite3_clear_bindings( stmt );
+  return equal;
+}
+
+bool SqliteRowComparator::geometryEqual( sqlite3_stmt *stmt1, int i1, sqlite3_stmt *stmt2, int i2 )
+{
+  if ( exactEqual( stmt1, i1, stmt2, i2 ) )
+    return true;
+
+  if ( sqlite3_column_type( stmt1, i1 ) != SQLITE_BLOB || sqlite3_column_type( stmt2, i2 ) != SQLITE_BLOB )
+    return false;
+
+  const char *geom1 = static_cast<const char *>( sqlite3_column_blob( stmt1, i1 ) );
+  const char *geom2 = static_cast<const char *>( sqlite3_column_blob( stmt2, i2 ) );
+  return gpkgGeometriesEqual( geom1, static_cast<size_t>( sqlite3_column_bytes( stmt1, i1 ) ),
+                              geom2, static_cast<size_t>( sqlite3_column_bytes( stmt2, i2 ) ), mGeometryTolerance );
+}
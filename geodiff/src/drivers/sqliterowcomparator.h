@@ -0,0 +1,74 @@
+/*
+ GEODIFF - MIT License
+ Copyright (C) 2023 Lutra Consulting
+*/
+
+#ifndef SQLITEROWCOMPARATOR_H
+#define SQLITEROWCOMPARATOR_H
+
+#include "sqliteutils.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+class Context;
+
+/**
+ * Compares rows of a table column by column when looking for updated rows. It is set up once
+ * per table: a comparison function is picked for each column based on the column's type, and
+ * rows are then compared just by reading values of the statements' columns (no copies are made).
+ *
+ * Columns ignored in the context (Context::isColumnIgnored()) are always considered equal, other
+ * values are compared exactly (same type and same content), except for:
+ * - datetime columns where different string representations of the same time are considered equal
+ *   (see "Time Values" section in https://sqlite.org/lang_datefunc.html) - the result is the same
+ *   as when comparing STRFTIME('%Y-%m-%d %H:%M:%f', value) of the two values. The most common
+ *   formats are handled directly, anything else is passed to SQLite.
+ * - geometry columns if geometry tolerance is set in the context (Context::geometryTolerance()),
+ *   these are compared with gpkgGeometriesEqual().
+ */
+class SqliteRowComparator
+{
+  public:
+    SqliteRowComparator( const Context *context, std::shared_ptr<Sqlite3Db> db, const std::string &tableName, const TableSchema &tbl );
+
+    /**
+     * Compares the current row of the old statement (starting at column offsetOld) with the current
+     * row of the new statement (starting at column offsetNew). Returns true if any of the columns
+     * differ - isUpdated() tells which ones.
+     */
+    bool compare( sqlite3_stmt *stmtOld, int offsetOld, sqlite3_stmt *stmtNew, int offsetNew );
+
+    //! Returns whether i-th column differed in the last call to compare()
+    bool isUpdated( size_t i ) const { return mUpdated[i]; }
+
+  private:
+    typedef bool ( SqliteRowComparator::*ColumnEqualFunction )( sqlite3_stmt *stmt1, int i1, sqlite3_stmt *stmt2, int i2 );
+
+    bool ignoredEqual( sqlite3_stmt *stmt1, int i1, sqlite3_stmt *stmt2, int i2 );
+    bool exactEqual( sqlite3_stmt *stmt1, int i1, sqlite3_stmt *stmt2, int i2 );
+    bool datetimeEqual( sqlite3_stmt *stmt1, int i1, sqlite3_stmt *stmt2, int i2 );
+    bool geometryEqual( sqlite3_stmt *stmt1, int i1, sqlite3_stmt *stmt2, int i2 );
+
+    const Context *mContext = nullptr;
+    std::shared_ptr<Sqlite3Db> mDb;
+    std::string mTableName;
+    double mGeometryTolerance = -1;
+    std::vector<ColumnEqualFunction> mEqual;
+    std::vector<char> mUpdated;
+    //! Comparison of datetime values in SQL (for formats not handled by sqliteDatetimeKey()), prepared on first use
+    Sqlite3Stmt mStmtDatetime;
+};
+
+/**
+ * Parses the most common text representation of datetime: "YYYY-MM-DD" optionally followed by
+ * a space or "T" and "HH:MM", "HH:MM:SS" or "HH:MM:SS.SSS" (any number of fractional digits),
+ * with an optional "Z" suffix after the time. On success it sets "key" to a number that is equal for two values
+ * exactly when STRFTIME('%Y-%m-%d %H:%M:%f', value) of the values are equal, and returns true.
+ * Returns false for any other input (e.g. julian day numbers, time zone offsets, whitespace) and
+ * for dates and times out of range (e.g. "2023-02-30" or hour 24), which SQLite may normalize.
+ */
+bool sqliteDatetimeKey( const char *str, size_t len, int64_t &key );
+
+#endif // SQLITEROWCOMPARATOR_H
@@ -0,0 +1,513 @@
+/*
+ GEODIFF - MIT License
+ Copyright (C) 2023 Lutra Consulting
+*/
+
+#include "sqliterowhashindex.h"
+
+#include "changesetindex.h"
+#include "geodiffcontext.hpp"
+#include "geodifflogger.hpp"
+#include "geodiffutils.hpp"
+
+#include <sqlite3.h>
+
+#include <map>
+#include <set>
+
+//! Number of bits of primary key values grouped to one block (i.e. 1024 values per block)
+static const int BLOCK_BITS = 10;
+
+//! Number of bits of node numbers grouped to one parent node (i.e. 16 children per node)
+static const int FANOUT_BITS = 4;
+
+//! Level of the roots of the tree (leaves are on level 0) - there are at most two nodes (negative and non-negative keys)
+static const int TOP_LEVEL = ( 64 - BLOCK_BITS + FANOUT_BITS - 1 ) / FANOUT_BITS;
+
+//! Version of the index format - part of the table signature, so that indexes in another format are not used
+static const char *INDEX_VERSION = "1";
+
+#define TABLES_TABLE ROW_HASH_INDEX_PREFIX "_tables"
+#define NODES_TABLE ROW_HASH_INDEX_PREFIX "_nodes"
+#define DIRTY_TABLE ROW_HASH_INDEX_PREFIX "_dirty"
+
+static const char *TRIGGER_OPS[] = { "insert", "update", "delete" };
+
+//! Returns value shifted right by the given number of bits, rounded towards negative infinity (the same as ">>" in SQLite)
+static int64_t shiftRight( int64_t value, int bits )
+{
+  return value >= 0 ? value >> bits : ~( ~value >> bits );
+}
+
+//! Returns the first number within the node of the next level up (the inverse of shiftRight())
+static int64_t shiftLeft( int64_t value, int bits )
+{
+  return value * ( static_cast<int64_t>( 1 ) << bits );
+}
+
+static void stepStatement( std::shared_ptr<Sqlite3Db> db, Sqlite3Stmt &stmt, const std::string &description )
+{
+  if ( sqlite3_step( stmt.get() ) != SQLITE_DONE )
+    throwSqliteError( db->get(), description );
+}
+
+static std::string primaryKeyColumn( const TableSchema &tbl )
+{
+  for ( const TableColumnInfo &c : tbl.columns )
+  {
+    if ( c.isPrimaryKey )
+      return c.name;
+  }
+  throw GeoDiffException( "Row hash index: missing primary key in table " + tbl.name );
+}
+
+//! Returns description of table columns stored with the index - the index is only valid if it matches
+static std::string tableSignature( const TableSchema &tbl )
+{
+  std::string signature = INDEX_VERSION;
+  for ( const TableColumnInfo &c : tbl.columns )
+  {
+    char *str = sqlite3_mprintf( ";%Q %Q%s", c.name.c_str(), c.type.dbType.c_str(), c.isPrimaryKey ? " pk" : "" );
+    signature += str;
+    sqlite3_free( str );
+  }
+  return signature;
+}
+
+static std::string triggerName( const std::string &tableName, const char *op )
+{
+  return std::string( ROW_HASH_INDEX_PREFIX ) + "_" + tableName + "_" + op;
+}
+
+static bool hasSqliteObject( std::shared_ptr<Sqlite3Db> db, const std::string &dbName, const char *type, const std::string &name )
+{
+  Sqlite3Stmt stmt;
+  stmt.prepare( db, "SELECT 1 FROM \"%w\".sqlite_master WHERE type = %Q AND name = %Q", dbName.c_str(), type, name.c_str() );
+  return sqlite3_step( stmt.get() ) == SQLITE_ROW;
+}
+
+/**
+ * Returns whether the table has UNIQUE indexes other than its primary key. Such tables can't be indexed:
+ * INSERT OR REPLACE may delete rows conflicting with a UNIQUE constraint without running DELETE triggers
+ * (unless recursive triggers are enabled), so the blocks of deleted rows would not be recorded.
+ */
+static bool hasUniqueIndexes( std::shared_ptr<Sqlite3Db> db, const std::string &dbName, const std::string &tableName )
+{
+  Sqlite3Stmt stmt;
+  stmt.prepare( db, "SELECT 1 FROM pragma_index_list( %Q, %Q ) WHERE \"unique\" AND origin <> 'pk'", tableName.c_str(), dbName.c_str() );
+  return sqlite3_step( stmt.get() ) == SQLITE_ROW;
+}
+
+static void dropTriggers( std::shared_ptr<Sqlite3Db> db, const std::string &tableName )
+{
+  for ( const char *op : TRIGGER_OPS )
+  {
+    Sqlite3Stmt stmt;
+    stmt.prepare( db, "DROP TRIGGER IF EXISTS \"main\".\"%w\"", triggerName( tableName, op ).c_str() );
+    stepStatement( db, stmt, "Row hash index: failed to drop trigger" );
+  }
+}
+
+//! Creates triggers that record blocks of rows modified in the table
+static void createTriggers( std::shared_ptr<Sqlite3Db> db, const std::string &tableName, const std::string &pkName )
+{
+  const char *table = tableName.c_str();
+  const char *pk = pkName.c_str();
+
+  Sqlite3Stmt stmt;
+  stmt.prepare( db, "CREATE TRIGGER \"main\".\"%w\" AFTER INSERT ON \"%w\" BEGIN "
+                "INSERT OR IGNORE INTO \"" DIRTY_TABLE "\" VALUES ( %Q, NEW.\"%w\" >> %d ); END",
+                triggerName( tableName, "insert" ).c_str(), table, table, pk, BLOCK_BITS );
+  stepStatement( db, stmt, "Row hash index: failed to create trigger" );
+
+  stmt.prepare( db, "CREATE TRIGGER \"main\".\"%w\" AFTER UPDATE ON \"%w\" BEGIN "
+                "INSERT OR IGNORE INTO \"" DIRTY_TABLE "\" VALUES ( %Q, OLD.\"%w\" >> %d ), ( %Q, NEW.\"%w\" >> %d ); END",
+                triggerName( tableName, "update" ).c_str(), table, table, pk, BLOCK_BITS, table, pk, BLOCK_BITS );
+  stepStatement( db, stmt, "Row hash index: failed to create trigger" );
+
+  stmt.prepare( db, "CREATE TRIGGER \"main\".\"%w\" AFTER DELETE ON \"%w\" BEGIN "
+                "INSERT OR IGNORE INTO \"" DIRTY_TABLE "\" VALUES ( %Q, OLD.\"%w\" >> %d ); END",
+                triggerName( tableName, "delete" ).c_str(), table, table, pk, BLOCK_BITS );
+  stepStatement( db, stmt, "Row hash index: failed to create trigger" );
+}
+
+static void deleteTableRows( std::shared_ptr<Sqlite3Db> db, const std::string &tableName )
+{
+  for ( const char *indexTable : { TABLES_TABLE, NODES_TABLE, DIRTY_TABLE } )
+  {
+    Sqlite3Stmt stmt;
+    stmt.prepare( db, "DELETE FROM \"main\".\"%w\" WHERE table_name = %Q", indexTable, tableName.c_str() );
+    stepStatement( db, stmt, "Row hash index: failed to delete rows of table " + tableName );
+  }
+}
+
+/**
+ * Calculates and stores hashes of nodes of the tree of a single table in "main" database
+ */
+class RowHashIndexWriter
+{
+  public:
+    RowHashIndexWriter( std::shared_ptr<Sqlite3Db> db, const TableSchema &tbl )
+      : mDb( db ), mTableName( tbl.name )
+    {
+      std::string pkName = primaryKeyColumn( tbl );
+      mPkIndex = static_cast<int>( tbl.columnFromName( pkName ) );
+      mStmtRows.prepare( db, "SELECT * FROM \"main\".\"%w\" ORDER BY \"%w\"", tbl.name.c_str(), pkName.c_str() );
+      mStmtBlockRows.prepare( db, "SELECT * FROM \"main\".\"%w\" WHERE \"%w\" BETWEEN ?1 AND ?2 ORDER BY \"%w\"",
+                              tbl.name.c_str(), pkName.c_str(), pkName.c_str() );
+      mStmtChildren.prepare( db, "SELECT node, hash FROM \"main\".\"" NODES_TABLE "\" WHERE table_name = %Q AND level = ?1 AND node BETWEEN ?2 AND ?3 ORDER BY node",
+                             tbl.name.c_str() );
+      mStmtWrite.prepare( db, "INSERT OR REPLACE INTO \"main\".\"" NODES_TABLE "\" VALUES ( %Q, ?1, ?2, ?3 )", tbl.name.c_str() );
+      mStmtDelete.prepare( db, "DELETE FROM \"main\".\"" NODES_TABLE "\" WHERE table_name = %Q AND level = ?1 AND node = ?2", tbl.name.c_str() );
+    }
+
+    //! Calculates hashes of all blocks of the table (existing nodes need to be deleted first)
+    void build()
+    {
+      std::set<int64_t> blocks;
+      bool hasBlock = false;
+      int64_t block = 0;
+      uint64_t hash = CHANGESET_CHECKSUM_INIT;
+      int rc;
+      while ( SQLITE_ROW == ( rc = sqlite3_step( mStmtRows.get() ) ) )
+      {
+        int64_t rowBlock = shiftRight( sqlite3_column_int64( mStmtRows.get(), mPkIndex ), BLOCK_BITS );
+        if ( !hasBlock || rowBlock != block )
+        {
+          if ( hasBlock )
+          {
+            writeNode( 0, block, hash );
+            blocks.insert( block );
+          }
+          hasBlock = true;
+          block = rowBlock;
+          hash = CHANGESET_CHECKSUM_INIT;
+        }
+        hash = sqliteRowHash( hash, mStmtRows.get() );
+      }
+      if ( rc != SQLITE_DONE )
+        throwSqliteError( mDb->get(), "Row hash index: failed to read rows of table " + mTableName );
+      if ( hasBlock )
+      {
+        writeNode( 0, block, hash );
+        blocks.insert( block );
+      }
+
+      updateParents( blocks );
+    }
+
+    //! Re-calculates hashes of the given blocks and their parent nodes
+    void update( const std::set<int64_t> &blocks )
+    {
+      for ( int64_t block : blocks )
+      {
+        int64_t from = shiftLeft( block, BLOCK_BITS );
+        sqlite3_reset( mStmtBlockRows.get() );
+        sqlite3_bind_int64( mStmtBlockRows.get(), 1, from );
+        sqlite3_bind_int64( mStmtBlockRows.get(), 2, from + ( ( static_cast<int64_t>( 1 ) << BLOCK_BITS ) - 1 ) );
+
+        bool hasRows = false;
+        uint64_t hash = CHANGESET_CHECKSUM_INIT;
+        int rc;
+        while ( SQLITE_ROW == ( rc = sqlite3_step( mStmtBlockRows.get() ) ) )
+        {
+          hash = sqliteRowHash( hash, mStmtBlockRows.get() );
+          hasRows = true;
+        }
+        if ( rc != SQLITE_DONE )
+          throwSqliteError( mDb->get(), "Row hash index: failed to read rows of table " + mTableName );
+
+        if ( hasRows )
+          writeNode( 0, block, hash );
+        else
+          deleteNode( 0, block );
+      }
+
+      updateParents( blocks );
+    }
+
+  private:
+    //! Re-calculates hashes of parents of the given nodes on level 0, then their parents etc. up to the top level
+    void updateParents( const std::set<int64_t> &blocks )
+    {
+      std::set<int64_t> nodes = blocks;
+      for ( int level = 1; level <= TOP_LEVEL; ++level )
+      {
+        std::set<int64_t> parents;
+        for ( int64_t node : nodes )
+          parents.insert( shiftRight( node, FANOUT_BITS ) );
+
+        for ( int64_t parent : parents )
+        {
+          int64_t from = shiftLeft( parent, FANOUT_BITS );
+          sqlite3_reset( mStmtChildren.get() );
+          sqlite3_bind_int( mStmtChildren.get(), 1, level - 1 );
+          sqlite3_bind_int64( mStmtChildren.get(), 2, from );
+          sqlite3_bind_int64( mStmtChildren.get(), 3, from + ( ( static_cast<int64_t>( 1 ) << FANOUT_BITS ) - 1 ) );
+
+          bool hasChildren = false;
+          uint64_t hash = CHANGESET_CHECKSUM_INIT;
+          int rc;
+          while ( SQLITE_ROW == ( rc = sqlite3_step( mStmtChildren.get() ) ) )
+          {
+            hash = sqliteHashInt64( hash, sqlite3_column_int64( mStmtChildren.get(), 0 ) );
+            hash = sqliteHashInt64( hash, sqlite3_column_int64( mStmtChildren.get(), 1 ) );
+            hasChildren = true;
+          }
+          if ( rc != SQLITE_DONE )
+            throwSqliteError( mDb->get(), "Row hash index: failed to read nodes of table " + mTableName );
+
+          if ( hasChildren )
+            writeNode( level, parent, hash );
+          else
+            deleteNode( level, parent );
+        }
+        nodes = parents;
+      }
+    }
+
+    void writeNode( int level, int64_t node, uint64_t hash )
+    {
+      sqlite3_reset( mStmtWrite.get() );
+      sqlite3_bind_int( mStmtWrite.get(), 1, level );
+      sqlite3_bind_int64( mStmtWrite.get(), 2, node );
+      sqlite3_bind_int64( mStmtWrite.get(), 3, static_cast<int64_t>( hash ) );
+      stepStatement( mDb, mStmtWrite, "Row hash index: failed to write node of table " + mTableName );
+    }
+
+    void deleteNode( int level, int64_t node )
+    {
+      sqlite3_reset( mStmtDelete.get() );
+      sqlite3_bind_int( mStmtDelete.get(), 1, level );
+      sqlite3_bind_int64( mStmtDelete.get(), 2, node );
+      stepStatement( mDb, mStmtDelete, "Row hash index: failed to delete node of table " + mTableName );
+    }
+
+    std::shared_ptr<Sqlite3Db> mDb;
+    std::string mTableName;
+    int mPkIndex = 0;
+    Sqlite3Stmt mStmtRows;
+    Sqlite3Stmt mStmtBlockRows;
+    Sqlite3Stmt mStmtChildren;
+    Sqlite3Stmt mStmtWrite;
+    Sqlite3Stmt mStmtDelete;
+};
+
+static std::set<int64_t> dirtyBlocks( std::shared_ptr<Sqlite3Db> db, const std::string &dbName, const std::string &tableName )
+{
+  std::set<int64_t> blocks;
+  Sqlite3Stmt stmt;
+  stmt.prepare( db, "SELECT block FROM \"%w\".\"" DIRTY_TABLE "\" WHERE table_name = %Q", dbName.c_str(), tableName.c_str() );
+  int rc;
+  while ( SQLITE_ROW == ( rc = sqlite3_step( stmt.get() ) ) )
+    blocks.insert( sqlite3_column_int64( stmt.get(), 0 ) );
+  if ( rc != SQLITE_DONE )
+    throwSqliteError( db->get(), "Row hash index: failed to read modified blocks of table " + tableName );
+  return blocks;
+}
+
+bool rowHashIndexExists( std::shared_ptr<Sqlite3Db> db )
+{
+  return hasSqliteObject( db, "main", "table", TABLES_TABLE );
+}
+
+void updateRowHashIndex( const Context *context, std::shared_ptr<Sqlite3Db> db, const std::vector<TableSchema> &tables )
+{
+  Buffer sql;
+  sql.printf( "CREATE TABLE IF NOT EXISTS \"main\".\"" TABLES_TABLE "\" ( table_name TEXT PRIMARY KEY, signature TEXT NOT NULL );"
+              "CREATE TABLE IF NOT EXISTS \"main\".\"" NODES_TABLE "\" ( table_name TEXT NOT NULL, level INTEGER NOT NULL, "
+              "node INTEGER NOT NULL, hash INTEGER NOT NULL, PRIMARY KEY ( table_name, level, node ) ) WITHOUT ROWID;"
+              "CREATE TABLE IF NOT EXISTS \"main\".\"" DIRTY_TABLE "\" ( table_name TEXT NOT NULL, block INTEGER NOT NULL, "
+              "PRIMARY KEY ( table_name, block ) ) WITHOUT ROWID;" );
+  db->exec( sql );
+
+  std::set<std::string> tableNames;
+  for ( const TableSchema &tbl : tables )
+  {
+    if ( hasUniqueIndexes( db, "main", tbl.name ) )
+    {
+      context->logger().debug( "Row hash index: table " + tbl.name + " has UNIQUE indexes and can't be indexed" );
+      continue;  // any existing index of the table gets removed below
+    }
+    tableNames.insert( tbl.name );
+
+    if ( hasRowHashIndex( db, "main", tbl ) )
+    {
+      std::set<int64_t> blocks = dirtyBlocks( db, "main", tbl.name );
+      if ( blocks.empty() )
+        continue;
+
+      context->logger().debug( "Row hash index: updating " + std::to_string( blocks.size() ) + " modified blocks of table " + tbl.name );
+      RowHashIndexWriter writer( db, tbl );
+      writer.update( blocks );
+
+      Sqlite3Stmt stmt;
+      stmt.prepare( db, "DELETE FROM \"main\".\"" DIRTY_TABLE "\" WHERE table_name = %Q", tbl.name.c_str() );
+      stepStatement( db, stmt, "Row hash index: failed to delete modified blocks of table " + tbl.name );
+    }
+    else
+    {
+      context->logger().debug( "Row hash index: indexing table " + tbl.name );
+      dropTriggers( db, tbl.name );
+      deleteTableRows( db, tbl.name );
+      createTriggers( db, tbl.name, primaryKeyColumn( tbl ) );
+      RowHashIndexWriter writer( db, tbl );
+      writer.build();
+
+      Sqlite3Stmt stmt;
+      stmt.prepare( db, "INSERT INTO \"main\".\"" TABLES_TABLE "\" VALUES ( %Q, %Q )", tbl.name.c_str(), tableSignature( tbl ).c_str() );
+      stepStatement( db, stmt, "Row hash index: failed to write table " + tbl.name );
+    }
+  }
+
+  // remove index of tables that do not exist anymore (or have changed and can't be indexed)
+  std::vector<std::string> removedTables;
+  Sqlite3Stmt stmt;
+  stmt.prepare( db, "SELECT table_name FROM \"main\".\"" TABLES_TABLE "\"" );
+  while ( SQLITE_ROW == sqlite3_step( stmt.get() ) )
+  {
+    std::string tableName = reinterpret_cast<const char *>( sqlite3_column_text( stmt.get(), 0 ) );
+    if ( tableNames.count( tableName ) == 0 )
+      removedTables.push_back( tableName );
+  }
+  stmt.close();
+
+  for ( const std::string &tableName : removedTables )
+  {
+    context->logger().debug( "Row hash index: removing index of table " + tableName );
+    dropTriggers( db, tableName );
+    deleteTableRows( db, tableName );
+  }
+}
+
+void removeRowHashIndex( const Context *context, std::shared_ptr<Sqlite3Db> db )
+{
+  std::vector<std::string> triggerNames;
+  Sqlite3Stmt stmt;
+  stmt.prepare( db, "SELECT name FROM \"main\".sqlite_master WHERE type = 'trigger'" );
+  while ( SQLITE_ROW == sqlite3_step( stmt.get() ) )
+  {
+    std::string name = reinterpret_cast<const char *>( sqlite3_column_text( stmt.get(), 0 ) );
+    if ( startsWith( name, ROW_HASH_INDEX_PREFIX "_" ) )
+      triggerNames.push_back( name );
+  }
+  stmt.close();
+
+  for ( const std::string &name : triggerNames )
+  {
+    stmt.prepare( db, "DROP TRIGGER \"main\".\"%w\"", name.c_str() );
+    stepStatement( db, stmt, "Row hash index: failed to drop trigger " + name );
+  }
+
+  for ( const char *indexTable : { TABLES_TABLE, NODES_TABLE, DIRTY_TABLE } )
+  {
+    stmt.prepare( db, "DROP TABLE IF EXISTS \"main\".\"%w\"", indexTable );
+    stepStatement( db, stmt, std::string( "Row hash index: failed to drop table " ) + indexTable );
+  }
+
+  context->logger().debug( "Row hash index: removed" );
+}
+
+bool hasRowHashIndex( std::shared_ptr<Sqlite3Db> db, const std::string &dbName, const TableSchema &tbl )
+{
+  if ( !hasSqliteObject( db, dbName, "table", TABLES_TABLE ) )
+    return false;
+
+  Sqlite3Stmt stmt;
+  stmt.prepare( db, "SELECT signature FROM \"%w\".\"" TABLES_TABLE "\" WHERE table_name = %Q", dbName.c_str(), tbl.name.c_str() );
+  if ( sqlite3_step( stmt.get() ) != SQLITE_ROW )
+    return false;
+  const char *signature = reinterpret_cast<const char *>( sqlite3_column_text( stmt.get(), 0 ) );
+  if ( !signature || tableSignature( tbl ) != signature )
+    return false;
+
+  // a UNIQUE index may have been added after the table got indexed
+  if ( hasUniqueIndexes( db, dbName, tbl.name ) )
+    return false;
+
+  // without the triggers, modified blocks would not get recorded and hashes could be out of date
+  for ( const char *op : TRIGGER_OPS )
+  {
+    if ( !hasSqliteObject( db, dbName, "trigger", triggerName( tbl.name, op ) ) )
+      return false;
+  }
+  return true;
+}
+
+//! Reads hashes of nodes on the given level within the range of node numbers
+static std::map<int64_t, int64_t> readNodes( Sqlite3Stmt &stmt, int level, int64_t from, int64_t to )
+{
+  std::map<int64_t, int64_t> nodes;
+  sqlite3_reset( stmt.get() );
+  sqlite3_bind_int( stmt.get(), 1, level );
+  sqlite3_bind_int64( stmt.get(), 2, from );
+  sqlite3_bind_int64( stmt.get(), 3, to );
+  while ( SQLITE_ROW == sqlite3_step( stmt.get() ) )
+    nodes[sqlite3_column_int64( stmt.get(), 0 )] = sqlite3_column_int64( stmt.get(), 1 );
+  return nodes;
+}
+
+std::vector<SqlitePrimaryKeyRange> rowHashIndexChangedRanges( std::shared_ptr<Sqlite3Db> db, const TableSchema &tbl, size_t &blockCount )
+{
+  // blocks modified since their hashes have been calculated need to be compared in any case
+  std::set<int64_t> blocks = dirtyBlocks( db, "main", tbl.name );
+  std::set<int64_t> blocksAux = dirtyBlocks( db, "aux", tbl.name );
+  blocks.insert( blocksAux.begin(), blocksAux.end() );
+
+  Sqlite3Stmt stmtNew, stmtOld;
+  const char *sql = "SELECT node, hash FROM \"%w\".\"" NODES_TABLE "\" WHERE table_name = %Q AND level = ?1 AND node BETWEEN ?2 AND ?3";
+  stmtNew.prepare( db, sql, "main", tbl.name.c_str() );
+  stmtOld.prepare( db, sql, "aux", tbl.name.c_str() );
+
+  // descend both trees from the top level, only following nodes whose hashes differ
+  std::vector<int64_t> differentNodes;
+  for ( int level = TOP_LEVEL; level >= 0; --level )
+  {
+    std::vector<std::pair<int64_t, int64_t>> ranges;
+    if ( level == TOP_LEVEL )
+      ranges.push_back( std::make_pair( INT64_MIN, INT64_MAX ) );
+    for ( int64_t parent : differentNodes )
+    {
+      int64_t from = shiftLeft( parent, FANOUT_BITS );
+      ranges.push_back( std::make_pair( from, from + ( ( static_cast<int64_t>( 1 ) << FANOUT_BITS ) - 1 ) ) );
+    }
+
+    differentNodes.clear();
+    for ( const std::pair<int64_t, int64_t> &range : ranges )
+    {
+      std::map<int64_t, int64_t> nodesNew = readNodes( stmtNew, level, range.first, range.second );
+      std::map<int64_t, int64_t> nodesOld = readNodes( stmtOld, level, range.first, range.second );
+      for ( const std::pair<const int64_t, int64_t> &node : nodesNew )
+      {
+        auto it = nodesOld.find( node.first );
+        if ( it == nodesOld.end() || it->second != node.second )
+          differentNodes.push_back( node.first );
+      }
+      for ( const std::pair<const int64_t, int64_t> &node : nodesOld )
+      {
+        if ( nodesNew.count( node.first ) == 0 )
+          differentNodes.push_back( node.first );
+      }
+    }
+  }
+  blocks.insert( differentNodes.begin(), differentNodes.end() );
+  blockCount = blocks.size();
+
+  // consecutive blocks are merged to a single range
+  std::vector<SqlitePrimaryKeyRange> ranges;
+  const int64_t blockSize = static_cast<int64_t>( 1 ) << BLOCK_BITS;
+  for ( int64_t block : blocks )
+  {
+    int64_t from = shiftLeft( block, BLOCK_BITS );
+    if ( !ranges.empty() && ranges.back().to == from - 1 )
+    {
+      ranges.back().to = from + ( blockSize - 1 );
+      continue;
+    }
+    SqlitePrimaryKeyRange range;
+    range.from = from;
+    range.to = from + ( blockSize - 1 );
+    ranges.push_back( range );
+  }
+  return ranges;
+}
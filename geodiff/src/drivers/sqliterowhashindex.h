@@ -0,0 +1,69 @@
+/*
+ GEODIFF - MIT License
+ Copyright (C) 2023 Lutra Consulting
+*/
+
+#ifndef SQLITEROWHASHINDEX_H
+#define SQLITEROWHASHINDEX_H
+
+#include "sqliteutils.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+/**
+ * Row hash index allows to find out which rows of a table may have changed without reading
+ * all the rows. It is stored in the database itself (tables and triggers with names starting
+ * with ROW_HASH_INDEX_PREFIX, which are ignored by geodiff otherwise) and it is only available
+ * for tables with INTEGER PRIMARY KEY and without other UNIQUE indexes (rows deleted by INSERT OR
+ * REPLACE because of a UNIQUE constraint conflict do not run DELETE triggers).
+ *
+ * Rows are grouped to blocks of primary key values (1024 values per block) and a hash of each
+ * block's content is stored. Blocks are the leaves of a Merkle tree: a node on the next level
+ * up holds a hash of the hashes of its 16 children, up to the top level with the roots of the tree.
+ * Triggers on indexed tables record blocks that got modified since the hashes were calculated
+ * ("dirty" blocks), so that the index can be refreshed just by re-calculating hashes of the dirty
+ * blocks and their parent nodes.
+ *
+ * When comparing two databases that both have the index, only the blocks with different hashes
+ * (found by descending the two trees from their roots) and dirty blocks in either of the databases
+ * need to be compared row by row.
+ */
+
+//! Prefix of names of tables and triggers of the row hash index
+#define ROW_HASH_INDEX_PREFIX "geodiff_row_hash"
+
+//! Returns whether the database ("main" schema) contains row hash index tables
+bool rowHashIndexExists( std::shared_ptr<Sqlite3Db> db );
+
+/**
+ * Creates row hash index in the database ("main" schema) if it does not exist yet and brings
+ * it up to date for the given tables (which all need to have INTEGER PRIMARY KEY). Tables whose
+ * index is valid only get their dirty blocks re-calculated, other tables are indexed from scratch.
+ * Tables with UNIQUE indexes other than the primary key are not indexed.
+ * Index of tables that are not listed (or can't be indexed) is removed. Should be called within a transaction.
+ * Throws GeoDiffException on error.
+ */
+void updateRowHashIndex( const Context *context, std::shared_ptr<Sqlite3Db> db, const std::vector<TableSchema> &tables );
+
+/**
+ * Removes row hash index tables and triggers from the database ("main" schema).
+ * Should be called within a transaction. Throws GeoDiffException on error.
+ */
+void removeRowHashIndex( const Context *context, std::shared_ptr<Sqlite3Db> db );
+
+/**
+ * Returns whether the table in the given schema ("main" or "aux") has a valid row hash index:
+ * it has been indexed with the same columns, its triggers are in place and it has no UNIQUE indexes.
+ */
+bool hasRowHashIndex( std::shared_ptr<Sqlite3Db> db, const std::string &dbName, const TableSchema &tbl );
+
+/**
+ * Returns ranges of primary keys of the table that may differ between "main" and "aux"
+ * databases, based on their row hash indexes (both need to be valid - see hasRowHashIndex()).
+ * Ranges are sorted and do not overlap. "blockCount" is set to the number of blocks in the ranges.
+ */
+std::vector<SqlitePrimaryKeyRange> rowHashIndexChangedRanges( std::shared_ptr<Sqlite3Db> db, const TableSchema &tbl, size_t &blockCount );
+
+#endif // SQLITEROWHASHINDEX_H
@@ -4,14 +4,18 @@
 */
 
 #include "sqliteutils.h"
+#include "sqliterowhashindex.h"
 
+#include "changesetindex.h"
 #include "geodiffutils.hpp"
 #include "geodifflogger.hpp"
 #include "geodiffcontext.hpp"
+#include "portableendian.h"
 
 #include <gpkg.h>
 
 #include <algorithm>
+#include <cmath>
 #include <memory.h>
 
 extern "C" {
@@ -310,6 +314,9 @@ void sqliteTriggers( const Context *context, std::shared_ptr<Sqlite3Db> db, std:
       continue;
     if ( startsWith( triggerName, "trigger_delete_feature_count_" ) )
       continue;
+    // triggers of row hash index only record modified rows, they stay active while applying changes
+    if ( startsWith( triggerName, ROW_HASH_INDEX_PREFIX ) )
+      continue;
     triggerNames.push_back( name );
     triggerCmds.push_back( sql );
   }
@@ -416,6 +423,9 @@ void sqliteTables( const Context *context,
     // internal table for AUTOINCREMENT
     if ( tableName == "sqlite_sequence" )
       continue;
+    // tables of the row hash index
+    if ( startsWith( tableName, ROW_HASH_INDEX_PREFIX ) )
+      continue;
 
     tableNames.push_back( tableName );
   }
@@ -586,12 +596,114 @@ void throwSqliteError( sqlite3 *db, const std::string &description )
     throw GeoDiffException( errMsg );
 }
 
-int parseGpkgbHeaderSize( const std::string &gpkgWkb )
+uint64_t sqliteHashInt64( uint64_t hash, int64_t value )
 {
-  // see GPKG binary header definition http://www.geopackage.org/spec/#gpb_spec
+  uint64_t x;
+  memcpy( &x, &value, 8 );
+  x = htobe64( x );  // the same hashes on all platforms
+  return changesetChecksum( hash, reinterpret_cast<const char *>( &x ), 8 );
+}
+
+//! Updates the hash with a single value: "number" is used for integers and floats (as bits), "data" for text and blobs
+static uint64_t hashValue( uint64_t hash, int type, int64_t number, const char *data, int size )
+{
+  char typeByte = static_cast<char>( type );
+  hash = changesetChecksum( hash, &typeByte, 1 );
+  if ( type == SQLITE_INTEGER || type == SQLITE_FLOAT )
+  {
+    hash = sqliteHashInt64( hash, number );
+  }
+  else if ( type == SQLITE_TEXT || type == SQLITE_BLOB )
+  {
+    hash = sqliteHashInt64( hash, size );
+    hash = changesetChecksum( hash, data, static_cast<size_t>( size ) );
+  }
+  return hash;
+}
 
-  char flagByte = gpkgWkb[ GPKG_FLAG_BYTE_POS ];
+static int64_t doubleBits( double d )
+{
+  int64_t bits;
+  memcpy( &bits, &d, 8 );
+  return bits;
+}
+
+uint64_t sqliteRowHash( uint64_t hash, sqlite3_stmt *stmt )
+{
+  int columnCount = sqlite3_column_count( stmt );
+  for ( int i = 0; i < columnCount; ++i )
+  {
+    int type = sqlite3_column_type( stmt, i );
+    if ( type == SQLITE_INTEGER )
+      hash = hashValue( hash, type, sqlite3_column_int64( stmt, i ), nullptr, 0 );
+    else if ( type == SQLITE_FLOAT )
+      hash = hashValue( hash, type, doubleBits( sqlite3_column_double( stmt, i ) ), nullptr, 0 );
+    else if ( type == SQLITE_TEXT )
+      hash = hashValue( hash, type, 0, reinterpret_cast<const char *>( sqlite3_column_text( stmt, i ) ), sqlite3_column_bytes( stmt, i ) );
+    else if ( type == SQLITE_BLOB )
+      hash = hashValue( hash, type, 0, reinterpret_cast<const char *>( sqlite3_column_blob( stmt, i ) ), sqlite3_column_bytes( stmt, i ) );
+    else
+      hash = hashValue( hash, type, 0, nullptr, 0 );
+  }
+  return hash;
+}
+
+//! State of geodiff_content_hash() aggregate function
+struct ContentHashState
+{
+  uint64_t sum;
+  uint64_t xor_;
+};
 
+static void contentHashStep( sqlite3_context *ctx, int argc, sqlite3_value **argv )
+{
+  ContentHashState *state = static_cast<ContentHashState *>( sqlite3_aggregate_context( ctx, sizeof( ContentHashState ) ) );
+  if ( !state )
+  {
+    sqlite3_result_error_nomem( ctx );
+    return;
+  }
+
+  uint64_t hash = CHANGESET_CHECKSUM_INIT;
+  for ( int i = 0; i < argc; ++i )
+  {
+    int type = sqlite3_value_type( argv[i] );
+    if ( type == SQLITE_INTEGER )
+      hash = hashValue( hash, type, sqlite3_value_int64( argv[i] ), nullptr, 0 );
+    else if ( type == SQLITE_FLOAT )
+      hash = hashValue( hash, type, doubleBits( sqlite3_value_double( argv[i] ) ), nullptr, 0 );
+    else if ( type == SQLITE_TEXT )
+      hash = hashValue( hash, type, 0, reinterpret_cast<const char *>( sqlite3_value_text( argv[i] ) ), sqlite3_value_bytes( argv[i] ) );
+    else if ( type == SQLITE_BLOB )
+      hash = hashValue( hash, type, 0, reinterpret_cast<const char *>( sqlite3_value_blob( argv[i] ) ), sqlite3_value_bytes( argv[i] ) );
+    else
+      hash = hashValue( hash, type, 0, nullptr, 0 );
+  }
+
+  // sum and xor do not depend on the order of rows
+  state->sum += hash;
+  state->xor_ ^= hash;
+}
+
+static void contentHashFinal( sqlite3_context *ctx )
+{
+  // aggregate context is zero-initialized, it is not allocated at all if there were no rows
+  ContentHashState *state = static_cast<ContentHashState *>( sqlite3_aggregate_context( ctx, 0 ) );
+  ContentHashState result = state ? *state : ContentHashState{ 0, 0 };
+  sqlite3_result_blob( ctx, &result, sizeof( result ), SQLITE_TRANSIENT );
+}
+
+void registerContentHashFunction( std::shared_ptr<Sqlite3Db> db )
+{
+  int rc = sqlite3_create_function( db->get(), "geodiff_content_hash", -1, SQLITE_UTF8 | SQLITE_DETERMINISTIC,
+                                    nullptr, nullptr, contentHashStep, contentHashFinal );
+  if ( rc != SQLITE_OK )
+    throwSqliteError( db->get(), "Failed to register geodiff_content_hash() function" );
+}
+
+//! Returns size of GeoPackage binary header with the given flags byte (including envelope)
+static int gpkgbHeaderSize( char flagByte )
+{
   char envelope_byte = ( flagByte & GPKG_ENVELOPE_SIZE_MASK ) >> 1;
   int envelope_size = 0;
 
@@ -619,6 +731,162 @@ int parseGpkgbHeaderSize( const std::string &gpkgWkb )
   return GPKG_NO_ENVELOPE_HEADER_SIZE + envelope_size;
 }
 
+int parseGpkgbHeaderSize( const std::string &gpkgWkb )
+{
+  // see GPKG binary header definition http://www.geopackage.org/spec/#gpb_spec
+
+  return gpkgbHeaderSize( gpkgWkb[ GPKG_FLAG_BYTE_POS ] );
+}
+
+//! Sequential reading of WKB data in either byte order
+struct WkbReader
+{
+  const unsigned char *ptr;
+  const unsigned char *end;
+  bool littleEndian = true;
+
+  bool readByteOrder()
+  {
+    if ( ptr == end || *ptr > 1 )
+      return false;
+    littleEndian = *ptr++ == 1;
+    return true;
+  }
+
+  bool readUInt32( uint32_t &value )
+  {
+    if ( end - ptr < 4 )
+      return false;
+    value = 0;
+    for ( int i = 0; i < 4; ++i )
+      value |= static_cast<uint32_t>( ptr[ littleEndian ? i : 3 - i ] ) << ( 8 * i );
+    ptr += 4;
+    return true;
+  }
+
+  bool readDouble( double &value )
+  {
+    if ( end - ptr < 8 )
+      return false;
+    uint64_t bits = 0;
+    for ( int i = 0; i < 8; ++i )
+      bits |= static_cast<uint64_t>( ptr[ littleEndian ? i : 7 - i ] ) << ( 8 * i );
+    memcpy( &value, &bits, 8 );
+    ptr += 8;
+    return true;
+  }
+};
+
+//! Compares "count" points with "dims" coordinates each, coordinates may differ up to tolerance
+static bool wkbPointsEqual( WkbReader &r1, WkbReader &r2, uint32_t count, int dims, double tolerance )
+{
+  for ( uint64_t i = 0; i < static_cast<uint64_t>( count ) * dims; ++i )
+  {
+    double x1, x2;
+    if ( !r1.readDouble( x1 ) || !r2.readDouble( x2 ) )
+      return false;
+    if ( std::isnan( x1 ) || std::isnan( x2 ) )
+    {
+      if ( std::isnan( x1 ) != std::isnan( x2 ) )  // empty point is encoded with NaN coordinates
+        return false;
+    }
+    else if ( std::fabs( x1 - x2 ) > tolerance )
+      return false;
+  }
+  return true;
+}
+
+/**
+ * Compares two (ISO) WKB geometries. Both must have the same structure (geometry types, number
+ * of parts and points), coordinates may differ up to tolerance. Byte order may differ too.
+ */
+static bool wkbEqual( WkbReader &r1, WkbReader &r2, double tolerance, int depth = 0 )
+{
+  uint32_t type1, type2;
+  if ( depth > 32 || !r1.readByteOrder() || !r2.readByteOrder() ||
+       !r1.readUInt32( type1 ) || !r2.readUInt32( type2 ) || type1 != type2 || type1 >= 4000 )
+    return false;
+
+  // ISO WKB: thousands give dimension (Z = 1000, M = 2000, ZM = 3000)
+  int dims = 2 + ( ( type1 / 1000 ) == 3 ? 2 : ( type1 / 1000 ) != 0 ? 1 : 0 );
+  uint32_t count1, count2;
+  switch ( type1 % 1000 )
+  {
+    case 1:   // Point
+      return wkbPointsEqual( r1, r2, 1, dims, tolerance );
+
+    case 2:   // LineString
+    case 8:   // CircularString
+      return r1.readUInt32( count1 ) && r2.readUInt32( count2 ) && count1 == count2 &&
+             wkbPointsEqual( r1, r2, count1, dims, tolerance );
+
+    case 3:   // Polygon
+    case 17:  // Triangle
+      if ( !r1.readUInt32( count1 ) || !r2.readUInt32( count2 ) || count1 != count2 )
+        return false;
+      for ( uint32_t i = 0; i < count1; ++i )
+      {
+        uint32_t points1, points2;
+        if ( !r1.readUInt32( points1 ) || !r2.readUInt32( points2 ) || points1 != points2 ||
+             !wkbPointsEqual( r1, r2, points1, dims, tolerance ) )
+          return false;
+      }
+      return true;
+
+    case 4:   // MultiPoint
+    case 5:   // MultiLineString
+    case 6:   // MultiPolygon
+    case 7:   // GeometryCollection
+    case 9:   // CompoundCurve
+    case 10:  // CurvePolygon
+    case 11:  // MultiCurve
+    case 12:  // MultiSurface
+    case 15:  // PolyhedralSurface
+    case 16:  // TIN
+      if ( !r1.readUInt32( count1 ) || !r2.readUInt32( count2 ) || count1 != count2 )
+        return false;
+      for ( uint32_t i = 0; i < count1; ++i )
+      {
+        if ( !wkbEqual( r1, r2, tolerance, depth + 1 ) )
+          return false;
+      }
+      return true;
+
+    default:
+      return false;
+  }
+}
+
+bool gpkgGeometriesEqual( const char *geom1, size_t length1, const char *geom2, size_t length2, double tolerance )
+{
+  // header: magic "GP", version, flags, SRS id and optional envelope - see http://www.geopackage.org/spec/#gpb_spec
+  auto headerSize = []( const char *geom, size_t length ) -> size_t
+  {
+    if ( length < GPKG_NO_ENVELOPE_HEADER_SIZE || geom[0] != 'G' || geom[1] != 'P' || ( geom[GPKG_FLAG_BYTE_POS] & 0x20 ) )
+      return 0;  // not a GeoPackage binary or extended GeoPackage binary
+    size_t size = static_cast<size_t>( gpkgbHeaderSize( geom[GPKG_FLAG_BYTE_POS] ) );
+    return size <= length ? size : 0;
+  };
+  auto srsId = []( const char *geom ) -> uint32_t
+  {
+    WkbReader r { reinterpret_cast<const unsigned char *>( geom ) + 4, reinterpret_cast<const unsigned char *>( geom ) + 8 };
+    r.littleEndian = geom[GPKG_FLAG_BYTE_POS] & 1;
+    uint32_t value = 0;
+    r.readUInt32( value );
+    return value;
+  };
+
+  size_t header1 = headerSize( geom1, length1 );
+  size_t header2 = headerSize( geom2, length2 );
+  if ( !header1 || !header2 || srsId( geom1 ) != srsId( geom2 ) )
+    return false;
+
+  // differences in envelope or other flags do not matter, only the geometry does
+  WkbReader r1 { reinterpret_cast<const unsigned char *>( geom1 ) + header1, reinterpret_cast<const unsigned char *>( geom1 ) + length1 };
+  WkbReader r2 { reinterpret_cast<const unsigned char *>( geom2 ) + header2, reinterpret_cast<const unsigned char *>( geom2 ) + length2 };
+  return wkbEqual( r1, r2, tolerance ) && r1.ptr == r1.end && r2.ptr == r2.end;
+}
+
 std::string createGpkgHeader( std::string &wkb, const TableColumnInfo &col )
 {
   // initialize instream with wkb
@@ -22,6 +22,13 @@
 class Buffer;
 class Context;
 
+//! Inclusive range of values of an integer primary key - used to diff a large table in parts
+struct SqlitePrimaryKeyRange
+{
+  int64_t from = 0;
+  int64_t to = 0;
+};
+
 
 class Sqlite3Db
 {
@@ -135,11 +142,34 @@ void throwSqliteError( sqlite3 *db, const std::string &description );
  */
 void logSqliteError( const Context *context, std::shared_ptr<Sqlite3Db> db, const std::string &description );
 
+//! Updates the hash (see changesetChecksum()) with a 64-bit integer - the hash is the same on all platforms
+uint64_t sqliteHashInt64( uint64_t hash, int64_t value );
+
+/**
+ * Updates the hash (see changesetChecksum()) with types and values of all columns of the current row
+ * of the statement and returns the new value. The hash is the same on all platforms.
+ */
+uint64_t sqliteRowHash( uint64_t hash, sqlite3_stmt *stmt );
+
+/**
+ * Registers aggregate SQL function geodiff_content_hash( column1, column2, ... ) which returns
+ * a hash of all rows (as a blob). Rows are hashed the same way as with sqliteRowHash() and their
+ * hashes are combined regardless of the order of rows. Throws GeoDiffException on error.
+ */
+void registerContentHashFunction( std::shared_ptr<Sqlite3Db> db );
+
 /**
  *  Returns size of GeoPackage binary header including envelope
  */
 int parseGpkgbHeaderSize( const std::string &gpkgWkb );
 
+/**
+ * Compares two geometries encoded as GeoPackage binary. Differences just in the header (e.g. envelope)
+ * are ignored except for SRS id, the WKB geometries need to have the same structure and coordinates
+ * may differ at most by the tolerance. Returns false also if either of the values cannot be parsed.
+ */
+bool gpkgGeometriesEqual( const char *geom1, size_t length1, const char *geom2, size_t length2, double tolerance );
+
 /**
  * Creates GeoPackage binary header and fills it with data from WKB
  * throws GeoDiffException on error
@@ -6,6 +6,7 @@
 #include "geodiff.h"
 #include <iostream>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <string>
 
@@ -64,7 +65,26 @@ static bool checkNoExtraArguments( const std::vector<std::string> &args, size_t
 
 static bool isOption( const std::string &str )
 {
-  return str.size() > 0 && str[0] == '-';
+  // a single dash is not an option - it stands for standard input/output
+  return str.size() > 1 && str[0] == '-';
+}
+
+static void logToStderr( GEODIFF_LoggerLevel level, const char *msg )
+{
+  switch ( level )
+  {
+    case LevelError: std::cerr << "Error: " << msg << std::endl; break;
+    case LevelWarning: std::cerr << "Warn: " << msg << std::endl; break;
+    case LevelInfo: std::cerr << "Info: " << msg << std::endl; break;
+    case LevelDebug: std::cerr << "Debug: " << msg << std::endl; break;
+  }
+}
+
+//! When a binary changeset is written to the standard output, log messages must not get mixed with it
+static void setChangesetOutput( GEODIFF_ContextH context, const std::string &chOutput )
+{
+  if ( isStdioPath( chOutput ) )
+    GEODIFF_CX_setLoggerCallback( context, &logToStderr );
 }
 
 static bool parseDriverOption( const std::vector<std::string> &args, size_t &i, const std::string &cmdName, std::string &driverName, std::string &driverOptions, std::string &tablesToSkip, std::string &tablesToInclude )
@@ -141,7 +161,8 @@ static int handleCmdDiff( GEODIFF_ContextH context, const std::vector<std::strin
   bool printOutput = true;
   std::string db1, db2, chOutput;
   std::string driver1Name = "sqlite", driver2Name = "sqlite", driver1Options, driver2Options;
-  std::string tablesToSkip, tablesToInclude;
+  std::string tablesToSkip, tablesToInclude, columnsToIgnore;
+  double geometryTolerance = -1;
   size_t i = 1;
 
   // parse options
@@ -202,6 +223,34 @@ static int handleCmdDiff( GEODIFF_ContextH context, const std::vector<std::strin
       i += 1;
       continue;
     }
+    else if ( args[i] == "--ignore-columns" )
+    {
+      if ( i + 1 >= args.size() )
+      {
+        std::cout << "Error: missing arguments for ignore-columns option" << std::endl;
+        return 1;
+      }
+      columnsToIgnore = args[i + 1];
+      i += 1;
+      continue;
+    }
+    else if ( args[i] == "--geometry-tolerance" )
+    {
+      if ( i + 1 >= args.size() )
+      {
+        std::cout << "Error: missing arguments for geometry-tolerance option" << std::endl;
+        return 1;
+      }
+      char *end = nullptr;
+      geometryTolerance = strtod( args[i + 1].c_str(), &end );
+      if ( args[i + 1].empty() || *end != '\0' || !( geometryTolerance >= 0 ) )
+      {
+        std::cout << "Error: invalid geometry tolerance '" << args[i + 1] << "'" << std::endl;
+        return 1;
+      }
+      i += 1;
+      continue;
+    }
     else
     {
       std::cout << "Error: unknown option '" << args[i] << "' for 'diff' command." << std::endl;
@@ -227,6 +276,9 @@ static int handleCmdDiff( GEODIFF_ContextH context, const std::vector<std::strin
     ctx->setTablesToSkip( parseIgnoredTables( tablesToSkip ) );
   else if ( !tablesToInclude.empty() )
     ctx->setTablesToInclude( parseIgnoredTables( tablesToInclude ) );
+  if ( !columnsToIgnore.empty() )
+    ctx->setColumnsToIgnore( parseIgnoredTables( columnsToIgnore ) );
+  ctx->setGeometryTolerance( geometryTolerance );
 
   // parse required arguments
   if ( !parseRequiredArgument( db1, args, i, "DB_1", "diff" ) )
@@ -236,9 +288,9 @@ static int handleCmdDiff( GEODIFF_ContextH context, const std::vector<std::strin
 
   if ( i < args.size() )
   {
-    // optional output argument
-    printOutput = false;
+    // optional output argument ("-" is the same as no output argument)
     chOutput = args[i++];
+    printOutput = isStdioPath( chOutput );
 
     if ( !checkNoExtraArguments( args, i, "diff" ) )
       return 1;
@@ -246,11 +298,17 @@ static int handleCmdDiff( GEODIFF_ContextH context, const std::vector<std::strin
 
   std::string changeset;
   TmpFile tmpChangeset;
-  if ( printOutput || writeJson || writeSummary )
+  if ( writeJson || writeSummary )
   {
     changeset = randomTmpFilename( );
     tmpChangeset.setPath( changeset );
   }
+  else if ( printOutput )
+  {
+    // binary changeset is streamed directly to the standard output
+    changeset = "-";
+    setChangesetOutput( context, changeset );
+  }
   else
     changeset = chOutput;
 
@@ -261,7 +319,7 @@ static int handleCmdDiff( GEODIFF_ContextH context, const std::vector<std::strin
                                          db1.data(), db2.data(), changeset.data() );
     if ( ret != GEODIFF_SUCCESS )
     {
-      std::cout << "Error: diff failed!" << std::endl;
+      std::cerr << "Error: diff failed!" << std::endl;
       return 1;
     }
   }
@@ -273,7 +331,7 @@ static int handleCmdDiff( GEODIFF_ContextH context, const std::vector<std::strin
                                          changeset.data() );
     if ( ret != GEODIFF_SUCCESS )
     {
-      std::cout << "Error: diff failed!" << std::endl;
+      std::cerr << "Error: diff failed!" << std::endl;
       return 1;
     }
   }
@@ -316,14 +374,6 @@ static int handleCmdDiff( GEODIFF_ContextH context, const std::vector<std::strin
       }
     }
   }
-  else if ( printOutput )
-  {
-    if ( !fileToStdout( changeset ) )
-    {
-      std::cout << "Error: unable to read content of file " << changeset << std::endl;
-      return 1;
-    }
-  }
 
   return 0;
 }
@@ -359,7 +409,7 @@ static int handleCmdApply( GEODIFF_ContextH context, const std::vector<std::stri
   int ret = GEODIFF_applyChangesetEx( context, driverName.data(), driverOptions.data(), db.data(), changeset.data() );
   if ( ret != GEODIFF_SUCCESS )
   {
-    std::cout << "Error: apply changeset failed!" << std::endl;
+    std::cerr << "Error: apply changeset failed!" << std::endl;
     return 1;
   }
 
@@ -405,7 +455,7 @@ static int handleCmdRebaseDiff( GEODIFF_ContextH context,  const std::vector<std
               chBaseTheir.data(), chRebased.data(), conflict.data() );
   if ( ret != GEODIFF_SUCCESS )
   {
-    std::cout << "Error: rebase-diff failed!" << std::endl;
+    std::cerr << "Error: rebase-diff failed!" << std::endl;
     return 1;
   }
 
@@ -447,7 +497,7 @@ static int handleCmdRebaseDb( GEODIFF_ContextH context, const std::vector<std::s
                               chBaseTheir.data(), conflict.data() );
   if ( ret != GEODIFF_SUCCESS )
   {
-    std::cout << "Error: rebase-db failed!" << std::endl;
+    std::cerr << "Error: rebase-db failed!" << std::endl;
     return 1;
   }
 
@@ -468,10 +518,12 @@ static int handleCmdInvert( GEODIFF_ContextH context, const std::vector<std::str
   if ( !checkNoExtraArguments( args, i, "invert" ) )
     return 1;
 
+  setChangesetOutput( context, chOutput );
+
   int ret = GEODIFF_invertChangeset( context, chInput.data(), chOutput.data() );
   if ( ret != GEODIFF_SUCCESS )
   {
-    std::cout << "Error: invert changeset failed!" << std::endl;
+    std::cerr << "Error: invert changeset failed!" << std::endl;
     return 1;
   }
 
@@ -489,6 +541,7 @@ static int handleCmdConcat( GEODIFF_ContextH context, const std::vector<std::str
   }
 
   std::string chOutput = args[args.size() - 1];
+  setChangesetOutput( context, chOutput );
 
   std::vector<const char *> changesets;
   for ( size_t i = 1; i < args.size() - 1; ++i )
@@ -499,7 +552,7 @@ static int handleCmdConcat( GEODIFF_ContextH context, const std::vector<std::str
   int ret = GEODIFF_concatChanges( context, ( int ) changesets.size(), changesets.data(), chOutput.data() );
   if ( ret != GEODIFF_SUCCESS )
   {
-    std::cout << "Error: concat changesets failed!" << std::endl;
+    std::cerr << "Error: concat changesets failed!" << std::endl;
     return 1;
   }
 
@@ -520,9 +573,9 @@ static int handleCmdAsJson( GEODIFF_ContextH context, const std::vector<std::str
 
   if ( i < args.size() )
   {
-    // optional output argument
-    printOutput = false;
+    // optional output argument ("-" is the same as no output argument)
     chOutput = args[i++];
+    printOutput = isStdioPath( chOutput );
 
     if ( !checkNoExtraArguments( args, i, "as-json" ) )
       return 1;
@@ -571,9 +624,9 @@ static int handleCmdAsSummary( GEODIFF_ContextH context, const std::vector<std::
 
   if ( i < args.size() )
   {
-    // optional output argument
-    printOutput = false;
+    // optional output argument ("-" is the same as no output argument)
     chOutput = args[i++];
+    printOutput = isStdioPath( chOutput );
 
     if ( !checkNoExtraArguments( args, i, "as-summary" ) )
       return 1;
@@ -807,13 +860,64 @@ static int handleCmdDump( GEODIFF_ContextH context, const std::vector<std::strin
   int ret = GEODIFF_dumpData( context, driverName.data(), driverOptions.data(), db.data(), chOutput.data() );
   if ( ret != GEODIFF_SUCCESS )
   {
-    std::cout << "Error: dump database failed!" << std::endl;
+    std::cerr << "Error: dump database failed!" << std::endl;
     return 1;
   }
 
   return 0;
 }
 
+static int handleCmdIndex( GEODIFF_ContextH context, const std::vector<std::string> &args )
+{
+  // geodiff index [OPTIONS...] DB
+
+  bool remove = false;
+  std::string db;
+  size_t i = 1;
+
+  // parse options
+  for ( ; i < args.size(); ++i )
+  {
+    if ( !isOption( args[i] ) )
+      break;  // no more options
+
+    if ( args[i] == "--remove" )
+    {
+      remove = true;
+      continue;
+    }
+    else
+    {
+      std::cerr << "Error: unknown option '" << args[i] << "' for 'index' command." << std::endl;
+      return 1;
+    }
+  }
+
+  if ( !parseRequiredArgument( db, args, i, "DB", "index" ) )
+    return 1;
+  if ( !checkNoExtraArguments( args, i, "index" ) )
+    return 1;
+
+  if ( remove )
+  {
+    if ( GEODIFF_removeRowHashIndex( context, db.data() ) != GEODIFF_SUCCESS )
+    {
+      std::cerr << "Error: removing row hash index failed!" << std::endl;
+      return 1;
+    }
+  }
+  else
+  {
+    if ( GEODIFF_updateRowHashIndex( context, db.data() ) != GEODIFF_SUCCESS )
+    {
+      std::cerr << "Error: updating row hash index failed!" << std::endl;
+      return 1;
+    }
+  }
+
+  return 0;
+}
+
 static int handleCmdDrivers( const std::vector<std::string> &args )
 {
   // geodiff drivers
@@ -863,13 +967,23 @@ You can control verbosity using the environment variable GEODIFF_LOGGER_LEVEL:\n
 In the commands listed below, database files may be any GeoPackage files or other\n\
 kinds of SQLite database files. This is using the default 'sqlite' driver. Even\n\
 when 'sqlite' driver is specified in a command with --driver option, there are\n\
-no extra driver options it needs (empty string \"\" can be passed).\n\
+no extra driver options it needs (empty string \"\" can be passed). Optionally,\n\
+\"row_hash_index\" driver option makes 'diff' use row hash index of the databases\n\
+(see 'index' command) and 'apply' keep the index up to date. \"bulk_apply\" driver\n\
+option makes 'apply' and 'copy' of large changesets faster: indexes get rebuilt once\n\
+at the end and changes are not synced to disk until the end. Options can be combined\n\
+(e.g. \"row_hash_index bulk_apply\").\n\
 \n\
 There may be other drivers available, for example 'postgres' driver. Its driver\n\
 options expect the connection string as understood by its client library - either\n\
 key/value pairs (e.g. \"host=localhost port=5432 dbname=mydb\") or connection URI\n\
 (e.g. \"postgresql://localhost:5432/mydb\").\n\
 \n\
+Changeset arguments (CH_INPUT, CH_OUTPUT) of 'diff', 'apply', 'invert', 'concat',\n\
+'as-json' and 'as-summary' commands may be \"-\" to read the changeset from the\n\
+standard input or to write it to the standard output, for example:\n\
+    geodiff diff a.gpkg b.gpkg - | geodiff apply c.gpkg -\n\
+\n\
 Create and apply changesets (diffs):\n\
 \n\
   geodiff diff [OPTIONS...] DB_1 DB_2 [CH_OUTPUT]\n\
@@ -897,6 +1011,14 @@ Create and apply changesets (diffs):\n\
       --include-tables TABLES\n\
                       Only include specified tables when creating a changeset. Tables are defined\n\
                       as a semicolon separated list of names. Cannot be used with --skip-tables.\n\
+      --ignore-columns COLUMNS\n\
+                      Do not compare specified columns when looking for updated rows. Columns\n\
+                      are defined as a semicolon separated list of names, either just a column\n\
+                      name (ignored in all tables) or TABLE.COLUMN.\n\
+      --geometry-tolerance TOLERANCE\n\
+                      Do not treat geometries as updated if they only differ in encoding\n\
+                      (e.g. GeoPackage envelope) or their coordinates differ at most by\n\
+                      TOLERANCE (in units of the coordinate system).\n\
 \n\
   geodiff apply [OPTIONS...] DB CH_INPUT\n\
 \n\
@@ -1034,6 +1156,18 @@ Utilities:\n\
       --include-tables TABLES\n\
                       Only include specified tables when dumping the database content. Tables\n\
                       are defined as a semicolon separated list of names. Cannot be used with --skip-tables.\n\
+\n\
+  geodiff index [OPTIONS...] DB\n\
+\n\
+    Creates or refreshes row hash index in database DB (SQLite or GeoPackage). The index\n\
+    holds hashes of blocks of rows of tables with INTEGER PRIMARY KEY, so that 'diff' with\n\
+    \"row_hash_index\" option of the sqlite driver only needs to compare blocks of rows\n\
+    that differ. The index is stored in the database (tables and triggers with names\n\
+    starting with \"geodiff_row_hash\"), triggers record rows modified since the index\n\
+    has been refreshed, so refreshing the index is fast if there were only few changes.\n\
+\n\
+    Options:\n\
+      --remove        Remove row hash index from the database instead\n\
 \n\
   geodiff drivers\n\
 \n\
@@ -1135,6 +1269,10 @@ int main( int argc, char *argv[] )
   {
     return handleCmdDump( context.handle(), args );
   }
+  else if ( command == "index" )
+  {
+    return handleCmdIndex( context.handle(), args );
+  }
   else if ( command == "drivers" )
   {
     return handleCmdDrivers( args );
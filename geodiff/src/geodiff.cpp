@@ -14,11 +14,13 @@
 #include "changesetutils.h"
 #include "changesetwriter.h"
 
+#include "sqlitedriver.h"
 #include "sqliteutils.h"
 
 #include <stdlib.h>
 #include <stdarg.h>
 #include <ctype.h>
+#include <cmath>
 #include <cstring>
 #include <string.h>
 
@@ -200,6 +202,102 @@ int GEODIFF_CX_setTablesToInclude( GEODIFF_ContextH contextHandle, int tablesCou
   return GEODIFF_SUCCESS;
 }
 
+int GEODIFF_CX_setColumnsToIgnore( GEODIFF_ContextH contextHandle, int columnsCount, const char **columnsToIgnore )
+{
+  Context *context = static_cast<Context *>( contextHandle );
+  if ( !context )
+  {
+    return GEODIFF_ERROR;
+  }
+
+  if ( columnsCount > 0 && !columnsToIgnore )
+  {
+    setAndLogError( context, "NULL arguments to GEODIFF_CX_setColumnsToIgnore" );
+    return GEODIFF_ERROR;
+  }
+
+  std::vector<std::string> columns;
+  for ( int i = 0; i < columnsCount; ++i )
+  {
+    columns.push_back( columnsToIgnore[i] );
+  }
+
+  context->setColumnsToIgnore( columns );
+  return GEODIFF_SUCCESS;
+}
+
+int GEODIFF_CX_setChangesetIndexEnabled( GEODIFF_ContextH contextHandle, bool enabled )
+{
+  Context *context = static_cast<Context *>( contextHandle );
+  if ( !context )
+  {
+    return GEODIFF_ERROR;
+  }
+
+  context->setChangesetIndexEnabled( enabled );
+  return GEODIFF_SUCCESS;
+}
+
+int GEODIFF_CX_setChangesetCompressionEnabled( GEODIFF_ContextH contextHandle, bool enabled )
+{
+  Context *context = static_cast<Context *>( contextHandle );
+  if ( !context )
+  {
+    return GEODIFF_ERROR;
+  }
+
+  context->setChangesetCompressionEnabled( enabled );
+  return GEODIFF_SUCCESS;
+}
+
+int GEODIFF_CX_setDiffThreadCount( GEODIFF_ContextH contextHandle, int threadCount )
+{
+  Context *context = static_cast<Context *>( contextHandle );
+  if ( !context )
+  {
+    return GEODIFF_ERROR;
+  }
+
+  if ( threadCount < 1 )
+  {
+    setAndLogError( context, "Invalid thread count in GEODIFF_CX_setDiffThreadCount: " + std::to_string( threadCount ) );
+    return GEODIFF_ERROR;
+  }
+
+  context->setDiffThreadCount( threadCount );
+  return GEODIFF_SUCCESS;
+}
+
+int GEODIFF_CX_setGeometryTolerance( GEODIFF_ContextH contextHandle, double tolerance )
+{
+  Context *context = static_cast<Context *>( contextHandle );
+  if ( !context )
+  {
+    return GEODIFF_ERROR;
+  }
+
+  if ( std::isnan( tolerance ) )
+  {
+    setAndLogError( context, "Invalid tolerance in GEODIFF_CX_setGeometryTolerance" );
+    return GEODIFF_ERROR;
+  }
+
+  context->setGeometryTolerance( tolerance );
+  return GEODIFF_SUCCESS;
+}
+
+int GEODIFF_CX_setProgressCallback( GEODIFF_ContextH contextHandle, GEODIFF_ProgressCallback progressCallback )
+{
+  Context *context = static_cast<Context *>( contextHandle );
+  if ( !context )
+  {
+    return GEODIFF_ERROR;
+  }
+
+  context->setProgressCallback( progressCallback );
+  return GEODIFF_SUCCESS;
+}
+
 const char *GEODIFF_CX_lastError( GEODIFF_ContextH contextHandle )
 {
   const Context *context = static_cast<const Context *>( contextHandle );
@@ -228,15 +326,10 @@ int GEODIFF_applyChangeset( GEODIFF_ContextH contextHandle, const char *base, co
   return GEODIFF_applyChangesetEx( contextHandle, "sqlite", nullptr, base, changeset );
 }
 
-static void createChangesetEx( const Context *context, const char *driverName, const char *driverExtraInfo,
-                               const char *base, const char *modified,
-                               const char *changeset )
+//! Returns driver opened for creation of changeset between base and modified
+static std::unique_ptr<Driver> openDiffDriver( const Context *context, const char *driverName, const char *driverExtraInfo,
+    const char *base, const char *modified )
 {
-  if ( !driverName || !base || !modified || !changeset )
-  {
-    throw GeoDiffException( "NULL arguments to GEODIFF_createChangesetEx" );
-  }
-
   std::map<std::string, std::string> conn;
   conn["base"] = std::string( base );
   conn["modified"] = std::string( modified );
@@ -246,10 +339,56 @@ static void createChangesetEx( const Context *context, const char *driverName, c
   if ( !driver )
     throw GeoDiffException( "Unable to use driver: " + std::string( driverName ) );
   driver->open( conn );
+  return driver;
+}
+
+//! Opens writer of a changeset created in memory, with index and compression as set in the context
+static void openBufferWriter( const Context *context, ChangesetWriter &writer, Buffer &output )
+{
+  writer.setIndexEnabled( context->isChangesetIndexEnabled() );
+  writer.setCompressionEnabled( context->isChangesetCompressionEnabled() );
+  writer.openBuffer( output );
+}
+
+//! Opens reader of a changeset in memory. Throws GeoDiffException on error
+static void openBufferReader( ChangesetReader &reader, const Buffer &buffer, const std::string &name )
+{
+  if ( !reader.openBuffer( buffer ) )
+    throw GeoDiffException( "Unable to read " + name + " changeset from buffer" );
+}
+
+/**
+ * Creates changeset between base and modified in memory, to be used by following steps of an operation
+ * (e.g. rebase) without a temporary file. It is not indexed nor compressed.
+ */
+static void createChangesetInBuffer( const Context *context, const char *driverName, const char *driverExtraInfo,
+                                     const char *base, const char *modified, Buffer &output )
+{
+  std::unique_ptr<Driver> driver = openDiffDriver( context, driverName, driverExtraInfo, base, modified );
+
+  ChangesetWriter writer;
+  writer.openBuffer( output );
+  driver->createChangeset( writer );
+  writer.close();
+}
+
+static void createChangesetEx( const Context *context, const char *driverName, const char *driverExtraInfo,
+                               const char *base, const char *modified,
+                               const char *changeset )
+{
+  if ( !driverName || !base || !modified || !changeset )
+  {
+    throw GeoDiffException( "NULL arguments to GEODIFF_createChangesetEx" );
+  }
+
+  std::unique_ptr<Driver> driver = openDiffDriver( context, driverName, driverExtraInfo, base, modified );
 
   ChangesetWriter writer;
+  writer.setIndexEnabled( context->isChangesetIndexEnabled() );
+  writer.setCompressionEnabled( context->isChangesetCompressionEnabled() );
   writer.open( changeset );
   driver->createChangeset( writer );
+  writer.close();
 }
 
 
@@ -303,8 +442,6 @@ static void makeCopy( const Context *context,
     throw GeoDiffException( "Cannot create driver " + dstDriverName );
   }
 
-  TmpFile tmpFileChangeset( tmpdir( ) + "geodiff_changeset" + std::to_string( rand() ) );
-
   // open source
   std::map<std::string, std::string> connSrc;
   connSrc["base"] = std::string( src );
@@ -333,11 +470,14 @@ static void makeCopy( const Context *context,
     }
   }
 
-  // get source data
+  // get source data - streamed through a temporary file rather than memory, as the dump
+  // holds the whole dataset
+  TmpFile tmpFileChangeset( tmpdir( ) + "geodiff_changeset" + std::to_string( rand() ) );
   {
     ChangesetWriter writer;
-    writer.open( tmpFileChangeset.c_path() );
+    writer.open( tmpFileChangeset.path() );
     driverSrc->dumpData( writer );
+    writer.close();
   }
 
   // create destination
@@ -352,7 +492,8 @@ static void makeCopy( const Context *context,
   // insert data to destination
   {
     ChangesetReader reader;
-    reader.open( tmpFileChangeset.c_path() );
+    if ( !reader.open( tmpFileChangeset.path() ) )
+      throw GeoDiffException( "Could not open changeset with source data: " + tmpFileChangeset.path() );
     driverDst->applyChangeset( reader );
   }
 
@@ -426,18 +567,14 @@ int GEODIFF_createChangesetDr( GEODIFF_ContextH contextHandle, const char *drive
 }
 
 
-static void applyChangesetEx(
+//! Applies changeset from an already opened reader to the base
+static void applyChangesetFromReader(
   Context *context,
   const char *driverName,
   const char *driverExtraInfo,
   const char *base,
-  const char *changeset )
+  ChangesetReader &reader )
 {
-  if ( !driverName || !base || !changeset )
-  {
-    throw GeoDiffException( "NULL arguments to GEODIFF_applyChangesetEx" );
-  }
-
   std::map<std::string, std::string> conn;
   conn["base"] = std::string( base );
   if ( driverExtraInfo )
@@ -447,9 +584,6 @@ static void applyChangesetEx(
     throw GeoDiffException( "Unable to use driver: " + std::string( driverName ) );
   driver->open( conn );
 
-  ChangesetReader reader;
-  if ( !reader.open( changeset ) )
-    throw GeoDiffException( "Unable to open changeset file for reading: " + std::string( changeset ) );
   if ( reader.isEmpty() )
   {
     context->logger().debug( "--- no changes ---" );
@@ -459,6 +593,25 @@ static void applyChangesetEx(
   driver->applyChangeset( reader );
 }
 
+static void applyChangesetEx(
+  Context *context,
+  const char *driverName,
+  const char *driverExtraInfo,
+  const char *base,
+  const char *changeset )
+{
+  if ( !driverName || !base || !changeset )
+  {
+    throw GeoDiffException( "NULL arguments to GEODIFF_applyChangesetEx" );
+  }
+
+  ChangesetReader reader;
+  if ( !reader.open( changeset ) )
+    throw GeoDiffException( "Unable to open changeset file for reading: " + std::string( changeset ) );
+
+  applyChangesetFromReader( context, driverName, driverExtraInfo, base, reader );
+}
+
 int GEODIFF_applyChangesetEx(
   GEODIFF_ContextH contextHandle,
   const char *driverName,
@@ -485,6 +638,20 @@ int GEODIFF_applyChangesetEx(
 }
 
 
+//! Writes conflicts of rebase to the conflict file as JSON, the file is not created when there are no conflicts
+static void writeConflicts( const Context *context, const std::vector<ConflictFeature> &conflicts, const char *conflictfile )
+{
+  if ( conflicts.empty() )
+  {
+    context->logger().debug( "No conflicts present" );
+  }
+  else
+  {
+    nlohmann::json res = conflictsToJSON( conflicts );
+    flushString( conflictfile, res.dump( 2 ) );
+  }
+}
+
 int GEODIFF_createRebasedChangeset(
   GEODIFF_ContextH contextHandle, const char *base,
   const char *modified,
@@ -498,7 +665,7 @@ int GEODIFF_createRebasedChangeset(
     return GEODIFF_ERROR;
   }
 
-  if ( !conflictfile )
+  if ( !base || !modified || !changeset_their || !changeset || !conflictfile )
   {
     setAndLogError( context, "NULL arguments to GEODIFF_createRebasedChangeset" );
     return GEODIFF_ERROR;
@@ -517,12 +684,33 @@ int GEODIFF_createRebasedChangeset(
       driver->open( conn );
     }
 
-    TmpFile changeset_BASE_MODIFIED( std::string( changeset ) + "_BASE_MODIFIED" );
-    int rc = GEODIFF_createChangeset( contextHandle, base, modified, changeset_BASE_MODIFIED.c_path() );
-    if ( rc != GEODIFF_SUCCESS )
-      return rc;
+    Buffer base2modified;
+    createChangesetInBuffer( context, "sqlite", nullptr, base, modified, base2modified );
+
+    ChangesetReader reader_BASE_MODIFIED;
+    openBufferReader( reader_BASE_MODIFIED, base2modified, "base2modified" );
+    ChangesetReader reader_BASE_THEIRS;
+    if ( !reader_BASE_THEIRS.open( changeset_their ) )
+      throw GeoDiffException( "Could not open changeset_BASE_THEIRS: " + std::string( changeset_their ) );
+
+    // same as with GEODIFF_createRebasedChangesetEx(), no rebased changeset is written when there is nothing to rebase
+    fileremove( changeset );
+    if ( reader_BASE_THEIRS.isEmpty() || reader_BASE_MODIFIED.isEmpty() )
+    {
+      context->logger().info( " -- no rebase needed! --\n" );
+      return GEODIFF_SUCCESS;
+    }
+
+    ChangesetWriter writer;
+    writer.setIndexEnabled( context->isChangesetIndexEnabled() );
+    writer.setCompressionEnabled( context->isChangesetCompressionEnabled() );
+    writer.open( changeset );
 
-    return GEODIFF_createRebasedChangesetEx( contextHandle, "sqlite", "", base, changeset_BASE_MODIFIED.c_path(), changeset_their, changeset, conflictfile );
+    std::vector<ConflictFeature> conflicts;
+    rebase( context, reader_BASE_THEIRS, writer, reader_BASE_MODIFIED, conflicts );
+    writer.close();
+    writeConflicts( context, conflicts, conflictfile );
+    return GEODIFF_SUCCESS;
   }
   catch ( const  GeoDiffException &exc )
   {
@@ -550,17 +738,7 @@ static void createRebasedChangesetEx(
 
   std::vector<ConflictFeature> conflicts;
   rebase( context, base2their, rebased, base2modified, conflicts );
-
-  // output conflicts
-  if ( conflicts.empty() )
-  {
-    context->logger().debug( "No conflicts present" );
-  }
-  else
-  {
-    nlohmann::json res = conflictsToJSON( conflicts );
-    flushString( conflictfile, res.dump( 2 ) );
-  }
+  writeConflicts( context, conflicts, conflictfile );
 }
 
 int GEODIFF_createRebasedChangesetEx(
@@ -641,7 +819,15 @@ int GEODIFF_changesCount(
   }
 
   int changesCount = 0;
-  ChangesetEntry entry;
+  if ( reader.hasIndex() )
+  {
+    // no need to go through the whole changeset
+    for ( const ChangesetTableIndex &t : reader.indexTables() )
+      changesCount += static_cast<int>( t.entryCount() );
+    return changesCount;
+  }
+
+  ChangesetEntryView entry;
   while ( reader.nextEntry( entry ) )
     ++changesCount;
 
@@ -712,14 +898,14 @@ int GEODIFF_listChangesSummary( GEODIFF_ContextH contextHandle, const char *chan
   return listChangesJSON( context, changeset, jsonfile, true );
 }
 
-static void invertChangesetByPath( const char *changeset, const char *changeset_inv )
+static void invertChangesetByPath( const Context *context, const char *changeset, const char *changeset_inv )
 {
   if ( !changeset )
   {
     throw GeoDiffException( "NULL arguments to GEODIFF_invertChangeset" );
   }
 
-  if ( !fileexists( changeset ) )
+  if ( !isStdioPath( changeset ) && !fileexists( changeset ) )
   {
     throw GeoDiffException( "Missing input files in GEODIFF_invertChangeset: " + std::string( changeset ) );
   }
@@ -731,9 +917,15 @@ static void invertChangesetByPath( const char *changeset, const char *changeset_
   }
 
   ChangesetWriter writer;
+  writer.setIndexEnabled( context->isChangesetIndexEnabled() );
+  writer.setCompressionEnabled( context->isChangesetCompressionEnabled() );
   writer.open( changeset_inv );
+  // inverted entries have the same size as the original ones (the compressed size is not known upfront)
+  if ( !context->isChangesetCompressionEnabled() )
+    writer.preallocate( reader.dataSize() );
 
   invertChangeset( reader, writer );
+  writer.close();
 }
 
 int GEODIFF_invertChangeset( GEODIFF_ContextH contextHandle, const char *changeset, const char *changeset_inv )
@@ -746,7 +938,7 @@ int GEODIFF_invertChangeset( GEODIFF_ContextH contextHandle, const char *changes
 
   try
   {
-    invertChangesetByPath( changeset, changeset_inv );
+    invertChangesetByPath( context, changeset, changeset_inv );
   }
   catch ( const GeoDiffException &exc )
   {
@@ -785,7 +977,7 @@ int GEODIFF_concatChanges(
   for ( int i = 0; i < inputChangesetsCount; ++i )
   {
     std::string filename = inputChangesets[i];
-    if ( !fileexists( filename ) )
+    if ( !isStdioPath( filename ) && !fileexists( filename ) )
     {
       setAndLogError( context, "Input file in GEODIFF_concatChanges does not exist: " + filename );
       return GEODIFF_ERROR;
@@ -806,6 +998,109 @@ int GEODIFF_concatChanges(
 }
 
 
+/**
+ * Rebases modified on top of changes in base2their. Changesets of the individual steps are only kept
+ * in memory. Throws GeoDiffException on error
+ */
+static void rebaseEx(
+  Context *context,
+  const char *driverName,
+  const char *driverExtraInfo,
+  const char *base,
+  const char *modified,
+  const Buffer &base2their,
+  const char *conflictfile )
+{
+  // situation 1: base2theirs is null, so we do not need rebase. modified is already fine
+  ChangesetReader reader_BASE_THEIRS;
+  openBufferReader( reader_BASE_THEIRS, base2their, "base2theirs" );
+  if ( reader_BASE_THEIRS.isEmpty() )
+    return;
+
+  Buffer base2modified;
+  try
+  {
+    createChangesetInBuffer( context, driverName, driverExtraInfo, base, modified, base2modified );
+  }
+  catch ( GeoDiffException &exc )
+  {
+    exc.addContext( "Unable to perform GEODIFF_createChangeset base2modified" );
+    throw;
+  }
+
+  // situation 2: we do not have changes (modified == base), so result is modified_theirs
+  ChangesetReader reader_BASE_MODIFIED;
+  openBufferReader( reader_BASE_MODIFIED, base2modified, "base2modified" );
+  if ( reader_BASE_MODIFIED.isEmpty() )
+  {
+    try
+    {
+      applyChangesetFromReader( context, driverName, driverExtraInfo, modified, reader_BASE_THEIRS );
+    }
+    catch ( GeoDiffException &exc )
+    {
+      exc.addContext( "Unable to perform GEODIFF_applyChangeset base2theirs" );
+      throw;
+    }
+    return;
+  }
+
+  // situation 3: we have changes both in ours and theirs
+
+  // 3A) Create all changesets
+  Buffer theirs2final;
+  try
+  {
+    ChangesetWriter writer;
+    writer.openBuffer( theirs2final );
+    std::vector<ConflictFeature> conflicts;
+    rebase( context, reader_BASE_THEIRS, writer, reader_BASE_MODIFIED, conflicts );
+    writer.close();
+    writeConflicts( context, conflicts, conflictfile );
+  }
+  catch ( GeoDiffException &exc )
+  {
+    exc.addContext( "Unable to perform GEODIFF_createChangeset theirs2final" );
+    throw;
+  }
+
+  Buffer modified2base;
+  {
+    ChangesetReader reader;
+    openBufferReader( reader, base2modified, "base2modified" );
+    ChangesetWriter writer;
+    writer.openBuffer( modified2base );
+    invertChangeset( reader, writer );
+    writer.close();
+  }
+
+  // 3B) concat to single changeset
+  Buffer modified2final;
+  {
+    ChangesetReader readerModified2base, readerBase2theirs, readerTheirs2final;
+    openBufferReader( readerModified2base, modified2base, "modified2base" );
+    openBufferReader( readerBase2theirs, base2their, "base2theirs" );
+    openBufferReader( readerTheirs2final, theirs2final, "theirs2final" );
+    ChangesetWriter writer;
+    writer.openBuffer( modified2final );
+    concatChangesets( context, { &readerModified2base, &readerBase2theirs, &readerTheirs2final }, writer );
+    writer.close();
+  }
+
+  // 3C) apply at once
+  try
+  {
+    ChangesetReader reader;
+    openBufferReader( reader, modified2final, "modified2final" );
+    applyChangesetFromReader( context, driverName, driverExtraInfo, modified, reader );
+  }
+  catch ( GeoDiffException &exc )
+  {
+    exc.addContext( "Unable to perform GEODIFF_applyChangeset modified2final" );
+    throw;
+  }
+}
+
 int GEODIFF_rebase(
   GEODIFF_ContextH contextHandle,
   const char *base,
@@ -843,12 +1138,10 @@ int GEODIFF_rebase(
     return GEODIFF_ERROR;
   }
 
-  std::string root = std::string( modified );
-
-  TmpFile base2theirs( root + "_base2theirs.bin" );
+  Buffer base2theirs;
   try
   {
-    createChangesetEx( context, "sqlite", nullptr, base, modified_their, base2theirs.c_path() );
+    createChangesetInBuffer( context, "sqlite", nullptr, base, modified_their, base2theirs );
   }
   catch ( GeoDiffException &exc )
   {
@@ -856,7 +1149,16 @@ int GEODIFF_rebase(
     return handleException( context, exc );
   }
 
-  return GEODIFF_rebaseEx( contextHandle, "sqlite", "", base, modified, base2theirs.c_path(), conflictfile );
+  try
+  {
+    rebaseEx( context, "sqlite", "", base, modified, base2theirs, conflictfile );
+  }
+  catch ( const GeoDiffException &exc )
+  {
+    return handleException( context, exc );
+  }
+
+  return GEODIFF_SUCCESS;
 }
 
 
@@ -883,94 +1185,21 @@ int GEODIFF_rebaseEx(
 
   try
   {
-    std::string root = tmpdir( ) + "geodiff_" + randomString( 6 );
+    Buffer base2theirBuffer;
+    if ( isStdioPath( base2their ) )
+      base2theirBuffer.readFileDescriptor( fileno( stdin ) );
+    else
+      base2theirBuffer.map( base2their );
 
-    // situation 1: base2theirs is null, so we do not need rebase. modified is already fine
-    if ( !GEODIFF_hasChanges( contextHandle, base2their ) )
-    {
-      return GEODIFF_SUCCESS;
-    }
+    rebaseEx( context, driverName, driverExtraInfo, base, modified, base2theirBuffer, conflictfile );
+  }
+  catch ( const GeoDiffException &exc )
+  {
+    return handleException( context, exc );
+  }
 
-    TmpFile base2modified( root + "_base2modified.bin" );
-    try
-    {
-      createChangesetEx( context, driverName, driverExtraInfo, base, modified, base2modified.c_path() );
-    }
-    catch ( GeoDiffException &exc )
-    {
-      exc.addContext( "Unable to perform GEODIFF_createChangeset base2modified" );
-      return handleException( context, exc );
-    }
-
-    // situation 2: we do not have changes (modified == base), so result is modified_theirs
-    if ( !GEODIFF_hasChanges( contextHandle, base2modified.c_path() ) )
-    {
-      try
-      {
-        applyChangesetEx( context, driverName, driverExtraInfo, modified, base2their );
-      }
-      catch ( GeoDiffException &exc )
-      {
-        exc.addContext( "Unable to perform GEODIFF_applyChangeset base2theirs" );
-        return handleException( context, exc );
-      }
-
-      return GEODIFF_SUCCESS;
-    }
-
-    // situation 3: we have changes both in ours and theirs
-
-    // 3A) Create all changesets
-    TmpFile theirs2final( root + "_theirs2final.bin" );
-    try
-    {
-      createRebasedChangesetEx( context, driverName, driverExtraInfo, base,
-                                base2modified.c_path(), base2their,
-                                theirs2final.c_path(), conflictfile );
-    }
-    catch ( GeoDiffException &exc )
-    {
-      exc.addContext( "Unable to perform GEODIFF_createChangeset theirs2final" );
-      return handleException( context, exc );
-    }
-
-    TmpFile modified2base( root + "_modified2base.bin" );
-    try
-    {
-      invertChangesetByPath( base2modified.c_path(), modified2base.c_path() );
-    }
-    catch ( GeoDiffException &exc )
-    {
-      exc.addContext( "Unable to perform GEODIFF_invertChangeset modified2base" );
-      return handleException( context, exc );
-    }
-
-    // 3B) concat to single changeset
-    TmpFile modified2final( root + "_modified2final.bin" );
-    std::vector<std::string> concatInput;
-    concatInput.push_back( modified2base.path() );
-    concatInput.push_back( base2their );
-    concatInput.push_back( theirs2final.path() );
-    concatChangesets( context, concatInput, modified2final.path() );  // throws GeoDiffException exception on error
-
-    // 3C) apply at once
-    try
-    {
-      applyChangesetEx( context, driverName, driverExtraInfo, modified, modified2final.c_path() );
-    }
-    catch ( GeoDiffException &exc )
-    {
-      exc.addContext( "Unable to perform GEODIFF_applyChangeset modified2final" );
-      return handleException( context, exc );
-    }
-
-    return GEODIFF_SUCCESS;
-  }
-  catch ( const GeoDiffException &exc )
-  {
-    return handleException( context, exc );
-  }
-}
+  return GEODIFF_SUCCESS;
+}
 
 
 int GEODIFF_makeCopy( GEODIFF_ContextH contextHandle,
@@ -1127,8 +1356,11 @@ int GEODIFF_dumpData( GEODIFF_ContextH contextHandle, const char *driverName, co
 
     // get source data
     ChangesetWriter writer;
+    writer.setIndexEnabled( context->isChangesetIndexEnabled() );
+    writer.setCompressionEnabled( context->isChangesetCompressionEnabled() );
     writer.open( changeset );
     driver->dumpData( writer );
+    writer.close();
   }
   catch ( const GeoDiffException &exc )
   {
@@ -1235,6 +1467,423 @@ int GEODIFF_schema( GEODIFF_ContextH contextHandle, const char *driverName, cons
 }
 
 
+int GEODIFF_updateRowHashIndex( GEODIFF_ContextH contextHandle, const char *db )
+{
+  Context *context = static_cast<Context *>( contextHandle );
+  if ( !context )
+  {
+    return GEODIFF_ERROR;
+  }
+
+  if ( !db )
+  {
+    setAndLogError( context, "NULL arguments to GEODIFF_updateRowHashIndex" );
+    return GEODIFF_ERROR;
+  }
+
+  try
+  {
+    SqliteDriver driver( context );
+    driver.open( Driver::sqliteParametersSingleSource( std::string( db ) ) );
+    driver.updateRowHashIndex();
+  }
+  catch ( const GeoDiffException &exc )
+  {
+    return handleException( context, exc );
+  }
+
+  return GEODIFF_SUCCESS;
+}
+
+int GEODIFF_removeRowHashIndex( GEODIFF_ContextH contextHandle, const char *db )
+{
+  Context *context = static_cast<Context *>( contextHandle );
+  if ( !context )
+  {
+    return GEODIFF_ERROR;
+  }
+
+  if ( !db )
+  {
+    setAndLogError( context, "NULL arguments to GEODIFF_removeRowHashIndex" );
+    return GEODIFF_ERROR;
+  }
+
+  try
+  {
+    SqliteDriver driver( context );
+    driver.open( Driver::sqliteParametersSingleSource( std::string( db ) ) );
+    driver.removeRowHashIndex();
+  }
+  catch ( const GeoDiffException &exc )
+  {
+    return handleException( context, exc );
+  }
+
+  return GEODIFF_SUCCESS;
+}
+
+
+GEODIFF_BufferH GEODIFF_createBuffer( GEODIFF_ContextH contextHandle, const char *data, int64_t size )
+{
+  Context *context = static_cast<Context *>( contextHandle );
+  if ( !context )
+  {
+    return nullptr;
+  }
+
+  if ( size < 0 || ( size > 0 && !data ) )
+  {
+    setAndLogError( context, "Invalid arguments to GEODIFF_createBuffer" );
+    return nullptr;
+  }
+
+  try
+  {
+    std::unique_ptr<Buffer> buffer( new Buffer );
+    char *z = buffer->allocate( size );
+    if ( size > 0 )
+      memcpy( z, data, ( size_t ) size );
+    return buffer.release();
+  }
+  catch ( const GeoDiffException &exc )
+  {
+    handleException( context, exc );
+    return nullptr;
+  }
+}
+
+int64_t GEODIFF_B_size( GEODIFF_ContextH /*contextHandle*/, GEODIFF_BufferH bufferHandle )
+{
+  return static_cast<const Buffer *>( bufferHandle )->size();
+}
+
+const char *GEODIFF_B_data( GEODIFF_ContextH /*contextHandle*/, GEODIFF_BufferH bufferHandle )
+{
+  return static_cast<const Buffer *>( bufferHandle )->c_buf();
+}
+
+void GEODIFF_B_destroy( GEODIFF_ContextH /*contextHandle*/, GEODIFF_BufferH bufferHandle )
+{
+  delete static_cast<Buffer *>( bufferHandle );
+}
+
+//! Opens writer to append to the given buffer, with changeset options taken from the context
+int GEODIFF_createChangesetToBuffer(
+  GEODIFF_ContextH contextHandle,
+  const char *driverName,
+  const char *driverExtraInfo,
+  const char *base,
+  const char *modified,
+  GEODIFF_BufferH *changeset )
+{
+  Context *context = static_cast<Context *>( contextHandle );
+  if ( !context )
+  {
+    return GEODIFF_ERROR;
+  }
+
+  if ( !driverName || !base || !modified || !changeset )
+  {
+    setAndLogError( context, "NULL arguments to GEODIFF_createChangesetToBuffer" );
+    return GEODIFF_ERROR;
+  }
+  *changeset = nullptr;
+
+  try
+  {
+    std::unique_ptr<Driver> driver = openDiffDriver( context, driverName, driverExtraInfo, base, modified );
+
+    std::unique_ptr<Buffer> output( new Buffer );
+    ChangesetWriter writer;
+    openBufferWriter( context, writer, *output );
+    driver->createChangeset( writer );
+    writer.close();
+    *changeset = output.release();
+  }
+  catch ( const GeoDiffException &exc )
+  {
+    return handleException( context, exc );
+  }
+
+  return GEODIFF_SUCCESS;
+}
+
+int GEODIFF_applyChangesetFromBuffer(
+  GEODIFF_ContextH contextHandle,
+  const char *driverName,
+  const char *driverExtraInfo,
+  const char *base,
+  GEODIFF_BufferH changeset )
+{
+  Context *context = static_cast<Context *>( contextHandle );
+  if ( !context )
+  {
+    return GEODIFF_ERROR;
+  }
+
+  if ( !driverName || !base || !changeset )
+  {
+    setAndLogError( context, "NULL arguments to GEODIFF_applyChangesetFromBuffer" );
+    return GEODIFF_ERROR;
+  }
+
+  try
+  {
+    ChangesetReader reader;
+    if ( !reader.openBuffer( *static_cast<const Buffer *>( changeset ) ) )
+      throw GeoDiffException( "Unable to read changeset from buffer" );
+
+    applyChangesetFromReader( context, driverName, driverExtraInfo, base, reader );
+  }
+  catch ( const GeoDiffException &exc )
+  {
+    return handleException( context, exc );
+  }
+
+  return GEODIFF_SUCCESS;
+}
+
+int GEODIFF_concatChangesBuffers(
+  GEODIFF_ContextH contextHandle,
+  int inputChangesetsCount,
+  const GEODIFF_BufferH *inputChangesets,
+  GEODIFF_BufferH *outputChangeset )
+{
+  Context *context = static_cast<Context *>( contextHandle );
+  if ( !context )
+  {
+    return GEODIFF_ERROR;
+  }
+
+  if ( inputChangesetsCount < 2 )
+  {
+    setAndLogError( context, "Need at least two input changesets in GEODIFF_concatChangesBuffers" );
+    return GEODIFF_ERROR;
+  }
+
+  if ( !inputChangesets || !outputChangeset )
+  {
+    setAndLogError( context, "NULL arguments to GEODIFF_concatChangesBuffers" );
+    return GEODIFF_ERROR;
+  }
+  *outputChangeset = nullptr;
+
+  try
+  {
+    std::vector<std::unique_ptr<ChangesetReader>> readers;
+    std::vector<ChangesetReader *> readerPtrs;
+    for ( int i = 0; i < inputChangesetsCount; ++i )
+    {
+      if ( !inputChangesets[i] )
+        throw GeoDiffException( "NULL input changeset in GEODIFF_concatChangesBuffers" );
+      readers.emplace_back( new ChangesetReader );
+      if ( !readers.back()->openBuffer( *static_cast<const Buffer *>( inputChangesets[i] ) ) )
+        throw GeoDiffException( "Unable to read input changeset " + std::to_string( i ) + " in GEODIFF_concatChangesBuffers" );
+      readerPtrs.push_back( readers.back().get() );
+    }
+
+    std::unique_ptr<Buffer> output( new Buffer );
+    ChangesetWriter writer;
+    openBufferWriter( context, writer, *output );
+    concatChangesets( context, readerPtrs, writer );
+    writer.close();
+    *outputChangeset = output.release();
+  }
+  catch ( const GeoDiffException &exc )
+  {
+    return handleException( context, exc );
+  }
+
+  return GEODIFF_SUCCESS;
+}
+
+int GEODIFF_createRebasedChangesetBuffer(
+  GEODIFF_ContextH contextHandle,
+  const char *driverName,
+  const char * /* driverExtraInfo */,
+  const char *base,
+  GEODIFF_BufferH base2modified,
+  GEODIFF_BufferH base2their,
+  GEODIFF_BufferH *rebased,
+  GEODIFF_BufferH *conflicts )
+{
+  Context *context = static_cast<Context *>( contextHandle );
+  if ( !context )
+  {
+    return GEODIFF_ERROR;
+  }
+
+  if ( !driverName || !base || !base2modified || !base2their || !rebased || !conflicts )
+  {
+    setAndLogError( context, "NULL arguments to GEODIFF_createRebasedChangesetBuffer" );
+    return GEODIFF_ERROR;
+  }
+  *rebased = nullptr;
+  *conflicts = nullptr;
+
+  try
+  {
+    ChangesetReader reader_BASE_MODIFIED;
+    if ( !reader_BASE_MODIFIED.openBuffer( *static_cast<const Buffer *>( base2modified ) ) )
+      throw GeoDiffException( "Unable to read base2modified changeset from buffer" );
+    ChangesetReader reader_BASE_THEIRS;
+    if ( !reader_BASE_THEIRS.openBuffer( *static_cast<const Buffer *>( base2their ) ) )
+      throw GeoDiffException( "Unable to read base2their changeset from buffer" );
+
+    std::unique_ptr<Buffer> output( new Buffer );
+    ChangesetWriter writer;
+    openBufferWriter( context, writer, *output );
+
+    std::vector<ConflictFeature> conflictFeatures;
+    rebase( context, reader_BASE_THEIRS, writer, reader_BASE_MODIFIED, conflictFeatures );
+    writer.close();
+
+    std::unique_ptr<Buffer> conflictsOutput( new Buffer );
+    if ( conflictFeatures.empty() )
+    {
+      context->logger().debug( "No conflicts present" );
+    }
+    else
+    {
+      std::string json = conflictsToJSON( conflictFeatures ).dump( 2 );
+      conflictsOutput->append( json.data(), ( int64_t ) json.size() );
+    }
+
+    *rebased = output.release();
+    *conflicts = conflictsOutput.release();
+  }
+  catch ( const GeoDiffException &exc )
+  {
+    return handleException( context, exc );
+  }
+
+  return GEODIFF_SUCCESS;
+}
+
+GEODIFF_ChangeCaptureH GEODIFF_startChangeCapture( GEODIFF_ContextH contextHandle, const char *db )
+{
+  Context *context = static_cast<Context *>( contextHandle );
+  if ( !context )
+  {
+    return nullptr;
+  }
+
+  if ( !db )
+  {
+    setAndLogError( context, "NULL arguments to GEODIFF_startChangeCapture" );
+    return nullptr;
+  }
+
+  try
+  {
+    std::unique_ptr<SqliteDriver> driver( new SqliteDriver( context ) );
+    driver->open( Driver::sqliteParametersSingleSource( std::string( db ) ) );
+    driver->startChangeCapture();
+    return driver.release();
+  }
+  catch ( const GeoDiffException &exc )
+  {
+    handleException( context, exc );
+    return nullptr;
+  }
+}
+
+int GEODIFF_CC_exec( GEODIFF_ContextH contextHandle, GEODIFF_ChangeCaptureH captureHandle, const char *sql )
+{
+  Context *context = static_cast<Context *>( contextHandle );
+  if ( !context )
+  {
+    return GEODIFF_ERROR;
+  }
+
+  if ( !captureHandle || !sql )
+  {
+    setAndLogError( context, "NULL arguments to GEODIFF_CC_exec" );
+    return GEODIFF_ERROR;
+  }
+
+  try
+  {
+    static_cast<SqliteDriver *>( captureHandle )->executeSql( std::string( sql ) );
+  }
+  catch ( const GeoDiffException &exc )
+  {
+    return handleException( context, exc );
+  }
+
+  return GEODIFF_SUCCESS;
+}
+
+int GEODIFF_CC_writeChangeset( GEODIFF_ContextH contextHandle, GEODIFF_ChangeCaptureH captureHandle, const char *changeset )
+{
+  Context *context = static_cast<Context *>( contextHandle );
+  if ( !context )
+  {
+    return GEODIFF_ERROR;
+  }
+
+  if ( !captureHandle || !changeset )
+  {
+    setAndLogError( context, "NULL arguments to GEODIFF_CC_writeChangeset" );
+    return GEODIFF_ERROR;
+  }
+
+  try
+  {
+    ChangesetWriter writer;
+    writer.setIndexEnabled( context->isChangesetIndexEnabled() );
+    writer.setCompressionEnabled( context->isChangesetCompressionEnabled() );
+    writer.open( changeset );
+    static_cast<SqliteDriver *>( captureHandle )->writeCapturedChangeset( writer );
+    writer.close();
+  }
+  catch ( const GeoDiffException &exc )
+  {
+    return handleException( context, exc );
+  }
+
+  return GEODIFF_SUCCESS;
+}
+
+int GEODIFF_CC_writeChangesetToBuffer( GEODIFF_ContextH contextHandle, GEODIFF_ChangeCaptureH captureHandle, GEODIFF_BufferH *changeset )
+{
+  Context *context = static_cast<Context *>( contextHandle );
+  if ( !context )
+  {
+    return GEODIFF_ERROR;
+  }
+
+  if ( !captureHandle || !changeset )
+  {
+    setAndLogError( context, "NULL arguments to GEODIFF_CC_writeChangesetToBuffer" );
+    return GEODIFF_ERROR;
+  }
+  *changeset = nullptr;
+
+  try
+  {
+    std::unique_ptr<Buffer> output( new Buffer );
+    ChangesetWriter writer;
+    openBufferWriter( context, writer, *output );
+    static_cast<SqliteDriver *>( captureHandle )->writeCapturedChangeset( writer );
+    writer.close();
+    *changeset = output.release();
+  }
+  catch ( const GeoDiffException &exc )
+  {
+    return handleException( context, exc );
+  }
+
+  return GEODIFF_SUCCESS;
+}
+
+void GEODIFF_CC_destroy( GEODIFF_ContextH /*contextHandle*/, GEODIFF_ChangeCaptureH captureHandle )
+{
+  delete static_cast<SqliteDriver *>( captureHandle );
+}
+
+
 GEODIFF_ChangesetReaderH GEODIFF_readChangeset( GEODIFF_ContextH contextHandle, const char *changeset )
 {
   Context *context = static_cast<Context *>( contextHandle );
@@ -1358,14 +2007,14 @@ void GEODIFF_V_destroy( GEODIFF_ContextH /*contextHandle*/, GEODIFF_ValueH value
 
 int GEODIFF_V_getDataSize( GEODIFF_ContextH /*contextHandle*/, GEODIFF_ValueH valueHandle )
 {
-  size_t ret = static_cast<Value *>( valueHandle )->getString().size();
+  size_t ret = static_cast<Value *>( valueHandle )->getStringSize();
   return ( int ) ret;
 }
 
 void GEODIFF_V_getData( GEODIFF_ContextH /*contextHandle*/, GEODIFF_ValueH valueHandle, char *data )
 {
-  const std::string &str = static_cast<Value *>( valueHandle )->getString();
-  memcpy( data, str.data(), str.size() );
+  const Value *value = static_cast<Value *>( valueHandle );
+  memcpy( data, value->getStringData(), value->getStringSize() );
 }
 
 const char *GEODIFF_CT_name( GEODIFF_ContextH /*contextHandle*/, GEODIFF_ChangesetTableH tableHandle )
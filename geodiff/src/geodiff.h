@@ -40,6 +40,7 @@
 #define GEODIFF_ERROR 1 //!< General error
 #define GEODIFF_CONFLICTS 2 //!< The changeset couldn't be applied directly
 #define GEODIFF_UNSUPPORTED_CHANGE 3 //! The diff for such entry is unsupported/not-implemented
+#define GEODIFF_CANCELLED 4 //!< The operation was cancelled by the progress callback
 
 /*
 ** Make sure we can call this stuff from C++.
@@ -127,6 +128,94 @@ GEODIFF_EXPORT int GEODIFF_CX_setTablesToSkip( GEODIFF_ContextH contextHandle, i
  */
 GEODIFF_EXPORT int GEODIFF_CX_setTablesToInclude( GEODIFF_ContextH contextHandle, int tablesCount, const char **tablesToInclude );
 
+/**
+ * Set list of columns that are not compared when creating changesets. Changes of values
+ * in these columns alone do not make a row updated, and when a row is updated because
+ * of other columns, the ignored columns are written as unchanged. Inserted and deleted
+ * rows still contain values of all columns. Useful for columns with bookkeeping data
+ * (e.g. time of last edit) that change on every save.
+ *
+ * Each entry is either a column name (to ignore the column in all tables) or a name
+ * in "table.column" format. Primary key columns are always compared.
+ *
+ * If empty list is passed, list will be reset.
+ */
+GEODIFF_EXPORT int GEODIFF_CX_setColumnsToIgnore( GEODIFF_ContextH contextHandle, int columnsCount, const char **columnsToIgnore );
+
+/**
+ * Set whether changesets written using this context (create changeset, rebase, concat,
+ * invert, dump data) should contain an index of tables at the end. The index allows
+ * to count changes, get summary or seek to a particular table without reading
+ * the whole changeset. Changesets with the index are still readable by older versions
+ * of geodiff, but they are not byte-identical to changesets without the index.
+ *
+ * Disabled by default.
+ */
+GEODIFF_EXPORT int GEODIFF_CX_setChangesetIndexEnabled( GEODIFF_ContextH contextHandle, bool enabled );
+
+/**
+ * Set whether changesets written using this context (create changeset, rebase, concat,
+ * invert, dump data) should be compressed. Compressed changesets are split into blocks
+ * that are compressed independently, they are typically several times smaller and they
+ * are read transparently by all geodiff functions. They are not readable by older versions
+ * of geodiff or by sqlite3 session extension.
+ *
+ * Note that a compressed changeset is decompressed to memory as a whole when it is read (unlike
+ * uncompressed changeset files, which are memory-mapped), so reading it needs memory for its
+ * full uncompressed size.
+ *
+ * Disabled by default.
+ */
+GEODIFF_EXPORT int GEODIFF_CX_setChangesetCompressionEnabled( GEODIFF_ContextH contextHandle, bool enabled );
+
+/**
+ * Set number of threads used when creating changesets between two databases. When set to more
+ * than one thread, tables are compared concurrently, each thread using its own connections
+ * to the databases, and the results are written to the changeset in the same order as when
+ * using a single thread. Logger callback may then get called from the worker threads
+ * (calls are serialized). Currently only used by the sqlite driver.
+ *
+ * Defaults to 1 (all tables are compared in the calling thread).
+ */
+GEODIFF_EXPORT int GEODIFF_CX_setDiffThreadCount( GEODIFF_ContextH contextHandle, int threadCount );
+
+/**
+ * Set tolerance for comparison of geometries when creating changesets. When set, geometries
+ * that differ only in their GeoPackage header (e.g. envelope, byte order of WKB) or whose
+ * coordinates differ at most by the tolerance are not considered updated. Geometries
+ * must still have the same type, number of parts and points and the same SRS id.
+ * Tolerance of zero only ignores differences in encoding.
+ *
+ * Defaults to -1 (negative value: geometries are compared byte by byte).
+ */
+GEODIFF_EXPORT int GEODIFF_CX_setGeometryTolerance( GEODIFF_ContextH contextHandle, double tolerance );
+
+/**
+ * Callback function pointer to report progress of long-running operations
+ *
+ * It is called when processing of a table starts and then regularly while processing
+ * entries of the table (rows or changeset entries):
+ * - tableName: name of the table being processed (empty string when the operation has finished)
+ * - tablesDone: number of tables that have been fully processed
+ * - tablesTotal: total number of tables, or -1 if not known in advance (e.g. when
+ *   reading tables from a changeset)
+ * - entriesDone: number of entries of the current table processed so far
+ *
+ * The callback returns true to continue, or false to cancel the operation. A cancelled
+ * operation returns GEODIFF_CANCELLED and any changes it made to a database are rolled back.
+ */
+typedef bool ( *GEODIFF_ProgressCallback )( const char *tableName, int tablesDone, int tablesTotal, int64_t entriesDone );
+
+/**
+ * Assign callback to report progress of GEODIFF_createChangeset(), GEODIFF_applyChangeset(),
+ * GEODIFF_concatChanges(), GEODIFF_rebase() and GEODIFF_makeCopy() (and their variants),
+ * which may also be cancelled by the callback. Changeset creation reports only tables.
+ * The callback is always called from the thread that called the operation.
+ *
+ * When progressCallback is nullptr (the default), no progress is reported.
+ */
+GEODIFF_EXPORT int GEODIFF_CX_setProgressCallback( GEODIFF_ContextH contextHandle, GEODIFF_ProgressCallback progressCallback );
+
 /**
  * Return null-terminated message of last error that occurred using this context.
  * Consider the pointer invalid after any call to the GeoDiff API.
@@ -163,7 +252,7 @@ GEODIFF_EXPORT bool GEODIFF_driverIsRegistered( GEODIFF_ContextH contextHandle,
  *
  * \param base [input] BASE sqlite3/geopackage file
  * \param modified [input] MODIFIED sqlite3/geopackage file
- * \param changeset [output] changeset between BASE -> MODIFIED
+ * \param changeset [output] changeset between BASE -> MODIFIED ("-" writes it to the standard output)
  * \returns GEODIFF_SUCCESS on success
  */
 GEODIFF_EXPORT int GEODIFF_createChangeset(
@@ -202,6 +291,9 @@ GEODIFF_EXPORT int GEODIFF_invertChangeset(
  * \param base [input] BASE sqlite3/geopackage file
  * \param modified [input] MODIFIED sqlite3/geopackage file
  * \param changeset_their [input] changeset between BASE -> MODIFIED_THEIR
+ * The changeset between BASE and MODIFIED is kept in memory (not in a temporary file),
+ * so memory use grows with the size of the local changes.
+ *
  * \param changeset [output] changeset between MODIFIED_THEIR -> MODIFIED_THEIR_PLUS_MINE . If CHANGESET_THEIR is empty changeset, file is not created. If BASE == MODIFIED, file is not created
  * \param conflictfile [output] json file containing all the automaticly resolved conflicts. If there are no conflicts, file is not created
  * \returns GEODIFF_SUCCESS on success
@@ -231,6 +323,9 @@ GEODIFF_EXPORT int GEODIFF_createRebasedChangeset(
  * Note, when rebase is not successfull, modified could be in random state.
  * This works in general, even when base==modified, or base==modified_theirs
  *
+ * Intermediate changesets of the steps are kept in memory (not in temporary files),
+ * so memory use grows with the size of both local and their changes.
+ *
  * \param base [input] BASE sqlite3/geopackage file
  * \param modified_their [input] MODIFIED sqlite3/geopackage file
  * \param modified [input/output] local copy of the changes to be rebased
@@ -256,7 +351,7 @@ GEODIFF_EXPORT int GEODIFF_rebase(
  * With WARN logging level client should be able to see the place of conflicts.
  *
  * \param base [input/output] BASE sqlite3/geopackage file
- * \param changeset [input] changeset to apply to BASE
+ * \param changeset [input] changeset to apply to BASE ("-" reads it from the standard input)
  * \returns GEODIFF_SUCCESS on success
  *          GEODIFF_CONFLICTS if the changeset was applied but conflicts were found
  */
@@ -332,7 +427,11 @@ GEODIFF_EXPORT int GEODIFF_concatChanges(
  * Supported drivers:
  *
  * - "sqlite" - does not need extra connection info (may be null). A dataset is a single Sqlite3
- *   database (a GeoPackage) - a path to a local file is expected.
+ *   database (a GeoPackage) - a path to a local file is expected. Extra connection info may contain
+ *   space separated options: "row_hash_index" (see GEODIFF_updateRowHashIndex()) or "bulk_apply"
+ *   to speed up applying of large changesets: indexes of modified tables get rebuilt once at the end
+ *   and the database is not synced to disk during the apply (the database may get corrupted if the
+ *   operating system crashes or power is lost meanwhile).
  *
  * - "postgres" - only available if compiled with postgres support. Needs extra connection info
  *   argument which is passed to libpq's PQconnectdb(), see PostgreSQL docs for syntax.
@@ -425,6 +524,10 @@ GEODIFF_EXPORT int GEODIFF_createRebasedChangesetEx(
 /**
  * This function takes care of updating "modified" dataset by taking any changes between "base"
  * and "modified" datasets and rebasing them on top of base2their changeset.
+ *
+ * Like in GEODIFF_rebase(), intermediate changesets are kept in memory, so memory use grows with
+ * the size of the changes. The base2their changeset file is memory-mapped (or read to memory when
+ * it is the standard input).
  */
 GEODIFF_EXPORT int GEODIFF_rebaseEx(
   GEODIFF_ContextH contextHandle,
@@ -457,6 +560,150 @@ GEODIFF_EXPORT int GEODIFF_schema(
   const char *json );
 
 
+/**
+ * Creates or refreshes row hash index in a SQLite/GeoPackage database. The index holds hashes
+ * of blocks of rows of all tables with INTEGER PRIMARY KEY and it is stored in the database
+ * itself (in tables and triggers with names starting with "geodiff_row_hash"). When both databases
+ * have the index and changeset is created with "row_hash_index" option of the sqlite driver
+ * (see GEODIFF_createChangesetEx()), only blocks of rows that may differ are compared instead
+ * of all rows. The triggers record blocks of rows modified since the index has been refreshed,
+ * so refreshing the index only re-calculates hashes of those blocks.
+ */
+GEODIFF_EXPORT int GEODIFF_updateRowHashIndex(
+  GEODIFF_ContextH contextHandle,
+  const char *db );
+
+/**
+ * Removes row hash index (see GEODIFF_updateRowHashIndex()) from a SQLite/GeoPackage database.
+ */
+GEODIFF_EXPORT int GEODIFF_removeRowHashIndex(
+  GEODIFF_ContextH contextHandle,
+  const char *db );
+
+
+/**
+ * In-memory changesets
+ *
+ * The following functions work with changesets held in memory buffers instead of files,
+ * so that callers (e.g. a server handling uploads) do not need to go through temporary files.
+ * Buffers contain exactly the same bytes as the changeset files would.
+ */
+typedef void *GEODIFF_BufferH;
+
+/**
+ * Creates a new buffer with a copy of the given data. The data may be NULL if size is zero.
+ * Returns NULL on error. The buffer must be freed with GEODIFF_B_destroy()
+ */
+GEODIFF_EXPORT GEODIFF_BufferH GEODIFF_createBuffer( GEODIFF_ContextH contextHandle, const char *data, int64_t size );
+
+//! Returns size of the buffer's content in bytes
+GEODIFF_EXPORT int64_t GEODIFF_B_size( GEODIFF_ContextH contextHandle, GEODIFF_BufferH bufferHandle );
+
+//! Returns pointer to the buffer's content (valid until the buffer is destroyed). May be NULL for an empty buffer
+GEODIFF_EXPORT const char *GEODIFF_B_data( GEODIFF_ContextH contextHandle, GEODIFF_BufferH bufferHandle );
+
+//! Frees the buffer
+GEODIFF_EXPORT void GEODIFF_B_destroy( GEODIFF_ContextH contextHandle, GEODIFF_BufferH bufferHandle );
+
+/**
+ * Same as GEODIFF_createChangesetEx(), but the changeset is written to a new buffer.
+ * On success, the caller owns the returned buffer and must free it with GEODIFF_B_destroy()
+ */
+GEODIFF_EXPORT int GEODIFF_createChangesetToBuffer(
+  GEODIFF_ContextH contextHandle,
+  const char *driverName,
+  const char *driverExtraInfo,
+  const char *base,
+  const char *modified,
+  GEODIFF_BufferH *changeset );
+
+/**
+ * Same as GEODIFF_applyChangesetEx(), but the changeset is read from a buffer
+ */
+GEODIFF_EXPORT int GEODIFF_applyChangesetFromBuffer(
+  GEODIFF_ContextH contextHandle,
+  const char *driverName,
+  const char *driverExtraInfo,
+  const char *base,
+  GEODIFF_BufferH changeset );
+
+/**
+ * Same as GEODIFF_concatChanges(), but input changesets are read from buffers and the result
+ * is written to a new buffer. On success, the caller owns the returned buffer.
+ */
+GEODIFF_EXPORT int GEODIFF_concatChangesBuffers(
+  GEODIFF_ContextH contextHandle,
+  int inputChangesetsCount,
+  const GEODIFF_BufferH *inputChangesets,
+  GEODIFF_BufferH *outputChangeset );
+
+/**
+ * Same as GEODIFF_createRebasedChangesetEx(), but changesets are read from buffers and the rebased
+ * changeset is written to a new buffer. Conflicts are written as JSON to another new buffer,
+ * which is empty if there are no conflicts. On success, the caller owns both returned buffers.
+ */
+GEODIFF_EXPORT int GEODIFF_createRebasedChangesetBuffer(
+  GEODIFF_ContextH contextHandle,
+  const char *driverName,
+  const char *driverExtraInfo,
+  const char *base,
+  GEODIFF_BufferH base2modified,
+  GEODIFF_BufferH base2their,
+  GEODIFF_BufferH *rebased,
+  GEODIFF_BufferH *conflicts );
+
+
+/**
+ * Change capture
+ *
+ * Instead of comparing a modified SQLite/GeoPackage database to its base copy, changes can be
+ * captured while they are being made (using SQLite session extension), so that writing a changeset
+ * costs only as much as the number of changes and no base copy of the database is needed.
+ * Changes need to be made through the capture's own connection to the database (see GEODIFF_CC_exec()).
+ * Tables are filtered the same way as when creating changesets (GeoPackage metadata tables
+ * and tables set with GEODIFF_CX_setTablesToSkip() / GEODIFF_CX_setTablesToInclude() are ignored).
+ * Only available if SQLite library has been built with session extension.
+ */
+typedef void *GEODIFF_ChangeCaptureH;
+
+/**
+ * Opens a SQLite/GeoPackage database and starts capturing its changes. Returns NULL on error.
+ * The capture must be freed with GEODIFF_CC_destroy()
+ */
+GEODIFF_EXPORT GEODIFF_ChangeCaptureH GEODIFF_startChangeCapture(
+  GEODIFF_ContextH contextHandle,
+  const char *db );
+
+//! Executes SQL statement(s) on the database of the capture
+GEODIFF_EXPORT int GEODIFF_CC_exec(
+  GEODIFF_ContextH contextHandle,
+  GEODIFF_ChangeCaptureH captureHandle,
+  const char *sql );
+
+/**
+ * Writes all changes captured so far to a changeset file. Multiple changes of a row are written
+ * as a single entry. Capturing continues, so a later call writes these changes again with any
+ * newer changes.
+ */
+GEODIFF_EXPORT int GEODIFF_CC_writeChangeset(
+  GEODIFF_ContextH contextHandle,
+  GEODIFF_ChangeCaptureH captureHandle,
+  const char *changeset );
+
+/**
+ * Same as GEODIFF_CC_writeChangeset(), but the changeset is written to a new buffer.
+ * On success, the caller owns the returned buffer and must free it with GEODIFF_B_destroy()
+ */
+GEODIFF_EXPORT int GEODIFF_CC_writeChangesetToBuffer(
+  GEODIFF_ContextH contextHandle,
+  GEODIFF_ChangeCaptureH captureHandle,
+  GEODIFF_BufferH *changeset );
+
+//! Stops capturing changes and closes the database
+GEODIFF_EXPORT void GEODIFF_CC_destroy(
+  GEODIFF_ContextH contextHandle,
+  GEODIFF_ChangeCaptureH captureHandle );
+
 typedef void *GEODIFF_ChangesetReaderH;
 typedef void *GEODIFF_ChangesetEntryH;
 typedef void *GEODIFF_ChangesetTableH;
@@ -72,6 +72,18 @@ bool Context::isTableSkipped( const std::string &tableName ) const
   return false;
 }
 
+bool Context::isColumnIgnored( const std::string &tableName, const std::string &columnName ) const
+{
+  if ( mColumnsToIgnore.empty() )
+    return false;
+
+  std::string qualifiedName = tableName + "." + columnName;
+  return std::any_of( mColumnsToIgnore.begin(), mColumnsToIgnore.end(), [&]( const std::string &column )
+  {
+    return column == columnName || column == qualifiedName;
+  } );
+}
+
 void Context::setLastError( const std::string &message )
 {
   mLastError = message;
@@ -86,3 +98,45 @@ TablesFilterMode Context::tableFilterMode() const
 {
   return mTablesFilterMode;
 }
+
+void Context::reportProgress( const std::string &tableName, int tablesDone, int tablesTotal, int64_t entriesDone ) const
+{
+  if ( mProgressCallback && !mProgressCallback( tableName.c_str(), tablesDone, tablesTotal, entriesDone ) )
+    throw GeoDiffCancelledException( "Operation cancelled" );
+}
+
+void ProgressReporter::startTable( const std::string &tableName )
+{
+  ++mTablesDone;
+  mTableName = tableName;
+  mEntriesDone = 0;
+  mContext->reportProgress( mTableName, mTablesDone, mTablesTotal, mEntriesDone );
+}
+
+void ProgressReporter::setEntriesDone( int64_t entriesDone )
+{
+  mEntriesDone = entriesDone;
+  mContext->reportProgress( mTableName, mTablesDone, mTablesTotal, mEntriesDone );
+}
+
+void ProgressReporter::entriesStepDone()
+{
+  if ( mSharedEntriesDone )
+  {
+    *mSharedEntriesDone += ENTRIES_STEP;
+    if ( *mCancelled )
+      throw GeoDiffCancelledException( "Operation cancelled" );
+  }
+  else if ( mContext->hasProgressCallback() )
+  {
+    mContext->reportProgress( mTableName, mTablesDone, mTablesTotal, mEntriesDone );
+  }
+}
+
+void ProgressReporter::finish()
+{
+  ++mTablesDone;
+  mTableName.clear();
+  mEntriesDone = 0;
+  mContext->reportProgress( mTableName, mTablesDone, mTablesTotal == -1 ? mTablesDone : mTablesTotal, mEntriesDone );
+}
@@ -6,6 +6,7 @@
 #ifndef GEODIFFCONTEXT_H
 #define GEODIFFCONTEXT_H
 
+#include <atomic>
 #include <string>
 #include <vector>
 
@@ -34,12 +35,113 @@ class Context
     const std::string &lastError() const;
     TablesFilterMode tableFilterMode() const;
 
+    /**
+     * Sets columns that are not compared when looking for updated rows. Each entry is either
+     * a column name (the column is ignored in all tables) or "table.column".
+     */
+    void setColumnsToIgnore( const std::vector<std::string> &columnsToIgnore ) { mColumnsToIgnore = columnsToIgnore; }
+    bool isColumnIgnored( const std::string &tableName, const std::string &columnName ) const;
+
+    /**
+     * Sets tolerance for comparison of geometries when creating changesets: geometries are then considered
+     * equal if their coordinates differ at most by the tolerance, and differences in GeoPackage header
+     * (e.g. envelope) are ignored. Negative value (the default) means geometries are compared byte by byte.
+     */
+    void setGeometryTolerance( double tolerance ) { mGeometryTolerance = tolerance; }
+    double geometryTolerance() const { return mGeometryTolerance; }
+
+    //! Sets whether written changesets should contain an index of tables
+    void setChangesetIndexEnabled( bool enabled ) { mChangesetIndexEnabled = enabled; }
+    bool isChangesetIndexEnabled() const { return mChangesetIndexEnabled; }
+
+    //! Sets whether written changesets should use the compressed container format
+    void setChangesetCompressionEnabled( bool enabled ) { mChangesetCompressionEnabled = enabled; }
+    bool isChangesetCompressionEnabled() const { return mChangesetCompressionEnabled; }
+
+    //! Sets number of threads used to compare tables when creating changesets (1 = no extra threads)
+    void setDiffThreadCount( int count ) { mDiffThreadCount = count; }
+    int diffThreadCount() const { return mDiffThreadCount; }
+
+    //! Sets callback to report progress of long-running operations (may be nullptr)
+    void setProgressCallback( GEODIFF_ProgressCallback callback ) { mProgressCallback = callback; }
+    bool hasProgressCallback() const { return mProgressCallback != nullptr; }
+
+    /**
+     * Passes progress to the progress callback (if set) - see GEODIFF_ProgressCallback.
+     * Throws GeoDiffCancelledException if the callback asks to cancel the operation.
+     */
+    void reportProgress( const std::string &tableName, int tablesDone, int tablesTotal, int64_t entriesDone ) const;
+
   private:
     Logger mLogger;
     std::vector<std::string> mTablesToSkip;
     std::vector<std::string> mTablesToInclude;
+    std::vector<std::string> mColumnsToIgnore;
     std::string mLastError;
     TablesFilterMode mTablesFilterMode = TablesFilterMode::None;
+    bool mChangesetIndexEnabled = false;
+    bool mChangesetCompressionEnabled = false;
+    int mDiffThreadCount = 1;
+    double mGeometryTolerance = -1;
+    GEODIFF_ProgressCallback mProgressCallback = nullptr;
+};
+
+/**
+ * Keeps track of progress of an operation that processes tables one after another
+ * and reports it to the context's progress callback. Progress within a table is only
+ * reported once every ENTRIES_STEP entries, so it is cheap to call for every entry.
+ */
+class ProgressReporter
+{
+  public:
+    static const int64_t ENTRIES_STEP = 1000;
+
+    explicit ProgressReporter( const Context *context, int tablesTotal = -1 )
+      : mContext( context ), mTablesTotal( tablesTotal ) {}
+
+    /**
+     * Creates reporter for a worker thread of an operation running in parallel. The progress callback
+     * is only called from the thread that started the operation, so this one just adds processed entries
+     * to "entriesDone" and throws GeoDiffCancelledException once "cancelled" is set (both once every
+     * ENTRIES_STEP entries). Only entryDone() may be called.
+     */
+    ProgressReporter( std::atomic<int64_t> *entriesDone, const std::atomic<bool> *cancelled )
+      : mSharedEntriesDone( entriesDone ), mCancelled( cancelled ) {}
+
+    //! Reports that processing of a new table starts
+    void startTable( const std::string &tableName );
+
+    //! Reports that an entry of the current table has been processed
+    void entryDone()
+    {
+      if ( ++mEntriesDone % ENTRIES_STEP == 0 )
+        entriesStepDone();
+    }
+
+    //! Reports that an entry has been processed, starting a new table if the entry belongs to a different one
+    void entryDone( const std::string &tableName )
+    {
+      if ( mTablesDone < 0 || tableName != mTableName )
+        startTable( tableName );
+      entryDone();
+    }
+
+    //! Reports the number of entries of the current table processed so far (e.g. counted by worker threads)
+    void setEntriesDone( int64_t entriesDone );
+
+    //! Reports that all tables have been processed
+    void finish();
+
+  private:
+    void entriesStepDone();
+
+    const Context *mContext = nullptr;
+    std::atomic<int64_t> *mSharedEntriesDone = nullptr;
+    const std::atomic<bool> *mCancelled = nullptr;
+    std::string mTableName;
+    int mTablesDone = -1;   //!< -1 until the first table starts
+    int mTablesTotal = -1;
+    int64_t mEntriesDone = 0;
 };
 
 
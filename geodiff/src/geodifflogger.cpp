@@ -75,6 +75,7 @@ void Logger::log( GEODIFF_LoggerLevel level, const std::string &msg ) const
     if ( static_cast<int>( level ) <= static_cast<int>( maxLogLevel() ) )
     {
       // Send to callback
+      std::lock_guard<std::mutex> lock( mMutex );
       mLoggerCallback( level, msg.c_str() );
     }
   }
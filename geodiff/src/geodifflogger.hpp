@@ -8,6 +8,7 @@
 
 #include <string>
 #include <memory>
+#include <mutex>
 #include <vector>
 #include <stdio.h>
 
@@ -33,6 +34,7 @@ class Logger
   private:
     GEODIFF_LoggerCallback mLoggerCallback = nullptr;
     GEODIFF_LoggerLevel mMaxLogLevel = GEODIFF_LoggerLevel::LevelError;
+    mutable std::mutex mMutex;  // serializes calls to the callback when logging from multiple threads
     void log( GEODIFF_LoggerLevel level, const std::string &msg ) const;
 };
 
@@ -11,6 +11,7 @@
 
 #include "changesetreader.h"
 #include "changesetwriter.h"
+#include "changesetentrypool.h"
 
 #include <memory>
 #include <stdio.h>
@@ -541,13 +542,15 @@ bool _handle_update( const ChangesetEntry &entry, const RebaseMapping &mapping,
 
 //! throws GeoDiffException on error
 void _prepare_new_changeset( const Context *context,
-                             ChangesetReader &reader, const std::string &changesetNew,
+                             ChangesetReader &reader, ChangesetWriter &writer,
                              const RebaseMapping &mapping, const DatabaseRebaseInfo &dbInfo,
                              std::vector<ConflictFeature> &conflicts )
 {
   ChangesetEntry entry;
   std::map<std::string, ChangesetTable> tableDefinitions;
-  std::map<std::string, std::vector<ChangesetEntry> > tableChanges;
+  std::map<std::string, std::vector<ChangesetEntry *> > tableChanges;
+  ChangesetEntryPool pool;  // owns entries in tableChanges
+  ProgressReporter progress( context );
 
   while ( reader.nextEntry( entry ) )
   {
@@ -559,6 +562,8 @@ void _prepare_new_changeset( const Context *context,
       continue;
     }
 
+    progress.entryDone( tableName );
+
     // Inserts table into the definitions, if it doesn't already contain it
     tableDefinitions.insert( {tableName, *entry.table} );
 
@@ -567,7 +572,7 @@ void _prepare_new_changeset( const Context *context,
     {
       // we have change in different table that was modified in theirs modifications
       // just copy plain the change to the output buffer
-      tableChanges[tableName].push_back( entry );
+      tableChanges[tableName].push_back( pool.create( entry ) );
       continue;
     }
 
@@ -591,28 +596,26 @@ void _prepare_new_changeset( const Context *context,
     }
 
     if ( writeEntry )
-      tableChanges[tableName].push_back( outEntry );
+      tableChanges[tableName].push_back( pool.create( std::move( outEntry ) ) );
   }
 
-  ChangesetWriter writer;
-  writer.open( changesetNew );
-
   for ( auto it : tableDefinitions )
   {
     auto chit = tableChanges.find( it.first );
     if ( chit == tableChanges.end() )
       continue;
 
-    const std::vector<ChangesetEntry> &changes = chit->second;
+    const std::vector<ChangesetEntry *> &changes = chit->second;
     if ( changes.empty() )
       continue;
 
     writer.beginTable( it.second );
-    for ( const ChangesetEntry &writeEntry : changes )
+    for ( const ChangesetEntry *writeEntry : changes )
     {
-      writer.writeEntry( writeEntry );
+      writer.writeEntry( *writeEntry );
     }
   }
+  progress.finish();
 }
 
 void rebase(
@@ -649,11 +652,56 @@ void rebase(
     return;
   }
 
+  ChangesetWriter writer;
+  writer.setIndexEnabled( context->isChangesetIndexEnabled() );
+  writer.setCompressionEnabled( context->isChangesetCompressionEnabled() );
+  writer.open( changeset_THEIRS_MODIFIED );
+  rebase( context, reader_BASE_THEIRS, writer, reader_BASE_MODIFIED, conflicts );
+  writer.close();
+}
+
+static void _copy_changeset( const Context *context, ChangesetReader &reader, ChangesetWriter &writer )
+{
+  ChangesetEntry entry;
+  std::string tableName;
+  ProgressReporter progress( context );
+  while ( reader.nextEntry( entry ) )
+  {
+    progress.entryDone( entry.table->name );
+    if ( entry.table->name != tableName )
+    {
+      tableName = entry.table->name;
+      writer.beginTable( *entry.table );
+    }
+    writer.writeEntry( entry );
+  }
+  progress.finish();
+}
+
+void rebase( const Context *context,
+             ChangesetReader &reader_BASE_THEIRS,
+             ChangesetWriter &writer_THEIRS_MODIFIED,
+             ChangesetReader &reader_BASE_MODIFIED,
+             std::vector<ConflictFeature> &conflicts )
+{
+  if ( reader_BASE_THEIRS.isEmpty() )
+  {
+    context->logger().info( " -- no rebase needed! (empty base2theirs) --\n" );
+    _copy_changeset( context, reader_BASE_MODIFIED, writer_THEIRS_MODIFIED );
+    return;
+  }
+  if ( reader_BASE_MODIFIED.isEmpty() )
+  {
+    context->logger().info( " -- no rebase needed! (empty base2modified) --\n" );
+    _copy_changeset( context, reader_BASE_THEIRS, writer_THEIRS_MODIFIED );
+    return;
+  }
+
   // 1. go through the original changeset and extract data that will be needed in the second step
   DatabaseRebaseInfo dbInfo;
   int rc = _parse_old_changeset( context, reader_BASE_THEIRS, dbInfo );
   if ( rc != GEODIFF_SUCCESS )
-    throw GeoDiffException( "Could not parse changeset_BASE_THEIRS: " + changeset_BASE_THEIRS );
+    throw GeoDiffException( "Could not parse changeset_BASE_THEIRS" );
 
   // 2. go through the changeset to be rebased and figure out changes we will need to do to it
   RebaseMapping mapping;
@@ -664,5 +712,5 @@ void rebase(
   reader_BASE_MODIFIED.rewind();
 
   // 3. go through the changeset to be rebased again and write it with changes determined in step 2
-  _prepare_new_changeset( context, reader_BASE_MODIFIED, changeset_THEIRS_MODIFIED, mapping, dbInfo, conflicts );
+  _prepare_new_changeset( context, reader_BASE_MODIFIED, writer_THEIRS_MODIFIED, mapping, dbInfo, conflicts );
 }
@@ -11,6 +11,8 @@
 #include "geodiffutils.hpp"
 
 class Logger;
+class ChangesetReader;
+class ChangesetWriter;
 
 //! throws GeoDiffException on error
 void rebase( const Context *context,
@@ -20,5 +22,13 @@ void rebase( const Context *context,
              std::vector<ConflictFeature> &conflicts// out
            );
 
+//! Same as above, but with changesets already opened in readers and writer (which is not closed). Throws GeoDiffException on error
+void rebase( const Context *context,
+             ChangesetReader &reader_BASE_THEIRS, //in
+             ChangesetWriter &writer_THEIRS_MODIFIED, // out
+             ChangesetReader &reader_BASE_MODIFIED, //in
+             std::vector<ConflictFeature> &conflicts// out
+           );
+
 
 #endif // GEODIFFREBASE_H
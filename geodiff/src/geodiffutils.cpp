@@ -38,9 +38,13 @@
 #include <tchar.h>
 #include <Shlwapi.h>
 #include <codecvt>
+#include <io.h>
+#include <fcntl.h>
 #else
 #include <unistd.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #endif
 
@@ -84,6 +88,16 @@ void Buffer::free()
     mAlloc = 0;
     mUsed = 0;
   }
+  if ( mMapped )
+  {
+#ifdef WIN32
+    UnmapViewOfFile( mMapped );
+#else
+    munmap( const_cast<char *>( mMapped ), mMappedSize );
+#endif
+    mMapped = nullptr;
+    mMappedSize = 0;
+  }
 }
 
 void Buffer::read( const std::string &filename )
@@ -101,21 +115,31 @@ void Buffer::read( const std::string &filename )
   }
 
   /* Seek to the end of the file */
-  int rc = fseek( fp, 0L, SEEK_END );
+#ifdef WIN32
+  int rc = _fseeki64( fp, 0, SEEK_END );
+#else
+  int rc = fseeko( fp, 0, SEEK_END );
+#endif
   if ( 0 != rc )
   {
-    fclose( fp );
-    throw GeoDiffException( "Unable to seek the end of " + filename );
+    // not seekable (e.g. a pipe) - read it until EOF instead
+    readStream( fp, filename );
+    return;
   }
 
-  long off_end;
+  int64_t off_end;
   /* Byte offset to the end of the file (size) */
-  if ( 0 > ( off_end = ftell( fp ) ) )
+#ifdef WIN32
+  off_end = _ftelli64( fp );
+#else
+  off_end = ftello( fp );
+#endif
+  if ( 0 > off_end )
   {
     fclose( fp );
     throw GeoDiffException( "Unable to read file size of " + filename );
   }
-  mAlloc = ( size_t )off_end;
+  mAlloc = off_end;
   mUsed = mAlloc;
 
   if ( mAlloc == 0 )
@@ -126,7 +150,7 @@ void Buffer::read( const std::string &filename )
   }
 
   /* Allocate a buffer to hold the whole file */
-  mZ = reinterpret_cast<char *>( sqlite3_malloc( mAlloc ) );
+  mZ = reinterpret_cast<char *>( sqlite3_malloc64( ( sqlite3_uint64 ) mAlloc ) );
   if ( mZ == nullptr )
   {
     fclose( fp );
@@ -137,7 +161,7 @@ void Buffer::read( const std::string &filename )
   rewind( fp );
 
   /* Slurp file into buffer */
-  if ( mAlloc != ( int ) fread( mZ, 1, mAlloc, fp ) )
+  if ( ( size_t ) mAlloc != fread( mZ, 1, ( size_t ) mAlloc, fp ) )
   {
     fclose( fp );
     throw GeoDiffException( "Unable to read " + filename + " to internal buffer" );
@@ -150,6 +174,190 @@ void Buffer::read( const std::string &filename )
   }
 }
 
+void Buffer::readStream( FILE *fp, const std::string &filename )
+{
+  // we do not know the size in advance - keep growing the buffer until we hit EOF
+  for ( ;; )
+  {
+    if ( mUsed == mAlloc )
+    {
+      mAlloc = mAlloc * 2 + 65536;
+      char *z = reinterpret_cast<char *>( sqlite3_realloc64( mZ, ( sqlite3_uint64 ) mAlloc ) );
+      if ( z == nullptr )
+      {
+        fclose( fp );
+        throw GeoDiffException( "Out of memory to read " + filename + " to internal buffer" );
+      }
+      mZ = z;
+    }
+
+    size_t nRead = fread( mZ + mUsed, 1, ( size_t )( mAlloc - mUsed ), fp );
+    mUsed += ( int64_t ) nRead;
+    if ( nRead == 0 )
+      break;
+  }
+
+  if ( ferror( fp ) )
+  {
+    fclose( fp );
+    throw GeoDiffException( "Unable to read " + filename + " to internal buffer" );
+  }
+
+  fclose( fp );
+
+  // release the unused part of the allocation
+  if ( mUsed == 0 )
+  {
+    sqlite3_free( mZ );
+    mZ = nullptr;
+  }
+  else if ( char *z = reinterpret_cast<char *>( sqlite3_realloc64( mZ, ( sqlite3_uint64 ) mUsed ) ) )
+  {
+    mZ = z;
+  }
+  mAlloc = mUsed;
+}
+
+void Buffer::readFileDescriptor( int fd )
+{
+  free();
+
+  FILE *fp = openFileDescriptor( fd, "rb" );
+  if ( !fp )
+    throw GeoDiffException( "Unable to open file descriptor " + std::to_string( fd ) );
+  readStream( fp, "file descriptor " + std::to_string( fd ) );
+}
+
+void Buffer::map( const std::string &filename )
+{
+  // clean the buffer
+  free();
+
+#ifdef WIN32
+  HANDLE hFile = CreateFileW( stringToWString( filename ).c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+                              OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr );
+  if ( hFile == INVALID_HANDLE_VALUE )
+  {
+    throw GeoDiffException( "Unable to open " + filename );
+  }
+
+  LARGE_INTEGER fileSize;
+  if ( GetFileType( hFile ) != FILE_TYPE_DISK || !GetFileSizeEx( hFile, &fileSize ) )
+  {
+    // not a regular file (e.g. a pipe) - use ordinary read
+    CloseHandle( hFile );
+    read( filename );
+    return;
+  }
+
+  if ( fileSize.QuadPart == 0 )
+  {
+    // empty file - nothing to map
+    CloseHandle( hFile );
+    return;
+  }
+
+  HANDLE hMapping = CreateFileMappingW( hFile, nullptr, PAGE_READONLY, 0, 0, nullptr );
+  if ( hMapping == nullptr )
+  {
+    CloseHandle( hFile );
+    read( filename );
+    return;
+  }
+
+  // the view keeps the mapping alive, we do not need the handles anymore
+  void *ptr = MapViewOfFile( hMapping, FILE_MAP_READ, 0, 0, 0 );
+  CloseHandle( hMapping );
+  CloseHandle( hFile );
+  if ( ptr == nullptr )
+  {
+    read( filename );
+    return;
+  }
+
+  mMapped = reinterpret_cast<const char *>( ptr );
+  mMappedSize = ( size_t ) fileSize.QuadPart;
+#else
+  int fd = ::open( filename.c_str(), O_RDONLY );
+  if ( fd < 0 )
+  {
+    throw GeoDiffException( "Unable to open " + filename );
+  }
+
+  struct stat st;
+  if ( fstat( fd, &st ) != 0 || !S_ISREG( st.st_mode ) )
+  {
+    // not a regular file (e.g. a pipe) - read from the already opened descriptor,
+    // as we may not be able to open it for the second time
+    FILE *fp = fdopen( fd, "rb" );
+    if ( fp == nullptr )
+    {
+      close( fd );
+      throw GeoDiffException( "Unable to open " + filename );
+    }
+    readStream( fp, filename );
+    return;
+  }
+
+  if ( st.st_size == 0 )
+  {
+    // empty file - nothing to map (mmap() does not accept zero length)
+    close( fd );
+    return;
+  }
+
+  void *ptr = mmap( nullptr, ( size_t ) st.st_size, PROT_READ, MAP_PRIVATE, fd, 0 );
+  close( fd );  // the mapping stays valid after the descriptor is closed
+  if ( ptr == MAP_FAILED )
+  {
+    read( filename );
+    return;
+  }
+
+  // changesets are decoded from the start to the end - let the kernel read ahead
+  madvise( ptr, ( size_t ) st.st_size, MADV_SEQUENTIAL );
+
+  mMapped = reinterpret_cast<const char *>( ptr );
+  mMappedSize = ( size_t ) st.st_size;
+#endif
+}
+
+char *Buffer::allocate( int64_t size )
+{
+  free();
+  if ( size == 0 )
+    return nullptr;
+
+  mZ = reinterpret_cast<char *>( sqlite3_malloc64( ( sqlite3_uint64 ) size ) );
+  if ( mZ == nullptr )
+  {
+    throw GeoDiffException( "Out of memory to allocate internal buffer" );
+  }
+  mAlloc = size;
+  mUsed = size;
+  return mZ;
+}
+
+void Buffer::append( const char *data, int64_t size )
+{
+  if ( mMapped )
+    throw GeoDiffException( "Unable to append data to a mapped file" );
+  if ( size <= 0 )
+    return;
+
+  if ( mUsed + size > mAlloc )
+  {
+    int64_t newAlloc = std::max( mAlloc * 2, mUsed + size ) + 65536;
+    char *z = reinterpret_cast<char *>( sqlite3_realloc64( mZ, ( sqlite3_uint64 ) newAlloc ) );
+    if ( z == nullptr )
+      throw GeoDiffException( "Out of memory in Buffer::append" );
+    mZ = z;
+    mAlloc = newAlloc;
+  }
+  memcpy( mZ + mUsed, data, ( size_t ) size );
+  mUsed += size;
+}
+
 void Buffer::printf( const char *zFormat, ... )
 {
   int nNew;
@@ -159,7 +367,7 @@ void Buffer::printf( const char *zFormat, ... )
     {
       va_list ap;
       va_start( ap, zFormat );
-      sqlite3_vsnprintf( mAlloc - mUsed, mZ + mUsed, zFormat, ap );
+      sqlite3_vsnprintf( ( int )( mAlloc - mUsed ), mZ + mUsed, zFormat, ap );
       va_end( ap );
       nNew = ( int )strlen( mZ + mUsed );
     }
@@ -173,7 +381,7 @@ void Buffer::printf( const char *zFormat, ... )
       break;
     }
     mAlloc = mAlloc * 2 + 1000;
-    mZ = reinterpret_cast<char *>( sqlite3_realloc( mZ, mAlloc ) );
+    mZ = reinterpret_cast<char *>( sqlite3_realloc64( mZ, ( sqlite3_uint64 ) mAlloc ) );
     if ( mZ == nullptr )
     {
       throw GeoDiffException( "out of memory in Buffer::printf" );
@@ -183,12 +391,21 @@ void Buffer::printf( const char *zFormat, ... )
 
 const char *Buffer::c_buf() const
 {
+  if ( mMapped )
+    return mMapped;
   return mZ;
 }
 
-int Buffer::size() const
+int64_t Buffer::size() const
 {
-  return mAlloc;
+  if ( mMapped )
+    return ( int64_t ) mMappedSize;
+  return mUsed;
+}
+
+bool Buffer::isMapped() const
+{
+  return mMapped != nullptr;
 }
 
 // ////////////////////////////////////////////////////////////////////////
@@ -222,6 +439,34 @@ FILE *openFile( const std::string &path, const std::string &mode )
 #endif
 }
 
+FILE *openFileDescriptor( int fd, const std::string &mode )
+{
+#ifdef WIN32
+  // changesets are binary - avoid any newline conversions on the original descriptor too
+  _setmode( fd, _O_BINARY );
+  int fdCopy = _dup( fd );
+  if ( fdCopy < 0 )
+    return nullptr;
+  FILE *fh = _fdopen( fdCopy, mode.c_str() );
+  if ( !fh )
+    _close( fdCopy );
+  return fh;
+#else
+  int fdCopy = dup( fd );
+  if ( fdCopy < 0 )
+    return nullptr;
+  FILE *fh = fdopen( fdCopy, mode.c_str() );
+  if ( !fh )
+    close( fdCopy );
+  return fh;
+#endif
+}
+
+bool isStdioPath( const std::string &path )
+{
+  return path == "-";
+}
+
 bool filecopy( const std::string &to, const std::string &from )
 {
   fileremove( to );
@@ -41,6 +41,14 @@ class GeoDiffConflictsException : public GeoDiffException
     int errorCode() const override { return GEODIFF_CONFLICTS; }
 };
 
+//! Thrown when an operation gets cancelled by the progress callback
+class GeoDiffCancelledException : public GeoDiffException
+{
+  public:
+    using GeoDiffException::GeoDiffException;
+    int errorCode() const override { return GEODIFF_CANCELLED; }
+};
+
 
 /**
  * Buffer for sqlite statements
@@ -57,20 +65,56 @@ class Buffer
      */
     void read( const std::string &filename );
 
+    /**
+     * Maps BINARY file on disk (e.g changeset file) to memory for read-only access,
+     * so that its content is paged in lazily from the page cache instead of being
+     * copied to the heap. Falls back to read() when the file cannot be mapped
+     * (e.g. it is a pipe or a FIFO).
+     * Frees the existing buffer if exists
+     */
+    void map( const std::string &filename );
+
+    /**
+     * Populates buffer with all data read from a file descriptor (e.g. a pipe or standard input)
+     * until the end of the stream. The file descriptor itself is not closed.
+     * Frees the existing buffer if exists
+     */
+    void readFileDescriptor( int fd );
+
+    /**
+     * Allocates buffer of the given size and returns pointer to it, so that
+     * the caller can fill it (e.g. with decompressed data)
+     * Frees the existing buffer if exists
+     */
+    char *allocate( int64_t size );
+
+    /**
+     * Adds data to the end of a buffer (the buffer must not be a memory mapping of a file)
+     */
+    void append( const char *data, int64_t size );
+
     /**
      * Adds formatted text to the end of a buffer
      */
     void printf( const char *zFormat, ... );
 
     const char *c_buf() const;
-    int size() const;
+    //! Returns number of bytes of the content
+    int64_t size() const;
+
+    //! Returns whether the buffer content is a read-only memory mapping of a file
+    bool isMapped() const;
 
   private:
     void free();
+    void readStream( FILE *fp, const std::string &filename );
 
     char *mZ = nullptr;  /* Stream (text or binary) */
-    int mAlloc = 0;     /* Bytes allocated in mZ[] */
-    int mUsed = 0;      /* Bytes actually used in mZ[] */
+    int64_t mAlloc = 0;     /* Bytes allocated in mZ[] */
+    int64_t mUsed = 0;      /* Bytes actually used in mZ[] */
+
+    const char *mMapped = nullptr;  /* Start of the file mapping (if mapped) */
+    size_t mMappedSize = 0;         /* Size of the file mapping in bytes */
 };
 
 
@@ -184,6 +228,16 @@ std::string wstringToString( const std::wstring &wStr );
  */
 FILE *openFile( const std::string &path, const std::string &mode );
 
+/**
+ *  Opens stream for a duplicate of the file descriptor, so that closing
+ *  the stream does not close the original file descriptor (e.g. standard output)
+ *  Returns nullptr on error
+ */
+FILE *openFileDescriptor( int fd, const std::string &mode );
+
+//! Returns whether the path is "-" which stands for standard input (when reading) or standard output (when writing)
+bool isStdioPath( const std::string &path );
+
 class TmpFile
 {
   public:
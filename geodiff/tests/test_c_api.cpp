@@ -7,8 +7,10 @@
 #include "geodiff_testutils.hpp"
 #include "geodiff.h"
 #include "geodiffutils.hpp"
+#include "sqliteutils.h"
 
 #include <string>
+#include <vector>
 
 TEST( CAPITest, invalid_calls )
 {
@@ -27,6 +29,9 @@ TEST( CAPITest, invalid_calls )
   ASSERT_EQ( GEODIFF_ERROR, GEODIFF_CX_setTablesToSkip( context, 1, nullptr ) );
   ASSERT_EQ( GEODIFF_ERROR, GEODIFF_CX_setTablesToInclude( invalidContext, 0, nullptr ) );
   ASSERT_EQ( GEODIFF_ERROR, GEODIFF_CX_setTablesToInclude( context, 1, nullptr ) );
+  ASSERT_EQ( GEODIFF_ERROR, GEODIFF_CX_setColumnsToIgnore( invalidContext, 0, nullptr ) );
+  ASSERT_EQ( GEODIFF_ERROR, GEODIFF_CX_setColumnsToIgnore( context, 1, nullptr ) );
+  ASSERT_EQ( GEODIFF_ERROR, GEODIFF_CX_setProgressCallback( invalidContext, nullptr ) );
 
   ASSERT_EQ( GEODIFF_ERROR, GEODIFF_createChangesetEx( invalidContext, "sqlite", nullptr, nullptr, nullptr, nullptr ) );
   ASSERT_EQ( GEODIFF_ERROR, GEODIFF_createChangesetEx( context, "sqlite", nullptr, nullptr, nullptr, nullptr ) );
@@ -212,6 +217,296 @@ TEST( CAPITest, test_rebases )
   GEODIFF_CX_destroy( context );
 }
 
+TEST( CAPITest, test_changeset_index )
+{
+  GEODIFF_ContextH context = GEODIFF_createContext();
+  makedir( pathjoin( tmpdir(), "test_changeset_index" ) );
+
+  std::string bar = pathjoin( testdir(), "concat", "bar-insert.diff" );
+  std::string foo = pathjoin( testdir(), "concat", "foo-insert-update-1.diff" );
+  const char *inputs[] = { bar.c_str(), foo.c_str() };
+
+  std::string plain = pathjoin( tmpdir(), "test_changeset_index", "plain.diff" );
+  std::string indexed = pathjoin( tmpdir(), "test_changeset_index", "indexed.diff" );
+  std::string plainSummary = pathjoin( tmpdir(), "test_changeset_index", "plain-summary.json" );
+  std::string indexedSummary = pathjoin( tmpdir(), "test_changeset_index", "indexed-summary.json" );
+  std::string indexedJson = pathjoin( tmpdir(), "test_changeset_index", "indexed.json" );
+  std::string plainJson = pathjoin( tmpdir(), "test_changeset_index", "plain.json" );
+
+  ASSERT_EQ( GEODIFF_SUCCESS, GEODIFF_concatChanges( context, 2, inputs, plain.c_str() ) );
+
+  ASSERT_EQ( GEODIFF_ERROR, GEODIFF_CX_setChangesetIndexEnabled( nullptr, true ) );
+  ASSERT_EQ( GEODIFF_SUCCESS, GEODIFF_CX_setChangesetIndexEnabled( context, true ) );
+  ASSERT_EQ( GEODIFF_SUCCESS, GEODIFF_concatChanges( context, 2, inputs, indexed.c_str() ) );
+
+  ASSERT_FALSE( fileContentEquals( plain, indexed ) );
+  EXPECT_EQ( GEODIFF_changesCount( context, plain.c_str() ), GEODIFF_changesCount( context, indexed.c_str() ) );
+
+  ASSERT_EQ( GEODIFF_SUCCESS, GEODIFF_listChangesSummary( context, plain.c_str(), plainSummary.c_str() ) );
+  ASSERT_EQ( GEODIFF_SUCCESS, GEODIFF_listChangesSummary( context, indexed.c_str(), indexedSummary.c_str() ) );
+  EXPECT_TRUE( fileContentEquals( plainSummary, indexedSummary ) );
+
+  ASSERT_EQ( GEODIFF_SUCCESS, GEODIFF_listChanges( context, plain.c_str(), plainJson.c_str() ) );
+  ASSERT_EQ( GEODIFF_SUCCESS, GEODIFF_listChanges( context, indexed.c_str(), indexedJson.c_str() ) );
+  EXPECT_TRUE( fileContentEquals( plainJson, indexedJson ) );
+
+  GEODIFF_CX_destroy( context );
+}
+
+TEST( CAPITest, test_changeset_compression )
+{
+  GEODIFF_ContextH context = GEODIFF_createContext();
+  makedir( pathjoin( tmpdir(), "test_changeset_compression" ) );
+
+  std::string base = pathjoin( testdir(), "base.gpkg" );
+  std::string modified = pathjoin( testdir(), "2_inserts", "inserted_1_A.gpkg" );
+  std::string plain = pathjoin( tmpdir(), "test_changeset_compression", "plain.diff" );
+  std::string compressed = pathjoin( tmpdir(), "test_changeset_compression", "compressed.diff" );
+  std::string plainJson = pathjoin( tmpdir(), "test_changeset_compression", "plain.json" );
+  std::string compressedJson = pathjoin( tmpdir(), "test_changeset_compression", "compressed.json" );
+  std::string patched = pathjoin( tmpdir(), "test_changeset_compression", "patched.gpkg" );
+
+  ASSERT_EQ( GEODIFF_SUCCESS, GEODIFF_createChangeset( context, base.c_str(), modified.c_str(), plain.c_str() ) );
+
+  ASSERT_EQ( GEODIFF_ERROR, GEODIFF_CX_setChangesetCompressionEnabled( nullptr, true ) );
+  ASSERT_EQ( GEODIFF_SUCCESS, GEODIFF_CX_setChangesetCompressionEnabled( context, true ) );
+  ASSERT_EQ( GEODIFF_SUCCESS, GEODIFF_createChangeset( context, base.c_str(), modified.c_str(), compressed.c_str() ) );
+  ASSERT_FALSE( fileContentEquals( plain, compressed ) );
+
+  ASSERT_EQ( GEODIFF_SUCCESS, GEODIFF_listChanges( context, plain.c_str(), plainJson.c_str() ) );
+  ASSERT_EQ( GEODIFF_SUCCESS, GEODIFF_listChanges( context, compressed.c_str(), compressedJson.c_str() ) );
+  EXPECT_TRUE( fileContentEquals( plainJson, compressedJson ) );
+
+  filecopy( patched, base );
+  ASSERT_EQ( GEODIFF_SUCCESS, GEODIFF_applyChangeset( context, patched.c_str(), compressed.c_str() ) );
+  EXPECT_EQ( GEODIFF_hasChanges( context, compressed.c_str() ), 1 );
+  EXPECT_TRUE( equals( patched, modified, false ) );
+
+  GEODIFF_CX_destroy( context );
+}
+
+TEST( CAPITest, test_diff_threads )
+{
+  GEODIFF_ContextH context = GEODIFF_createContext();
+  makedir( pathjoin( tmpdir(), "test_diff_threads" ) );
+
+  std::string base = pathjoin( testdir(), "skip_tables", "base.gpkg" );
+  std::string modified = pathjoin( testdir(), "skip_tables", "modified_all.gpkg" );
+  std::string sequential = pathjoin( tmpdir(), "test_diff_threads", "sequential.diff" );
+  std::string parallel = pathjoin( tmpdir(), "test_diff_threads", "parallel.diff" );
+  std::string sequentialIndexed = pathjoin( tmpdir(), "test_diff_threads", "sequential-indexed.diff" );
+  std::string parallelIndexed = pathjoin( tmpdir(), "test_diff_threads", "parallel-indexed.diff" );
+
+  ASSERT_EQ( GEODIFF_ERROR, GEODIFF_CX_setDiffThreadCount( nullptr, 4 ) );
+  ASSERT_EQ( GEODIFF_ERROR, GEODIFF_CX_setDiffThreadCount( context, 0 ) );
+
+  ASSERT_EQ( GEODIFF_SUCCESS, GEODIFF_createChangeset( context, base.c_str(), modified.c_str(), sequential.c_str() ) );
+  ASSERT_EQ( GEODIFF_SUCCESS, GEODIFF_CX_setChangesetIndexEnabled( context, true ) );
+  ASSERT_EQ( GEODIFF_SUCCESS, GEODIFF_createChangeset( context, base.c_str(), modified.c_str(), sequentialIndexed.c_str() ) );
+
+  // tables are compared concurrently, but the output must be exactly the same
+  ASSERT_EQ( GEODIFF_SUCCESS, GEODIFF_CX_setDiffThreadCount( context, 4 ) );
+  ASSERT_EQ( GEODIFF_SUCCESS, GEODIFF_createChangeset( context, base.c_str(), modified.c_str(), parallelIndexed.c_str() ) );
+  ASSERT_EQ( GEODIFF_SUCCESS, GEODIFF_CX_setChangesetIndexEnabled( context, false ) );
+  ASSERT_EQ( GEODIFF_SUCCESS, GEODIFF_createChangeset( context, base.c_str(), modified.c_str(), parallel.c_str() ) );
+
+  EXPECT_EQ( GEODIFF_changesCount( context, parallel.c_str() ), 6 );
+  EXPECT_TRUE( fileContentEquals( sequential, parallel ) );
+  EXPECT_TRUE( fileContentEquals( sequentialIndexed, parallelIndexed ) );
+
+  // errors from worker threads are reported
+  std::string modifiedScheme = pathjoin( testdir(), "modified_scheme", "added_attribute.gpkg" );
+  EXPECT_EQ( GEODIFF_ERROR, GEODIFF_createChangeset( context, pathjoin( testdir(), "base.gpkg" ).c_str(), modifiedScheme.c_str(), parallel.c_str() ) );
+
+  GEODIFF_CX_destroy( context );
+}
+
+static std::string bufferContent( GEODIFF_ContextH context, GEODIFF_BufferH buffer )
+{
+  return std::string( GEODIFF_B_data( context, buffer ), ( size_t ) GEODIFF_B_size( context, buffer ) );
+}
+
+static std::string fileContent( const std::string &filename )
+{
+  Buffer buf;
+  buf.read( filename );
+  return std::string( buf.c_buf(), ( size_t ) buf.size() );
+}
+
+TEST( CAPITest, test_changeset_buffers )
+{
+  GEODIFF_ContextH context = GEODIFF_createContext();
+  makedir( pathjoin( tmpdir(), "test_changeset_buffers" ) );
+
+  std::string base = pathjoin( testdir(), "base.gpkg" );
+  std::string modifiedA = pathjoin( testdir(), "2_inserts", "inserted_1_A.gpkg" );
+  std::string modifiedB = pathjoin( testdir(), "2_inserts", "inserted_1_B.gpkg" );
+  std::string changesetA = pathjoin( tmpdir(), "test_changeset_buffers", "base-A.diff" );
+  std::string changesetB = pathjoin( tmpdir(), "test_changeset_buffers", "base-B.diff" );
+  std::string concatenated = pathjoin( tmpdir(), "test_changeset_buffers", "concat.diff" );
+  std::string rebased = pathjoin( tmpdir(), "test_changeset_buffers", "rebased.diff" );
+  std::string conflicts = pathjoin( tmpdir(), "test_changeset_buffers", "conflicts.json" );
+  std::string patched = pathjoin( tmpdir(), "test_changeset_buffers", "patched.gpkg" );
+
+  ASSERT_EQ( GEODIFF_SUCCESS, GEODIFF_createChangeset( context, base.c_str(), modifiedA.c_str(), changesetA.c_str() ) );
+  ASSERT_EQ( GEODIFF_SUCCESS, GEODIFF_createChangeset( context, base.c_str(), modifiedB.c_str(), changesetB.c_str() ) );
+
+  // create + apply
+  GEODIFF_BufferH bufA = nullptr;
+  ASSERT_EQ( GEODIFF_ERROR, GEODIFF_createChangesetToBuffer( context, "sqlite", nullptr, base.c_str(), modifiedA.c_str(), nullptr ) );
+  ASSERT_EQ( GEODIFF_SUCCESS, GEODIFF_createChangesetToBuffer( context, "sqlite", nullptr, base.c_str(), modifiedA.c_str(), &bufA ) );
+  ASSERT_TRUE( bufA );
+  EXPECT_EQ( bufferContent( context, bufA ), fileContent( changesetA ) );
+
+  filecopy( patched, base );
+  ASSERT_EQ( GEODIFF_SUCCESS, GEODIFF_applyChangesetFromBuffer( context, "sqlite", nullptr, patched.c_str(), bufA ) );
+  EXPECT_TRUE( equals( patched, modifiedA, false ) );
+
+  // buffers created from existing data
+  std::string contentB = fileContent( changesetB );
+  GEODIFF_BufferH bufB = GEODIFF_createBuffer( context, contentB.data(), ( int64_t ) contentB.size() );
+  ASSERT_TRUE( bufB );
+  EXPECT_EQ( bufferContent( context, bufB ), contentB );
+  EXPECT_FALSE( GEODIFF_createBuffer( context, nullptr, 10 ) );
+  GEODIFF_BufferH bufEmpty = GEODIFF_createBuffer( context, nullptr, 0 );
+  ASSERT_TRUE( bufEmpty );
+  EXPECT_EQ( GEODIFF_B_size( context, bufEmpty ), 0 );
+
+  // applying an empty changeset is a no-op
+  ASSERT_EQ( GEODIFF_SUCCESS, GEODIFF_applyChangesetFromBuffer( context, "sqlite", nullptr, patched.c_str(), bufEmpty ) );
+
+  // concat
+  const char *inputFiles[] = { changesetA.c_str(), changesetB.c_str() };
+  ASSERT_EQ( GEODIFF_SUCCESS, GEODIFF_concatChanges( context, 2, inputFiles, concatenated.c_str() ) );
+  GEODIFF_BufferH inputBuffers[] = { bufA, bufB };
+  GEODIFF_BufferH bufConcat = nullptr;
+  ASSERT_EQ( GEODIFF_ERROR, GEODIFF_concatChangesBuffers( context, 1, inputBuffers, &bufConcat ) );
+  ASSERT_EQ( GEODIFF_SUCCESS, GEODIFF_concatChangesBuffers( context, 2, inputBuffers, &bufConcat ) );
+  EXPECT_EQ( bufferContent( context, bufConcat ), fileContent( concatenated ) );
+
+  // rebase
+  ASSERT_EQ( GEODIFF_SUCCESS, GEODIFF_createRebasedChangesetEx( context, "sqlite", nullptr, base.c_str(), changesetA.c_str(), changesetB.c_str(), rebased.c_str(), conflicts.c_str() ) );
+  GEODIFF_BufferH bufRebased = nullptr;
+  GEODIFF_BufferH bufConflicts = nullptr;
+  ASSERT_EQ( GEODIFF_SUCCESS, GEODIFF_createRebasedChangesetBuffer( context, "sqlite", nullptr, base.c_str(), bufA, bufB, &bufRebased, &bufConflicts ) );
+  EXPECT_EQ( bufferContent( context, bufRebased ), fileContent( rebased ) );
+  EXPECT_EQ( GEODIFF_B_size( context, bufConflicts ), 0 );
+  EXPECT_FALSE( fileexists( conflicts ) );
+
+  GEODIFF_B_destroy( context, bufA );
+  GEODIFF_B_destroy( context, bufB );
+  GEODIFF_B_destroy( context, bufEmpty );
+  GEODIFF_B_destroy( context, bufConcat );
+  GEODIFF_B_destroy( context, bufRebased );
+  GEODIFF_B_destroy( context, bufConflicts );
+  GEODIFF_CX_destroy( context );
+}
+
+struct ProgressCall
+{
+  std::string tableName;
+  int tablesDone;
+  int tablesTotal;
+  int64_t entriesDone;
+
+  bool operator==( const ProgressCall &other ) const
+  {
+    return tableName == other.tableName && tablesDone == other.tablesDone && tablesTotal == other.tablesTotal && entriesDone == other.entriesDone;
+  }
+};
+
+static std::vector<ProgressCall> sProgressCalls;
+static size_t sProgressCancelAtCall = 0;  // operation gets cancelled by this call (zero = never)
+
+static bool progressCallback( const char *tableName, int tablesDone, int tablesTotal, int64_t entriesDone )
+{
+  sProgressCalls.push_back( { tableName, tablesDone, tablesTotal, entriesDone } );
+  return sProgressCalls.size() != sProgressCancelAtCall;
+}
+
+TEST( CAPITest, test_progress )
+{
+  GEODIFF_ContextH context = GEODIFF_createContext();
+  makedir( pathjoin( tmpdir(), "test_progress" ) );
+
+  std::string base = pathjoin( tmpdir(), "test_progress", "base.db" );
+  std::string modified = pathjoin( tmpdir(), "test_progress", "modified.db" );
+  std::string patched = pathjoin( tmpdir(), "test_progress", "patched.db" );
+  std::string copy = pathjoin( tmpdir(), "test_progress", "copy.db" );
+  std::string changeset = pathjoin( tmpdir(), "test_progress", "base-modified.diff" );
+  std::string changesetPatched = pathjoin( tmpdir(), "test_progress", "base-patched.diff" );
+  std::string concatenated = pathjoin( tmpdir(), "test_progress", "concat.diff" );
+
+  // 2500 rows are inserted to table "a" and 10 rows to table "b"
+  for ( const std::string &file : { base, modified } )
+  {
+    fileremove( file );
+    Sqlite3Db db;
+    db.create( file );
+    Buffer sql;
+    sql.printf( "CREATE TABLE a ( fid INTEGER PRIMARY KEY, name TEXT ); CREATE TABLE b ( fid INTEGER PRIMARY KEY, name TEXT );" );
+    if ( file == modified )
+      sql.printf( "WITH RECURSIVE c(x) AS ( SELECT 1 UNION ALL SELECT x + 1 FROM c WHERE x < 2500 ) "
+                  "INSERT INTO a SELECT x, 'a' || x FROM c;"
+                  "WITH RECURSIVE c(x) AS ( SELECT 1 UNION ALL SELECT x + 1 FROM c WHERE x < 10 ) "
+                  "INSERT INTO b SELECT x, 'b' || x FROM c;" );
+    db.exec( sql );
+  }
+  filecopy( patched, base );
+
+  ASSERT_EQ( GEODIFF_SUCCESS, GEODIFF_CX_setProgressCallback( context, progressCallback ) );
+
+  // diff reports tables and compared rows
+  sProgressCalls.clear();
+  ASSERT_EQ( GEODIFF_SUCCESS, GEODIFF_createChangeset( context, base.c_str(), modified.c_str(), changeset.c_str() ) );
+  std::vector<ProgressCall> expectedDiff = { { "a", 0, 2, 0 }, { "a", 0, 2, 1000 }, { "a", 0, 2, 2000 }, { "b", 1, 2, 0 }, { "", 2, 2, 0 } };
+  EXPECT_EQ( sProgressCalls, expectedDiff );
+
+  // the number of tables is not known in advance when reading a changeset
+  sProgressCalls.clear();
+  ASSERT_EQ( GEODIFF_SUCCESS, GEODIFF_concatChanges( context, 2, std::vector<const char *>( 2, changeset.c_str() ).data(), concatenated.c_str() ) );
+  std::vector<ProgressCall> expectedApply = { { "a", 0, -1, 0 }, { "a", 0, -1, 1000 }, { "a", 0, -1, 2000 }, { "b", 1, -1, 0 }, { "", 2, 2, 0 } };
+  ASSERT_EQ( sProgressCalls.size(), 9 );  // both changesets are read
+  EXPECT_EQ( sProgressCalls.back(), ProgressCall( { "", 4, 4, 0 } ) );
+
+  // cancelled apply does not change the database
+  sProgressCalls.clear();
+  sProgressCancelAtCall = 3;
+  EXPECT_EQ( GEODIFF_CANCELLED, GEODIFF_applyChangeset( context, patched.c_str(), changeset.c_str() ) );
+  EXPECT_EQ( std::string( GEODIFF_CX_lastError( context ) ), "Operation cancelled" );
+  EXPECT_EQ( sProgressCalls.back(), ProgressCall( { "a", 0, -1, 2000 } ) );
+  ASSERT_EQ( GEODIFF_SUCCESS, GEODIFF_createChangeset( context, base.c_str(), patched.c_str(), changesetPatched.c_str() ) );
+  EXPECT_EQ( GEODIFF_changesCount( context, changesetPatched.c_str() ), 0 );
+
+  sProgressCalls.clear();
+  sProgressCancelAtCall = 0;
+  ASSERT_EQ( GEODIFF_SUCCESS, GEODIFF_applyChangeset( context, patched.c_str(), changeset.c_str() ) );
+  EXPECT_EQ( sProgressCalls, expectedApply );
+
+  // cancellation of other operations - diff gets cancelled while comparing rows of "a"
+  // (with more threads, rows are compared by workers and the second call may also be the start of "b")
+  for ( int threads : { 1, 4 } )
+  {
+    ASSERT_EQ( GEODIFF_SUCCESS, GEODIFF_CX_setDiffThreadCount( context, threads ) );
+    sProgressCalls.clear();
+    sProgressCancelAtCall = 2;
+    EXPECT_EQ( GEODIFF_CANCELLED, GEODIFF_createChangeset( context, base.c_str(), modified.c_str(), changesetPatched.c_str() ) );
+    ASSERT_EQ( sProgressCalls.size(), 2 );
+    if ( threads == 1 )
+      EXPECT_EQ( sProgressCalls.back(), ProgressCall( { "a", 0, 2, 1000 } ) );
+  }
+
+  sProgressCalls.clear();
+  sProgressCancelAtCall = 1;
+  EXPECT_EQ( GEODIFF_CANCELLED, GEODIFF_concatChanges( context, 2, std::vector<const char *>( 2, changeset.c_str() ).data(), concatenated.c_str() ) );
+  sProgressCalls.clear();
+  EXPECT_EQ( GEODIFF_CANCELLED, GEODIFF_makeCopy( context, "sqlite", "", modified.c_str(), "sqlite", "", copy.c_str() ) );
+
+  sProgressCancelAtCall = 0;
+  ASSERT_EQ( GEODIFF_SUCCESS, GEODIFF_CX_setProgressCallback( context, nullptr ) );
+  GEODIFF_CX_destroy( context );
+}
+
 int main( int argc, char **argv )
 {
   testing::InitGoogleTest( &argc, argv );
@@ -8,6 +8,17 @@
 #include "geodiff.h"
 
 #include "changesetreader.h"
+#include "changesetwriter.h"
+#include "changesetgetvarint.h"
+#include "changesetputvarint.h"
+#include "geodiffutils.hpp"
+
+#include <thread>
+
+#ifndef WIN32
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
 TEST( ChangesetReaderTest, test_open )
 {
@@ -100,6 +111,386 @@ TEST( ChangesetReaderTest, test_read_delete )
   EXPECT_FALSE( reader.nextEntry( entry ) );
 }
 
+TEST( ChangesetReaderTest, test_read_view )
+{
+  std::string changeset = pathjoin( testdir(), "2_inserts", "base-inserted_1_A.diff" );
+
+  ChangesetReader reader;
+  EXPECT_TRUE( reader.open( changeset ) );
+  ChangesetReader readerView;
+  EXPECT_TRUE( readerView.open( changeset ) );
+
+  int count = 0;
+  ChangesetEntry entry;
+  ChangesetEntryView view;
+  while ( reader.nextEntry( entry ) )
+  {
+    ASSERT_TRUE( readerView.nextEntry( view ) );
+    EXPECT_EQ( view.op, entry.op );
+    EXPECT_EQ( view.table->name, entry.table->name );
+
+    ChangesetEntry copy = view.toEntry();
+    EXPECT_EQ( copy.oldValues, entry.oldValues );
+    EXPECT_EQ( copy.newValues, entry.newValues );
+    ++count;
+  }
+  EXPECT_FALSE( readerView.nextEntry( view ) );
+  EXPECT_EQ( count, 1 );
+
+  // text values are not copied and not null-terminated
+  readerView.rewind();
+  ASSERT_TRUE( readerView.nextEntry( view ) );
+  ASSERT_EQ( view.newValues[2].type(), Value::TypeText );
+  EXPECT_EQ( std::string( view.newValues[2].getStringData(), view.newValues[2].getStringSize() ), "my new point A" );
+
+  // view of an owning entry
+  ChangesetEntryView viewOfEntry = ChangesetEntryView::fromEntry( entry );
+  ASSERT_EQ( viewOfEntry.newValues[2].type(), Value::TypeText );
+  EXPECT_EQ( viewOfEntry.newValues[2].getStringData(), entry.newValues[2].getStringData() );
+  EXPECT_EQ( viewOfEntry.newValues[3].toValue(), entry.newValues[3] );
+}
+
+TEST( ChangesetReaderTest, test_varint64 )
+{
+  std::vector<uint64_t> values = { 0, 1, 127, 128, 16383, 16384, 0x7fffffff, 0xffffffff, 0x100000000ULL,
+                                   0x123456789abULL, 0x00ffffffffffffffULL, 0x0100000000000000ULL, UINT64_MAX
+                                 };
+  for ( uint64_t v : values )
+  {
+    unsigned char buf[9];
+    int n = sqlite3PutVarint( buf, v );
+    u64 res;
+    EXPECT_EQ( sqlite3GetVarint( buf, &res ), n );
+    EXPECT_EQ( res, v );
+  }
+}
+
+TEST( ChangesetReaderTest, test_read_truncated )
+{
+  makedir( pathjoin( tmpdir(), "test_read_truncated" ) );
+  std::string changeset = pathjoin( tmpdir(), "test_read_truncated", "truncated.diff" );
+
+  // table record with unfinished varint of column count at the very end of file
+  flushString( changeset, std::string( "T\xff\xff", 3 ) );
+
+  ChangesetReader reader;
+  EXPECT_TRUE( reader.open( changeset ) );
+  ChangesetEntry entry;
+  EXPECT_THROW( reader.nextEntry( entry ), GeoDiffException );
+}
+
+TEST( ChangesetReaderTest, test_large_changeset )
+{
+  // writes and reads back a changeset larger than 4 GB - this needs a lot
+  // of disk space and time, so it only runs when explicitly requested
+  if ( getEnvVar( "GEODIFF_TEST_LARGE_CHANGESETS", "" ).empty() )
+    GTEST_SKIP() << "set GEODIFF_TEST_LARGE_CHANGESETS=1 to run";
+
+  makedir( pathjoin( tmpdir(), "test_large_changeset" ) );
+  std::string changeset = pathjoin( tmpdir(), "test_large_changeset", "large.diff" );
+
+  ChangesetTable table;
+  table.name = "large";
+  table.primaryKeys = { true, false };
+
+  const int entryCount = 5;
+  const size_t blobSize = 1024 * 1024 * 1024 + 123;  // a bit over 1 GB
+  {
+    Value blob;
+    {
+      std::string data( blobSize, 'a' );
+      blob.setString( Value::TypeBlob, data.data(), data.size() );
+    }
+
+    ChangesetWriter writer;
+    ASSERT_NO_THROW( writer.open( changeset ) );
+    writer.beginTable( table );
+    for ( int i = 0; i < entryCount; ++i )
+      writer.writeEntry( ChangesetEntry::make( &table, ChangesetEntry::OpInsert, {}, { Value::makeInt( i ), blob } ) );
+    ASSERT_NO_THROW( writer.close() );
+  }
+
+  Buffer buf;
+  buf.map( changeset );
+  EXPECT_GT( buf.size(), int64_t( 4 ) * 1024 * 1024 * 1024 );
+
+  ChangesetReader reader;
+  ASSERT_TRUE( reader.open( changeset ) );
+  ChangesetEntryView entry;
+  int count = 0;
+  while ( reader.nextEntry( entry ) )
+  {
+    EXPECT_EQ( entry.newValues[0].getInt(), count );
+    ASSERT_EQ( entry.newValues[1].getStringSize(), blobSize );
+    EXPECT_EQ( entry.newValues[1].getStringData()[0], 'a' );
+    EXPECT_EQ( entry.newValues[1].getStringData()[blobSize - 1], 'a' );
+    ++count;
+  }
+  EXPECT_EQ( count, entryCount );
+
+  fileremove( changeset );
+}
+
+TEST( ChangesetReaderTest, test_index )
+{
+  makedir( pathjoin( tmpdir(), "test_index" ) );
+  std::string plain = pathjoin( tmpdir(), "test_index", "plain.diff" );
+  std::string indexed = pathjoin( tmpdir(), "test_index", "indexed.diff" );
+
+  ChangesetTable tableA;
+  tableA.name = "a";
+  tableA.primaryKeys = { true, false };
+  ChangesetTable tableB;
+  tableB.name = "b";
+  tableB.primaryKeys = { true };
+
+  for ( const std::string &filename : { plain, indexed } )
+  {
+    ChangesetWriter writer;
+    writer.setIndexEnabled( filename == indexed );
+    writer.open( filename );
+    writer.beginTable( tableA );
+    writer.writeEntry( ChangesetEntry::make( &tableA, ChangesetEntry::OpInsert, {}, { Value::makeInt( 1 ), Value::makeText( "one" ) } ) );
+    writer.writeEntry( ChangesetEntry::make( &tableA, ChangesetEntry::OpInsert, {}, { Value::makeInt( 2 ), Value::makeText( "two" ) } ) );
+    writer.writeEntry( ChangesetEntry::make( &tableA, ChangesetEntry::OpUpdate, { Value::makeInt( 3 ), Value::makeText( "x" ) }, { Value(), Value::makeText( "y" ) } ) );
+    writer.beginTable( tableB );
+    writer.writeEntry( ChangesetEntry::make( &tableB, ChangesetEntry::OpDelete, { Value::makeInt( 4 ) }, {} ) );
+    writer.close();
+  }
+
+  ChangesetReader readerPlain;
+  ASSERT_TRUE( readerPlain.open( plain ) );
+  EXPECT_FALSE( readerPlain.hasIndex() );
+  EXPECT_FALSE( readerPlain.verifyIndexChecksum() );
+  EXPECT_FALSE( readerPlain.seekToTable( "b" ) );
+
+  ChangesetReader reader;
+  ASSERT_TRUE( reader.open( indexed ) );
+  ASSERT_TRUE( reader.hasIndex() );
+  EXPECT_TRUE( reader.verifyIndexChecksum() );
+  ASSERT_EQ( reader.indexTables().size(), 2 );
+  EXPECT_EQ( reader.indexTables()[0].name, "a" );
+  EXPECT_EQ( reader.indexTables()[0].offset, 0 );
+  EXPECT_EQ( reader.indexTables()[0].inserts, 2 );
+  EXPECT_EQ( reader.indexTables()[0].updates, 1 );
+  EXPECT_EQ( reader.indexTables()[0].deletes, 0 );
+  EXPECT_EQ( reader.indexTables()[1].name, "b" );
+  EXPECT_EQ( reader.indexTables()[1].entryCount(), 1 );
+  Buffer plainContent;
+  plainContent.read( plain );
+  EXPECT_EQ( reader.indexTables()[1].offset + reader.indexTables()[1].size, ( uint64_t ) plainContent.size() );
+
+  // entries are the same as without index
+  ChangesetEntry entry, entryPlain;
+  while ( readerPlain.nextEntry( entryPlain ) )
+  {
+    ASSERT_TRUE( reader.nextEntry( entry ) );
+    EXPECT_EQ( entry.table->name, entryPlain.table->name );
+    EXPECT_EQ( entry.op, entryPlain.op );
+    EXPECT_EQ( entry.oldValues, entryPlain.oldValues );
+    EXPECT_EQ( entry.newValues, entryPlain.newValues );
+  }
+  EXPECT_FALSE( reader.nextEntry( entry ) );
+
+  // random access to a table
+  EXPECT_FALSE( reader.seekToTable( "c" ) );
+  ASSERT_TRUE( reader.seekToTable( "b" ) );
+  ASSERT_TRUE( reader.nextEntry( entry ) );
+  EXPECT_EQ( entry.table->name, "b" );
+  EXPECT_EQ( entry.op, ChangesetEntry::OpDelete );
+  EXPECT_FALSE( reader.nextEntry( entry ) );
+
+  // corrupted data are detected by checksum
+  Buffer indexedContent;
+  indexedContent.read( indexed );
+  std::string content( indexedContent.c_buf(), indexedContent.size() );
+  content[10] ^= 0x01;
+  flushString( indexed, content );
+  ChangesetReader readerCorrupted;
+  ASSERT_TRUE( readerCorrupted.open( indexed ) );
+  ASSERT_TRUE( readerCorrupted.hasIndex() );
+  EXPECT_FALSE( readerCorrupted.verifyIndexChecksum() );
+}
+
+TEST( ChangesetReaderTest, test_compressed )
+{
+  makedir( pathjoin( tmpdir(), "test_compressed" ) );
+  std::string plain = pathjoin( tmpdir(), "test_compressed", "plain.diff" );
+  std::string compressed = pathjoin( tmpdir(), "test_compressed", "compressed.diff" );
+
+  ChangesetTable table;
+  table.name = "t";
+  table.primaryKeys = { true, false, false };
+
+  // random blob larger than a block does not compress - it gets stored as is
+  std::string randomBlob( 3 * 1024 * 1024 + 123, 0 );
+  uint32_t x = 12345;
+  for ( char &c : randomBlob )
+  {
+    x = x * 1103515245 + 12345;
+    c = static_cast<char>( x >> 24 );
+  }
+  Value blob;
+  blob.setString( Value::TypeBlob, randomBlob.data(), randomBlob.size() );
+
+  for ( const std::string &filename : { plain, compressed } )
+  {
+    ChangesetWriter writer;
+    writer.setCompressionEnabled( filename == compressed );
+    writer.setIndexEnabled( true );
+    writer.open( filename );
+    writer.beginTable( table );
+    for ( int i = 0; i < 100000; ++i )
+      writer.writeEntry( ChangesetEntry::make( &table, ChangesetEntry::OpInsert, {}, { Value::makeInt( i ), Value::makeText( "feature " + std::to_string( i % 100 ) ), Value::makeDouble( i * 0.5 ) } ) );
+    writer.writeEntry( ChangesetEntry::make( &table, ChangesetEntry::OpInsert, {}, { Value::makeInt( -1 ), blob, Value::makeNull() } ) );
+    writer.close();
+  }
+
+  Buffer plainContent, compressedContent;
+  plainContent.read( plain );
+  compressedContent.read( compressed );
+  EXPECT_LT( compressedContent.size(), plainContent.size() / 2 + ( int64_t ) randomBlob.size() );
+
+  ChangesetReader readerPlain, reader;
+  ASSERT_TRUE( readerPlain.open( plain ) );
+  ASSERT_TRUE( reader.open( compressed ) );
+  ASSERT_TRUE( reader.hasIndex() );
+  EXPECT_TRUE( reader.verifyIndexChecksum() );
+  EXPECT_EQ( reader.indexTables()[0].inserts, 100001 );
+  ChangesetEntry entry, entryPlain;
+  int count = 0;
+  while ( readerPlain.nextEntry( entryPlain ) )
+  {
+    ASSERT_TRUE( reader.nextEntry( entry ) );
+    ASSERT_EQ( entry.newValues, entryPlain.newValues );
+    ++count;
+  }
+  EXPECT_FALSE( reader.nextEntry( entry ) );
+  EXPECT_EQ( count, 100001 );
+
+  // truncated or corrupted container is rejected
+  std::string content( compressedContent.c_buf(), compressedContent.size() );
+  std::string truncated = pathjoin( tmpdir(), "test_compressed", "truncated.diff" );
+  flushString( truncated, content.substr( 0, content.size() - 100 ) );
+  ChangesetReader readerTruncated;
+  EXPECT_FALSE( readerTruncated.open( truncated ) );
+
+  std::string corrupted = pathjoin( tmpdir(), "test_compressed", "corrupted.diff" );
+  content[21] ^= 0x40;  // uncompressed size of the first block
+  flushString( corrupted, content );
+  ChangesetReader readerCorrupted;
+  EXPECT_FALSE( readerCorrupted.open( corrupted ) );
+
+  // empty changeset stays empty
+  std::string empty = pathjoin( tmpdir(), "test_compressed", "empty.diff" );
+  {
+    ChangesetWriter writer;
+    writer.setCompressionEnabled( true );
+    writer.open( empty );
+    writer.close();
+  }
+  Buffer emptyContent;
+  emptyContent.read( empty );
+  EXPECT_EQ( emptyContent.size(), 0 );
+}
+
+TEST( ChangesetReaderTest, test_mapped_buffer )
+{
+  std::string changeset = pathjoin( testdir(), "2_updates", "base-updated_A.diff" );
+
+  Buffer bufRead;
+  bufRead.read( changeset );
+  EXPECT_FALSE( bufRead.isMapped() );
+
+  Buffer bufMapped;
+  bufMapped.map( changeset );
+  EXPECT_TRUE( bufMapped.isMapped() );
+  ASSERT_EQ( bufMapped.size(), bufRead.size() );
+  EXPECT_EQ( memcmp( bufMapped.c_buf(), bufRead.c_buf(), bufRead.size() ), 0 );
+
+  // empty file cannot be mapped, but it is still a valid (empty) changeset
+  makedir( pathjoin( tmpdir(), "test_mapped_buffer" ) );
+  std::string empty = pathjoin( tmpdir(), "test_mapped_buffer", "empty.diff" );
+  flushString( empty, "" );
+
+  Buffer bufEmpty;
+  bufEmpty.map( empty );
+  EXPECT_FALSE( bufEmpty.isMapped() );
+  EXPECT_EQ( bufEmpty.size(), 0 );
+
+  ChangesetReader reader;
+  EXPECT_TRUE( reader.open( empty ) );
+  EXPECT_TRUE( reader.isEmpty() );
+}
+
+#ifndef WIN32
+TEST( ChangesetReaderTest, test_read_fifo )
+{
+  std::string changeset = pathjoin( testdir(), "2_deletes", "base-deleted_A.diff" );
+  makedir( pathjoin( tmpdir(), "test_read_fifo" ) );
+  std::string fifo = pathjoin( tmpdir(), "test_read_fifo", "changeset.fifo" );
+  fileremove( fifo );
+  ASSERT_EQ( mkfifo( fifo.c_str(), 0600 ), 0 );
+
+  Buffer content;
+  content.read( changeset );
+  std::string data( content.c_buf(), content.size() );
+
+  // pipes cannot be mapped - the reader needs to fall back to reading the stream
+  std::thread writer( [&fifo, &data]() { flushString( fifo, data ); } );
+
+  ChangesetReader reader;
+  EXPECT_TRUE( reader.open( fifo ) );
+  writer.join();
+
+  ChangesetEntry entry;
+  EXPECT_TRUE( reader.nextEntry( entry ) );
+  EXPECT_EQ( entry.op, ChangesetEntry::OpDelete );
+  EXPECT_EQ( entry.table->name, "simple" );
+  EXPECT_EQ( entry.oldValues[2].getString(), "feature2" );
+  EXPECT_FALSE( reader.nextEntry( entry ) );
+
+  fileremove( fifo );
+}
+
+TEST( ChangesetReaderTest, test_pipe_file_descriptors )
+{
+  int fds[2];
+  ASSERT_EQ( pipe( fds ), 0 );
+
+  ChangesetTable table;
+  table.name = "t";
+  table.primaryKeys = { true, false };
+
+  // the writer streams a compressed changeset to the pipe while the reader consumes it
+  std::thread writerThread( [&table, &fds]()
+  {
+    ChangesetWriter writer;
+    writer.setCompressionEnabled( true );
+    writer.openFileDescriptor( fds[1] );
+    writer.beginTable( table );
+    for ( int i = 0; i < 10000; ++i )
+      writer.writeEntry( ChangesetEntry::make( &table, ChangesetEntry::OpInsert, {}, { Value::makeInt( i ), Value::makeText( "row" ) } ) );
+    writer.close();
+    close( fds[1] );  // the writer only closes its own copy of the descriptor
+  } );
+
+  ChangesetReader reader;
+  EXPECT_TRUE( reader.openFileDescriptor( fds[0] ) );
+  writerThread.join();
+  close( fds[0] );
+
+  ChangesetEntry entry;
+  int count = 0;
+  while ( reader.nextEntry( entry ) )
+  {
+    EXPECT_EQ( entry.newValues[0].getInt(), count );
+    ++count;
+  }
+  EXPECT_EQ( count, 10000 );
+}
+#endif
+
 
 int main( int argc, char **argv )
 {
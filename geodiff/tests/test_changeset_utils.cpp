@@ -8,13 +8,17 @@
 #include "geodiff.h"
 
 #include "changesetutils.h"
+#include "changesetapplyorder.h"
 #include "changesetreader.h"
 #include "changesetwriter.h"
+#include "changesetentrypool.h"
 
 #include "geodiffutils.hpp"
 
 #include "json.hpp"
 
+#include <fstream>
+
 static void doInvert( const std::string &changeset, const std::string &invChangeset )
 {
   ChangesetReader reader;
@@ -375,6 +379,77 @@ TEST( ChangesetUtils, test_concat_changesets_multiple_tables )
   } );
 }
 
+TEST( ChangesetUtils, test_entry_pool )
+{
+  ChangesetTable table;
+  table.name = "t";
+  table.primaryKeys = { true, false };
+
+  ChangesetEntryPool pool;
+  std::vector<ChangesetEntry *> entries;
+  for ( int i = 0; i < ( int ) ChangesetEntryPool::CHUNK_SIZE + 10; ++i )
+    entries.push_back( pool.create( ChangesetEntry::make( &table, ChangesetEntry::OpInsert, {}, { Value::makeInt( i ), Value::makeText( "x" ) } ) ) );
+  EXPECT_EQ( pool.size(), ChangesetEntryPool::CHUNK_SIZE + 10 );
+  EXPECT_EQ( pool.chunkCount(), 2 );
+  EXPECT_EQ( entries[5]->newValues[0], Value::makeInt( 5 ) );
+  EXPECT_EQ( entries[5]->table, &table );
+
+  // released entries get reused
+  ChangesetEntry *released = entries[5];
+  pool.release( released );
+  EXPECT_EQ( pool.size(), ChangesetEntryPool::CHUNK_SIZE + 9 );
+  ChangesetEntry moved = ChangesetEntry::make( &table, ChangesetEntry::OpDelete, { Value::makeInt( 42 ), Value::makeNull() }, {} );
+  ChangesetEntry *reused = pool.create( std::move( moved ) );
+  EXPECT_EQ( reused, released );
+  EXPECT_EQ( reused->op, ChangesetEntry::OpDelete );
+  EXPECT_EQ( reused->oldValues[0], Value::makeInt( 42 ) );
+  EXPECT_TRUE( reused->newValues.empty() );
+  EXPECT_EQ( pool.chunkCount(), 2 );
+}
+
+TEST( ChangesetUtils, test_apply_order )
+{
+  ChangesetApplyOrder order( { { "child", "parent" }, { "grandchild", "child" }, { "tree", "tree" }, { "a", "b" }, { "b", "a" } } );
+  EXPECT_TRUE( order.isOrdered( "parent" ) );
+  EXPECT_TRUE( order.isOrdered( "grandchild" ) );
+  EXPECT_TRUE( order.isOrdered( "a" ) );
+  EXPECT_FALSE( order.isOrdered( "tree" ) );  // references itself only - left to retrying
+  EXPECT_FALSE( order.isOrdered( "other" ) );
+
+  // referenced tables first, tables in a cycle in the order of names
+  std::vector<std::string> expectedTables = { "parent", "child", "grandchild", "a", "b" };
+  EXPECT_EQ( order.orderedTables(), expectedTables );
+
+  ChangesetTable parent, child, grandchild;
+  parent.name = "parent";
+  child.name = "child";
+  grandchild.name = "grandchild";
+  for ( ChangesetTable *table : { &parent, &child, &grandchild } )
+    table->primaryKeys = { true };
+
+  order.addEntry( ChangesetEntry::make( &grandchild, ChangesetEntry::OpInsert, {}, { Value::makeInt( 1 ) } ) );
+  order.addEntry( ChangesetEntry::make( &child, ChangesetEntry::OpDelete, { Value::makeInt( 2 ) }, {} ) );
+  order.addEntry( ChangesetEntry::make( &parent, ChangesetEntry::OpInsert, {}, { Value::makeInt( 3 ) } ) );
+  order.addEntry( ChangesetEntry::make( &parent, ChangesetEntry::OpDelete, { Value::makeInt( 4 ) }, {} ) );
+  order.addEntry( ChangesetEntry::make( &child, ChangesetEntry::OpUpdate, { Value::makeInt( 5 ) }, { Value() } ) );
+
+  // inserts and updates of parents first, then deletes of children first
+  std::vector<const ChangesetEntry *> entries = order.orderedEntries();
+  ASSERT_EQ( entries.size(), 5 );
+  std::vector<std::pair<std::string, int64_t>> keys;
+  for ( const ChangesetEntry *entry : entries )
+  {
+    const Value &pk = entry->op == ChangesetEntry::OpInsert ? entry->newValues[0] : entry->oldValues[0];
+    keys.push_back( { entry->table->name, pk.getInt() } );
+  }
+  std::vector<std::pair<std::string, int64_t>> expectedKeys = { { "parent", 3 }, { "child", 5 }, { "grandchild", 1 }, { "child", 2 }, { "parent", 4 } };
+  EXPECT_EQ( keys, expectedKeys );
+
+  // tables are copied, as they are typically owned by a changeset reader
+  EXPECT_NE( entries[0]->table, &parent );
+  EXPECT_EQ( entries[0]->table, entries[4]->table );
+}
+
 TEST( ChangesetUtils, test_schema )
 {
   makedir( pathjoin( tmpdir(), "test_schema" ) );
@@ -413,6 +488,55 @@ TEST( ChangesetUtils, test_schema )
   EXPECT_TRUE( created == expected );
 }
 
+TEST( ChangesetUtils, test_writer_buffering )
+{
+  makedir( pathjoin( tmpdir(), "test_writer_buffering" ) );
+  std::string changeset = pathjoin( tmpdir(), "test_writer_buffering", "out.diff" );
+
+  ChangesetTable table;
+  table.name = "simple";
+  table.primaryKeys = { true, false };
+
+  // enough entries to overflow the internal buffer a few times + a blob larger than the buffer
+  const int entryCount = 100000;
+  std::string largeBlob( 3 * 1024 * 1024, 'x' );
+  Value blobValue;
+  blobValue.setString( Value::TypeBlob, largeBlob.data(), largeBlob.size() );
+
+  {
+    ChangesetWriter writer;
+    ASSERT_NO_THROW( writer.open( changeset ) );
+    writer.preallocate( 8 * 1024 * 1024 );
+    writer.beginTable( table );
+    for ( int i = 0; i < entryCount; ++i )
+    {
+      Value v = i == entryCount / 2 ? blobValue : Value::makeText( "feature " + std::to_string( i ) );
+      writer.writeEntry( ChangesetEntry::make( &table, ChangesetEntry::OpInsert, {}, { Value::makeInt( i ), v } ) );
+    }
+    EXPECT_NO_THROW( writer.close() );
+  }
+
+  ChangesetReader reader;
+  EXPECT_TRUE( reader.open( changeset ) );
+  ChangesetEntry entry;
+  int count = 0;
+  while ( reader.nextEntry( entry ) )
+  {
+    EXPECT_EQ( entry.op, ChangesetEntry::OpInsert );
+    EXPECT_EQ( entry.newValues[0].getInt(), count );
+    if ( count == entryCount / 2 )
+      EXPECT_EQ( entry.newValues[1].getString(), largeBlob );
+    else
+      EXPECT_EQ( entry.newValues[1].getString(), "feature " + std::to_string( count ) );
+    ++count;
+  }
+  EXPECT_EQ( count, entryCount );
+
+  // preallocation must not change the size of the written file
+  std::ifstream f( changeset, std::ifstream::ate | std::ifstream::binary );
+  EXPECT_LT( static_cast<int64_t>( f.tellg() ), 8 * 1024 * 1024 );
+}
+
 int main( int argc, char **argv )
 {
   testing::InitGoogleTest( &argc, argv );
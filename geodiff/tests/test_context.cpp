@@ -118,6 +118,20 @@ TEST( ContextTest, clearIncludeResetsIsTableSkipped )
   EXPECT_FALSE( ctx.isTableSkipped( "lines" ) );
 }
 
+TEST( ContextTest, ignoredColumns )
+{
+  Context ctx;
+  EXPECT_FALSE( ctx.isColumnIgnored( "lines", "last_edited" ) );
+  ctx.setColumnsToIgnore( { "last_edited", "points.editor" } );
+  EXPECT_TRUE( ctx.isColumnIgnored( "lines", "last_edited" ) );
+  EXPECT_TRUE( ctx.isColumnIgnored( "points", "last_edited" ) );
+  EXPECT_TRUE( ctx.isColumnIgnored( "points", "editor" ) );
+  EXPECT_FALSE( ctx.isColumnIgnored( "lines", "editor" ) );
+  EXPECT_FALSE( ctx.isColumnIgnored( "points", "name" ) );
+  ctx.setColumnsToIgnore( {} );
+  EXPECT_FALSE( ctx.isColumnIgnored( "lines", "last_edited" ) );
+}
+
 int main( int argc, char **argv )
 {
   testing::InitGoogleTest( &argc, argv );
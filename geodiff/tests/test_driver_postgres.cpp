@@ -16,6 +16,8 @@
 
 #include "json.hpp"
 
+#include <fstream>
+
 extern "C"
 {
 #include <libpq-fe.h>
@@ -418,6 +420,250 @@ TEST( PostgresDriverTest, test_apply_changeset_conflict )
   EXPECT_TRUE( schemasEqual( conninfo, "gd_base", "gd_test_apply", pathjoin( tmpdir(), "test_postgres" ) ) );
 }
 
+TEST( PostgresDriverTest, test_apply_changeset_same_driver )
+{
+  // prepared statements of an apply must not clash with the next apply using the same connection
+  std::string conninfo = pgTestConnInfo();
+  std::string fileConflict = pathjoin( testdir(), "conflict", "base-conflict-delete.diff" );
+  std::string fileInserted = pathjoin( testdir(), "postgres", "inserted_1_a.diff" );
+  std::string fileInverted = pathjoin( tmpdir(), "test_postgres", "inserted_1_a_inverted.diff" );
+
+  makedir( pathjoin( tmpdir(), "test_postgres" ) );
+  {
+    ChangesetReader reader;
+    ChangesetWriter writer;
+    ASSERT_TRUE( reader.open( fileInserted ) );
+    writer.open( fileInverted );
+    invertChangeset( reader, writer );
+    writer.close();
+  }
+
+  execSqlCommands( conninfo, pathjoin( testdir(), "postgres", "base.sql" ) );
+  execSqlCommands( conninfo, pathjoin( testdir(), "postgres", "test_apply.sql" ) );
+  execSqlCommands( conninfo, pathjoin( testdir(), "postgres", "base.sql" ) );
+
+  DriverParametersMap params;
+  params["conninfo"] = conninfo;
+  params["base"] = "gd_test_apply";
+
+  {
+    std::unique_ptr<Driver> driver( Driver::createDriver( static_cast<Context *>( testContext() ), "postgres" ) );
+    ASSERT_TRUE( driver );
+    driver->open( params );
+
+    ChangesetReader readerConflict;
+    EXPECT_TRUE( readerConflict.open( fileConflict ) );
+    EXPECT_ANY_THROW( driver->applyChangeset( readerConflict ) );
+
+    ChangesetReader readerInserted;
+    EXPECT_TRUE( readerInserted.open( fileInserted ) );
+    driver->applyChangeset( readerInserted );
+
+    ChangesetReader readerInverted;
+    EXPECT_TRUE( readerInverted.open( fileInverted ) );
+    driver->applyChangeset( readerInverted );
+  }
+
+  EXPECT_TRUE( schemasEqual( conninfo, "gd_base", "gd_test_apply", pathjoin( tmpdir(), "test_postgres" ) ) );
+}
+
+TEST( PostgresDriverTest, test_apply_changeset_self_reference )
+{
+  // inserts that violate a (not deferrable) foreign key within a batch of changes
+  // must be retried after the rows they reference get inserted
+  std::string conninfo = pgTestConnInfo();
+  execSqlCommandsFromString( conninfo,
+                             "DROP SCHEMA IF EXISTS gd_self_ref CASCADE; CREATE SCHEMA gd_self_ref;"
+                             "CREATE TABLE gd_self_ref.items ( fid integer PRIMARY KEY, parent_fid integer REFERENCES gd_self_ref.items( fid ) );" );
+
+  makedir( pathjoin( tmpdir(), "test_postgres" ) );
+  std::string changeset = pathjoin( tmpdir(), "test_postgres", "self_reference.diff" );
+
+  ChangesetTable table;
+  table.name = "items";
+  table.primaryKeys = { true, false };
+  {
+    ChangesetWriter writer;
+    ASSERT_NO_THROW( writer.open( changeset ) );
+    writer.beginTable( table );
+    // more rows than fit into a single batch (these get inserted by a single command)
+    for ( int i = 10; i < 1210; ++i )
+      writer.writeEntry( ChangesetEntry::make( &table, ChangesetEntry::OpInsert, {}, { Value::makeInt( i ), Value::makeNull() } ) );
+    // a different kind of change, so that the following inserts get applied one by one
+    writer.writeEntry( ChangesetEntry::make( &table, ChangesetEntry::OpUpdate, { Value::makeInt( 10 ), Value::makeNull() }, { Value(), Value::makeInt( 11 ) } ) );
+    writer.writeEntry( ChangesetEntry::make( &table, ChangesetEntry::OpInsert, {}, { Value::makeInt( 1 ), Value::makeInt( 2 ) } ) );
+    writer.writeEntry( ChangesetEntry::make( &table, ChangesetEntry::OpInsert, {}, { Value::makeInt( 2 ), Value::makeNull() } ) );
+    writer.writeEntry( ChangesetEntry::make( &table, ChangesetEntry::OpInsert, {}, { Value::makeInt( 3 ), Value::makeInt( 1 ) } ) );
+    ASSERT_NO_THROW( writer.close() );
+  }
+
+  DriverParametersMap params;
+  params["conninfo"] = conninfo;
+  params["base"] = "gd_self_ref";
+
+  {
+    std::unique_ptr<Driver> driver( Driver::createDriver( static_cast<Context *>( testContext() ), "postgres" ) );
+    ASSERT_TRUE( driver );
+    driver->open( params );
+
+    ChangesetReader reader;
+    EXPECT_TRUE( reader.open( changeset ) );
+    EXPECT_NO_THROW( driver->applyChangeset( reader ) );
+  }
+
+  PGconn *c = PQconnectdb( conninfo.c_str() );
+  ASSERT_EQ( PQstatus( c ), CONNECTION_OK );
+  PGresult *res = PQexec( c, "SELECT count(*), count(parent_fid) FROM gd_self_ref.items" );
+  ASSERT_EQ( PQresultStatus( res ), PGRES_TUPLES_OK );
+  EXPECT_EQ( std::string( PQgetvalue( res, 0, 0 ) ), "1203" );
+  EXPECT_EQ( std::string( PQgetvalue( res, 0, 1 ) ), "3" );
+  PQclear( res );
+  PQfinish( c );
+}
+
+//! Returns the first value of the query result
+static std::string pgQueryValue( const std::string &conninfo, const std::string &sql )
+{
+  PGconn *c = PQconnectdb( conninfo.c_str() );
+  PGresult *res = PQexec( c, sql.c_str() );
+  std::string value = PQresultStatus( res ) == PGRES_TUPLES_OK ? PQgetvalue( res, 0, 0 ) : PQresultErrorMessage( res );
+  PQclear( res );
+  PQfinish( c );
+  return value;
+}
+
+//! Returns GeoPackage geometry blob with a point (without envelope)
+static Value gpkgPoint( double x, double y )
+{
+  std::string blob( "GP\x00\x01", 4 );  // magic, version, flags (little endian)
+  int32_t srsId = 4326;
+  uint32_t wkbType = 1;
+  blob.append( reinterpret_cast<const char *>( &srsId ), 4 );
+  blob.push_back( '\x01' );  // WKB byte order (little endian)
+  blob.append( reinterpret_cast<const char *>( &wkbType ), 4 );
+  blob.append( reinterpret_cast<const char *>( &x ), 8 );
+  blob.append( reinterpret_cast<const char *>( &y ), 8 );
+  Value v;
+  v.setString( Value::TypeBlob, blob.data(), blob.size() );
+  return v;
+}
+
+TEST( PostgresDriverTest, test_apply_changeset_bulk )
+{
+  // long runs of inserts, updates and deletes of a table get applied with set based commands
+  std::string conninfo = pgTestConnInfo();
+  execSqlCommandsFromString( conninfo,
+                             "DROP SCHEMA IF EXISTS gd_bulk CASCADE; CREATE SCHEMA gd_bulk;"
+                             "CREATE TABLE gd_bulk.items ( fid serial PRIMARY KEY, name varchar(20), value double precision, geom geometry(Point, 4326), price numeric(6,1) );" );
+
+  makedir( pathjoin( tmpdir(), "test_postgres" ) );
+  std::string changesetInsert = pathjoin( tmpdir(), "test_postgres", "bulk_insert.diff" );
+  std::string changesetUpdate = pathjoin( tmpdir(), "test_postgres", "bulk_update.diff" );
+  std::string changesetConflict = pathjoin( tmpdir(), "test_postgres", "bulk_conflict.diff" );
+  std::string changesetStale = pathjoin( tmpdir(), "test_postgres", "bulk_stale.diff" );
+
+  ChangesetTable table;
+  table.name = "items";
+  table.primaryKeys = { true, false, false, false, false };
+  auto rowValues = []( int i )
+  {
+    std::vector<Value> values = { Value::makeInt( i ), Value::makeText( "item " + std::to_string( i ) ), Value::makeDouble( i * 0.5 ), gpkgPoint( i, -i ), Value::makeDouble( i * 0.5 ) };
+    if ( i % 10 == 0 )
+      values[3] = Value::makeNull();
+    return values;
+  };
+
+  {
+    ChangesetWriter writer;
+    ASSERT_NO_THROW( writer.open( changesetInsert ) );
+    writer.beginTable( table );
+    for ( int i = 1; i <= 500; ++i )
+      writer.writeEntry( ChangesetEntry::make( &table, ChangesetEntry::OpInsert, {}, rowValues( i ) ) );
+    ASSERT_NO_THROW( writer.close() );
+  }
+  {
+    ChangesetWriter writer;
+    ASSERT_NO_THROW( writer.open( changesetUpdate ) );
+    writer.beginTable( table );
+    for ( int i = 1; i <= 300; ++i )
+    {
+      std::vector<Value> oldValues = { Value::makeInt( i ), Value::makeText( "item " + std::to_string( i ) ), Value(), Value(), Value() };
+      std::vector<Value> newValues = { Value(), Value::makeText( "renamed " + std::to_string( i ) ), Value(), Value(), Value() };
+      writer.writeEntry( ChangesetEntry::make( &table, ChangesetEntry::OpUpdate, oldValues, newValues ) );
+    }
+    for ( int i = 301; i <= 450; ++i )
+      writer.writeEntry( ChangesetEntry::make( &table, ChangesetEntry::OpDelete, rowValues( i ), {} ) );
+    ASSERT_NO_THROW( writer.close() );
+  }
+  {
+    // the last delete does not match the row
+    ChangesetWriter writer;
+    ASSERT_NO_THROW( writer.open( changesetConflict ) );
+    writer.beginTable( table );
+    for ( int i = 451; i <= 500; ++i )
+    {
+      std::vector<Value> oldValues = rowValues( i );
+      if ( i == 500 )
+        oldValues[2] = Value::makeDouble( 1 );
+      writer.writeEntry( ChangesetEntry::make( &table, ChangesetEntry::OpDelete, oldValues, {} ) );
+    }
+    ASSERT_NO_THROW( writer.close() );
+  }
+  {
+    // the last update has a stale old price, which is equal to the current one only when rounded to numeric(6,1)
+    ChangesetWriter writer;
+    ASSERT_NO_THROW( writer.open( changesetStale ) );
+    writer.beginTable( table );
+    for ( int i = 1; i <= 200; ++i )
+    {
+      std::vector<Value> oldValues = { Value::makeInt( i ), Value(), Value(), Value(), Value::makeDouble( i == 200 ? 100.04 : i * 0.5 ) };
+      std::vector<Value> newValues = { Value(), Value(), Value(), Value(), Value::makeDouble( i * 0.5 + 1 ) };
+      writer.writeEntry( ChangesetEntry::make( &table, ChangesetEntry::OpUpdate, oldValues, newValues ) );
+    }
+    ASSERT_NO_THROW( writer.close() );
+  }
+
+  DriverParametersMap params;
+  params["conninfo"] = conninfo;
+  params["base"] = "gd_bulk";
+
+  std::unique_ptr<Driver> driver( Driver::createDriver( static_cast<Context *>( testContext() ), "postgres" ) );
+  ASSERT_TRUE( driver );
+  driver->open( params );
+
+  {
+    ChangesetReader reader;
+    EXPECT_TRUE( reader.open( changesetInsert ) );
+    EXPECT_NO_THROW( driver->applyChangeset( reader ) );
+  }
+  EXPECT_EQ( pgQueryValue( conninfo, "SELECT count(*) FROM gd_bulk.items" ), "500" );
+  EXPECT_EQ( pgQueryValue( conninfo, "SELECT sum(value) FROM gd_bulk.items" ), "62625" );
+  EXPECT_EQ( pgQueryValue( conninfo, "SELECT sum(ST_X(geom)) FROM gd_bulk.items WHERE ST_SRID(geom) = 4326" ), "112500" );
+  EXPECT_EQ( pgQueryValue( conninfo, "SELECT last_value FROM gd_bulk.items_fid_seq" ), "500" );
+
+  {
+    ChangesetReader reader;
+    EXPECT_TRUE( reader.open( changesetUpdate ) );
+    EXPECT_NO_THROW( driver->applyChangeset( reader ) );
+  }
+  EXPECT_EQ( pgQueryValue( conninfo, "SELECT count(*) FROM gd_bulk.items" ), "350" );
+  EXPECT_EQ( pgQueryValue( conninfo, "SELECT count(*) FROM gd_bulk.items WHERE name LIKE 'renamed %'" ), "300" );
+
+  {
+    ChangesetReader reader;
+    EXPECT_TRUE( reader.open( changesetConflict ) );
+    EXPECT_THROW( driver->applyChangeset( reader ), GeoDiffConflictsException );
+  }
+  EXPECT_EQ( pgQueryValue( conninfo, "SELECT count(*) FROM gd_bulk.items" ), "350" );
+
+  {
+    ChangesetReader reader;
+    EXPECT_TRUE( reader.open( changesetStale ) );
+    EXPECT_THROW( driver->applyChangeset( reader ), GeoDiffConflictsException );
+  }
+  EXPECT_EQ( pgQueryValue( conninfo, "SELECT sum(price) FROM gd_bulk.items WHERE fid <= 200" ), "10050.0" );
+}
+
 TEST( PostgresDriverTest, test_dump_data )
 {
   std::string conninfo = pgTestConnInfo();
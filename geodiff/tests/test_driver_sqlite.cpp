@@ -11,9 +11,14 @@
 #include "changesetreader.h"
 #include "changesetwriter.h"
 #include "driver.h"
+#include "geodiffcontext.hpp"
+#include "sqliterowcomparator.h"
+#include "sqliterowhashindex.h"
 #include "sqliteutils.h"
 #include "geodiffutils.hpp"
 
+#include <fstream>
+
 static void testCreateChangeset( const std::string &testname, const std::string &fileBase, const std::string &fileModified, const std::string &fileExpected )
 {
   makedir( pathjoin( tmpdir(), testname ) );
@@ -287,6 +292,122 @@ TEST( SqliteDriverTest, apply_changeset_conflict )
   ASSERT_TRUE( equals( testdb, fileBase ) );
 }
 
+TEST( SqliteDriverTest, apply_changeset_foreign_keys )
+{
+  // the changeset has parent rows deleted before child rows (tables are sorted by name) - applied in this order
+  // the cascading delete of a parent would remove the child rows before their own deletes get applied
+  std::string testname = "test_apply_changeset_foreign_keys";
+  makedir( pathjoin( tmpdir(), testname ) );
+  std::string fileBase = pathjoin( tmpdir(), testname, "base.sqlite" );
+  std::string fileModified = pathjoin( tmpdir(), testname, "modified.sqlite" );
+  std::string fileOutput = pathjoin( tmpdir(), testname, "output.sqlite" );
+  std::string fileChangeset = pathjoin( tmpdir(), testname, "base-modified.diff" );
+  std::string fileCheck = pathjoin( tmpdir(), testname, "modified-output.diff" );
+
+  for ( const std::string &file : { fileBase, fileModified } )
+  {
+    fileremove( file );
+    std::shared_ptr<Sqlite3Db> db = std::make_shared<Sqlite3Db>();
+    db->create( file );
+    Buffer sql;
+    sql.printf( "CREATE TABLE a_parent ( fid INTEGER PRIMARY KEY, name TEXT );"
+                "CREATE TABLE b_child ( fid INTEGER PRIMARY KEY, parent INTEGER REFERENCES a_parent( fid ) ON DELETE CASCADE );" );
+    if ( file == fileBase )
+      sql.printf( "INSERT INTO a_parent VALUES ( 1, 'a' ), ( 2, 'b' ); INSERT INTO b_child VALUES ( 1, 1 ), ( 2, 2 );" );
+    else
+      sql.printf( "INSERT INTO a_parent VALUES ( 2, 'b' ), ( 3, 'c' ); INSERT INTO b_child VALUES ( 2, 2 ), ( 3, 3 );" );
+    db->exec( sql );
+  }
+  filecopy( fileOutput, fileBase );
+
+  Context ctx;
+  std::unique_ptr<Driver> driver( Driver::createDriver( &ctx, "sqlite" ) );
+  driver->open( Driver::sqliteParameters( fileBase, fileModified ) );
+  {
+    ChangesetWriter writer;
+    ASSERT_NO_THROW( writer.open( fileChangeset ) );
+    driver->createChangeset( writer );
+  }
+
+  driver = Driver::createDriver( &ctx, "sqlite" );
+  driver->open( Driver::sqliteParametersSingleSource( fileOutput ) );
+  {
+    ChangesetReader reader;
+    ASSERT_TRUE( reader.open( fileChangeset ) );
+    ASSERT_NO_THROW( driver->applyChangeset( reader ) );
+  }
+
+  driver = Driver::createDriver( &ctx, "sqlite" );
+  driver->open( Driver::sqliteParameters( fileModified, fileOutput ) );
+  {
+    ChangesetWriter writer;
+    ASSERT_NO_THROW( writer.open( fileCheck ) );
+    driver->createChangeset( writer );
+  }
+  ChangesetReader reader;
+  ASSERT_TRUE( reader.open( fileCheck ) );
+  EXPECT_TRUE( reader.isEmpty() );
+}
+
+
+static int sqliteCount( const std::string &file, const std::string &sql )
+{
+  std::shared_ptr<Sqlite3Db> db = std::make_shared<Sqlite3Db>();
+  db->open( file );
+  register_gpkg_extensions( db );
+  Sqlite3Stmt statement;
+  statement.prepare( db, "%s", sql.c_str() );
+  EXPECT_EQ( sqlite3_step( statement.get() ), SQLITE_ROW );
+  return sqlite3_column_int( statement.get(), 0 );
+}
+
+TEST( SqliteDriverTest, apply_changeset_bulk )
+{
+  // with "bulk_apply" option indexes are dropped while applying changes and rebuilt at the end
+  std::string testname = "test_apply_changeset_bulk";
+  makedir( pathjoin( tmpdir(), testname ) );
+  std::string testdb = pathjoin( tmpdir(), testname, "output.gpkg" );
+  filecopy( testdb, pathjoin( testdir(), "base.gpkg" ) );
+  {
+    std::shared_ptr<Sqlite3Db> db = std::make_shared<Sqlite3Db>();
+    db->open( testdb );
+    Buffer sql;
+    sql.printf( "CREATE INDEX idx_simple_name ON simple ( name )" );
+    db->exec( sql );
+  }
+
+  DriverParametersMap conn = Driver::sqliteParametersSingleSource( testdb );
+  conn["conninfo"] = "bulk_apply";
+  std::unique_ptr<Driver> driver( Driver::createDriver( static_cast<Context *>( testContext() ), "sqlite" ) );
+  driver->open( conn );
+  {
+    ChangesetReader reader;
+    ASSERT_TRUE( reader.open( pathjoin( testdir(), "2_inserts", "base-inserted_1_A.diff" ) ) );
+    ASSERT_NO_THROW( driver->applyChangeset( reader ) );
+  }
+  driver.reset();
+
+  EXPECT_TRUE( equals( testdb, pathjoin( testdir(), "2_inserts", "inserted_1_A.gpkg" ) ) );
+  EXPECT_EQ( sqliteCount( testdb, "SELECT count(*) FROM sqlite_master WHERE type = 'index' AND name = 'idx_simple_name'" ), 1 );
+  EXPECT_EQ( sqliteCount( testdb, "SELECT count(*) FROM sqlite_master WHERE type = 'trigger' AND name LIKE 'rtree_simple_geometry_%'" ), 6 );
+  EXPECT_EQ( sqliteCount( testdb, "SELECT count(*) FROM rtree_simple_geometry" ), 4 );
+  EXPECT_EQ( sqliteCount( testdb, "SELECT count(*) FROM rtree_simple_geometry AS r JOIN simple AS s ON r.id = s.fid "
+                          "WHERE r.minx <= ST_MinX(s.geometry) AND r.maxx >= ST_MaxX(s.geometry) AND r.maxy - r.miny < 1e-3" ), 4 );
+
+  // everything is rolled back on conflicts
+  driver = Driver::createDriver( static_cast<Context *>( testContext() ), "sqlite" );
+  driver->open( conn );
+  {
+    ChangesetReader reader;
+    ASSERT_TRUE( reader.open( pathjoin( testdir(), "conflict", "base-conflict-delete.diff" ) ) );
+    EXPECT_ANY_THROW( driver->applyChangeset( reader ) );
+  }
+  driver.reset();
+
+  EXPECT_TRUE( equals( testdb, pathjoin( testdir(), "2_inserts", "inserted_1_A.gpkg" ) ) );
+  EXPECT_EQ( sqliteCount( testdb, "SELECT count(*) FROM sqlite_master WHERE type = 'index' AND name = 'idx_simple_name'" ), 1 );
+  EXPECT_EQ( sqliteCount( testdb, "SELECT count(*) FROM sqlite_master WHERE type = 'trigger' AND name LIKE 'rtree_simple_geometry_%'" ), 6 );
+}
 
 TEST( SqliteDriverTest, test_create_from_gpkg )
 {
@@ -380,6 +501,756 @@ TEST( SqliteDriverTest, test_timestamp_miliseconds )
                     );
 }
 
+TEST( SqliteDriverTest, test_datetime_key )
+{
+  // datetime values parsed natively must compare the same way as the output of STRFTIME() in SQLite
+  std::vector<std::string> values =
+  {
+    "2021-04-01", "2021-04-01 00:00", "2021-04-01T00:00:00", "2021-04-01 00:00:00.000Z",
+    "2021-04-01 15:00:00", "2021-04-01T15:00:00Z", "2021-04-01 15:00", "2021-04-01 15:00:00.0001",
+    "2021-04-01 15:00:00.123", "2021-04-01 15:00:00.1234", "2021-04-01 15:00:00.1235", "2021-04-01 15:00:00.12",
+    "2021-04-01 15:00:59.9995", "2021-04-01 15:00:59.999", "2021-04-01 23:59:59.999", "2021-04-02 00:00",
+    "2021-02-28", "2021-03-01", "2024-02-29", "2000-02-29", "0000-01-01", "9999-12-31 23:59:59.999",
+  };
+
+  std::shared_ptr<Sqlite3Db> db = std::make_shared<Sqlite3Db>();
+  db->open( ":memory:" );
+  std::vector<std::string> formatted;
+  std::vector<int64_t> keys;
+  for ( const std::string &v : values )
+  {
+    Sqlite3Stmt stmt;
+    stmt.prepare( db, "SELECT STRFTIME('%%Y-%%m-%%d %%H:%%M:%%f', %Q)", v.c_str() );
+    ASSERT_EQ( sqlite3_step( stmt.get() ), SQLITE_ROW );
+    ASSERT_EQ( sqlite3_column_type( stmt.get(), 0 ), SQLITE_TEXT ) << v;
+    formatted.push_back( reinterpret_cast<const char *>( sqlite3_column_text( stmt.get(), 0 ) ) );
+
+    int64_t key;
+    ASSERT_TRUE( sqliteDatetimeKey( v.data(), v.size(), key ) ) << v;
+    keys.push_back( key );
+  }
+
+  for ( size_t i = 0; i < values.size(); ++i )
+    for ( size_t j = 0; j < values.size(); ++j )
+      EXPECT_EQ( keys[i] == keys[j], formatted[i] == formatted[j] ) << values[i] << " / " << values[j];
+
+  // formats left to SQLite
+  int64_t key;
+  for ( const std::string v : { "", "2459306.125", "2021-04-01 15:00:00+02:00", " 2021-04-01", "2021-04-01  15:00", "15:00", "2021-4-1", "2021-04-01 15:00:00.", "now", "2023-01-01Z" } )
+    EXPECT_FALSE( sqliteDatetimeKey( v.data(), v.size(), key ) ) << v;
+
+  // days out of range of the month and hour 24 may get normalized by SQLite (e.g. "2023-02-30" to "2023-03-02")
+  for ( const std::string v : { "2023-02-30", "2023-02-29", "1900-02-29", "2024-02-30", "2021-04-31", "2021-12-32", "2021-04-01 24:00" } )
+    EXPECT_FALSE( sqliteDatetimeKey( v.data(), v.size(), key ) ) << v;
+}
+
+TEST( SqliteDriverTest, test_datetime_update )
+{
+  // equal datetime values in different formats are not updates - both when tables are compared
+  // in a single pass (integer primary key) and when compared with SQL queries (NOCASE primary key)
+  std::string testname = "test_datetime_update";
+  makedir( pathjoin( tmpdir(), testname ) );
+  std::string fileBase = pathjoin( tmpdir(), testname, "base.sqlite" );
+  std::string fileModified = pathjoin( tmpdir(), testname, "modified.sqlite" );
+  std::string fileOutput = pathjoin( tmpdir(), testname, "output.diff" );
+  fileremove( fileBase );
+  fileremove( fileModified );
+
+  const char *sqlCreate =
+    "CREATE TABLE t_int ( fid INTEGER PRIMARY KEY, name TEXT, ts DATETIME );"
+    "CREATE TABLE t_nocase ( code TEXT PRIMARY KEY COLLATE NOCASE, name TEXT, ts DATETIME );";
+  const char *sqlRows = "INSERT INTO %s VALUES ( %s, 'a', '2021-04-01 15:00:00' ), ( %s, 'b', '2021-04-01 15:00:00.5' ),"
+                        " ( %s, 'c', '2021-04-01 15:00:00' ), ( %s, 'd', 2459306.125 ), ( %s, 'e', '2021-04-01 17:00:00+02:00' );";
+  const char *sqlRowsModified = "INSERT INTO %s VALUES ( %s, 'a', '2021-04-01T15:00:00Z' ), ( %s, 'b', '2021-04-01 15:00:00.500' ),"
+                                " ( %s, 'cc', '2021-04-01 15:00:01' ), ( %s, 'd', '2021-04-01 15:00' ), ( %s, 'e', '2021-04-01 15:00' );";
+
+  for ( const std::string &file : { fileBase, fileModified } )
+  {
+    const char *rows = file == fileBase ? sqlRows : sqlRowsModified;
+    std::shared_ptr<Sqlite3Db> db = std::make_shared<Sqlite3Db>();
+    db->create( file );
+    Buffer sql;
+    sql.printf( "%s", sqlCreate );
+    sql.printf( rows, "t_int", "1", "2", "3", "4", "5" );
+    sql.printf( rows, "t_nocase", "'1'", "'2'", "'3'", "'4'", "'5'" );
+    db->exec( sql );
+  }
+
+  std::unique_ptr<Driver> driver( Driver::createDriver( static_cast<Context *>( testContext() ), "sqlite" ) );
+  driver->open( Driver::sqliteParameters( fileBase, fileModified ) );
+  {
+    ChangesetWriter writer;
+    ASSERT_NO_THROW( writer.open( fileOutput ) );
+    driver->createChangeset( writer );
+  }
+
+  // only the row with changed name and time is an update, with both columns changed
+  std::map<std::string, int> updates;
+  ChangesetReader reader;
+  ASSERT_TRUE( reader.open( fileOutput ) );
+  ChangesetEntry entry;
+  while ( reader.nextEntry( entry ) )
+  {
+    ASSERT_EQ( entry.op, ChangesetEntry::OpUpdate );
+    ++updates[entry.table->name];
+    EXPECT_EQ( entry.newValues[0].type(), Value::TypeUndefined );
+    EXPECT_EQ( entry.newValues[1].getString(), "cc" );
+    EXPECT_EQ( entry.newValues[2].getString(), "2021-04-01 15:00:01" );
+  }
+  std::map<std::string, int> expected = { { "t_int", 1 }, { "t_nocase", 1 } };
+  EXPECT_EQ( updates, expected );
+}
+
+TEST( SqliteDriverTest, test_ignore_columns )
+{
+  std::string testname = "test_ignore_columns";
+  makedir( pathjoin( tmpdir(), testname ) );
+  std::string fileBase = pathjoin( tmpdir(), testname, "base.sqlite" );
+  std::string fileModified = pathjoin( tmpdir(), testname, "modified.sqlite" );
+  std::string fileOutput = pathjoin( tmpdir(), testname, "output.diff" );
+  fileremove( fileBase );
+  fileremove( fileModified );
+
+  // t_int is compared in a single pass, t_nocase with SQL queries and t_same only differs in ignored columns
+  const char *sqlCreate =
+    "CREATE TABLE t_int ( fid INTEGER PRIMARY KEY, name TEXT, last_edited TEXT, editor TEXT );"
+    "CREATE TABLE t_nocase ( fid TEXT PRIMARY KEY COLLATE NOCASE, name TEXT, last_edited TEXT, editor TEXT );"
+    "CREATE TABLE t_same ( fid INTEGER PRIMARY KEY, name TEXT, last_edited TEXT, editor TEXT );";
+
+  for ( const std::string &file : { fileBase, fileModified } )
+  {
+    bool base = file == fileBase;
+    std::shared_ptr<Sqlite3Db> db = std::make_shared<Sqlite3Db>();
+    db->create( file );
+    Buffer sql;
+    sql.printf( "%s", sqlCreate );
+    for ( const char *table : { "t_int", "t_nocase" } )
+    {
+      if ( base )
+        sql.printf( "INSERT INTO %s VALUES ( 1, 'a', 't1', 'x' ), ( 2, 'b', 't1', 'x' ), ( 3, 'c', 't1', 'x' );", table );
+      else
+        sql.printf( "INSERT INTO %s VALUES ( 1, 'a', 't2', 'y' ), ( 2, 'bb', 't2', 'x' ), ( 4, 'd', 't2', 'y' );", table );
+    }
+    sql.printf( "INSERT INTO t_same VALUES ( 1, 'a', %Q, %Q );", base ? "t1" : "t2", base ? "x" : "y" );
+    db->exec( sql );
+  }
+
+  Context ctx;
+  ctx.setColumnsToIgnore( { "last_edited", "t_int.editor", "t_nocase.editor", "t_same.editor" } );
+  std::unique_ptr<Driver> driver( Driver::createDriver( &ctx, "sqlite" ) );
+  driver->open( Driver::sqliteParameters( fileBase, fileModified ) );
+  {
+    ChangesetWriter writer;
+    ASSERT_NO_THROW( writer.open( fileOutput ) );
+    driver->createChangeset( writer );
+  }
+
+  // only row 2 is updated and only in the name column, inserted and deleted rows have all columns
+  std::map<std::string, int> counts;
+  ChangesetReader reader;
+  ASSERT_TRUE( reader.open( fileOutput ) );
+  ChangesetEntry entry;
+  while ( reader.nextEntry( entry ) )
+  {
+    ++counts[entry.table->name];
+    if ( entry.op == ChangesetEntry::OpUpdate )
+    {
+      EXPECT_NE( entry.oldValues[0].type(), Value::TypeUndefined );
+      EXPECT_EQ( entry.newValues[1].getString(), "bb" );
+      EXPECT_EQ( entry.oldValues[2].type(), Value::TypeUndefined );
+      EXPECT_EQ( entry.newValues[2].type(), Value::TypeUndefined );
+      EXPECT_EQ( entry.newValues[3].type(), Value::TypeUndefined );
+    }
+    else if ( entry.op == ChangesetEntry::OpInsert )
+    {
+      EXPECT_EQ( entry.newValues[2].getString(), "t2" );
+      EXPECT_EQ( entry.newValues[3].getString(), "y" );
+    }
+    else
+    {
+      EXPECT_EQ( entry.oldValues[2].getString(), "t1" );
+      EXPECT_EQ( entry.oldValues[3].getString(), "x" );
+    }
+  }
+  std::map<std::string, int> expected = { { "t_int", 3 }, { "t_nocase", 3 } };
+  EXPECT_EQ( counts, expected );
+}
+
+TEST( SqliteDriverTest, test_geometry_tolerance )
+{
+  std::string testname = "test_geometry_tolerance";
+  makedir( pathjoin( tmpdir(), testname ) );
+  std::string fileBase = pathjoin( testdir(), "base.gpkg" );
+  std::string fileModified = pathjoin( tmpdir(), testname, "modified.gpkg" );
+  std::string fileOutput = pathjoin( tmpdir(), testname, "output.diff" );
+  filecopy( fileModified, fileBase );
+
+  {
+    std::shared_ptr<Sqlite3Db> db = std::make_shared<Sqlite3Db>();
+    db->open( fileModified );
+    register_gpkg_extensions( db );
+    Buffer sql;
+    // feature1: the same point with envelope in the header
+    sql.printf( "UPDATE simple SET geometry = X'47500003E6100000"
+                "1E78CBA1366CF1BF1E78CBA1366CF1BF70E6AAC83981DD3F70E6AAC83981DD3F"
+                "01010000001E78CBA1366CF1BF70E6AAC83981DD3F' WHERE fid = 1;" );
+    // feature2: last bit of X coordinate changed
+    sql.printf( "UPDATE simple SET geometry = X'47500001E61000000101000000F1431AAFE449D7BFF874B615E6FDE13F' WHERE fid = 2;" );
+    // feature3: Y coordinate changed to 1
+    sql.printf( "UPDATE simple SET geometry = X'47500001E610000001010000009CB92A724E60E7BF000000000000F03F' WHERE fid = 3;" );
+    db->exec( sql );
+  }
+
+  for ( double tolerance : { -1.0, 1e-9 } )
+  {
+    Context ctx;
+    ctx.setGeometryTolerance( tolerance );
+    std::unique_ptr<Driver> driver( Driver::createDriver( &ctx, "sqlite" ) );
+    driver->open( Driver::sqliteParameters( fileBase, fileModified ) );
+    {
+      ChangesetWriter writer;
+      ASSERT_NO_THROW( writer.open( fileOutput ) );
+      driver->createChangeset( writer );
+    }
+
+    std::vector<int64_t> updatedFids;
+    ChangesetReader reader;
+    ASSERT_TRUE( reader.open( fileOutput ) );
+    ChangesetEntry entry;
+    while ( reader.nextEntry( entry ) )
+    {
+      ASSERT_EQ( entry.op, ChangesetEntry::OpUpdate );
+      updatedFids.push_back( entry.oldValues[0].getInt() );
+    }
+    EXPECT_EQ( updatedFids, tolerance < 0 ? std::vector<int64_t>( { 1, 2, 3 } ) : std::vector<int64_t>( { 3 } ) );
+  }
+}
+
+TEST( SqliteDriverTest, test_merge_join )
+{
+  // tables with primary key index are compared in a single pass over both tables, others
+  // (e.g. with non-binary collation) are compared with SQL queries - results must be the same
+  std::string testname = "test_merge_join";
+  makedir( pathjoin( tmpdir(), testname ) );
+  std::string fileBase = pathjoin( tmpdir(), testname, "base.sqlite" );
+  std::string fileModified = pathjoin( tmpdir(), testname, "modified.sqlite" );
+  std::string fileOutput = pathjoin( tmpdir(), testname, "output.diff" );
+  fileremove( fileBase );
+  fileremove( fileModified );
+
+  const char *sqlCreate =
+    "CREATE TABLE t_int ( fid INTEGER PRIMARY KEY, name TEXT, num );"
+    "CREATE TABLE t_text ( code TEXT PRIMARY KEY, v );"
+    "CREATE TABLE t_nocase ( code TEXT PRIMARY KEY COLLATE NOCASE, v );"
+    "CREATE TABLE t_composite ( a INTEGER, b TEXT, v, PRIMARY KEY ( b, a ) );";
+
+  {
+    std::shared_ptr<Sqlite3Db> db = std::make_shared<Sqlite3Db>();
+    db->create( fileBase );
+    Buffer sql;
+    sql.printf( "%s", sqlCreate );
+    sql.printf( "INSERT INTO t_int VALUES ( 1, 'one', 1 ), ( 2, 'two', 2 ), ( 3, 'three', 3 ), ( 4, 'four', 4 ), ( 5, NULL, NULL ),"
+                " ( 7, 'seven', 9007199254740993 ), ( 8, 'eight', 9007199254740992 );" );
+    sql.printf( "INSERT INTO t_text VALUES ( 'a', 1 ), ( 'b', 2 ), ( 'c', 3 );" );
+    sql.printf( "INSERT INTO t_nocase VALUES ( 'x', 1 ), ( 'z', 9007199254740993 );" );
+    sql.printf( "INSERT INTO t_composite VALUES ( 1, 'x', 1 ), ( 2, 'x', 2 );" );
+    db->exec( sql );
+  }
+
+  {
+    std::shared_ptr<Sqlite3Db> db = std::make_shared<Sqlite3Db>();
+    db->create( fileModified );
+    Buffer sql;
+    sql.printf( "%s", sqlCreate );
+    // 0 and 6 inserted, 2 deleted, 3 updated, 4 and 8 have equal numeric value stored as a float (not an update),
+    // 7 is updated to a float that differs from the integer only above 2^53 (equal when compared as doubles)
+    sql.printf( "INSERT INTO t_int VALUES ( 0, 'zero', 0 ), ( 1, 'one', 1 ), ( 3, 'THREE', 3 ), ( 4, 'four', 4.0 ), ( 5, NULL, NULL ), ( 6, 'six', 6 ),"
+                " ( 7, 'seven', 9007199254740992.0 ), ( 8, 'eight', 9007199254740992.0 );" );
+    sql.printf( "INSERT INTO t_text VALUES ( 'a', 1 ), ( 'b', 22 ), ( 'bb', 4 );" );
+    sql.printf( "INSERT INTO t_nocase VALUES ( 'x', 1 ), ( 'y', 2 ), ( 'z', 9007199254740992.0 );" );
+    sql.printf( "INSERT INTO t_composite VALUES ( 1, 'x', 5 ), ( 1, 'y', 1 );" );
+    db->exec( sql );
+  }
+
+  std::unique_ptr<Driver> driver( Driver::createDriver( static_cast<Context *>( testContext() ), "sqlite" ) );
+  driver->open( Driver::sqliteParameters( fileBase, fileModified ) );
+  {
+    ChangesetWriter writer;
+    ASSERT_NO_THROW( writer.open( fileOutput ) );
+    driver->createChangeset( writer );
+  }
+
+  // table name -> number of inserts, updates and deletes
+  std::map<std::string, std::vector<int>> counts;
+  ChangesetReader reader;
+  ASSERT_TRUE( reader.open( fileOutput ) );
+  ChangesetEntry entry;
+  while ( reader.nextEntry( entry ) )
+  {
+    std::vector<int> &c = counts[entry.table->name];
+    c.resize( 3 );
+    if ( entry.op == ChangesetEntry::OpInsert )
+      ++c[0];
+    else if ( entry.op == ChangesetEntry::OpUpdate )
+      ++c[1];
+    else if ( entry.op == ChangesetEntry::OpDelete )
+      ++c[2];
+  }
+
+  EXPECT_EQ( counts.size(), 4 );
+  EXPECT_EQ( counts["t_int"], std::vector<int>( { 2, 2, 1 } ) );
+  EXPECT_EQ( counts["t_text"], std::vector<int>( { 1, 1, 1 } ) );
+  EXPECT_EQ( counts["t_nocase"], std::vector<int>( { 1, 1, 0 } ) );
+  EXPECT_EQ( counts["t_composite"], std::vector<int>( { 1, 1, 1 } ) );
+}
+
+TEST( SqliteDriverTest, test_pk_ranges )
+{
+  // with more threads, a large table with integer primary key is compared in ranges of keys
+  // by multiple threads - the result must be the same as when comparing it in one go
+  std::string testname = "test_pk_ranges";
+  makedir( pathjoin( tmpdir(), testname ) );
+  std::string fileBase = pathjoin( tmpdir(), testname, "base.sqlite" );
+  std::string fileModified = pathjoin( tmpdir(), testname, "modified.sqlite" );
+  fileremove( fileBase );
+  fileremove( fileModified );
+
+  const char *sqlCreate =
+    "CREATE TABLE t_big ( fid INTEGER PRIMARY KEY, name TEXT, num );"
+    "CREATE TABLE t_small ( code TEXT PRIMARY KEY, v );"
+    "WITH RECURSIVE n(i) AS ( SELECT 1 UNION ALL SELECT i + 1 FROM n WHERE i < 50000 ) "
+    "INSERT INTO t_big SELECT i, 'row ' || i, i FROM n;"
+    "INSERT INTO t_small VALUES ( 'a', 1 ), ( 'b', 2 );";
+
+  {
+    std::shared_ptr<Sqlite3Db> db = std::make_shared<Sqlite3Db>();
+    db->create( fileBase );
+    Buffer sql;
+    sql.printf( "%s", sqlCreate );
+    db->exec( sql );
+  }
+
+  {
+    std::shared_ptr<Sqlite3Db> db = std::make_shared<Sqlite3Db>();
+    db->create( fileModified );
+    Buffer sql;
+    sql.printf( "%s", sqlCreate );
+    sql.printf( "UPDATE t_big SET num = -num WHERE fid %% 1000 = 0;" );   // 50 updates
+    sql.printf( "DELETE FROM t_big WHERE fid %% 777 = 1;" );             // 65 deletes
+    sql.printf( "INSERT INTO t_big VALUES ( -5, 'neg', 0 ), ( 200000, 'far', 0 );" );
+    sql.printf( "UPDATE t_small SET v = 3 WHERE code = 'b';" );
+    db->exec( sql );
+  }
+
+  auto createChangeset = [&]( int threadCount, bool indexEnabled )
+  {
+    GEODIFF_ContextH context = GEODIFF_createContext();
+    EXPECT_EQ( GEODIFF_CX_setDiffThreadCount( context, threadCount ), GEODIFF_SUCCESS );
+    std::unique_ptr<Driver> driver( Driver::createDriver( static_cast<Context *>( context ), "sqlite" ) );
+    driver->open( Driver::sqliteParameters( fileBase, fileModified ) );
+    Buffer output;
+    {
+      ChangesetWriter writer;
+      writer.setIndexEnabled( indexEnabled );
+      writer.openBuffer( output );
+      driver->createChangeset( writer );
+      writer.close();
+    }
+    driver.reset();
+    GEODIFF_CX_destroy( context );
+    return std::string( output.c_buf(), static_cast<size_t>( output.size() ) );
+  };
+
+  for ( bool indexEnabled : { false, true } )
+  {
+    std::string sequential = createChangeset( 1, indexEnabled );
+    EXPECT_EQ( createChangeset( 2, indexEnabled ), sequential );
+    EXPECT_EQ( createChangeset( 4, indexEnabled ), sequential );
+  }
+
+  // all changes of the large table are in a single table block
+  Buffer data;
+  std::string changeset = createChangeset( 4, false );
+  data.append( changeset.data(), static_cast<int64_t>( changeset.size() ) );
+  ChangesetReader reader;
+  ASSERT_TRUE( reader.openBuffer( data ) );
+  std::vector<std::string> tableBlocks;
+  int count = 0;
+  ChangesetEntry entry;
+  while ( reader.nextEntry( entry ) )
+  {
+    if ( tableBlocks.empty() || tableBlocks.back() != entry.table->name )
+      tableBlocks.push_back( entry.table->name );
+    ++count;
+  }
+  EXPECT_EQ( tableBlocks, std::vector<std::string>( { "t_big", "t_small" } ) );
+  EXPECT_EQ( count, 50 + 65 + 2 + 1 );
+}
+
+TEST( SqliteDriverTest, test_row_hash_index )
+{
+  // with row hash index in both databases, only blocks of rows that may differ get compared,
+  // the result must be the same as when comparing all rows
+  std::string testname = "test_row_hash_index";
+  makedir( pathjoin( tmpdir(), testname ) );
+  std::string fileBase = pathjoin( tmpdir(), testname, "base.sqlite" );
+  std::string fileModified = pathjoin( tmpdir(), testname, "modified.sqlite" );
+  std::string fileApplied = pathjoin( tmpdir(), testname, "applied.sqlite" );
+  std::string fileChangeset = pathjoin( tmpdir(), testname, "changeset.diff" );
+  fileremove( fileBase );
+
+  {
+    std::shared_ptr<Sqlite3Db> db = std::make_shared<Sqlite3Db>();
+    db->create( fileBase );
+    Buffer sql;
+    sql.printf( "CREATE TABLE t_int ( fid INTEGER PRIMARY KEY, name TEXT, num );"
+                "CREATE TABLE t_text ( code TEXT PRIMARY KEY, v );"
+                "WITH RECURSIVE n(i) AS ( SELECT 1 UNION ALL SELECT i + 1 FROM n WHERE i < 20000 ) "
+                "INSERT INTO t_int SELECT i, 'row ' || i, i FROM n;"
+                "INSERT INTO t_text VALUES ( 'a', 1 ), ( 'b', 2 );" );
+    db->exec( sql );
+  }
+
+  ASSERT_EQ( GEODIFF_updateRowHashIndex( testContext(), fileBase.c_str() ), GEODIFF_SUCCESS );
+  filecopy( fileModified, fileBase );
+  filecopy( fileApplied, fileBase );
+
+  {
+    // the triggers record modified blocks (fid 10 in block 0, fid 3000 in block 2, fid 100000 in block 97)
+    std::shared_ptr<Sqlite3Db> db = std::make_shared<Sqlite3Db>();
+    db->open( fileModified );
+    Buffer sql;
+    sql.printf( "UPDATE t_int SET num = -1 WHERE fid = 10;"
+                "DELETE FROM t_int WHERE fid = 3000;"
+                "INSERT INTO t_int VALUES ( 100000, 'new', 0 );"
+                "UPDATE t_text SET v = 3 WHERE code = 'b';" );
+    db->exec( sql );
+  }
+
+  auto createChangeset = [&]( const std::string &base, const std::string &modified, const std::string &options )
+  {
+    DriverParametersMap conn = Driver::sqliteParameters( base, modified );
+    conn["conninfo"] = options;
+    std::unique_ptr<Driver> driver( Driver::createDriver( static_cast<Context *>( testContext() ), "sqlite" ) );
+    driver->open( conn );
+    Buffer output;
+    {
+      ChangesetWriter writer;
+      writer.openBuffer( output );
+      driver->createChangeset( writer );
+      writer.close();
+    }
+    return std::string( output.c_buf(), static_cast<size_t>( output.size() ) );
+  };
+
+  auto changedBlocks = [&]( const std::string &base, const std::string &modified )
+  {
+    std::unique_ptr<Driver> driver( Driver::createDriver( static_cast<Context *>( testContext() ), "sqlite" ) );
+    driver->open( Driver::sqliteParameters( base, modified ) );
+    std::shared_ptr<Sqlite3Db> db = std::make_shared<Sqlite3Db>();
+    db->open( modified );
+    Buffer sql;
+    sql.printf( "ATTACH '%q' AS aux", base.c_str() );
+    db->exec( sql );
+    TableSchema tbl = driver->tableSchema( "t_int" );
+    EXPECT_TRUE( hasRowHashIndex( db, "main", tbl ) );
+    EXPECT_TRUE( hasRowHashIndex( db, "aux", tbl ) );
+    size_t blockCount = 0;
+    rowHashIndexChangedRanges( db, tbl, blockCount );
+    return blockCount;
+  };
+
+  // index tables are not listed as tables of the database
+  {
+    std::unique_ptr<Driver> driver( Driver::createDriver( static_cast<Context *>( testContext() ), "sqlite" ) );
+    driver->open( Driver::sqliteParametersSingleSource( fileBase ) );
+    EXPECT_EQ( driver->listTables(), std::vector<std::string>( { "t_int", "t_text" } ) );
+  }
+
+  // modified blocks are only known from the triggers at this point
+  std::string expected = createChangeset( fileBase, fileModified, "" );
+  EXPECT_EQ( createChangeset( fileBase, fileModified, "row_hash_index" ), expected );
+  EXPECT_EQ( changedBlocks( fileBase, fileModified ), 3 );
+
+  // after refresh, modified blocks are found by comparing hashes
+  ASSERT_EQ( GEODIFF_updateRowHashIndex( testContext(), fileModified.c_str() ), GEODIFF_SUCCESS );
+  EXPECT_EQ( createChangeset( fileBase, fileModified, "row_hash_index" ), expected );
+  EXPECT_EQ( changedBlocks( fileBase, fileModified ), 3 );
+
+  // applying the changeset with the option keeps the index up to date
+  {
+    std::unique_ptr<Driver> driver( Driver::createDriver( static_cast<Context *>( testContext() ), "sqlite" ) );
+    DriverParametersMap conn = Driver::sqliteParametersSingleSource( fileApplied );
+    conn["conninfo"] = "row_hash_index";
+    driver->open( conn );
+    Buffer data;
+    data.append( expected.data(), static_cast<int64_t>( expected.size() ) );
+    ChangesetReader reader;
+    ASSERT_TRUE( reader.openBuffer( data ) );
+    driver->applyChangeset( reader );
+  }
+  EXPECT_EQ( createChangeset( fileApplied, fileModified, "row_hash_index" ), "" );
+  EXPECT_EQ( changedBlocks( fileApplied, fileModified ), 0 );
+
+  // unknown driver options are ignored
+  EXPECT_EQ( createChangeset( fileBase, fileModified, "no_such_option" ), expected );
+
+  // after removal, the databases are compared as usual
+  ASSERT_EQ( GEODIFF_removeRowHashIndex( testContext(), fileModified.c_str() ), GEODIFF_SUCCESS );
+  EXPECT_EQ( createChangeset( fileBase, fileModified, "row_hash_index" ), expected );
+  {
+    std::shared_ptr<Sqlite3Db> db = std::make_shared<Sqlite3Db>();
+    db->open( fileModified );
+    Sqlite3Stmt stmt;
+    stmt.prepare( db, "SELECT count(*) FROM sqlite_master WHERE name LIKE 'geodiff_row_hash%%'" );
+    ASSERT_EQ( sqlite3_step( stmt.get() ), SQLITE_ROW );
+    EXPECT_EQ( sqlite3_column_int( stmt.get(), 0 ), 0 );
+  }
+}
+
+TEST( SqliteDriverTest, test_row_hash_index_unique )
+{
+  // INSERT OR REPLACE deletes rows conflicting with a UNIQUE constraint without running DELETE triggers,
+  // so tables with UNIQUE indexes other than the primary key must not use row hash index
+  std::string testname = "test_row_hash_index_unique";
+  makedir( pathjoin( tmpdir(), testname ) );
+  std::string fileBase = pathjoin( tmpdir(), testname, "base.sqlite" );
+  std::string fileModified = pathjoin( tmpdir(), testname, "modified.sqlite" );
+  fileremove( fileBase );
+
+  {
+    std::shared_ptr<Sqlite3Db> db = std::make_shared<Sqlite3Db>();
+    db->create( fileBase );
+    Buffer sql;
+    sql.printf( "CREATE TABLE t_unique ( fid INTEGER PRIMARY KEY, code TEXT UNIQUE );"
+                "CREATE TABLE t_later ( fid INTEGER PRIMARY KEY, code TEXT );"
+                "WITH RECURSIVE n(i) AS ( SELECT 1 UNION ALL SELECT i + 1 FROM n WHERE i < 10000 ) "
+                "INSERT INTO t_unique SELECT i, 'code ' || i FROM n;"
+                "INSERT INTO t_later SELECT fid, code FROM t_unique;" );
+    db->exec( sql );
+  }
+
+  ASSERT_EQ( GEODIFF_updateRowHashIndex( testContext(), fileBase.c_str() ), GEODIFF_SUCCESS );
+  filecopy( fileModified, fileBase );
+
+  std::unique_ptr<Driver> driver( Driver::createDriver( static_cast<Context *>( testContext() ), "sqlite" ) );
+  driver->open( Driver::sqliteParametersSingleSource( fileBase ) );
+  TableSchema tblUnique = driver->tableSchema( "t_unique" );
+  TableSchema tblLater = driver->tableSchema( "t_later" );
+
+  {
+    // fid 5000 gets deleted because of the conflicting code (block 4), only block 19 is recorded by the triggers
+    std::shared_ptr<Sqlite3Db> db = std::make_shared<Sqlite3Db>();
+    db->open( fileModified );
+    EXPECT_FALSE( hasRowHashIndex( db, "main", tblUnique ) );
+    EXPECT_TRUE( hasRowHashIndex( db, "main", tblLater ) );
+    Buffer sql;
+    sql.printf( "INSERT OR REPLACE INTO t_unique VALUES ( 20000, 'code 5000' );"
+                "CREATE UNIQUE INDEX idx_later ON t_later ( code );"
+                "INSERT OR REPLACE INTO t_later VALUES ( 20000, 'code 5000' );" );
+    db->exec( sql );
+    EXPECT_FALSE( hasRowHashIndex( db, "main", tblLater ) );
+  }
+
+  auto createChangeset = [&]( const std::string &options )
+  {
+    DriverParametersMap conn = Driver::sqliteParameters( fileBase, fileModified );
+    conn["conninfo"] = options;
+    std::unique_ptr<Driver> driver( Driver::createDriver( static_cast<Context *>( testContext() ), "sqlite" ) );
+    driver->open( conn );
+    Buffer output;
+    {
+      ChangesetWriter writer;
+      writer.openBuffer( output );
+      driver->createChangeset( writer );
+      writer.close();
+    }
+    return std::string( output.c_buf(), static_cast<size_t>( output.size() ) );
+  };
+
+  std::string expected = createChangeset( "" );
+  EXPECT_EQ( createChangeset( "row_hash_index" ), expected );
+
+  Buffer data;
+  data.append( expected.data(), static_cast<int64_t>( expected.size() ) );
+  ChangesetReader reader;
+  ASSERT_TRUE( reader.openBuffer( data ) );
+  ChangesetEntry entry;
+  int deletes = 0;
+  while ( reader.nextEntry( entry ) )
+  {
+    if ( entry.op == ChangesetEntry::OpDelete )
+      ++deletes;
+  }
+  EXPECT_EQ( deletes, 2 );
+
+  // the index of a table with a UNIQUE index is removed on update
+  ASSERT_EQ( GEODIFF_updateRowHashIndex( testContext(), fileModified.c_str() ), GEODIFF_SUCCESS );
+  {
+    std::shared_ptr<Sqlite3Db> db = std::make_shared<Sqlite3Db>();
+    db->open( fileModified );
+    Sqlite3Stmt stmt;
+    stmt.prepare( db, "SELECT count(*) FROM sqlite_master WHERE type = 'trigger' AND tbl_name IN ( 't_unique', 't_later' )" );
+    ASSERT_EQ( sqlite3_step( stmt.get() ), SQLITE_ROW );
+    EXPECT_EQ( sqlite3_column_int( stmt.get(), 0 ), 0 );
+  }
+}
+
+static std::vector<std::string> sFingerprintLog;
+
+static void fingerprintLogger( GEODIFF_LoggerLevel level, const char *msg )
+{
+  if ( level == GEODIFF_LoggerLevel::LevelDebug )
+    sFingerprintLog.push_back( msg );
+}
+
+TEST( SqliteDriverTest, test_unchanged_tables )
+{
+  // tables with the same content in both databases are skipped based on their row count and content hash
+  std::string testname = "test_unchanged_tables";
+  makedir( pathjoin( tmpdir(), testname ) );
+  std::string fileBase = pathjoin( tmpdir(), testname, "base.sqlite" );
+  std::string fileModified = pathjoin( tmpdir(), testname, "modified.sqlite" );
+  fileremove( fileBase );
+  fileremove( fileModified );
+
+  const char *sqlCreate =
+    "CREATE TABLE t_same ( fid INTEGER PRIMARY KEY, name TEXT, num );"
+    "CREATE TABLE t_empty ( fid INTEGER PRIMARY KEY, name TEXT );"
+    "CREATE TABLE t_count ( fid INTEGER PRIMARY KEY, name TEXT );"
+    "CREATE TABLE t_content ( code TEXT PRIMARY KEY, v );"
+    "CREATE TABLE t_swap ( fid INTEGER PRIMARY KEY, name TEXT );"
+    "CREATE TABLE t_type ( fid INTEGER PRIMARY KEY, v );"
+    "WITH RECURSIVE n(i) AS ( SELECT 1 UNION ALL SELECT i + 1 FROM n WHERE i < 1000 ) "
+    "INSERT INTO t_same SELECT i, 'row ' || i, i * 0.5 FROM n;"
+    "INSERT INTO t_count VALUES ( 1, 'a' ), ( 2, 'b' );"
+    "INSERT INTO t_content VALUES ( 'a', 1 ), ( 'b', X'0102' ), ( 'c', NULL );"
+    "INSERT INTO t_swap VALUES ( 1, 'a' ), ( 2, 'b' );"
+    "INSERT INTO t_type VALUES ( 1, 1 );";
+
+  {
+    std::shared_ptr<Sqlite3Db> db = std::make_shared<Sqlite3Db>();
+    db->create( fileBase );
+    Buffer sql;
+    sql.printf( "%s", sqlCreate );
+    db->exec( sql );
+  }
+
+  {
+    // t_same gets the same rows inserted in a different order
+    std::shared_ptr<Sqlite3Db> db = std::make_shared<Sqlite3Db>();
+    db->create( fileModified );
+    Buffer sql;
+    sql.printf( "%s", sqlCreate );
+    sql.printf( "DELETE FROM t_same;"
+                "WITH RECURSIVE n(i) AS ( SELECT 1000 UNION ALL SELECT i - 1 FROM n WHERE i > 1 ) "
+                "INSERT INTO t_same SELECT i, 'row ' || i, i * 0.5 FROM n;" );
+    sql.printf( "DELETE FROM t_count WHERE fid = 2;" );
+    sql.printf( "UPDATE t_content SET v = X'0103' WHERE code = 'b';" );
+    sql.printf( "UPDATE t_swap SET name = CASE fid WHEN 1 THEN 'b' ELSE 'a' END;" );
+    sql.printf( "UPDATE t_type SET v = 1.0;" );
+    db->exec( sql );
+  }
+
+  GEODIFF_ContextH context = GEODIFF_createContext();
+  GEODIFF_CX_setLoggerCallback( context, &fingerprintLogger );
+  GEODIFF_CX_setMaximumLoggerLevel( context, GEODIFF_LoggerLevel::LevelDebug );
+  sFingerprintLog.clear();
+
+  Buffer output;
+  {
+    std::unique_ptr<Driver> driver( Driver::createDriver( static_cast<Context *>( context ), "sqlite" ) );
+    driver->open( Driver::sqliteParameters( fileBase, fileModified ) );
+    ChangesetWriter writer;
+    writer.openBuffer( output );
+    driver->createChangeset( writer );
+    writer.close();
+  }
+  GEODIFF_CX_destroy( context );
+
+  auto logged = []( const std::string &msg )
+  {
+    return std::find( sFingerprintLog.begin(), sFingerprintLog.end(), msg ) != sFingerprintLog.end();
+  };
+  EXPECT_TRUE( logged( "Table t_same is unchanged (1000 rows) - skipping" ) );
+  EXPECT_TRUE( logged( "Table t_empty is unchanged (0 rows) - skipping" ) );
+  EXPECT_TRUE( logged( "Table t_count has different number of rows (2 -> 1) - comparing rows" ) );
+  EXPECT_TRUE( logged( "Table t_content has different content hash - comparing rows" ) );
+  EXPECT_TRUE( logged( "Table t_swap has different content hash - comparing rows" ) );
+  EXPECT_TRUE( logged( "Table t_type has different content hash - comparing rows" ) );
+
+  std::map<std::string, int> counts;
+  ChangesetReader reader;
+  ASSERT_TRUE( reader.openBuffer( output ) );
+  ChangesetEntry entry;
+  while ( reader.nextEntry( entry ) )
+    counts[entry.table->name]++;
+  // t_type rows are compared (hashes of 1 and 1.0 differ), but they are equal when compared row by row
+  std::map<std::string, int> expectedCounts = { { "t_count", 1 }, { "t_content", 1 }, { "t_swap", 2 } };
+  EXPECT_EQ( counts, expectedCounts );
+}
+
+#ifdef HAVE_SQLITE_SESSION
+TEST( SqliteDriverTest, test_change_capture )
+{
+  std::string testname = "test_change_capture";
+  makedir( pathjoin( tmpdir(), testname ) );
+  std::string fileBase = pathjoin( tmpdir(), testname, "base.gpkg" );
+  std::string fileCaptured = pathjoin( tmpdir(), testname, "captured.gpkg" );
+  std::string fileApplied = pathjoin( tmpdir(), testname, "applied.gpkg" );
+  std::string fileChangeset = pathjoin( tmpdir(), testname, "captured.diff" );
+  filecopy( fileBase, pathjoin( testdir(), "base.gpkg" ) );
+  filecopy( fileCaptured, fileBase );
+  filecopy( fileApplied, fileBase );
+
+  EXPECT_EQ( GEODIFF_startChangeCapture( testContext(), nullptr ), nullptr );
+  EXPECT_EQ( GEODIFF_startChangeCapture( testContext(), "invalid_file" ), nullptr );
+
+  GEODIFF_ChangeCaptureH capture = GEODIFF_startChangeCapture( testContext(), fileCaptured.c_str() );
+  ASSERT_TRUE( capture );
+
+  // nothing captured yet
+  ASSERT_EQ( GEODIFF_CC_writeChangeset( testContext(), capture, fileChangeset.c_str() ), GEODIFF_SUCCESS );
+  EXPECT_EQ( GEODIFF_changesCount( testContext(), fileChangeset.c_str() ), 0 );
+
+  // the second update of the inserted row and an update reverted back are not written as separate entries
+  EXPECT_EQ( GEODIFF_CC_exec( testContext(), capture,
+                              "INSERT INTO simple ( fid, name, rating ) VALUES ( 100, 'new', 1 );"
+                              "UPDATE simple SET rating = 2 WHERE fid = 100;"
+                              "UPDATE simple SET name = 'renamed' WHERE fid = 1;"
+                              "UPDATE simple SET rating = rating + 1 WHERE fid = 2;"
+                              "UPDATE simple SET rating = rating - 1 WHERE fid = 2;"
+                              "DELETE FROM simple WHERE fid = 3;" ), GEODIFF_SUCCESS );
+  EXPECT_EQ( GEODIFF_CC_exec( testContext(), capture, "INSERT INTO no_such_table VALUES ( 1 )" ), GEODIFF_ERROR );
+
+  ASSERT_EQ( GEODIFF_CC_writeChangeset( testContext(), capture, fileChangeset.c_str() ), GEODIFF_SUCCESS );
+  EXPECT_EQ( GEODIFF_changesCount( testContext(), fileChangeset.c_str() ), 3 );
+
+  GEODIFF_BufferH buffer = nullptr;
+  ASSERT_EQ( GEODIFF_CC_writeChangesetToBuffer( testContext(), capture, &buffer ), GEODIFF_SUCCESS );
+  Buffer fileContent;
+  fileContent.read( fileChangeset );
+  EXPECT_EQ( std::string( GEODIFF_B_data( testContext(), buffer ), static_cast<size_t>( GEODIFF_B_size( testContext(), buffer ) ) ),
+             std::string( fileContent.c_buf(), static_cast<size_t>( fileContent.size() ) ) );
+  GEODIFF_B_destroy( testContext(), buffer );
+
+  GEODIFF_CC_destroy( testContext(), capture );
+
+  // only changes of the table itself are captured (not of GeoPackage metadata tables and R-tree index)
+  {
+    ChangesetReader reader;
+    ASSERT_TRUE( reader.open( fileChangeset ) );
+    ChangesetEntry entry;
+    while ( reader.nextEntry( entry ) )
+      EXPECT_EQ( entry.table->name, "simple" );
+  }
+
+  // applying the captured changes to the base gives the same database
+  ASSERT_EQ( GEODIFF_applyChangeset( testContext(), fileApplied.c_str(), fileChangeset.c_str() ), GEODIFF_SUCCESS );
+  EXPECT_TRUE( equals( fileApplied, fileCaptured ) );
+}
+#endif
+
 TEST( SqliteDriverTest, apply_with_gpkg_contents )
 {
   // In geodiff >= 1.0 we ignore gpkg_* metadata tables. However older geodiff
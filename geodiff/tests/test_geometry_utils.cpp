@@ -10,6 +10,8 @@
 #include "changesetreader.h"
 #include "sqliteutils.h"
 
+#include <algorithm>
+
 
 TEST( GeometryUtilsTest, test_wkb_from_geometry )
 {
@@ -75,6 +77,68 @@ TEST( GeometryUtilsTest, test_wkb_from_geometry_errors )
   delete []c_wkb;
 }
 
+//! Appends value with the given byte order (native byte order is expected to be little endian)
+template<typename T> static void appendValue( std::string &data, T value, bool littleEndian = true )
+{
+  std::string bytes( reinterpret_cast<const char *>( &value ), sizeof( T ) );
+  if ( !littleEndian )
+    std::reverse( bytes.begin(), bytes.end() );
+  data += bytes;
+}
+
+//! Returns GeoPackage binary of a linestring (or point if there is a single point)
+static std::string gpkgGeometry( const std::vector<double> &coords, bool envelope = false, bool wkbLittleEndian = true, int srsId = 4326 )
+{
+  std::string data = "GP";
+  data += '\0';                                        // version
+  data += static_cast<char>( envelope ? 0x03 : 0x01 );  // little endian header, optionally with XY envelope
+  appendValue<int32_t>( data, srsId );
+  if ( envelope )
+  {
+    for ( double v : { coords[0], coords[0], coords[1], coords[1] } )
+      appendValue<double>( data, v );
+  }
+
+  data += static_cast<char>( wkbLittleEndian ? 1 : 0 );
+  appendValue<uint32_t>( data, coords.size() == 2 ? 1 : 2, wkbLittleEndian );
+  if ( coords.size() != 2 )
+    appendValue<uint32_t>( data, static_cast<uint32_t>( coords.size() / 2 ), wkbLittleEndian );
+  for ( double v : coords )
+    appendValue<double>( data, v, wkbLittleEndian );
+  return data;
+}
+
+TEST( GeometryUtilsTest, test_gpkg_geometries_equal )
+{
+  auto equal = []( const std::string &g1, const std::string &g2, double tolerance )
+  {
+    return gpkgGeometriesEqual( g1.data(), g1.size(), g2.data(), g2.size(), tolerance );
+  };
+
+  std::string point = gpkgGeometry( { 1, 2 } );
+  EXPECT_TRUE( equal( point, point, 0 ) );
+
+  // differences only in encoding
+  EXPECT_TRUE( equal( point, gpkgGeometry( { 1, 2 }, true ), 0 ) );
+  EXPECT_TRUE( equal( point, gpkgGeometry( { 1, 2 }, false, false ), 0 ) );
+
+  // coordinates within tolerance
+  EXPECT_FALSE( equal( point, gpkgGeometry( { 1 + 1e-9, 2 } ), 0 ) );
+  EXPECT_TRUE( equal( point, gpkgGeometry( { 1 + 1e-9, 2 } ), 1e-6 ) );
+  EXPECT_FALSE( equal( point, gpkgGeometry( { 1, 2.1 } ), 1e-6 ) );
+
+  std::string line = gpkgGeometry( { 1, 2, 3, 4 } );
+  EXPECT_TRUE( equal( line, gpkgGeometry( { 1, 2, 3 + 1e-9, 4 }, false, false ), 1e-6 ) );
+  EXPECT_FALSE( equal( line, gpkgGeometry( { 1, 2, 3, 4, 5, 6 } ), 1e-6 ) );
+  EXPECT_FALSE( equal( line, point, 1e-6 ) );
+
+  // different SRS, truncated or invalid data
+  EXPECT_FALSE( equal( point, gpkgGeometry( { 1, 2 }, false, true, 3857 ), 1e-6 ) );
+  EXPECT_FALSE( equal( point, point.substr( 0, point.size() - 1 ), 1e-6 ) );
+  EXPECT_FALSE( equal( point, point + '\0', 1e-6 ) );
+  EXPECT_FALSE( equal( point, "not a geometry", 1e-6 ) );
+}
+
 
 int main( int argc, char **argv )
 {
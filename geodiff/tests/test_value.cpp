@@ -0,0 +1,163 @@
+/*
+ GEODIFF - MIT License
+ Copyright (C) 2023 Lutra Consulting
+*/
+
+#include "gtest/gtest.h"
+#include "geodiff_testutils.hpp"
+#include "geodiff.h"
+
+#include "changeset.h"
+#include "changesetreader.h"
+#include "changesetwriter.h"
+#include "geodiffutils.hpp"
+
+#include <atomic>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+
+// count heap allocations made within this test executable
+static std::atomic<size_t> sAllocationCount( 0 );
+
+void *operator new( size_t size )
+{
+  ++sAllocationCount;
+  void *ptr = malloc( size ? size : 1 );
+  if ( !ptr )
+    throw std::bad_alloc();
+  return ptr;
+}
+
+void operator delete( void *ptr ) noexcept
+{
+  free( ptr );
+}
+
+void operator delete( void *ptr, size_t ) noexcept
+{
+  free( ptr );
+}
+
+
+TEST( ValueTest, test_inline_and_shared )
+{
+  Value empty = Value::makeText( "" );
+  EXPECT_EQ( empty.type(), Value::TypeText );
+  EXPECT_EQ( empty.getStringSize(), 0 );
+  EXPECT_EQ( empty.getString(), "" );
+
+  // short strings do not allocate
+  size_t count = sAllocationCount;
+  Value shortText;
+  shortText.setString( Value::TypeText, "2023-05-01T12:00:00Z", 20 );
+  Value shortCopy( shortText );
+  EXPECT_EQ( sAllocationCount, count );
+  EXPECT_EQ( shortCopy, shortText );
+  EXPECT_EQ( std::string( shortCopy.getStringData(), shortCopy.getStringSize() ), "2023-05-01T12:00:00Z" );
+  EXPECT_NE( shortCopy.getStringData(), shortText.getStringData() );
+
+  // large blobs are shared between copies
+  std::string large( 1000, 'x' );
+  Value blob;
+  blob.setString( Value::TypeBlob, large.data(), large.size() );
+  count = sAllocationCount;
+  Value blobCopy = blob;
+  EXPECT_EQ( sAllocationCount, count );
+  EXPECT_EQ( blobCopy.getStringData(), blob.getStringData() );
+  EXPECT_EQ( blobCopy.getString(), large );
+  EXPECT_EQ( std::hash<Value> {}( blobCopy ), std::hash<Value> {}( blob ) );
+
+  // modifying a copy does not affect the other instance
+  blob.setInt( 1 );
+  EXPECT_EQ( blobCopy.type(), Value::TypeBlob );
+  EXPECT_EQ( blobCopy.getString(), large );
+
+  // moved-from value is left undefined
+  Value moved( std::move( blobCopy ) );
+  EXPECT_EQ( blobCopy.type(), Value::TypeUndefined );
+  EXPECT_EQ( moved.getString(), large );
+  Value movedShort;
+  movedShort = std::move( shortCopy );
+  EXPECT_EQ( shortCopy.type(), Value::TypeUndefined );
+  EXPECT_EQ( movedShort, shortText );
+
+  // text and blob with the same content are different values
+  Value text;
+  text.setString( Value::TypeText, large.data(), large.size() );
+  EXPECT_NE( text, moved );
+}
+
+TEST( ValueTest, test_allocations_per_entry )
+{
+  // a typical attribute table: numbers, codes, dates and names
+  makedir( pathjoin( tmpdir(), "test_allocations_per_entry" ) );
+  std::string changeset = pathjoin( tmpdir(), "test_allocations_per_entry", "changeset.diff" );
+  std::string output = pathjoin( tmpdir(), "test_allocations_per_entry", "output.diff" );
+
+  const int entryCount = 10000;
+  ChangesetTable table;
+  table.name = "features";
+  table.primaryKeys = { true, false, false, false, false };
+  {
+    ChangesetWriter writer;
+    writer.open( changeset );
+    writer.beginTable( table );
+    for ( int i = 0; i < entryCount; ++i )
+    {
+      std::vector<Value> values = { Value::makeInt( i ), Value::makeText( "C" + std::to_string( i % 50 ) ),
+                                    Value::makeText( "2023-05-" + std::to_string( 10 + i % 20 ) ),
+                                    Value::makeText( "Feature name " + std::to_string( i ) ), Value::makeDouble( i * 0.1 )
+                                  };
+      writer.writeEntry( ChangesetEntry::make( &table, ChangesetEntry::OpInsert, {}, values ) );
+    }
+    writer.close();
+  }
+
+  ChangesetReader reader;
+  ASSERT_TRUE( reader.open( changeset ) );
+  ChangesetWriter writer;
+  writer.open( output );
+  writer.beginTable( table );
+
+  ChangesetEntry entry;
+  std::vector<Value> merged;
+  merged.reserve( table.columnCount() );
+  ASSERT_TRUE( reader.nextEntry( entry ) );  // warm up - let the containers allocate their capacity
+
+  size_t readCount = 0, copyCount = 0, writeCount = 0;
+  for ( int i = 1; i < entryCount; ++i )
+  {
+    size_t count = sAllocationCount;
+    ASSERT_TRUE( reader.nextEntry( entry ) );
+    readCount += sAllocationCount - count;
+
+    // what merging does with the values - copies them around
+    count = sAllocationCount;
+    merged.assign( entry.newValues.begin(), entry.newValues.end() );
+    Value v = merged[3];
+    merged[3] = std::move( v );
+    copyCount += sAllocationCount - count;
+
+    count = sAllocationCount;
+    writer.writeEntry( entry );
+    writeCount += sAllocationCount - count;
+  }
+  writer.close();
+
+  double n = entryCount - 1;
+  std::cout << "allocations per entry: read " << readCount / n << ", copy " << copyCount / n << ", write " << writeCount / n << std::endl;
+
+  EXPECT_EQ( readCount, 0 );
+  EXPECT_EQ( copyCount, 0 );
+  EXPECT_EQ( writeCount, 0 );
+}
+
+int main( int argc, char **argv )
+{
+  testing::InitGoogleTest( &argc, argv );
+  init_test();
+  int ret =  RUN_ALL_TESTS();
+  finalize_test();
+  return ret;
+}
@@ -13,6 +13,8 @@ from .geodifflib import (
     GeoDiffLibConflictError,
     GeoDiffLibUnsupportedChangeError,
     GeoDiffLibVersionError,
+    GeoDiffLibCancelledError,
+    ChangeCapture,
     ChangesetEntry,
     ChangesetReader,
     UndefinedValue,
@@ -25,6 +27,8 @@ __all__ = [
     "GeoDiffLibConflictError",
     "GeoDiffLibUnsupportedChangeError",
     "GeoDiffLibVersionError",
+    "GeoDiffLibCancelledError",
+    "ChangeCapture",
     "ChangesetEntry",
     "ChangesetReader",
     "UndefinedValue",
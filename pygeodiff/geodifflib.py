@@ -31,11 +31,16 @@ class GeoDiffLibVersionError(GeoDiffLibError):
     pass
 
 
+class GeoDiffLibCancelledError(GeoDiffLibError):
+    pass
+
+
 # keep in sync with c-library
 SUCCESS = 0
 ERROR = 1
 CONFLICT = 2
 UNSUPPORTED_CHANGE = 3
+CANCELLED = 4
 
 
 class GeoDiffLib:
@@ -98,6 +103,54 @@ class GeoDiffLib:
         self._CR_destroy = self.lib.GEODIFF_CR_destroy
         self._CR_destroy.argtypes = [ctypes.c_void_p, ctypes.c_void_p]
 
+        # Buffer
+        self._createBuffer = self.lib.GEODIFF_createBuffer
+        self._createBuffer.argtypes = [
+            ctypes.c_void_p,
+            ctypes.c_char_p,
+            ctypes.c_int64,
+        ]
+        self._createBuffer.restype = ctypes.c_void_p
+
+        self._B_size = self.lib.GEODIFF_B_size
+        self._B_size.argtypes = [ctypes.c_void_p, ctypes.c_void_p]
+        self._B_size.restype = ctypes.c_int64
+
+        self._B_data = self.lib.GEODIFF_B_data
+        self._B_data.argtypes = [ctypes.c_void_p, ctypes.c_void_p]
+        self._B_data.restype = ctypes.c_void_p
+
+        self._B_destroy = self.lib.GEODIFF_B_destroy
+        self._B_destroy.argtypes = [ctypes.c_void_p, ctypes.c_void_p]
+
+        # ChangeCapture
+        self._startChangeCapture = self.lib.GEODIFF_startChangeCapture
+        self._startChangeCapture.argtypes = [ctypes.c_void_p, ctypes.c_char_p]
+        self._startChangeCapture.restype = ctypes.c_void_p
+
+        self._CC_exec = self.lib.GEODIFF_CC_exec
+        self._CC_exec.argtypes = [ctypes.c_void_p, ctypes.c_void_p, ctypes.c_char_p]
+        self._CC_exec.restype = ctypes.c_int
+
+        self._CC_writeChangeset = self.lib.GEODIFF_CC_writeChangeset
+        self._CC_writeChangeset.argtypes = [
+            ctypes.c_void_p,
+            ctypes.c_void_p,
+            ctypes.c_char_p,
+        ]
+        self._CC_writeChangeset.restype = ctypes.c_int
+
+        self._CC_writeChangesetToBuffer = self.lib.GEODIFF_CC_writeChangesetToBuffer
+        self._CC_writeChangesetToBuffer.argtypes = [
+            ctypes.c_void_p,
+            ctypes.c_void_p,
+            ctypes.c_void_p,
+        ]
+        self._CC_writeChangesetToBuffer.restype = ctypes.c_int
+
+        self._CC_destroy = self.lib.GEODIFF_CC_destroy
+        self._CC_destroy.argtypes = [ctypes.c_void_p, ctypes.c_void_p]
+
         # ChangesetEntry
         self._CE_operation = self.lib.GEODIFF_CE_operation
         self._CE_operation.argtypes = [ctypes.c_void_p, ctypes.c_void_p]
@@ -178,6 +231,8 @@ class GeoDiffLib:
             raise GeoDiffLibConflictError(msg)
         elif rc == UNSUPPORTED_CHANGE:
             raise GeoDiffLibUnsupportedChangeError(msg)
+        elif rc == CANCELLED:
+            raise GeoDiffLibCancelledError(msg)
         else:
             raise GeoDiffLibVersionError(
                 "Internal error (enum " + str(rc) + " not handled)"
@@ -237,6 +292,37 @@ class GeoDiffLib:
         func(context, callbackLogger)
         return callbackLogger
 
+    def set_progress_callback(self, context, callback):
+        """
+        Set GeoDiff to call callback to report progress of long-running operations.
+        Like with set_logger_callback(), the returned handle MUST be kept referenced
+        while the context is alive or until a new callback is set.
+        """
+        func = self.lib.GEODIFF_CX_setProgressCallback
+        cFuncType = ctypes.CFUNCTYPE(
+            ctypes.c_bool, ctypes.c_char_p, ctypes.c_int, ctypes.c_int, ctypes.c_int64
+        )
+        func.argtypes = [ctypes.c_void_p, cFuncType]
+        func.restype = ctypes.c_int
+        if callback:
+
+            def progress(table_name, tables_done, tables_total, entries_done):
+                return bool(
+                    callback(
+                        table_name.decode("utf-8"),
+                        tables_done,
+                        tables_total,
+                        entries_done,
+                    )
+                )
+
+            callbackProgress = cFuncType(progress)
+        else:
+            callbackProgress = cFuncType()
+        rc = func(context, callbackProgress)
+        self._parse_return_code(context, rc, "set_progress_callback")
+        return callbackProgress
+
     def set_maximum_logger_level(self, context, maxLevel):
         func = self.lib.GEODIFF_CX_setMaximumLoggerLevel
         func.argtypes = [ctypes.c_void_p, ctypes.c_int]
@@ -263,6 +349,23 @@ class GeoDiffLib:
         rc = func(ctypes.c_void_p(context), ctypes.c_int(len(tables)), arr)
         self._parse_return_code(context, rc, "set_tables_to_include")
 
+    def set_columns_to_ignore(self, context, columns):
+        arr = (ctypes.c_char_p * len(columns))()
+        for i in range(len(columns)):
+            arr[i] = columns[i].encode("utf-8")
+
+        func = self.lib.GEODIFF_CX_setColumnsToIgnore
+        func.restype = ctypes.c_int
+        rc = func(ctypes.c_void_p(context), ctypes.c_int(len(columns)), arr)
+        self._parse_return_code(context, rc, "set_columns_to_ignore")
+
+    def set_geometry_tolerance(self, context, tolerance):
+        func = self.lib.GEODIFF_CX_setGeometryTolerance
+        func.argtypes = [ctypes.c_void_p, ctypes.c_double]
+        func.restype = ctypes.c_int
+        rc = func(context, tolerance)
+        self._parse_return_code(context, rc, "set_geometry_tolerance")
+
     def version(self):
         func = self.lib.GEODIFF_version
         func.restype = ctypes.c_char_p
@@ -293,11 +396,10 @@ class GeoDiffLib:
         drivers_list = []
         driversCount = _driver_count_f(context)
         for index in range(driversCount):
-            name_raw = 256 * ""
-            b_string1 = name_raw.encode("utf-8")
-            res = _driver_name_from_index_f(context, index, b_string1)
+            name_raw = ctypes.create_string_buffer(256)
+            res = _driver_name_from_index_f(context, index, name_raw)
             self._parse_return_code(context, res, "drivers")
-            name = b_string1.decode("utf-8")
+            name = name_raw.value.decode("utf-8")
             drivers_list.append(name)
 
         return drivers_list
@@ -610,6 +712,104 @@ class GeoDiffLib:
         )
         self._parse_return_code(context, res, "schema")
 
+    def update_row_hash_index(self, context, db):
+        res = self.lib.GEODIFF_updateRowHashIndex(
+            ctypes.c_void_p(context), ctypes.c_char_p(db.encode("utf-8"))
+        )
+        self._parse_return_code(context, res, "update_row_hash_index")
+
+    def remove_row_hash_index(self, context, db):
+        res = self.lib.GEODIFF_removeRowHashIndex(
+            ctypes.c_void_p(context), ctypes.c_char_p(db.encode("utf-8"))
+        )
+        self._parse_return_code(context, res, "remove_row_hash_index")
+
+    def _buffer_from_bytes(self, context, data):
+        buf = self._createBuffer(context, bytes(data), len(data))
+        if buf is None:
+            self._parse_return_code(context, ERROR, "create_buffer")
+        return buf
+
+    def _bytes_from_buffer(self, context, buf):
+        """returns content of the buffer as bytes and destroys the buffer"""
+        try:
+            size = self._B_size(context, buf)
+            if size == 0:
+                return b""
+            return ctypes.string_at(self._B_data(context, buf), size)
+        finally:
+            self._B_destroy(context, buf)
+
+    def create_changeset_to_bytes(self, context, driver, driver_info, base, modified):
+        out = ctypes.c_void_p()
+        res = self.lib.GEODIFF_createChangesetToBuffer(
+            ctypes.c_void_p(context),
+            ctypes.c_char_p(driver.encode("utf-8")),
+            ctypes.c_char_p(driver_info.encode("utf-8")),
+            ctypes.c_char_p(base.encode("utf-8")),
+            ctypes.c_char_p(modified.encode("utf-8")),
+            ctypes.byref(out),
+        )
+        self._parse_return_code(context, res, "create_changeset_to_bytes")
+        return self._bytes_from_buffer(context, out)
+
+    def apply_changeset_from_bytes(self, context, driver, driver_info, base, changeset):
+        buf = self._buffer_from_bytes(context, changeset)
+        try:
+            res = self.lib.GEODIFF_applyChangesetFromBuffer(
+                ctypes.c_void_p(context),
+                ctypes.c_char_p(driver.encode("utf-8")),
+                ctypes.c_char_p(driver_info.encode("utf-8")),
+                ctypes.c_char_p(base.encode("utf-8")),
+                ctypes.c_void_p(buf),
+            )
+        finally:
+            self._B_destroy(context, buf)
+        self._parse_return_code(context, res, "apply_changeset_from_bytes")
+
+    def concat_changes_bytes(self, context, list_changesets):
+        buffers = [self._buffer_from_bytes(context, ch) for ch in list_changesets]
+        arr = (ctypes.c_void_p * len(buffers))(*buffers)
+        out = ctypes.c_void_p()
+        try:
+            res = self.lib.GEODIFF_concatChangesBuffers(
+                ctypes.c_void_p(context),
+                ctypes.c_int(len(buffers)),
+                arr,
+                ctypes.byref(out),
+            )
+        finally:
+            for buf in buffers:
+                self._B_destroy(context, buf)
+        self._parse_return_code(context, res, "concat_changes_bytes")
+        return self._bytes_from_buffer(context, out)
+
+    def create_rebased_changeset_bytes(
+        self, context, driver, driver_info, base, base2modified, base2their
+    ):
+        buf_modified = self._buffer_from_bytes(context, base2modified)
+        buf_their = self._buffer_from_bytes(context, base2their)
+        out_rebased = ctypes.c_void_p()
+        out_conflicts = ctypes.c_void_p()
+        try:
+            res = self.lib.GEODIFF_createRebasedChangesetBuffer(
+                ctypes.c_void_p(context),
+                ctypes.c_char_p(driver.encode("utf-8")),
+                ctypes.c_char_p(driver_info.encode("utf-8")),
+                ctypes.c_char_p(base.encode("utf-8")),
+                ctypes.c_void_p(buf_modified),
+                ctypes.c_void_p(buf_their),
+                ctypes.byref(out_rebased),
+                ctypes.byref(out_conflicts),
+            )
+        finally:
+            self._B_destroy(context, buf_modified)
+            self._B_destroy(context, buf_their)
+        self._parse_return_code(context, res, "create_rebased_changeset_bytes")
+        rebased = self._bytes_from_buffer(context, out_rebased)
+        conflicts = self._bytes_from_buffer(context, out_conflicts)
+        return rebased, conflicts.decode("utf-8")
+
     def read_changeset(self, context, changeset):
         b_string1 = changeset.encode("utf-8")
 
@@ -618,6 +818,12 @@ class GeoDiffLib:
             raise GeoDiffLibError("Unable to open reader for: " + changeset)
         return ChangesetReader(self, context, reader_ptr)
 
+    def start_change_capture(self, context, db):
+        capture_ptr = self._startChangeCapture(context, db.encode("utf-8"))
+        if capture_ptr is None:
+            self._parse_return_code(context, ERROR, "start_change_capture")
+        return ChangeCapture(self, context, capture_ptr)
+
     def create_wkb_from_gpkg_header(self, context, geometry):
         func = self.lib.GEODIFF_createWkbFromGpkgHeader
         func.argtypes = [
@@ -679,6 +885,58 @@ class ChangesetReader(object):
     next = __next__  # python 2.x compatibility (requires next())
 
 
+class ChangeCapture(object):
+    """Wrapper around GEODIFF_CC_* functions from C API"""
+
+    def __init__(self, geodiff, context, capture_ptr):
+        self.geodiff = geodiff
+        self.capture_ptr = capture_ptr
+        self.context = context
+
+    def __del__(self):
+        self.close()
+
+    def close(self):
+        """Stops capturing changes and closes the database"""
+        if self.capture_ptr is not None:
+            self.geodiff._CC_destroy(self.context, self.capture_ptr)
+            self.capture_ptr = None
+
+    def _check_open(self):
+        if self.capture_ptr is None:
+            raise GeoDiffLibError("Change capture has been closed")
+
+    def execute(self, sql):
+        """Executes SQL statement(s) on the database, capturing the changes"""
+        self._check_open()
+        res = self.geodiff._CC_exec(
+            self.context, self.capture_ptr, sql.encode("utf-8")
+        )
+        self.geodiff._parse_return_code(self.context, res, "change_capture_execute")
+
+    def write_changeset(self, changeset):
+        """Writes all changes captured so far to a changeset file"""
+        self._check_open()
+        res = self.geodiff._CC_writeChangeset(
+            self.context, self.capture_ptr, changeset.encode("utf-8")
+        )
+        self.geodiff._parse_return_code(
+            self.context, res, "change_capture_write_changeset"
+        )
+
+    def write_changeset_to_bytes(self):
+        """Returns all changes captured so far as changeset bytes"""
+        self._check_open()
+        out = ctypes.c_void_p()
+        res = self.geodiff._CC_writeChangesetToBuffer(
+            self.context, self.capture_ptr, ctypes.byref(out)
+        )
+        self.geodiff._parse_return_code(
+            self.context, res, "change_capture_write_changeset_to_bytes"
+        )
+        return self.geodiff._bytes_from_buffer(self.context, out)
+
+
 class ChangesetEntry(object):
     """Wrapper around GEODIFF_CE_* functions from C API"""
 
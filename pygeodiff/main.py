@@ -32,6 +32,7 @@ class GeoDiff:
         self.clib = None
         self.context = None
         self.callbackLogger = None
+        self.callbackProgress = None
 
     def __del__(self):
         self.shutdown()
@@ -61,6 +62,7 @@ class GeoDiff:
 
         self.clib = None
         self.callbackLogger = None
+        self.callbackProgress = None
 
     def set_logger_callback(self, callback):
         """
@@ -73,6 +75,21 @@ class GeoDiff:
         self.callbackLogger = self.clib.set_logger_callback(self.context, callback)
         return None
 
+    def set_progress_callback(self, callback):
+        """
+        Assign callback to report progress of create_changeset, apply_changeset,
+        concat_changes, rebase and make_copy (and their variants).
+        Callback function has 4 arguments: (string) table name, (int) number of tables done,
+        (int) total number of tables (-1 if not known in advance), (int) number of entries
+        of the current table done. It returns True to continue or False to cancel
+        the operation, which then raises GeoDiffLibCancelledError and any changes
+        made to the database are rolled back.
+        When callback is None, no progress is reported.
+        """
+        self._lazy_load()
+        self.callbackProgress = self.clib.set_progress_callback(self.context, callback)
+        return None
+
     def set_tables_to_skip(self, tables):
         """
         Set list of tables to exclude from geodiff operations. Once defined, these
@@ -99,6 +116,29 @@ class GeoDiff:
         self._lazy_load()
         return self.clib.set_tables_to_include(self.context, tables)
 
+    def set_columns_to_ignore(self, columns):
+        """
+        Set list of columns that are not compared when creating changesets, e.g. columns
+        with time of the last edit. Changes in these columns alone do not make a row updated,
+        and they are written as unchanged in updated rows. Inserted and deleted rows still
+        contain all columns.
+
+        Each entry is either a column name (ignored in all tables) or "table.column".
+        Primary key columns are always compared. If empty list is passed, the list will be reset.
+        """
+        self._lazy_load()
+        return self.clib.set_columns_to_ignore(self.context, columns)
+
+    def set_geometry_tolerance(self, tolerance):
+        """
+        Set tolerance for comparison of geometries when creating changesets. Geometries that
+        differ only in encoding (e.g. GeoPackage envelope) or whose coordinates differ at most
+        by the tolerance are not considered updated. Negative value (the default) means that
+        geometries are compared byte by byte.
+        """
+        self._lazy_load()
+        return self.clib.set_geometry_tolerance(self.context, tolerance)
+
     LevelError = 1
     LevelWarning = 2
     LevelInfo = 3
@@ -285,6 +325,55 @@ class GeoDiff:
         self._lazy_load()
         return self.clib.concat_changes(self.context, list_changesets, output_changeset)
 
+    def create_changeset_to_bytes(self, driver, driver_info, base, modified):
+        """
+        Same as create_changeset_ex(), but instead of writing the changeset to a file,
+        it is returned as bytes object (with the same content as the file would have).
+
+        :raises GeoDiffLibError: raised on error
+        """
+        self._lazy_load()
+        return self.clib.create_changeset_to_bytes(
+            self.context, driver, driver_info, base, modified
+        )
+
+    def apply_changeset_from_bytes(self, driver, driver_info, base, changeset):
+        """
+        Same as apply_changeset_ex(), but the changeset is passed as bytes object
+        instead of a path to a changeset file.
+
+        :raises GeoDiffLibError: raised on error
+        """
+        self._lazy_load()
+        return self.clib.apply_changeset_from_bytes(
+            self.context, driver, driver_info, base, changeset
+        )
+
+    def concat_changes_bytes(self, list_changesets):
+        """
+        Same as concat_changes(), but input changesets are passed as a list of bytes objects
+        and the combined changeset is returned as bytes object.
+
+        :raises GeoDiffLibError: raised on error
+        """
+        self._lazy_load()
+        return self.clib.concat_changes_bytes(self.context, list_changesets)
+
+    def create_rebased_changeset_bytes(
+        self, driver, driver_info, base, base2modified, base2their
+    ):
+        """
+        Same as create_rebased_changeset_ex(), but changesets are passed as bytes objects.
+        Returns tuple (rebased, conflicts) where "rebased" is the rebased changeset as bytes
+        and "conflicts" is a string with conflicts in JSON (empty string if there are no conflicts).
+
+        :raises GeoDiffLibError: raised on error
+        """
+        self._lazy_load()
+        return self.clib.create_rebased_changeset_bytes(
+            self.context, driver, driver_info, base, base2modified, base2their
+        )
+
     def make_copy(
         self, driver_src, driver_src_info, src, driver_dst, driver_dst_info, dst
     ):
@@ -298,7 +387,10 @@ class GeoDiff:
         Supported drivers:
 
         - "sqlite" - does not need extra connection info (may be null). A dataset is a single
-        Sqlite3 database (a GeoPackage) - a path to a local file is expected.
+        Sqlite3 database (a GeoPackage) - a path to a local file is expected. Extra connection
+        info may contain space separated options: "row_hash_index" (see update_row_hash_index())
+        or "bulk_apply" to speed up applying of large changesets (indexes of modified tables
+        get rebuilt once at the end and the database is not synced to disk during the apply).
 
         - "postgres" - only available if compiled with postgres support. Needs extra connection info
         argument which is passed to libpq's PQconnectdb(), see PostgreSQL docs for syntax.
@@ -460,6 +552,47 @@ class GeoDiff:
         self._lazy_load()
         return self.clib.schema(self.context, driver, driver_info, src, json)
 
+    def update_row_hash_index(self, db):
+        """
+        Creates or refreshes row hash index in a SQLite/GeoPackage database. The index holds hashes
+        of blocks of rows of all tables with INTEGER PRIMARY KEY and it is stored in the database
+        itself (in tables and triggers with names starting with "geodiff_row_hash"). When both
+        databases have the index and create_changeset_ex() is called with "row_hash_index" driver
+        info of the sqlite driver, only blocks of rows that may differ are compared instead of all rows.
+        Triggers record blocks of rows modified since the index has been refreshed, so refreshing
+        the index only re-calculates hashes of those blocks.
+
+        :raises GeoDiffLibError: raised on error
+        """
+        self._lazy_load()
+        return self.clib.update_row_hash_index(self.context, db)
+
+    def remove_row_hash_index(self, db):
+        """
+        Removes row hash index (see update_row_hash_index()) from a SQLite/GeoPackage database.
+
+        :raises GeoDiffLibError: raised on error
+        """
+        self._lazy_load()
+        return self.clib.remove_row_hash_index(self.context, db)
+
+    def start_change_capture(self, db):
+        """
+        Opens a SQLite/GeoPackage database and starts capturing its changes as they are made
+        (using SQLite session extension), so that a changeset can be written without keeping
+        a base copy of the database and without comparing the databases. Only changes made with
+        execute() of the returned object are captured. GeoPackage metadata tables and tables
+        skipped with set_tables_to_skip() / set_tables_to_include() are ignored.
+
+        Only available if the SQLite library has been built with session extension.
+
+        :returns: change capture object with execute(), write_changeset(),
+            write_changeset_to_bytes() and close() methods
+        :raises GeoDiffLibError: raised on error
+        """
+        self._lazy_load()
+        return self.clib.start_change_capture(self.context, db)
+
     def read_changeset(self, changeset):
         """
         Opens a changeset file.
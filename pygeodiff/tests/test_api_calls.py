@@ -4,6 +4,8 @@
     :license: MIT, see LICENSE for more details.
 """
 
+import pygeodiff
+
 from .testutils import (
     GeoDiffTests,
     TestError,
@@ -76,6 +78,23 @@ class UnitTestsPythonApiCalls(GeoDiffTests):
             outdir + "/make-copy.gpkg",
         )
 
+        print("-- make_copy with bulk_apply")
+        self.geodiff.make_copy(
+            "sqlite",
+            "",
+            geodiff_test_dir() + "/base.gpkg",
+            "sqlite",
+            "bulk_apply",
+            outdir + "/make-copy-bulk.gpkg",
+        )
+        self.geodiff.create_changeset(
+            outdir + "/make-copy.gpkg",
+            outdir + "/make-copy-bulk.gpkg",
+            outdir + "/make-copy-bulk.diff",
+        )
+        if self.geodiff.has_changes(outdir + "/make-copy-bulk.diff"):
+            raise TestError("make_copy with bulk_apply differs")
+
         print("-- make_copy_sqlite")
         self.geodiff.make_copy_sqlite(
             geodiff_test_dir() + "/base.gpkg", outdir + "/make-copy-sqlite.gpkg"
@@ -142,3 +161,155 @@ class UnitTestsPythonApiCalls(GeoDiffTests):
         self.geodiff.schema(
             "sqlite", "", geodiff_test_dir() + "/base.gpkg", outdir + "/schema.json"
         )
+
+        print("-- update_row_hash_index")
+        self.geodiff.make_copy_sqlite(
+            geodiff_test_dir() + "/base.gpkg", outdir + "/row-hash-base.gpkg"
+        )
+        self.geodiff.update_row_hash_index(outdir + "/row-hash-base.gpkg")
+        self.geodiff.make_copy_sqlite(
+            outdir + "/row-hash-base.gpkg", outdir + "/row-hash-modified.gpkg"
+        )
+        self.geodiff.apply_changeset_ex(
+            "sqlite",
+            "row_hash_index",
+            outdir + "/row-hash-modified.gpkg",
+            geodiff_test_dir() + "/2_inserts/base-inserted_1_A.diff",
+        )
+        self.geodiff.create_changeset_ex(
+            "sqlite",
+            "row_hash_index",
+            outdir + "/row-hash-base.gpkg",
+            outdir + "/row-hash-modified.gpkg",
+            outdir + "/row-hash.diff",
+        )
+        if self.geodiff.changes_count(outdir + "/row-hash.diff") != 1:
+            raise TestError("expected 1 change in diff using row hash index")
+        self.geodiff.remove_row_hash_index(outdir + "/row-hash-base.gpkg")
+
+    def test_change_capture(self):
+        print("********************************************************")
+        print("PYTHON: test change capture")
+
+        outdir = create_dir("api-calls-capture")
+        base = outdir + "/base.gpkg"
+        captured = outdir + "/captured.gpkg"
+        self.geodiff.make_copy_sqlite(geodiff_test_dir() + "/base.gpkg", base)
+        self.geodiff.make_copy_sqlite(base, captured)
+
+        try:
+            capture = self.geodiff.start_change_capture(captured)
+        except pygeodiff.GeoDiffLibError as e:
+            if "session extension" in str(e):
+                self.skipTest("SQLite has been built without session extension")
+            raise
+
+        capture.execute("UPDATE simple SET rating = 100 WHERE fid = 1")
+        capture.execute("DELETE FROM simple WHERE fid = 2")
+        capture.write_changeset(outdir + "/captured.diff")
+        changeset = capture.write_changeset_to_bytes()
+        capture.close()
+        self.assertRaises(pygeodiff.GeoDiffLibError, capture.execute, "SELECT 1")
+
+        if self.geodiff.changes_count(outdir + "/captured.diff") != 2:
+            raise TestError("expected 2 captured changes")
+        with open(outdir + "/captured.diff", "rb") as f:
+            if f.read() != changeset:
+                raise TestError("captured changeset differs between file and bytes")
+
+        self.geodiff.create_changeset(base, captured, outdir + "/diff.diff")
+        if self.geodiff.changes_count(outdir + "/diff.diff") != 2:
+            raise TestError("expected 2 changes between base and captured database")
+
+    def test_bytes_api_calls(self):
+        print("********************************************************")
+        print("PYTHON: test in-memory changeset API calls")
+
+        outdir = create_dir("api-calls-bytes")
+
+        print("-- create_changeset_to_bytes")
+        base2modified = self.geodiff.create_changeset_to_bytes(
+            "sqlite",
+            "",
+            geodiff_test_dir() + "/base.gpkg",
+            geodiff_test_dir() + "/2_inserts/inserted_1_A.gpkg",
+        )
+        self.geodiff.create_changeset_ex(
+            "sqlite",
+            "",
+            geodiff_test_dir() + "/base.gpkg",
+            geodiff_test_dir() + "/2_inserts/inserted_1_A.gpkg",
+            outdir + "/base2modified.diff",
+        )
+        with open(outdir + "/base2modified.diff", "rb") as f:
+            if f.read() != base2modified:
+                raise TestError("changeset in memory differs from changeset file")
+
+        print("-- apply_changeset_from_bytes")
+        self.geodiff.make_copy_sqlite(
+            geodiff_test_dir() + "/base.gpkg", outdir + "/apply-bytes.gpkg"
+        )
+        self.geodiff.apply_changeset_from_bytes(
+            "sqlite", "", outdir + "/apply-bytes.gpkg", base2modified
+        )
+
+        print("-- concat_changes_bytes")
+        base2their = self.geodiff.create_changeset_to_bytes(
+            "sqlite",
+            "",
+            geodiff_test_dir() + "/base.gpkg",
+            geodiff_test_dir() + "/2_inserts/inserted_1_B.gpkg",
+        )
+        with open(outdir + "/base2their.diff", "wb") as f:
+            f.write(base2their)
+        self.geodiff.concat_changes(
+            [outdir + "/base2modified.diff", outdir + "/base2their.diff"],
+            outdir + "/concat.diff",
+        )
+        concat = self.geodiff.concat_changes_bytes([base2modified, base2their])
+        with open(outdir + "/concat.diff", "rb") as f:
+            if f.read() != concat:
+                raise TestError("concatenated changesets differ")
+
+        print("-- create_rebased_changeset_bytes")
+        rebased, conflicts = self.geodiff.create_rebased_changeset_bytes(
+            "sqlite", "", geodiff_test_dir() + "/base.gpkg", base2modified, base2their
+        )
+        if not rebased:
+            raise TestError("expected non-empty rebased changeset")
+        if conflicts:
+            raise TestError("expected no conflicts")
+
+    def test_progress(self):
+        print("********************************************************")
+        print("PYTHON: test progress callback")
+
+        outdir = create_dir("api-calls-progress")
+        base = geodiff_test_dir() + "/base.gpkg"
+        modified = geodiff_test_dir() + "/2_inserts/inserted_1_A.gpkg"
+        patched = outdir + "/patched.gpkg"
+
+        calls = []
+
+        def progress(table_name, tables_done, tables_total, entries_done):
+            calls.append((table_name, tables_done, tables_total, entries_done))
+            return True
+
+        self.geodiff.set_progress_callback(progress)
+        self.geodiff.create_changeset(base, modified, outdir + "/diff.diff")
+        if not calls or calls[-1][0] != "" or calls[-1][1] != calls[-1][2]:
+            raise TestError("unexpected progress of create_changeset: " + str(calls))
+
+        print("-- cancelled apply_changeset")
+        self.geodiff.make_copy_sqlite(base, patched)
+        self.geodiff.set_progress_callback(lambda *args: False)
+        try:
+            self.geodiff.apply_changeset(patched, outdir + "/diff.diff")
+            raise TestError("expected cancelled apply_changeset")
+        except pygeodiff.GeoDiffLibCancelledError:
+            pass
+
+        self.geodiff.set_progress_callback(None)
+        self.geodiff.create_changeset(base, patched, outdir + "/patched.diff")
+        if self.geodiff.has_changes(outdir + "/patched.diff"):
+            raise TestError("cancelled apply_changeset changed the database")
@@ -582,6 +582,41 @@ class UnitTestsCliCalls(GeoDiffCliTests):
             expect_fail=True,
         )
 
+        print("-- index")
+        self.run_command(["index"], expect_fail=True)
+        self.run_command(["index", "--badoption"], expect_fail=True)
+        self.run_command(
+            ["index", geodiff_test_dir() + "/non-existent.gpkg"], expect_fail=True
+        )
+        self.run_command(
+            ["copy", geodiff_test_dir() + "/base.gpkg", outdir + "/index.gpkg"]
+        )
+        self.run_command(["index", outdir + "/index.gpkg"])
+        self.run_command(["index", outdir + "/index.gpkg", "extra_arg"], expect_fail=True)
+        self.run_command(
+            [
+                "diff",
+                "--driver",
+                "sqlite",
+                "row_hash_index",
+                outdir + "/index.gpkg",
+                outdir + "/index.gpkg",
+                outdir + "/index.diff",
+            ]
+        )
+        self.run_command(
+            [
+                "diff",
+                "--driver",
+                "sqlite",
+                "bad_option",
+                outdir + "/index.gpkg",
+                outdir + "/index.gpkg",
+                outdir + "/index.diff",
+            ]
+        )
+        self.run_command(["index", "--remove", outdir + "/index.gpkg"])
+
         print("-- drivers")
         self.run_command(["drivers"], check_in_output="sqlite")
         self.run_command(["drivers", "extra_arg"], expect_fail=True)
@@ -6,6 +6,7 @@
 
 import os
 import shutil
+import sqlite3
 from .testutils import (
     GeoDiffTests,
     check_nchanges,
@@ -194,3 +195,34 @@ class UnitTestsPythonSingleCommit(GeoDiffTests):
         with self.assertRaises(GeoDiffLibError):
             self.geodiff.set_tables_to_include(["points"])
             self.geodiff.set_tables_to_skip(["lines"])
+
+    def test_ignore_columns(self):
+        testdir = tmpdir() + "/py" + "test_ignore_columns"
+        base = testdir + "/" + "base.sqlite"
+        modified = testdir + "/" + "modified.sqlite"
+        changeset = testdir + "/" + "changeset.bin"
+
+        create_dir("test_ignore_columns")
+        for filename, rows in (
+            (base, [(1, "a", "t1"), (2, "b", "t1")]),
+            (modified, [(1, "a", "t2"), (2, "bb", "t2"), (3, "c", "t2")]),
+        ):
+            if os.path.exists(filename):
+                os.remove(filename)
+            db = sqlite3.connect(filename)
+            db.execute(
+                "CREATE TABLE t (fid INTEGER PRIMARY KEY, name TEXT, last_edited TEXT)"
+            )
+            db.executemany("INSERT INTO t VALUES (?, ?, ?)", rows)
+            db.commit()
+            db.close()
+
+        self.geodiff.create_changeset(base, modified, changeset)
+        check_nchanges(self.geodiff, changeset, 3)
+
+        # row 1 only differs in the ignored column
+        self.geodiff.set_columns_to_ignore(["t.last_edited"])
+        self.geodiff.create_changeset(base, modified, changeset)
+        check_nchanges(self.geodiff, changeset, 2)
+
+        self.geodiff.set_columns_to_ignore([])